@@ -0,0 +1,52 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include "common.h"
+#include "database.h"
+#include "statement.h"
+
+/**
+ * The rows an aggregate SELECT returns, one per group, laid out in a schema
+ * of their own so they print and step like table rows. Columns are named
+ * after their items ("COUNT(*)", "SUM(salary)"). COUNT and the GROUP BY
+ * column keep their types; SUM, MIN, MAX and AVG are TEXT so that 64-bit
+ * sums, fractional averages and the NULL of an empty input fit.
+ */
+typedef struct {
+  Schema schema;
+  uint32_t num_rows;
+  uint8_t *rows; // num_rows rows of schema.row_size bytes
+  bool failed;   // The input could not all be read; the rows are wrong
+} ResultSet;
+
+/**
+ * aggregate_execute runs an aggregate SELECT. Rows from the table's batch
+ * scan are folded into a hash table of groups, a batch at a time; without
+ * GROUP BY every row falls into a single group. Groups are returned in the
+ * order they were first seen. MIN and MAX of the primary key alone, without
+ * a WHERE clause, are read off the ends of the B-Tree instead, and COUNT(*)
+ * of a primary key range off the row counts in its internal nodes. A full
+ * scan of a large table is split across Database.scan_threads threads
+ * (parallel.h), each folding its part into groups of its own that are then
+ * merged. ORDER BY (of the GROUP BY column), LIMIT and OFFSET apply to the
+ * groups. A result whose input could not all be read is marked failed.
+ */
+ResultSet *aggregate_execute(Statement *statement, Database *db);
+
+/**
+ * Where aggregate_execute() takes its input from: the table's rows, the row
+ * counts of its B-Tree, or the keys at either end of it.
+ */
+typedef enum : uint8_t {
+  AGGREGATE_ROWS,
+  AGGREGATE_ROW_COUNTS,
+  AGGREGATE_KEY_EDGES
+} AggregateInput;
+
+AggregateInput aggregate_input(Statement *statement, Database *db);
+
+/** aggregate_schema lays out the rows an aggregate SELECT returns. */
+void aggregate_schema(Statement *statement, Database *db, Schema *schema);
+void result_set_free(ResultSet *result);
+
+#endif
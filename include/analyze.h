@@ -0,0 +1,76 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include "common.h"
+#include "database.h"
+#include "statement.h"
+
+/**
+ * `ANALYZE [table]` samples a table's leaves and keeps what it finds on a
+ * page of its own (catalog.stats_pages): the table's rows, leaves and depth,
+ * and per column the number of distinct values, the smallest and largest,
+ * and an equi-depth histogram, HISTOGRAM_BUCKETS upper bounds with as many
+ * sampled rows in each bucket. Columns are described by their keys, as an
+ * index holds them, so TEXT values by their hashes.
+ *
+ * Up to ANALYZE_SAMPLE_LEAVES leaves spread evenly over the table are read;
+ * the internal nodes tell where they are. When the sample is not the whole
+ * table, distinct counts are scaled up from it with the GEE estimator: values
+ * seen once stand for sqrt(rows / sampled) values each, unless no value was
+ * seen twice and the column is taken to be unique.
+ *
+ * The planner prices each way of reading an analyzed table in page fetches
+ * and takes the cheapest (see choose_access_path()); tables never analyzed
+ * keep the rule that the narrowest range wins. Writes do not keep statistics
+ * up to date: ANALYZE again once the data has changed shape.
+ */
+constexpr uint32_t HISTOGRAM_BUCKETS = 32;
+constexpr uint32_t ANALYZE_SAMPLE_LEAVES = 64;
+
+typedef struct {
+  uint32_t distinct;
+  uint32_t min;
+  uint32_t max;
+  uint32_t bounds[HISTOGRAM_BUCKETS]; // Ascending, the last is max
+} ColumnStats;
+
+typedef struct TableStats {
+  uint32_t rows;
+  uint32_t leaves;
+  uint32_t depth;
+  uint32_t sampled; // Rows the column statistics were built from
+  ColumnStats columns[MAX_FIELDS];
+} TableStats;
+
+static_assert(sizeof(TableStats) <= PAGE_SIZE, "TableStats must fit a page");
+
+/** analyze_table gathers and stores the statistics of a table. */
+void analyze_table(Database *db, uint32_t table_index);
+
+/** analyze_load reads the statistics of every analyzed table. */
+void analyze_load(Database *db);
+void analyze_free(Database *db);
+
+/**
+ * estimate_range returns the share of rows, from 0 to 1, whose key in column
+ * `field` lies in `range`.
+ */
+double estimate_range(const TableStats *stats, uint32_t field,
+                      const KeyRange *range);
+
+/**
+ * estimate_filter returns the share of rows a WHERE clause keeps, taking its
+ * terms as independent.
+ */
+double estimate_filter(const TableStats *stats, const Schema *schema,
+                       const Predicate *predicate);
+
+/**
+ * estimate_cost prices walking `share` of a tree's keys in page fetches: down
+ * the tree, along the leaves in reach and, for an index, down the table again
+ * for every row found.
+ */
+double estimate_cost(Database *db, const TableStats *stats, uint32_t tree,
+                     double share);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "common.h"
+#include "database.h"
+#include "statement.h"
+
+/**
+ * Vectorized table scans. A BatchScan walks a table's leaves and hands out up
+ * to BATCH_SIZE rows at a time in columnar form: the keys and the INT columns
+ * the query reads are decoded into arrays, and the WHERE clause is applied a
+ * column at a time, leaving a selection vector of the rows that pass. Filters
+ * and aggregates are then plain loops over arrays, which the compiler can
+ * unroll and vectorize, instead of an indirect call and a branch per row.
+ */
+constexpr uint32_t BATCH_SIZE = 1024;
+
+// A batch keeps its leaves pinned, so it stops short of filling the pool
+constexpr uint32_t BATCH_MAX_LEAVES = MAX_PAGES_IN_MEMORY / 4;
+
+typedef struct {
+  uint32_t count;           // Rows in the batch
+  uint32_t num_selected;    // Rows that passed the filter
+  uint16_t sel[BATCH_SIZE]; // Positions of those rows, in key order
+  uint32_t keys[BATCH_SIZE];
+  const uint8_t *rows[BATCH_SIZE]; // Value bytes, in the pinned leaves
+  uint32_t *columns[MAX_FIELDS];   // Decoded INT columns; nullptr if unread
+} RowBatch;
+
+typedef struct BatchScan BatchScan;
+
+/**
+ * batch_scan_open starts a batch scan from a cursor select_open() placed on a
+ * table's B-Tree, taking ownership of the cursor. The scan stops at the key
+ * bound select_open() chose. `columns` is a bit mask of INT fields to decode
+ * besides the ones the WHERE clause reads.
+ */
+BatchScan *batch_scan_open(Statement *statement, Database *db, Cursor *c,
+                           uint32_t columns);
+
+/**
+ * batch_scan_leaves starts a batch scan of a table's leaves from `first_leaf`
+ * along the leaf links, stopping before `end_leaf` (0 runs to the last leaf).
+ * The leaves are read with pager_peek() into the scan's own buffers instead
+ * of through the cache, so scans of different leaves can run in parallel
+ * threads while the Pager is otherwise left alone.
+ */
+BatchScan *batch_scan_leaves(Statement *statement, Database *db,
+                             uint32_t first_leaf, uint32_t end_leaf,
+                             uint32_t columns);
+
+/**
+ * batch_scan_limit ends the scan once `limit` rows have been selected. The
+ * first batch holds only that many rows and later ones grow from there, so a
+ * LIMIT reads about as many leaves as its rows fill.
+ */
+void batch_scan_limit(BatchScan *scan, uint32_t limit);
+
+/**
+ * batch_scan_next decodes and filters the next batch, or returns nullptr when
+ * the scan is done. The batch, including its row pointers, is valid until the
+ * next call. A batch may have no selected rows.
+ */
+RowBatch *batch_scan_next(BatchScan *scan);
+
+/**
+ * batch_scan_reads returns how many leaves a batch_scan_leaves() scan read
+ * from the file rather than found in the cache. Such a scan leaves the
+ * Pager's and the Database's counters alone, rows included, as it may be on
+ * another thread; the caller adds them in.
+ */
+uint64_t batch_scan_reads(const BatchScan *scan);
+
+/**
+ * batch_scan_failed tells whether a batch_scan_leaves() scan ended early
+ * because a leaf could not be read from the file.
+ */
+bool batch_scan_failed(const BatchScan *scan);
+void batch_scan_close(BatchScan *scan);
+
+#endif
@@ -14,6 +14,8 @@ uint32_t *node_parent(void *node);
 /* Leaf Node Accessors */
 uint32_t *leaf_node_num_cells(void *node);
 uint32_t *leaf_node_next_leaf(void *node);
+/** leaf_node_prev_leaf is the page of the leaf before, 0 for the first. */
+uint32_t *leaf_node_prev_leaf(void *node);
 
 /* Internal Node Accessors */
 uint32_t *internal_node_num_keys(void *node);
@@ -22,6 +24,11 @@ uint32_t *internal_node_right_child(void *node);
 uint32_t *internal_node_cell(void *node, uint32_t cell_num);
 uint32_t *internal_node_child(void *node, uint32_t child_num);
 uint32_t *internal_node_key(void *node, uint32_t key_num);
+/**
+ * internal_node_count returns the number of rows in the subtree under child
+ * `child_num` (num_keys for the right child).
+ */
+uint32_t *internal_node_count(void *node, uint32_t child_num);
 
 /* Dynamic Cell Accessors */
 uint32_t leaf_node_cell_size(Schema *schema);
@@ -34,22 +41,79 @@ uint32_t internal_node_max_keys();
 void initialize_leaf_node(void *node);
 void initialize_internal_node(void *node);
 
-uint32_t get_node_max_key(Database *db, uint32_t table_index, void *node);
+uint32_t get_node_max_key(Database *db, uint32_t tree, void *node);
+/** node_row_count returns the number of rows in the subtree under `node`. */
+uint32_t node_row_count(void *node);
 
 /**
  * find_node traverses the B-Tree to find the leaf page containing a specific
- * key.
+ * key. The cursor is left on the first cell whose key is not smaller, so with
+ * duplicate keys (index trees) it lands on the first of them.
+ */
+Cursor *find_node(Database *db, uint32_t tree, uint32_t pg, uint32_t key);
+
+/**
+ * btree_row_count returns the number of rows in a tree, read off the counts
+ * in its root.
+ */
+uint32_t btree_row_count(Database *db, uint32_t tree);
+
+/**
+ * btree_rank returns the number of keys smaller than `key`. Every level adds
+ * up the counts of the children left of the path, so it costs one descent.
+ */
+uint32_t btree_rank(Database *db, uint32_t tree, uint32_t key);
+
+/**
+ * btree_leaf_count returns the number of leaves in a tree and sets `depth` to
+ * its number of levels, 1 for a lone leaf. Of the leaves, only the first is
+ * read.
+ */
+uint32_t btree_leaf_count(Database *db, uint32_t tree, uint32_t *depth);
+
+/**
+ * btree_leaf_pages stores the page numbers of a tree's leaves in key order,
+ * finding them from the internal nodes alone; `pages` must have room for
+ * btree_leaf_count() of them. Returns how many it stored.
+ */
+uint32_t btree_leaf_pages(Database *db, uint32_t tree, uint32_t *pages);
+
+/** btree_range_count returns the number of keys in first..last. */
+uint32_t btree_range_count(Database *db, uint32_t tree, uint32_t first,
+                           uint32_t last);
+
+/**
+ * find_node_by_rank returns a cursor on the row with `rank` smaller rows
+ * before it, or past the last row if there are not that many.
  */
-Cursor *find_node(Database *db, uint32_t table_index, uint32_t pg,
-                  uint32_t key);
+Cursor *find_node_by_rank(Database *db, uint32_t tree, uint32_t rank);
+
+/**
+ * btree_insert_pages returns the most new pages an insert into a tree can
+ * take: one per level if every node on the path splits, and one more for a
+ * new root. Pages are only ever appended, so an insert needs that many below
+ * TABLE_MAX_PAGES before it starts.
+ */
+uint32_t btree_insert_pages(Database *db, uint32_t tree);
 
 struct Statement;
 void leaf_node_insert(Cursor *c, uint32_t key, struct Statement *s);
+/** leaf_node_insert_row inserts an already serialized row at the cursor. */
+void leaf_node_insert_row(Cursor *c, uint32_t key, const void *row);
 void leaf_node_delete(Cursor *c);
 
+/**
+ * btree_upgrade brings a tree written in an older format `version` up to
+ * CATALOG_FORMAT_VERSION. Leaves get the longer header with a link back to
+ * the previous leaf; a full leaf that no longer fits splits in two. The
+ * internal levels are then rebuilt with row counts from the leaves up,
+ * reusing the old internal pages.
+ */
+void btree_upgrade(Database *db, uint32_t tree, uint32_t version);
+
 /**
  * verify_btree checks the structural integrity of the B-Tree.
  */
-bool verify_btree(Database *db, uint32_t table_index);
+bool verify_btree(Database *db, uint32_t tree);
 
 #endif
@@ -13,7 +13,9 @@ constexpr int MAX_PAGES_IN_MEMORY = 100;
 constexpr int MAX_FIELDS = 16;
 constexpr size_t FIELD_NAME_MAX = 32;
 constexpr size_t TABLE_NAME_MAX = 32;
+constexpr uint32_t TEXT_FIELD_SIZE = 32; // Bytes per TEXT column, incl. NUL
 constexpr int MAX_TABLES = 5;
+constexpr int MAX_INDEXES = 5;
 
 typedef enum : uint8_t { FIELD_INT, FIELD_TEXT } FieldType;
 
@@ -44,30 +46,39 @@ constexpr size_t PARENT_POINTER_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
 constexpr size_t COMMON_NODE_HEADER_SIZE =
     NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE;
 
-/* Leaf Node Header Layout (num_cells, next_leaf) */
+/* Leaf Node Header Layout (num_cells, next_leaf, prev_leaf) */
 constexpr size_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t);
 constexpr size_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
 constexpr size_t LEAF_NODE_NEXT_LEAF_SIZE = sizeof(uint32_t);
 constexpr size_t LEAF_NODE_NEXT_LEAF_OFFSET =
     LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
-constexpr size_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE +
-                                         LEAF_NODE_NUM_CELLS_SIZE +
-                                         LEAF_NODE_NEXT_LEAF_SIZE;
+constexpr size_t LEAF_NODE_PREV_LEAF_SIZE = sizeof(uint32_t);
+constexpr size_t LEAF_NODE_PREV_LEAF_OFFSET =
+    LEAF_NODE_NEXT_LEAF_OFFSET + LEAF_NODE_NEXT_LEAF_SIZE;
+constexpr size_t LEAF_NODE_HEADER_SIZE =
+    COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE +
+    LEAF_NODE_NEXT_LEAF_SIZE + LEAF_NODE_PREV_LEAF_SIZE;
 
-/* Internal Node Header Layout (num_keys, right_child) */
+/* Internal Node Header Layout (num_keys, right_child, right_child_count) */
 constexpr size_t INTERNAL_NODE_NUM_KEYS_SIZE = sizeof(uint32_t);
 constexpr size_t INTERNAL_NODE_NUM_KEYS_OFFSET = COMMON_NODE_HEADER_SIZE;
 constexpr size_t INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(uint32_t);
 constexpr size_t INTERNAL_NODE_RIGHT_CHILD_OFFSET =
     INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
-constexpr size_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE +
-                                             INTERNAL_NODE_NUM_KEYS_SIZE +
-                                             INTERNAL_NODE_RIGHT_CHILD_SIZE;
+constexpr size_t INTERNAL_NODE_RIGHT_COUNT_SIZE = sizeof(uint32_t);
+constexpr size_t INTERNAL_NODE_RIGHT_COUNT_OFFSET =
+    INTERNAL_NODE_RIGHT_CHILD_OFFSET + INTERNAL_NODE_RIGHT_CHILD_SIZE;
+constexpr size_t INTERNAL_NODE_HEADER_SIZE =
+    COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE +
+    INTERNAL_NODE_RIGHT_CHILD_SIZE + INTERNAL_NODE_RIGHT_COUNT_SIZE;
 
+/* Internal Node Cell Layout (child, key, count of rows under the child) */
 constexpr size_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
 constexpr size_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
+constexpr size_t INTERNAL_NODE_COUNT_SIZE = sizeof(uint32_t);
 constexpr size_t INTERNAL_NODE_CELL_SIZE =
-    INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_CHILD_SIZE;
-constexpr size_t INTERNAL_NODE_MAX_KEYS = 510;
+    INTERNAL_NODE_KEY_SIZE + INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_COUNT_SIZE;
+constexpr size_t INTERNAL_NODE_MAX_KEYS =
+    (PAGE_SIZE - INTERNAL_NODE_HEADER_SIZE) / INTERNAL_NODE_CELL_SIZE;
 
 #endif
@@ -3,6 +3,7 @@
 
 #include "common.h"
 #include "pager.h"
+#include <stdio.h>
 
 typedef struct {
   char name[TABLE_NAME_MAX];
@@ -10,27 +11,106 @@ typedef struct {
   Schema schema;
 } TableDefinition;
 
+/**
+ * An index is a B-Tree of its own whose keys are a column's values (the hash
+ * for TEXT columns) and whose rows are the primary keys holding them.
+ */
+typedef struct {
+  char name[TABLE_NAME_MAX];
+  uint32_t table_index;
+  uint32_t field_index;
+  uint32_t root_page_num;
+} IndexDefinition;
+
 typedef struct {
   uint32_t num_tables;
   TableDefinition tables[MAX_TABLES];
+  // Appended after the tables, so catalogs written before indexes existed
+  // read back with none
+  uint32_t num_indexes;
+  IndexDefinition indexes[MAX_INDEXES];
+  // Zero in files written before internal nodes kept row counts
+  uint32_t format_version;
+  // Page holding each table's ANALYZE statistics, 0 until it is analyzed
+  uint32_t stats_pages[MAX_TABLES];
 } Catalog;
 
+/**
+ * CATALOG_FORMAT_VERSION is the on-disk layout this build writes. Version 1
+ * added subtree row counts to internal nodes, version 2 links from each leaf
+ * to the previous one; older files are upgraded when opened.
+ */
+constexpr uint32_t CATALOG_FORMAT_VERSION = 2;
+
+static_assert(sizeof(Catalog) <= PAGE_SIZE, "Catalog must fit on page 0");
+
+/**
+ * B-Trees are numbered: table i is tree i, index i is tree INDEX_TREE_BASE + i.
+ * Cursors and the B-Tree code take a tree number where they used to take a
+ * table index.
+ */
+constexpr uint32_t INDEX_TREE_BASE = MAX_TABLES;
+
+constexpr size_t SORT_MEMORY_DEFAULT = 64u << 20;
+constexpr size_t JOIN_MEMORY_DEFAULT = 64u << 20;
+
+/**
+ * How execute_select() prints rows. CSV and TSV start with a line of column
+ * names; CSV quotes TEXT values holding a comma, quote or line break
+ * (RFC 4180), TSV escapes tabs, line breaks and backslashes as \t, \n, \r
+ * and \\. PRINT_BINARY writes, with every integer little-endian:
+ *
+ *   header: u32 column count, then per column u8 type (0 INT, 1 TEXT),
+ *           u8 name length and the name's bytes
+ *   row:    u32 length of the rest, then per column a u32 for an INT or u8
+ *           length and bytes for a TEXT
+ *   end:    u32 0
+ */
 typedef enum {
   PRINT_PLAIN,
-  PRINT_BOX
+  PRINT_BOX,
+  PRINT_CSV,
+  PRINT_TSV,
+  PRINT_BINARY
 } PrintMode;
 
+// Rows box mode holds to measure column widths before printing
+constexpr uint32_t BOX_BUFFER_ROWS = 1000;
+
 typedef struct {
   Pager *pager;
   Catalog catalog;
   PrintMode print_mode;
+  // Destination for results and messages (stdout unless redirected)
+  FILE *out;
+  // Bumped whenever the catalog changes, invalidating cached plans
+  uint32_t schema_version;
+  // Memory an ORDER BY may use before it spills sorted runs to disk
+  size_t sort_memory;
+  // Memory a hash join's table may use before it partitions to disk
+  size_t join_memory;
+  // Threads a full table scan or a CSV import may split across (1 keeps
+  // it serial)
+  uint32_t scan_threads;
+  // Scripts being run, `.read` inside `.read`
+  uint32_t script_depth;
+  // `.timer on` and `.stats on`: report each statement's cost after it runs
+  bool show_timer;
+  bool show_stats;
+  // B-Tree nodes split by inserts, and table rows read by scans
+  uint64_t splits;
+  uint64_t rows_scanned;
+  struct PlanCache *plan_cache;
+  // Statistics of analyzed tables, read from their stats_pages (analyze.h)
+  struct TableStats *table_stats[MAX_TABLES];
 } Database;
 
 typedef struct {
   Database *db;
   uint32_t page_num;
   uint32_t cell_num;
-  uint32_t table_index; // Index into catalog
+  uint32_t table_index; // Tree number: a catalog table or INDEX_TREE_BASE + i
+  uint32_t row_page;    // Table page of the row select_next() last returned
 } Cursor;
 
 /**
@@ -38,13 +118,51 @@ typedef struct {
  * reconstructs the catalog; if not, it initializes an empty one.
  */
 Database *db_open(const char *filename);
+
+/**
+ * db_try_open is db_open() without exiting: it returns nullptr, with errno
+ * set, when the file cannot be opened.
+ */
+Database *db_try_open(const char *filename);
 void db_close(Database *db);
 void db_save_catalog(Database *db);
 
+/**
+ * DbStats is what `.stats` reports: the Pager's counters together with the
+ * Database's, since the file was opened or db_reset_stats() last ran.
+ */
+typedef struct {
+  uint64_t fetches;
+  uint64_t hits;
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t evictions;
+  uint64_t splits;
+  uint64_t rows_scanned;
+  uint32_t pinned_peak;
+} DbStats;
+
+DbStats db_stats(Database *db);
+/**
+ * db_stats_since returns how far the counters have moved since `before` was
+ * taken; the peak pin count is the current one.
+ */
+DbStats db_stats_since(Database *db, const DbStats *before);
+void db_reset_stats(Database *db);
+
 /**
  * table_start returns a cursor at the very first record of the table.
  */
 Cursor *table_start(Database *db, uint32_t table_index);
+/**
+ * table_end returns a cursor just past the last record of a tree, reached by
+ * following the rightmost children down.
+ */
+Cursor *table_end(Database *db, uint32_t tree);
 int find_table(Database *db, const char *name);
 
+/** tree_schema returns the row layout of a tree: an index row is one INT. */
+Schema *tree_schema(Database *db, uint32_t tree);
+uint32_t tree_root_page(Database *db, uint32_t tree);
+
 #endif
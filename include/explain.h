@@ -0,0 +1,41 @@
+#ifndef EXPLAIN_H
+#define EXPLAIN_H
+
+#include "common.h"
+#include "database.h"
+#include "statement.h"
+
+/**
+ * EXPLAIN prints the plan of a SELECT, an operator per line with its input
+ * indented below it: LIMIT, SORT, FILTER, the aggregate or join, and at the
+ * bottom how each table is read. A read is a POINT SEEK or RANGE SEEK down
+ * the table's B-Tree with find_node(), a FULL SCAN of its leaves from
+ * table_start(), or an INDEX SEEK, INDEX RANGE SCAN or INDEX SCAN of an index
+ * followed by a lookup of each row. Reads carry the rows and pages they are
+ * expected to touch, taken from the B-Tree's row counts and its number of
+ * leaves; no leaf but the first is read to plan. Once ANALYZE has described
+ * the table, the SELECT and its FILTER carry the rows they are expected to
+ * return too, estimated from its statistics (see analyze.h).
+ *
+ * EXPLAIN ANALYZE runs the SELECT first, counting its rows instead of
+ * printing them. The executor pulls rows through the operators in one loop
+ * rather than running them one after another, so time and pages are given
+ * for the statement as a whole, next to the rows it returned and scanned.
+ */
+typedef struct {
+  uint64_t rows;       // Returned
+  double first_ms;     // Until the first row was ready
+  double total_ms;
+  DbStats stats;       // What the run moved, see db_stats_since()
+  uint32_t sort_runs;  // Runs an ORDER BY spilled to disk
+  uint32_t partitions; // Partitions a hash join spilled to disk
+} ExplainActual;
+
+/**
+ * explain_select prints the plan of a prepared SELECT to db->out, followed by
+ * `actual` for EXPLAIN ANALYZE (nullptr otherwise).
+ */
+void explain_select(Statement *statement, Database *db,
+                    const ExplainActual *actual);
+
+#endif
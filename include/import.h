@@ -0,0 +1,51 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include "common.h"
+#include "database.h"
+
+/**
+ * Bulk loading from CSV: `.import FILE TABLE`. The file is mapped into memory
+ * and cut into chunks at record boundaries, one per thread. Each thread
+ * parses its chunk straight into serialized rows and sorts them by key; the
+ * calling thread then merges the chunks and inserts the rows in key order,
+ * so consecutive inserts land on the same leaf.
+ *
+ * Records are RFC 4180, as `.mode csv` writes them: fields separated by
+ * commas, double quotes around fields holding a comma, quote or line break,
+ * and `""` for a quote inside one. Lines may end in CRLF and blank lines are
+ * skipped. A first record that names the table's columns is a header and is
+ * skipped too.
+ *
+ * Nothing is inserted unless the whole file parses. A row whose key is
+ * already in the table, or came earlier in the file, is skipped and counted.
+ * If the database file runs out of pages, the rows inserted before stay.
+ */
+typedef enum : uint8_t {
+  IMPORT_SUCCESS,
+  IMPORT_CANNOT_OPEN,
+  IMPORT_COLUMN_COUNT,
+  IMPORT_NOT_A_NUMBER,
+  IMPORT_STRING_TOO_LONG,
+  IMPORT_BAD_QUOTE,
+  IMPORT_TABLE_FULL // The file ran out of pages; the rows before stay in
+} ImportResult;
+
+typedef struct {
+  uint64_t rows;       // Inserted
+  uint64_t duplicates; // Skipped for a key already taken
+  uint64_t record;     // On a parse error, the failing record, from 1
+  uint32_t threads;    // Chunks parsed in parallel
+} ImportStats;
+
+// Files are not split into chunks smaller than this
+constexpr size_t IMPORT_MIN_CHUNK = 1 << 16;
+
+/**
+ * import_csv loads the CSV file at `path` into table `table_index`, parsing
+ * with up to `num_threads` threads.
+ */
+ImportResult import_csv(Database *db, uint32_t table_index, const char *path,
+                        uint32_t num_threads, ImportStats *stats);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "common.h"
+#include "database.h"
+
+/**
+ * Secondary indexes. Each index is a B-Tree (tree INDEX_TREE_BASE + i) with one
+ * cell per table row: the key is the indexed column's value (its hash for TEXT
+ * columns) and the row is the table row's primary key. Rows with equal values
+ * are kept in insertion order.
+ *
+ * The table's INSERT, UPDATE and DELETE keep every index of the table in step
+ * through index_insert_row() and index_delete_row().
+ */
+
+/** find_index returns the catalog position of the index called `name`. */
+int find_index(Database *db, const char *name);
+
+/** find_column_index returns an index on a table column, or -1 if none. */
+int find_column_index(Database *db, uint32_t table_index, uint32_t field);
+
+/** index_key returns the key a row has in an index on column `field`. */
+uint32_t index_key(Schema *schema, uint32_t field, const void *row);
+
+/**
+ * index_build fills a newly created index from the rows already in its table.
+ * Returns false, leaving it part built, if the file runs out of pages.
+ */
+[[nodiscard]] bool index_build(Database *db, uint32_t index);
+
+/**
+ * index_insert_pages returns the most new pages filing a row in each index of
+ * the table can take (btree_insert_pages()). Inserts and updates make sure
+ * they are free first, so a full file fails the statement, not the Pager.
+ */
+uint32_t index_insert_pages(Database *db, uint32_t table_index);
+
+void index_insert_row(Database *db, uint32_t table_index, uint32_t pk,
+                      const void *row);
+void index_delete_row(Database *db, uint32_t table_index, uint32_t pk,
+                      const void *row);
+/** index_update_row refiles a row whose indexed values or key changed. */
+void index_update_row(Database *db, uint32_t table_index, uint32_t old_pk,
+                      const void *old_row, uint32_t pk, const void *row);
+
+/**
+ * index_fetch_row looks up the table row an index cell points at, returning
+ * its value bytes or nullptr if it is gone. If `page` is not null it is set
+ * to the page the row is on.
+ */
+void *index_fetch_row(Database *db, uint32_t table_index, uint32_t pk,
+                      uint32_t *page);
+
+/** verify_indexes checks every index of a table against the table's rows. */
+bool verify_indexes(Database *db, uint32_t table_index);
+
+#endif
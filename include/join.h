@@ -0,0 +1,78 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include "common.h"
+#include "database.h"
+#include "sort.h"
+#include "statement.h"
+
+/**
+ * Inner equi-joins: `SELECT * FROM a JOIN b ON a.x = b.y` returns each pair
+ * of rows whose join columns are equal, laid out as a's row followed by b's.
+ * The joined columns are named `table.column`; a column name alone will do
+ * when only one of the tables has it.
+ *
+ * When a join column is its table's primary key, the other table is scanned
+ * and each of its rows probes the key's B-Tree with find_node(): an index
+ * nested-loop join. Otherwise the smaller table is read into a hash table on
+ * its join column and the larger one streams past it. If the hash table
+ * outgrows Database.join_memory, both tables are split by a hash of the join
+ * column into partitions in temporary files, and the partitions are joined
+ * one pair at a time (a grace hash join).
+ *
+ * A WHERE clause without OR has its terms on a single table applied while
+ * that table is read, so they can bound its walk as in a plain SELECT. Every
+ * term is checked again on the joined row.
+ */
+typedef enum : uint8_t { JOIN_INDEX_LOOP, JOIN_HASH } JoinMethod;
+
+typedef struct Join Join;
+
+/** join_schema lays out the rows a join returns. */
+void join_schema(const Statement *statement, Database *db, Schema *schema);
+
+/**
+ * join_open starts a join. Unless the join has an ORDER BY, which sorts its
+ * rows first (join_sorted()), the OFFSET is skipped here.
+ */
+Join *join_open(Statement *statement, Database *db);
+
+/**
+ * join_next returns the next joined row, or nullptr after the last. The row
+ * is valid until the next call.
+ */
+const void *join_next(Join *join);
+JoinMethod join_method(const Join *join);
+
+/**
+ * join_plan tells how join_open() will run a join, and whether the left
+ * table is the inner one: the one probed by key, or built into the hash
+ * table.
+ */
+JoinMethod join_plan(const Statement *statement, Database *db,
+                     bool *inner_left);
+
+/**
+ * join_side_scan fills `scan` with the SELECT that reads one table of a
+ * join, the left or the right, carrying the WHERE terms on that table alone.
+ */
+void join_side_scan(const Statement *statement, Database *db, bool right,
+                    Statement *scan);
+
+/** join_partitions returns the partitions a hash join spilled, 0 if none. */
+uint32_t join_partitions(const Join *join);
+
+/**
+ * join_failed tells whether a hash join's partitions could not be written to
+ * or read back from their temporary files, ending the rows early.
+ */
+bool join_failed(const Join *join);
+void join_close(Join *join);
+
+/**
+ * join_sorted reads every row of a join into a finished sorter, which has
+ * failed if the join did.
+ */
+Sorter *join_sorted(Statement *statement, Database *db);
+
+#endif
@@ -22,9 +22,14 @@
 #define lseek _lseek
 #define close _close
 #define isatty _isatty
+#define fileno _fileno
 #define strdup _strdup
 #define strcasecmp _stricmp
 #define strncasecmp _strnicmp
+#define pread os_pread
+
+// Reads at an offset without moving the file position, like POSIX pread
+int os_pread(int fd, void *buf, size_t count, int64_t offset);
 
 #ifndef STDIN_FILENO
 #define STDIN_FILENO 0
@@ -79,4 +84,14 @@ void terminal_disable_raw_mode();
 int terminal_read_line(char *buf, size_t size);
 void terminal_history_add(const char *line);
 
+/** os_cpu_count returns the number of processors online, at least 1. */
+uint32_t os_cpu_count();
+
+/**
+ * os_map_file maps a whole file read-only into memory and sets *size to its
+ * length. Returns nullptr if it cannot be opened or mapped.
+ */
+const char *os_map_file(const char *path, size_t *size);
+void os_unmap_file(const char *data, size_t size);
+
 #endif // OS_PORTABILITY_H
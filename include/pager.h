@@ -25,19 +25,62 @@ typedef struct {
   bool is_dirty[TABLE_MAX_PAGES];
   // Array of reference counts for pins on each page
   uint32_t pinned[TABLE_MAX_PAGES];
+  // The part of each page's pins that unpin_page_all() leaves (pager_hold())
+  uint32_t held[TABLE_MAX_PAGES];
   // Number of pages currently loaded in memory
   uint32_t num_pages_in_memory;
   // Timer for tracking page usage
   uint32_t timer;
+  // Pages handed out by get_page, and pages read from the file (parallel
+  // scans add the ones they peek at)
+  uint64_t fetches;
+  uint64_t reads;
+  // Fetches of pages already in memory
+  uint64_t hits;
+  // Pages dropped from memory to make room, and pages written to the file
+  uint64_t evictions;
+  uint64_t writes;
+  // Pages with at least one pin, and the most there have been at once
+  uint32_t num_pinned;
+  uint32_t pinned_peak;
 } Pager;
 
 Pager *pager_open(const char *filename);
+
+/**
+ * pager_try_open is pager_open() for callers that report errors themselves:
+ * it returns nullptr, with errno set, when the file cannot be opened.
+ */
+Pager *pager_try_open(const char *filename);
 void pager_flush(Pager *p, uint32_t pg);
 void mark_page_dirty(Pager *p, uint32_t pg);
 void pin_page(Pager *p, uint32_t pg);
 void unpin_page(Pager *p, uint32_t pg);
 void unpin_page_all(Pager *p);
+
+/**
+ * pager_hold pins a page until pager_release(), through any number of
+ * unpin_page_all() calls. Statements of the library API hold the page their
+ * current row is on, so other statements running meanwhile, which unpin
+ * everything they used when they finish, cannot evict it.
+ */
+void pager_hold(Pager *p, uint32_t pg);
+void pager_release(Pager *p, uint32_t pg);
 void *get_page(Pager *p, uint32_t pg);
+
+/** pager_has_room tells whether `pages` more pages fit in the file. */
+static inline bool pager_has_room(const Pager *p, uint32_t pages) {
+  return p->num_pages + pages <= TABLE_MAX_PAGES;
+}
+
+/**
+ * pager_peek returns page `pg` without caching or pinning it: the cached copy
+ * if there is one, else the page read from the file into `buffer`, or nullptr
+ * if it cannot be read in full. It changes nothing in the Pager, so several
+ * threads may peek at once, provided none of them calls anything else on it
+ * meanwhile.
+ */
+void *pager_peek(Pager *p, uint32_t pg, void *buffer);
 void pager_close(Pager *p);
 
 #endif
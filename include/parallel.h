@@ -0,0 +1,71 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "batch.h"
+#include "common.h"
+#include "database.h"
+#include "statement.h"
+
+/**
+ * Parallel table scans. The table's B-Tree is cut into tasks along its
+ * internal nodes' separator keys: the root's children first, then their
+ * children, a level at a time, until there are PARALLEL_TASKS_PER_THREAD
+ * subtrees per thread or the leaves are reached. Neighbouring subtrees are
+ * then grouped so there are no more tasks than that. Each task walks the
+ * leaves of its subtrees with its own batch_scan_leaves().
+ *
+ * Tasks are dealt out in contiguous runs, one run per thread. A thread takes
+ * tasks from the front of its own run and, once that is empty, steals from
+ * the back of the fullest other run, so a thread given dense subtrees does
+ * not hold the others up. The calling thread is one of the workers, and the
+ * scan returns when every task is done.
+ *
+ * The Pager is not thread-safe, so the scan only reads pages, with
+ * pager_peek(); nothing else may use the Database until it returns.
+ */
+constexpr uint32_t PARALLEL_TASKS_PER_THREAD = 4;
+constexpr uint32_t PARALLEL_MAX_THREADS = 64;
+
+// Tables with fewer rows are not worth starting threads for
+constexpr uint32_t PARALLEL_MIN_ROWS = 1 << 15;
+
+typedef struct ParallelScan ParallelScan;
+
+/**
+ * ParallelConsumer receives the batches of task `task` on worker thread
+ * `worker`, numbered from 0 (the calling thread) below the thread count.
+ * A task's batches come in key order, all to one worker, one task at a time;
+ * different workers' calls run concurrently.
+ */
+typedef void (*ParallelConsumer)(void *arg, uint32_t worker, uint32_t task,
+                                 const RowBatch *batch);
+
+/**
+ * parallel_scan_open splits a full scan of the statement's table into tasks
+ * for `num_threads` threads, once select_open() has chosen the table as the
+ * access path. Returns nullptr when that is not worth doing: a single
+ * thread, a bounded key range, or too small a table.
+ */
+ParallelScan *parallel_scan_open(Statement *statement, Database *db,
+                                 uint32_t num_threads);
+
+/** parallel_scan_tasks returns the number of tasks, in key order. */
+uint32_t parallel_scan_tasks(const ParallelScan *scan);
+
+/** parallel_scan_threads returns the number of workers the tasks run on. */
+uint32_t parallel_scan_threads(const ParallelScan *scan);
+
+/**
+ * parallel_scan_run scans every task, decoding `columns` as
+ * batch_scan_open() would, and hands each batch to `consume`. Returns false
+ * if a leaf could not be read from the file; the tasks not yet started are
+ * then skipped, and what was consumed is incomplete.
+ */
+[[nodiscard]] bool parallel_scan_run(ParallelScan *scan, uint32_t columns,
+                       ParallelConsumer consume, void *arg);
+
+/** parallel_scan_steals returns how many tasks were stolen in the last run. */
+uint32_t parallel_scan_steals(const ParallelScan *scan);
+void parallel_scan_close(ParallelScan *scan);
+
+#endif
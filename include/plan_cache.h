@@ -0,0 +1,61 @@
+#ifndef PLAN_CACHE_H
+#define PLAN_CACHE_H
+
+#include "common.h"
+#include "database.h"
+#include "statement.h"
+
+/**
+ * The plan cache keeps prepared statements keyed by their normalized text
+ * (literals replaced by '?', see normalize_statement()). A line whose shape is
+ * cached skips tokenizing, table lookup and parsing: it is matched against
+ * the cached text in one pass, the plan is copied and the line's literals are
+ * bound to its parameters. Lines that differ in more than their literals
+ * (including whitespace) get separate plans.
+ *
+ * The cache is direct-mapped on the text before the first literal; a shape
+ * evicts whatever was in its slot. Plans are dropped when the schema version
+ * changes.
+ */
+constexpr uint32_t PLAN_CACHE_SLOTS = 64;
+constexpr size_t PLAN_CACHE_SQL_MAX = 256;
+constexpr uint64_t PLAN_CACHE_TIMING_SAMPLE = 32; // Time one hit in this many
+
+typedef struct {
+  bool valid;
+  uint32_t schema_version;
+  char sql[PLAN_CACHE_SQL_MAX];
+  Statement plan; // Prepared from `sql`; every literal is a parameter
+} PlanCacheEntry;
+
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;      // Cacheable shapes that had to be prepared
+  uint64_t uncacheable; // Lines prepared directly (errors, CREATE, ...)
+  uint64_t sampled_hits;
+  uint64_t sampled_hit_ns; // Time spent serving the sampled hits
+  uint64_t parse_ns;       // Time spent in prepare_statement()
+  uint64_t parses;
+} PlanCacheStats;
+
+typedef struct PlanCache {
+  PlanCacheEntry entries[PLAN_CACHE_SLOTS];
+  PlanCacheEntry *last_hit;
+  PlanCacheStats stats;
+} PlanCache;
+
+PlanCache *plan_cache_create();
+void plan_cache_free(PlanCache *cache);
+void plan_cache_clear(PlanCache *cache);
+
+/**
+ * plan_cache_prepare is a drop-in replacement for prepare_statement(). On a
+ * hit the returned statement has all of its parameters bound, so num_params
+ * is 0; '?' typed in the line itself is never cached and is reported by
+ * num_params as usual.
+ */
+[[nodiscard]] PrepareResult plan_cache_prepare(Database *db, char *line,
+                                               Statement *statement);
+void plan_cache_print_stats(Database *db);
+
+#endif
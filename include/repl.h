@@ -0,0 +1,41 @@
+#ifndef REPL_H
+#define REPL_H
+
+#include "common.h"
+#include "database.h"
+
+/**
+ * REPL_ERROR means the line ran and failed; its message has gone to db->out
+ * like any other output.
+ */
+typedef enum : uint8_t { REPL_CONTINUE, REPL_EXIT, REPL_ERROR } ReplResult;
+
+// Scripts are read this many bytes at a time
+constexpr size_t SCRIPT_CHUNK_SIZE = 1 << 16;
+// How deep `.read` may nest, so a script that reads itself stops
+constexpr uint32_t SCRIPT_MAX_DEPTH = 16;
+
+/**
+ * repl_execute_line runs one line of input (a meta-command or a SQL
+ * statement) and writes everything it would print to db->out. Both the
+ * interactive loop and server mode go through here, so a client sees exactly
+ * what a terminal user would.
+ */
+ReplResult repl_execute_line(Database *db, char *line);
+
+/**
+ * repl_execute_script runs a script file (`-f FILE` or `.read FILE`; "-" is
+ * standard input) through repl_execute_line(), without prompts. A SQL
+ * statement runs to a semicolon outside quotes, however many lines and bytes
+ * that takes; a meta-command is one line. Lines starting with `--` are
+ * comments.
+ *
+ * A failing statement does not stop the script unless `stop_on_error` is
+ * set. Either way the statements that ran before a failure stay applied:
+ * there are no transactions to undo them. Returns REPL_EXIT after `.exit`,
+ * REPL_ERROR if the file cannot be read or any statement failed.
+ */
+ReplResult repl_execute_script(Database *db, const char *path,
+                               bool stop_on_error);
+
+#endif
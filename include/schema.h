@@ -9,5 +9,6 @@ void deserialize_row(Schema *schema, void *src, struct Statement *s);
 void serialize_field(Schema *schema, uint32_t field_idx, void *val, void *dest);
 void deserialize_field(Schema *schema, uint32_t field_idx, void *src, void *dest);
 uint32_t hash_string(const char *str);
+uint32_t hash_string_n(const char *str, size_t len);
 
 #endif
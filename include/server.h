@@ -0,0 +1,40 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "common.h"
+#include "database.h"
+
+/**
+ * Server mode keeps a single Database open and lets many clients talk to it
+ * over persistent Unix domain socket connections, instead of paying process
+ * startup and db_open() for every batch.
+ *
+ * Wire protocol: every frame is a 4-byte big-endian payload length followed by
+ * the payload.
+ *   - Request payload:  one line of input, exactly as typed at the REPL
+ *                       (SQL statement or meta-command). A trailing newline
+ *                       is ignored; a payload with a line break inside is
+ *                       refused with an error rather than run in part.
+ *   - Response payload: everything the REPL would have printed for that line.
+ * Sending ".exit" closes the connection after an empty response.
+ *
+ * An epoll loop accepts connections and hands readable ones to a pool of
+ * worker threads. Sockets are non-blocking and each connection keeps the
+ * part of a frame received so far, so a client that stalls mid-frame does
+ * not hold a worker. Workers read and write frames in parallel, but statement
+ * execution is serialized on one lock because the Pager and B-Tree are not
+ * thread-safe.
+ */
+
+constexpr uint32_t SERVER_MAX_FRAME = 1 << 20;
+constexpr uint32_t SERVER_DEFAULT_WORKERS = 4;
+constexpr uint32_t SERVER_MAX_CONNECTIONS = 1024;
+
+/**
+ * server_run listens on socket_path until SIGINT/SIGTERM. Returns 0 on a clean
+ * shutdown and -1 if the socket could not be set up. The caller still owns db
+ * and must close it afterwards.
+ */
+int server_run(Database *db, const char *socket_path, uint32_t num_workers);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SIMPLEDB_H
+#define SIMPLEDB_H
+
+#include <stdint.h>
+
+/**
+ * libsimpledb: embed the database in an application instead of driving the
+ * REPL with text. A statement is parsed once by sdb_prepare() and can then be
+ * bound, stepped and reset any number of times; rows are read straight from
+ * the B-Tree pages without being formatted or printed.
+ *
+ *   sdb *db;
+ *   sdb_stmt *stmt;
+ *   sdb_open("app.db", &db);
+ *   sdb_prepare(db, "SELECT * FROM users WHERE id = ?", &stmt);
+ *   sdb_bind_int(stmt, 1, 42);
+ *   while (sdb_step(stmt) == SDB_ROW)
+ *     printf("%s\n", sdb_column_text(stmt, 1));
+ *   sdb_finalize(stmt);
+ *   sdb_close(db);
+ *
+ * Parameters are written as '?' and numbered from 1. Columns are numbered
+ * from 0 in schema order. A connection must only be used by one thread at a
+ * time.
+ */
+
+typedef struct sdb sdb;
+typedef struct sdb_stmt sdb_stmt;
+
+typedef enum {
+  SDB_OK = 0,
+  SDB_ROW,        // sdb_step() produced a row; read it with sdb_column_*()
+  SDB_DONE,       // sdb_step() finished; the next step starts over
+  SDB_ERROR,      // Statement could not be prepared or executed
+  SDB_CONSTRAINT, // INSERT of a duplicate primary key
+  SDB_NOTFOUND,   // UPDATE/DELETE of a key that does not exist
+  SDB_RANGE,      // Parameter or column index out of range
+  SDB_MISUSE      // API called in the wrong state (e.g. unbound parameter)
+} sdb_result;
+
+/**
+ * sdb_open opens or creates a database file. When the file cannot be opened
+ * it returns SDB_ERROR, and *out is still a connection for sdb_errmsg() that
+ * must be closed with sdb_close().
+ */
+[[nodiscard]] int sdb_open(const char *filename, sdb **out);
+int sdb_close(sdb *db);
+const char *sdb_errmsg(sdb *db);
+
+[[nodiscard]] int sdb_prepare(sdb *db, const char *sql, sdb_stmt **out);
+int sdb_bind_int(sdb_stmt *stmt, int param, uint32_t value);
+int sdb_bind_text(sdb_stmt *stmt, int param, const char *value);
+int sdb_step(sdb_stmt *stmt);
+int sdb_reset(sdb_stmt *stmt);
+int sdb_finalize(sdb_stmt *stmt);
+
+int sdb_column_count(sdb_stmt *stmt);
+const char *sdb_column_name(sdb_stmt *stmt, int col);
+uint32_t sdb_column_int(sdb_stmt *stmt, int col);
+
+/**
+ * sdb_column_text points directly into the page holding the current row. It
+ * stays valid until the next sdb_step(), sdb_reset() or sdb_finalize(), while
+ * other statements run, though one writing to the row's table may change it.
+ */
+const char *sdb_column_text(sdb_stmt *stmt, int col);
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include "common.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * A ResultSink collects a SELECT's printed output in a SINK_BUFFER_SIZE
+ * buffer of its own and hands it on a buffer at a time, instead of calling
+ * printf once per value. Integers are formatted by hand, two digits per step.
+ * When the stream has a file descriptor, each flush is a single write() to
+ * it (after flushing whatever the stream itself still holds, so output stays
+ * in order); streams without one, such as open_memstream(), get one fwrite().
+ * A sink allocates nothing.
+ */
+constexpr uint32_t SINK_BUFFER_SIZE = 1 << 16;
+
+typedef struct {
+  FILE *out;
+  int fd; // -1 to go through `out`
+  uint32_t len;
+  char buf[SINK_BUFFER_SIZE];
+} ResultSink;
+
+void sink_open(ResultSink *sink, FILE *out);
+
+/** sink_flush hands on everything buffered so far. */
+void sink_flush(ResultSink *sink);
+
+static inline void sink_bytes(ResultSink *sink, const char *bytes,
+                              size_t len) {
+  if (len > SINK_BUFFER_SIZE - sink->len) {
+    sink_flush(sink);
+    if (len > SINK_BUFFER_SIZE) {
+      fwrite(bytes, 1, len, sink->out);
+      return;
+    }
+  }
+  memcpy(sink->buf + sink->len, bytes, len);
+  sink->len += (uint32_t)len;
+}
+
+static inline void sink_char(ResultSink *sink, char c) {
+  if (sink->len == SINK_BUFFER_SIZE)
+    sink_flush(sink);
+  sink->buf[sink->len++] = c;
+}
+
+/** sink_fill writes `c` `n` times over; n is at most SINK_BUFFER_SIZE. */
+static inline void sink_fill(ResultSink *sink, char c, size_t n) {
+  if (n > SINK_BUFFER_SIZE - sink->len)
+    sink_flush(sink);
+  memset(sink->buf + sink->len, c, n);
+  sink->len += (uint32_t)n;
+}
+
+/** sink_text writes a NUL-terminated string of at most `size` bytes. */
+static inline void sink_text(ResultSink *sink, const char *text,
+                             size_t size) {
+  const char *end = memchr(text, '\0', size);
+  sink_bytes(sink, text, end != nullptr ? (size_t)(end - text) : size);
+}
+
+/**
+ * format_uint writes `value` in decimal into the (up to 10) characters just
+ * before `end` and returns where the digits start.
+ */
+char *format_uint(uint32_t value, char *end);
+
+static inline void sink_uint(ResultSink *sink, uint32_t value) {
+  char digits[10];
+  char *start = format_uint(value, digits + sizeof(digits));
+  sink_bytes(sink, start, (size_t)(digits + sizeof(digits) - start));
+}
+
+/** sink_u32le writes `value` as four little-endian bytes. */
+static inline void sink_u32le(ResultSink *sink, uint32_t value) {
+  char bytes[4] = {(char)value, (char)(value >> 8), (char)(value >> 16),
+                   (char)(value >> 24)};
+  sink_bytes(sink, bytes, sizeof(bytes));
+}
+
+/** sink_repeat writes `len` bytes `times` times over. */
+void sink_repeat(ResultSink *sink, const char *bytes, size_t len,
+                 uint32_t times);
+
+#endif
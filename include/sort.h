@@ -0,0 +1,59 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include "common.h"
+#include "database.h"
+#include "statement.h"
+
+/**
+ * Sorting for ORDER BY. Rows are copied into the sorter and handed back in
+ * column order; rows with equal values keep the order they were added in.
+ *
+ * When only the first `offset + limit` rows are wanted and they fit in the
+ * memory budget (Database.sort_memory), the sorter keeps just those in a
+ * bounded heap, so a top-N query never holds more than N rows. Otherwise rows
+ * are buffered up to the budget; each full buffer is sorted and written to a
+ * temporary file as a run, and the runs are merged in one pass at the end.
+ */
+typedef struct Sorter Sorter;
+
+/**
+ * sorter_open starts a sort of rows laid out by `schema` on column `field`.
+ * Only rows offset .. offset + limit - 1 of the sorted order are handed out.
+ */
+Sorter *sorter_open(Database *db, const Schema *schema, uint32_t field,
+                    bool desc, uint32_t offset, uint32_t limit);
+void sorter_add(Sorter *sorter, const void *row);
+
+/** sorter_finish ends the input; rows can be read from then on. */
+void sorter_finish(Sorter *sorter);
+
+/**
+ * sorter_next returns the next row in order, or nullptr after the last. The
+ * row is valid until the next call. A failed sorter hands out no more rows.
+ */
+const void *sorter_next(Sorter *sorter);
+
+/** sorter_rewind starts handing out the rows again from the first. */
+void sorter_rewind(Sorter *sorter);
+
+/** sorter_runs returns the number of runs spilled to disk, 0 if none. */
+uint32_t sorter_runs(const Sorter *sorter);
+
+/**
+ * sorter_failed tells whether a run could not be written to or read back
+ * from the temporary file, leaving the rows incomplete.
+ */
+bool sorter_failed(const Sorter *sorter);
+
+/** sorter_fail fails the sorter for input that could not all be read. */
+void sorter_fail(Sorter *sorter);
+void sorter_close(Sorter *sorter);
+
+/**
+ * select_sorted reads every row a SELECT's cursor returns into a finished
+ * sorter for its ORDER BY, taking ownership of the cursor.
+ */
+Sorter *select_sorted(Statement *statement, Database *db, Cursor *c);
+
+#endif
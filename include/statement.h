@@ -17,7 +17,15 @@ typedef enum : uint8_t {
   PREPARE_NO_TABLE,
   PREPARE_TABLE_ALREADY_EXISTS,
   PREPARE_CATALOG_FULL,
-  PREPARE_STRING_TOO_LONG
+  PREPARE_STRING_TOO_LONG,
+  PREPARE_PARAMETER_OUT_OF_RANGE,
+  PREPARE_NO_COLUMN,
+  PREPARE_INDEX_ALREADY_EXISTS,
+  PREPARE_INDEX_CATALOG_FULL,
+  PREPARE_AGGREGATE_NOT_INT,
+  PREPARE_NOT_GROUPED,
+  PREPARE_JOIN_TYPE_MISMATCH,
+  PREPARE_EXPLAIN_NOT_SELECT
 } PrepareResult;
 
 typedef enum : uint8_t {
@@ -26,17 +34,140 @@ typedef enum : uint8_t {
   STATEMENT_DELETE,
   STATEMENT_UPDATE,
   STATEMENT_CREATE_TABLE,
+  STATEMENT_CREATE_INDEX,
   STATEMENT_BEGIN,
   STATEMENT_COMMIT,
-  STATEMENT_ROLLBACK
+  STATEMENT_ROLLBACK,
+  STATEMENT_ANALYZE
 } StatementType;
 
+/**
+ * The keys of the B-Tree a SELECT walks (see select_open()). Either end may
+ * be missing, or hold a key that is itself included or not.
+ */
+typedef struct {
+  uint32_t lower;
+  uint32_t upper;
+  bool has_lower;
+  bool has_upper;
+  bool lower_inclusive;
+  bool upper_inclusive;
+} KeyRange;
+
+/**
+ * `EXPLAIN SELECT ...` prints the plan of a SELECT instead of running it;
+ * `EXPLAIN ANALYZE SELECT ...` runs it, discarding the rows, and prints the
+ * plan with what running it cost (see explain.h).
+ */
+typedef enum : uint8_t {
+  EXPLAIN_NONE,
+  EXPLAIN_PLAN,
+  EXPLAIN_ANALYZE
+} ExplainMode;
+
+typedef enum : uint8_t {
+  CMP_EQ,
+  CMP_NE,
+  CMP_LT,
+  CMP_LE,
+  CMP_GT,
+  CMP_GE
+} CompareOp;
+
+/**
+ * A token is a slice of the input line. Nothing is copied or allocated while
+ * parsing; values the statement keeps (TEXT literals) are copied into the
+ * statement's arena.
+ */
+typedef struct {
+  const char *ptr; // nullptr once the input is exhausted
+  uint32_t len;
+  bool quoted; // Was written as a '...' string literal
+} Token;
+
+/**
+ * A '?' placeholder in a statement. Binding a value writes it to the field
+ * value (INSERT values, UPDATE SET), to the key of an UPDATE or DELETE
+ * (WHERE id = ?), to a term of a SELECT's WHERE clause or to its LIMIT or
+ * OFFSET.
+ */
+typedef enum : uint8_t {
+  PARAM_FIELD_VALUE,
+  PARAM_KEY,
+  PARAM_PREDICATE,
+  PARAM_LIMIT,
+  PARAM_OFFSET
+} ParamTarget;
+
+typedef struct {
+  ParamTarget target;
+  uint8_t field_idx; // Term number for PARAM_PREDICATE
+} Parameter;
+
+constexpr uint32_t MAX_PARAMS = MAX_FIELDS + 1;
+
+/**
+ * A SELECT's WHERE clause is compiled once into terms `column op value`. Runs
+ * of terms joined by AND form groups, and the groups are ORed (AND binds
+ * tighter than OR). Each term's eval is specialized for the column type and
+ * operator and reads the column straight from the row bytes, so testing a
+ * row neither dispatches on types nor copies fields out.
+ */
+typedef struct PredicateTerm PredicateTerm;
+typedef bool (*TermEval)(const PredicateTerm *term, const uint8_t *row);
+
+struct PredicateTerm {
+  TermEval eval;
+  const char *text; // TEXT value, in the statement arena
+  uint32_t value;   // INT value, or the hash of the TEXT value
+  uint16_t offset;  // Column offset within the row
+  uint8_t field;
+  CompareOp op;
+  uint8_t next_group; // Where to continue when this term is false
+  bool ends_group;    // Last term of its AND group
+};
+
+constexpr uint32_t MAX_PREDICATE_TERMS = 8;
+
+typedef struct {
+  uint32_t num_terms; // 0 matches every row
+  PredicateTerm terms[MAX_PREDICATE_TERMS];
+} Predicate;
+
+/**
+ * An item of an aggregate SELECT's column list: an aggregate function of a
+ * column, or (AGG_GROUP) the GROUP BY column itself. COUNT(*) counts every
+ * row; as there are no NULLs, COUNT(col) does too.
+ */
 typedef enum : uint8_t {
-  WHERE_NONE,
-  WHERE_EQUALS,
-  WHERE_GREATER_THAN,
-  WHERE_LESS_THAN
-} WhereCondition;
+  AGG_GROUP,
+  AGG_COUNT,
+  AGG_SUM,
+  AGG_MIN,
+  AGG_MAX,
+  AGG_AVG
+} AggregateFunc;
+
+typedef struct {
+  AggregateFunc func;
+  uint8_t field; // COUNT_ALL for COUNT(*)
+} SelectItem;
+
+constexpr uint8_t COUNT_ALL = UINT8_MAX;
+
+constexpr uint32_t MAX_SELECT_ITEMS = MAX_FIELDS;
+
+/**
+ * Each statement owns a small arena for the TEXT values it carries, so parsing
+ * and binding never touch the heap. One slot per TEXT field is enough; a
+ * SELECT only needs one for its WHERE value.
+ */
+constexpr size_t STATEMENT_ARENA_SIZE = MAX_FIELDS * TEXT_FIELD_SIZE;
+
+typedef struct {
+  char buf[STATEMENT_ARENA_SIZE];
+  uint32_t used;
+} StatementArena;
 
 typedef struct Statement {
   StatementType type;
@@ -44,12 +175,41 @@ typedef struct Statement {
   uint32_t table_index; // Looked up during prepare
   uint32_t delete_id;
   uint32_t insert_values[MAX_FIELDS];
-  char *insert_strings[MAX_FIELDS];
-  Schema new_schema; // For CREATE TABLE
-  WhereCondition where_condition;
-  uint32_t where_key;
+  char *insert_strings[MAX_FIELDS]; // Points into the arena
+  // Keys of the tree a SELECT walks, chosen by select_open(), and whether
+  // the walk runs from the last key back
+  KeyRange key_range;
+  bool reverse;
   uint32_t update_key;
   bool update_mask[MAX_FIELDS];
+  Parameter params[MAX_PARAMS];
+  uint32_t num_params;
+  char index_name[TABLE_NAME_MAX]; // For CREATE INDEX, on column index_field
+  uint32_t index_field;
+  // Column list of an aggregate SELECT; none for SELECT *
+  uint32_t num_items;
+  SelectItem items[MAX_SELECT_ITEMS];
+  bool grouped; // GROUP BY group_field
+  uint8_t group_field;
+  bool ordered; // ORDER BY order_field [DESC]
+  bool order_desc;
+  uint8_t order_field;
+  // SELECT ... FROM table JOIN join_table ON join_left_field =
+  // join_right_field; fields of the joined row are numbered as in
+  // join_schema(), the left table's first
+  bool joined;
+  uint32_t join_table;
+  uint8_t join_left_field;
+  uint8_t join_right_field;
+  // Rows a SELECT returns after skipping `offset` (UINT32_MAX without LIMIT);
+  // for aggregates, rows of the result
+  uint32_t limit;
+  uint32_t offset;
+  ExplainMode explain; // For SELECT
+  // Kept last: statement_copy() skips them when they are unused
+  Predicate predicate; // For SELECT
+  Schema new_schema;   // For CREATE TABLE
+  StatementArena arena;
 } Statement;
 
 typedef enum : uint8_t {
@@ -57,6 +217,7 @@ typedef enum : uint8_t {
   EXECUTE_TABLE_FULL,
   EXECUTE_DUPLICATE_KEY,
   EXECUTE_KEY_NOT_FOUND,
+  EXECUTE_IO_ERROR, // A page or temporary file could not be read or written
   EXECUTE_UNKNOWN_ERROR
 } ExecuteResult;
 
@@ -66,4 +227,107 @@ typedef enum : uint8_t {
                                               Database *db);
 void free_statement(Statement *statement);
 
+/**
+ * statement_copy duplicates a prepared statement, pointing the copy's TEXT
+ * values at its own arena.
+ */
+void statement_copy(Statement *dest, const Statement *src);
+
+/**
+ * bind_parameter_int, bind_parameter_text and bind_parameter_token set the
+ * value of parameter `param` (numbered from 0 in the order the '?'
+ * placeholders appear), so a prepared statement can be executed again without
+ * being parsed again. Text is converted exactly as a literal in the SQL would
+ * be.
+ */
+[[nodiscard]] PrepareResult bind_parameter_int(Statement *statement,
+                                               Database *db, uint32_t param,
+                                               uint32_t value);
+[[nodiscard]] PrepareResult bind_parameter_text(Statement *statement,
+                                                Database *db, uint32_t param,
+                                                const char *value);
+[[nodiscard]] PrepareResult bind_parameter_token(Statement *statement,
+                                                 Database *db, uint32_t param,
+                                                 Token value);
+
+/**
+ * normalize_statement writes `line` to `out` with every literal (a number or a
+ * quoted string) replaced by '?', so statements that only differ in their
+ * literals normalize to the same text. The literals are returned in order.
+ * Returns false if `out` or `literals` is too small.
+ *
+ * match_normalized checks whether `line` normalizes to `sql`, collecting the
+ * literals on the way. It is a single pass that neither tokenizes nor copies.
+ */
+[[nodiscard]] bool normalize_statement(const char *line, char *out,
+                                       size_t size, Token *literals,
+                                       uint32_t max_literals,
+                                       uint32_t *num_literals);
+[[nodiscard]] bool match_normalized(const char *line, const char *sql,
+                                    Token *literals, uint32_t max_literals,
+                                    uint32_t *num_literals);
+
+/** predicate_matches tests a row's value bytes against a predicate. */
+bool predicate_matches(const Predicate *predicate, const void *row);
+
+/**
+ * predicate_key_range tells whether a predicate selects exactly the rows
+ * whose primary key lies in first..last: it has no OR and only compares an
+ * INT primary key, with anything but '!='. No terms is the whole key space;
+ * contradicting terms leave first > last.
+ */
+bool predicate_key_range(const Predicate *predicate, const Schema *schema,
+                         uint32_t *first, uint32_t *last);
+
+/**
+ * select_open positions a cursor at the first row a SELECT may return, and
+ * select_next advances it, returning the next matching row's value bytes or
+ * nullptr when the scan is done. The returned row is only valid until the
+ * next call.
+ *
+ * When the WHERE clause has no OR, its terms on one column may bound the
+ * walk to a key range: on the primary key the table's B-Tree is walked, on
+ * an indexed column the index, fetching each row by its primary key. The
+ * cursor seeks straight to the first key in range and the walk stops at the
+ * first key past it. Only '=' is used for TEXT columns, whose keys are
+ * hashes. Otherwise every row of the table is tested.
+ *
+ * An ORDER BY ... DESC on the key of the tree walked runs the walk backward
+ * over the leaves' previous-leaf links, from the upper bound or the last key.
+ *
+ * The OFFSET of a non-aggregate SELECT is skipped here. When the WHERE clause
+ * is only a primary key range, the walk starts at the row of that rank,
+ * found through the row counts in the B-Tree without visiting the rows
+ * before it.
+ */
+Cursor *select_open(Statement *statement, Database *db);
+
+/**
+ * select_plan makes select_open()'s choices without opening anything: it
+ * sets the key range and direction of the walk and returns the tree walked,
+ * the table's or INDEX_TREE_BASE + an index's.
+ */
+uint32_t select_plan(Statement *statement, Database *db);
+
+/**
+ * key_range_bounds returns the smallest and largest key a range admits. An
+ * empty range gives first > last.
+ */
+void key_range_bounds(const KeyRange *range, uint32_t *first, uint32_t *last);
+/**
+ * key_range_narrow intersects a range with the keys `op value` admits. '!='
+ * cannot narrow a range and is ignored.
+ */
+void key_range_narrow(KeyRange *range, CompareOp op, uint32_t value);
+void *select_next(Statement *statement, Database *db, Cursor *c);
+
+/**
+ * select_needs_sort tells whether rows from a cursor select_open() returned
+ * still need sorting for the ORDER BY. Walks of the table come out in primary
+ * key order and walks of an INT index in the order of its column, either way
+ * round, so an ORDER BY on that column needs none. When a sort is needed,
+ * select_open() leaves the OFFSET to it.
+ */
+bool select_needs_sort(const Statement *statement, const Cursor *c);
+
 #endif
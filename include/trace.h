@@ -0,0 +1,91 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "common.h"
+
+/**
+ * Hot-path tracing, built in with `meson configure -Dtracing=true` (which
+ * defines SIMPLEDB_TRACING). Without it TRACE_BEGIN and TRACE_END expand to
+ * nothing and trace_start() refuses, so the engine carries no trace code.
+ *
+ * Built in, `.trace FILE` starts recording spans around get_page(),
+ * find_node(), leaf_node_insert_row(), node splits and serialize_row(), and
+ * `.trace off` writes them to FILE in the Chrome trace event format (load it
+ * in chrome://tracing or ui.perfetto.dev). Each span has its start and
+ * duration and, on Linux where perf_event_open() allows it, the CPU cycles,
+ * instructions and cache misses of the calling thread while it ran.
+ *
+ * Timing an operation costs about as much as a page fetch from the cache, so
+ * each thread records one call in `sample_every` of the cheap operations;
+ * splits are rare and slow and every one is recorded. Nested spans are kept
+ * only when sampled themselves.
+ */
+typedef enum : uint8_t {
+  TRACE_GET_PAGE,
+  TRACE_FIND_NODE,
+  TRACE_LEAF_INSERT,
+  TRACE_LEAF_SPLIT,
+  TRACE_INTERNAL_SPLIT,
+  TRACE_SERIALIZE_ROW,
+  TRACE_NUM_OPS
+} TraceOp;
+
+constexpr uint32_t TRACE_SAMPLE_DEFAULT = 1024;
+// Spans kept until `.trace off`; later ones are dropped and counted
+constexpr uint32_t TRACE_MAX_EVENTS = 1 << 16;
+
+/**
+ * trace_start begins recording, to be written to `path` by trace_stop().
+ * Returns false if tracing is not built in or `path` cannot be written.
+ */
+bool trace_start(const char *path, uint32_t sample_every);
+
+/**
+ * trace_stop writes the recorded spans and stops recording, setting *written
+ * to the spans written and *dropped to those that did not fit. Returns false
+ * if nothing was being recorded.
+ */
+bool trace_stop(uint32_t *written, uint32_t *dropped);
+
+#ifdef SIMPLEDB_TRACING
+
+#include <threads.h>
+
+constexpr uint32_t TRACE_COUNTERS = 3; // Cycles, instructions, cache misses
+
+typedef struct {
+  uint64_t start_ns; // 0 when the call is not sampled
+  uint64_t counters[TRACE_COUNTERS];
+  TraceOp op;
+  bool counted; // The counters could be read at the start
+} TraceSpan;
+
+extern bool trace_on;
+extern uint32_t trace_every[TRACE_NUM_OPS];
+extern thread_local uint32_t trace_calls[TRACE_NUM_OPS];
+
+TraceSpan trace_sample(TraceOp op);
+void trace_record(const TraceSpan *span);
+
+static inline TraceSpan trace_begin(TraceOp op) {
+  if (!trace_on || ++trace_calls[op] < trace_every[op])
+    return (TraceSpan){.op = op};
+  return trace_sample(op);
+}
+
+static inline void trace_end(const TraceSpan *span) {
+  if (span->start_ns != 0)
+    trace_record(span);
+}
+
+#define TRACE_BEGIN(span, op) TraceSpan span = trace_begin(op)
+#define TRACE_END(span) trace_end(&span)
+
+#else
+
+#define TRACE_BEGIN(span, op)
+#define TRACE_END(span)
+
+#endif
+
+#endif
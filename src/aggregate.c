@@ -0,0 +1,576 @@
+#include "aggregate.h"
+#include "batch.h"
+#include "btree.h"
+#include "parallel.h"
+#include "schema.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  uint64_t sum;
+  uint32_t min;
+  uint32_t max;
+} Accumulator;
+
+typedef struct {
+  uint32_t key; // INT group value, or the hash of the TEXT value
+  uint64_t count;
+  uint64_t first; // Task the group was first seen in, then its place there
+  char text[TEXT_FIELD_SIZE]; // TEXT group value
+  Accumulator acc[MAX_SELECT_ITEMS];
+} Group;
+
+/**
+ * Groups are kept in an array in the order they were first seen. An open
+ * addressing table of group numbers finds them by key.
+ */
+typedef struct {
+  Statement *statement;
+  Schema *schema;
+  Group *groups;
+  uint32_t num_groups;
+  uint32_t max_groups;
+  uint32_t *slots;    // Group number + 1; 0 is empty
+  uint32_t num_slots; // A power of two, at least twice num_groups
+  uint32_t task;      // Parallel scan task being folded in; 0 if serial
+  uint32_t seen;      // Groups first seen in that task so far
+} Aggregation;
+
+static inline uint32_t mix(uint32_t key) {
+  key ^= key >> 16;
+  key *= 0x85ebca6bu;
+  key ^= key >> 13;
+  key *= 0xc2b2ae35u;
+  return key ^ (key >> 16);
+}
+
+static inline uint32_t row_int(Schema *schema, uint32_t field,
+                               const uint8_t *row) {
+  uint32_t value;
+  memcpy(&value, row + schema->fields[field].offset, sizeof(value));
+  return value;
+}
+
+static void grow_slots(Aggregation *agg) {
+  uint32_t num_slots = agg->num_slots > 0 ? agg->num_slots * 2 : 64;
+  uint32_t mask = num_slots - 1;
+  uint32_t *slots = calloc(num_slots, sizeof(uint32_t));
+  for (uint32_t g = 0; g < agg->num_groups; g++) {
+    uint32_t i = mix(agg->groups[g].key) & mask;
+    while (slots[i] != 0)
+      i = (i + 1) & mask;
+    slots[i] = g + 1;
+  }
+  free(agg->slots);
+  agg->slots = slots;
+  agg->num_slots = num_slots;
+}
+
+static uint32_t new_group(Aggregation *agg, uint32_t key, const char *text) {
+  if (agg->num_groups == agg->max_groups) {
+    agg->max_groups = agg->max_groups > 0 ? agg->max_groups * 2 : 16;
+    agg->groups = realloc(agg->groups, agg->max_groups * sizeof(Group));
+  }
+  Group *g = &agg->groups[agg->num_groups];
+  *g = (Group){.key = key, .first = (uint64_t)agg->task << 32 | agg->seen++};
+  if (text != nullptr)
+    snprintf(g->text, sizeof(g->text), "%s", text);
+  for (uint32_t i = 0; i < MAX_SELECT_ITEMS; i++)
+    g->acc[i].min = UINT32_MAX;
+  return agg->num_groups++;
+}
+
+/**
+ * find_group returns the group with an INT key, or with a TEXT value and its
+ * hash, creating it on first sight.
+ */
+static uint32_t find_group(Aggregation *agg, uint32_t key, const char *text) {
+  uint32_t mask = agg->num_slots - 1;
+  uint32_t i = mix(key) & mask;
+  for (; agg->slots[i] != 0; i = (i + 1) & mask) {
+    Group *g = &agg->groups[agg->slots[i] - 1];
+    if (g->key == key && (text == nullptr || strcmp(g->text, text) == 0)) {
+      // A worker's tasks can come out of key order
+      if (g->first >> 32 > agg->task)
+        g->first = (uint64_t)agg->task << 32 | agg->seen++;
+      return agg->slots[i] - 1;
+    }
+  }
+  uint32_t g = new_group(agg, key, text);
+  agg->slots[i] = g + 1;
+  if (agg->num_groups * 2 > agg->num_slots)
+    grow_slots(agg);
+  return g;
+}
+
+static uint32_t row_group(Aggregation *agg, const uint8_t *row) {
+  uint32_t field = agg->statement->group_field;
+  if (agg->schema->fields[field].type == FIELD_INT)
+    return find_group(agg, row_int(agg->schema, field, row), nullptr);
+  const char *text = (const char *)row + agg->schema->fields[field].offset;
+  return find_group(agg, hash_string(text), text);
+}
+
+/** aggregate_row folds one row, fetched through an index, into its group. */
+static void aggregate_row(Aggregation *agg, const uint8_t *row) {
+  Statement *statement = agg->statement;
+  Group *g = &agg->groups[statement->grouped ? row_group(agg, row) : 0];
+  g->count++;
+  for (uint32_t j = 0; j < statement->num_items; j++) {
+    SelectItem *item = &statement->items[j];
+    if (item->func == AGG_GROUP || item->func == AGG_COUNT)
+      continue;
+    uint32_t value = row_int(agg->schema, item->field, row);
+    Accumulator *acc = &g->acc[j];
+    acc->sum += value;
+    acc->min = value < acc->min ? value : acc->min;
+    acc->max = value > acc->max ? value : acc->max;
+  }
+}
+
+/**
+ * aggregate_batch folds a batch's selected rows into their groups. Without
+ * GROUP BY each aggregate is one loop over a column; with it, the rows' group
+ * numbers are looked up first and each aggregate is then one loop over them.
+ */
+static void aggregate_batch(Aggregation *agg, const RowBatch *b) {
+  Statement *statement = agg->statement;
+  const uint16_t *sel = b->sel;
+  uint32_t n = b->num_selected;
+
+  if (!statement->grouped) {
+    Group *g = &agg->groups[0];
+    g->count += n;
+    for (uint32_t j = 0; j < statement->num_items; j++) {
+      SelectItem *item = &statement->items[j];
+      if (item->func == AGG_GROUP || item->func == AGG_COUNT)
+        continue;
+      const uint32_t *column = b->columns[item->field];
+      Accumulator *acc = &g->acc[j];
+      switch (item->func) {
+      case AGG_SUM:
+      case AGG_AVG: {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < n; i++)
+          sum += column[sel[i]];
+        acc->sum += sum;
+        break;
+      }
+      case AGG_MIN: {
+        uint32_t min = acc->min;
+        for (uint32_t i = 0; i < n; i++)
+          min = column[sel[i]] < min ? column[sel[i]] : min;
+        acc->min = min;
+        break;
+      }
+      case AGG_MAX: {
+        uint32_t max = acc->max;
+        for (uint32_t i = 0; i < n; i++)
+          max = column[sel[i]] > max ? column[sel[i]] : max;
+        acc->max = max;
+        break;
+      }
+      case AGG_GROUP:
+      case AGG_COUNT:
+        break;
+      }
+    }
+    return;
+  }
+
+  uint32_t gid[BATCH_SIZE];
+  const uint32_t *keys = b->columns[statement->group_field];
+  if (keys != nullptr) {
+    for (uint32_t i = 0; i < n; i++)
+      gid[i] = find_group(agg, keys[sel[i]], nullptr);
+  } else {
+    for (uint32_t i = 0; i < n; i++)
+      gid[i] = row_group(agg, b->rows[sel[i]]);
+  }
+  Group *groups = agg->groups;
+  for (uint32_t i = 0; i < n; i++)
+    groups[gid[i]].count++;
+  for (uint32_t j = 0; j < statement->num_items; j++) {
+    SelectItem *item = &statement->items[j];
+    if (item->func == AGG_GROUP || item->func == AGG_COUNT)
+      continue;
+    const uint32_t *column = b->columns[item->field];
+    switch (item->func) {
+    case AGG_SUM:
+    case AGG_AVG:
+      for (uint32_t i = 0; i < n; i++)
+        groups[gid[i]].acc[j].sum += column[sel[i]];
+      break;
+    case AGG_MIN:
+      for (uint32_t i = 0; i < n; i++) {
+        Accumulator *acc = &groups[gid[i]].acc[j];
+        acc->min = column[sel[i]] < acc->min ? column[sel[i]] : acc->min;
+      }
+      break;
+    case AGG_MAX:
+      for (uint32_t i = 0; i < n; i++) {
+        Accumulator *acc = &groups[gid[i]].acc[j];
+        acc->max = column[sel[i]] > acc->max ? column[sel[i]] : acc->max;
+      }
+      break;
+    case AGG_GROUP:
+    case AGG_COUNT:
+      break;
+    }
+  }
+}
+
+/**
+ * merge_groups folds the groups of `from` into `into`, keeping for each the
+ * earliest place it was seen.
+ */
+static void merge_groups(Aggregation *into, const Aggregation *from) {
+  Statement *statement = into->statement;
+  bool text = statement->grouped &&
+              into->schema->fields[statement->group_field].type == FIELD_TEXT;
+  for (uint32_t i = 0; i < from->num_groups; i++) {
+    const Group *part = &from->groups[i];
+    uint32_t g = statement->grouped
+                     ? find_group(into, part->key, text ? part->text : nullptr)
+                     : 0;
+    Group *group = &into->groups[g];
+    group->count += part->count;
+    group->first = part->first < group->first ? part->first : group->first;
+    for (uint32_t j = 0; j < statement->num_items; j++) {
+      Accumulator *acc = &group->acc[j];
+      const Accumulator *add = &part->acc[j];
+      acc->sum += add->sum;
+      acc->min = add->min < acc->min ? add->min : acc->min;
+      acc->max = add->max > acc->max ? add->max : acc->max;
+    }
+  }
+}
+
+static int compare_first_seen(const void *a, const void *b) {
+  uint64_t x = ((const Group *)a)->first;
+  uint64_t y = ((const Group *)b)->first;
+  return (x > y) - (x < y);
+}
+
+static void aggregate_task(void *arg, uint32_t worker, uint32_t task,
+                           const RowBatch *batch) {
+  Aggregation *part = &((Aggregation *)arg)[worker];
+  if (part->task != task) {
+    part->task = task;
+    part->seen = 0;
+  }
+  aggregate_batch(part, batch);
+}
+
+/**
+ * aggregate_parallel gives each worker of a parallel scan groups of its own
+ * and merges them afterwards. Tasks are numbered in key order and groups
+ * remember the first task and place they were seen in, so sorting on that
+ * puts them in the order a single scan would have found them. Returns false
+ * if the scan could not read every leaf.
+ */
+static bool aggregate_parallel(Aggregation *agg, ParallelScan *scan,
+                               uint32_t columns) {
+  uint32_t num_threads = parallel_scan_threads(scan);
+  Aggregation *parts = malloc(num_threads * sizeof(Aggregation));
+  for (uint32_t w = 0; w < num_threads; w++) {
+    parts[w] = (Aggregation){.statement = agg->statement,
+                             .schema = agg->schema};
+    grow_slots(&parts[w]);
+    if (!agg->statement->grouped)
+      new_group(&parts[w], 0, nullptr);
+  }
+  bool read = parallel_scan_run(scan, columns, aggregate_task, parts);
+  // Groups new to `agg` sort after any it had, until their place is merged
+  agg->task = UINT32_MAX;
+  for (uint32_t w = 0; w < num_threads; w++) {
+    merge_groups(agg, &parts[w]);
+    free(parts[w].groups);
+    free(parts[w].slots);
+  }
+  free(parts);
+  if (agg->statement->grouped)
+    qsort(agg->groups, agg->num_groups, sizeof(Group), compare_first_seen);
+  return read;
+}
+
+/** pk_edges_only tells whether a query only asks for MIN/MAX of the key. */
+static bool pk_edges_only(Statement *statement) {
+  if (statement->predicate.num_terms > 0 || statement->grouped)
+    return false;
+  for (uint32_t j = 0; j < statement->num_items; j++) {
+    SelectItem *item = &statement->items[j];
+    if ((item->func != AGG_MIN && item->func != AGG_MAX) || item->field != 0)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * read_pk_edges takes the smallest key from the first leaf and the largest
+ * from the last, in O(log n). Leaves emptied by deletes are stepped over
+ * through their links. Returns false if the table is empty.
+ */
+static bool read_pk_edges(Database *db, uint32_t table, Group *g) {
+  Schema *schema = &db->catalog.tables[table].schema;
+  Cursor *first = table_start(db, table);
+  Cursor *last = table_end(db, table);
+  unpin_page_all(db->pager);
+  void *node = get_page(db->pager, first->page_num);
+  while (*leaf_node_num_cells(node) == 0 && *leaf_node_next_leaf(node) != 0) {
+    unpin_page_all(db->pager);
+    node = get_page(db->pager, *leaf_node_next_leaf(node));
+  }
+  void *last_node = get_page(db->pager, last->page_num);
+  while (*leaf_node_num_cells(last_node) == 0 &&
+         *leaf_node_prev_leaf(last_node) != 0) {
+    unpin_page(db->pager, last->page_num);
+    last->page_num = *leaf_node_prev_leaf(last_node);
+    last_node = get_page(db->pager, last->page_num);
+  }
+  bool found = *leaf_node_num_cells(node) > 0;
+  if (found) {
+    uint32_t min = *leaf_node_key(node, 0, schema);
+    uint32_t max = *leaf_node_key(
+        last_node, *leaf_node_num_cells(last_node) - 1, schema);
+    g->count = 1; // Not reported; only marks the result as non-empty
+    for (uint32_t j = 0; j < MAX_SELECT_ITEMS; j++)
+      g->acc[j] = (Accumulator){.min = min, .max = max};
+  }
+  free(first);
+  free(last);
+  unpin_page_all(db->pager);
+  return found;
+}
+
+static const char *func_name(AggregateFunc func) {
+  switch (func) {
+  case AGG_COUNT:
+    return "COUNT";
+  case AGG_SUM:
+    return "SUM";
+  case AGG_MIN:
+    return "MIN";
+  case AGG_MAX:
+    return "MAX";
+  case AGG_AVG:
+    return "AVG";
+  case AGG_GROUP:
+    break;
+  }
+  return "";
+}
+
+void aggregate_schema(Statement *statement, Database *db, Schema *schema) {
+  Schema *table = &db->catalog.tables[statement->table_index].schema;
+  *schema = (Schema){.num_fields = statement->num_items};
+  for (uint32_t j = 0; j < statement->num_items; j++) {
+    SelectItem *item = &statement->items[j];
+    Field *f = &schema->fields[j];
+    const char *column =
+        item->field == COUNT_ALL ? "*" : table->fields[item->field].name;
+    if (item->func == AGG_GROUP) {
+      snprintf(f->name, sizeof(f->name), "%s", column);
+      f->type = table->fields[item->field].type;
+    } else {
+      // Long column names are cut short to fit
+      int len = snprintf(f->name, sizeof(f->name), "%s(%.24s",
+                         func_name(item->func), column);
+      if (len < (int)sizeof(f->name) - 1)
+        strcat(f->name, ")");
+      f->type = item->func == AGG_COUNT ? FIELD_INT : FIELD_TEXT;
+    }
+    f->size = f->type == FIELD_INT ? sizeof(uint32_t) : TEXT_FIELD_SIZE;
+    f->offset = schema->row_size;
+    schema->row_size += f->size;
+  }
+}
+
+static ResultSet *build_result(Aggregation *agg, Database *db) {
+  Statement *statement = agg->statement;
+  ResultSet *result = malloc(sizeof(ResultSet));
+  aggregate_schema(statement, db, &result->schema);
+  uint32_t row_size = result->schema.row_size;
+  result->num_rows = agg->num_groups;
+  result->rows = calloc(agg->num_groups > 0 ? agg->num_groups : 1, row_size);
+
+  for (uint32_t g = 0; g < agg->num_groups; g++) {
+    Group *group = &agg->groups[g];
+    uint8_t *row = result->rows + g * row_size;
+    for (uint32_t j = 0; j < statement->num_items; j++) {
+      Field *f = &result->schema.fields[j];
+      Accumulator *acc = &group->acc[j];
+      char *text = (char *)row + f->offset;
+      uint32_t value = 0;
+      switch (statement->items[j].func) {
+      case AGG_GROUP:
+        if (f->type == FIELD_TEXT)
+          snprintf(text, TEXT_FIELD_SIZE, "%s", group->text);
+        value = group->key;
+        break;
+      case AGG_COUNT:
+        value = (uint32_t)group->count;
+        break;
+      case AGG_SUM:
+        snprintf(text, TEXT_FIELD_SIZE, "%llu", (unsigned long long)acc->sum);
+        break;
+      case AGG_MIN:
+        snprintf(text, TEXT_FIELD_SIZE, "%u", acc->min);
+        break;
+      case AGG_MAX:
+        snprintf(text, TEXT_FIELD_SIZE, "%u", acc->max);
+        break;
+      case AGG_AVG:
+        snprintf(text, TEXT_FIELD_SIZE, "%.2f",
+                 group->count > 0 ? (double)acc->sum / (double)group->count
+                                  : 0.0);
+        break;
+      }
+      if (f->type == FIELD_INT)
+        memcpy(row + f->offset, &value, sizeof(value));
+      else if (group->count == 0 && statement->items[j].func != AGG_GROUP)
+        snprintf(text, TEXT_FIELD_SIZE, "NULL"); // Aggregate of no rows
+    }
+  }
+  return result;
+}
+
+/**
+ * count_only tells whether a query asks for nothing but COUNT(*) of a
+ * primary key range, which the B-Tree's row counts answer in O(log n).
+ */
+static bool count_only(Statement *statement, Database *db, uint32_t *first,
+                       uint32_t *last) {
+  if (statement->grouped)
+    return false;
+  for (uint32_t j = 0; j < statement->num_items; j++) {
+    if (statement->items[j].func != AGG_COUNT)
+      return false;
+  }
+  return predicate_key_range(&statement->predicate,
+                             &db->catalog.tables[statement->table_index].schema,
+                             first, last);
+}
+
+AggregateInput aggregate_input(Statement *statement, Database *db) {
+  uint32_t first, last;
+  if (count_only(statement, db, &first, &last))
+    return AGGREGATE_ROW_COUNTS;
+  return pk_edges_only(statement) ? AGGREGATE_KEY_EDGES : AGGREGATE_ROWS;
+}
+
+static int compare_int_groups(const void *a, const void *b) {
+  uint32_t x = ((const Group *)a)->key;
+  uint32_t y = ((const Group *)b)->key;
+  return (x > y) - (x < y);
+}
+
+static int compare_text_groups(const void *a, const void *b) {
+  return strcmp(((const Group *)a)->text, ((const Group *)b)->text);
+}
+
+/**
+ * order_groups sorts the groups for an ORDER BY, which is always on the GROUP
+ * BY column. Group values are distinct, so descending order is the reverse.
+ */
+static void order_groups(Aggregation *agg) {
+  Statement *statement = agg->statement;
+  if (!statement->ordered)
+    return;
+  bool text = agg->schema->fields[statement->group_field].type == FIELD_TEXT;
+  qsort(agg->groups, agg->num_groups, sizeof(Group),
+        text ? compare_text_groups : compare_int_groups);
+  if (!statement->order_desc)
+    return;
+  for (uint32_t i = 0, j = agg->num_groups; i + 1 < j; i++, j--) {
+    Group group = agg->groups[i];
+    agg->groups[i] = agg->groups[j - 1];
+    agg->groups[j - 1] = group;
+  }
+}
+
+/** limit_result applies LIMIT and OFFSET to the rows of a result. */
+static void limit_result(ResultSet *result, Statement *statement) {
+  uint32_t skip = statement->offset < result->num_rows ? statement->offset
+                                                       : result->num_rows;
+  uint32_t row_size = result->schema.row_size;
+  result->num_rows -= skip;
+  memmove(result->rows, result->rows + skip * row_size,
+          result->num_rows * row_size);
+  if (result->num_rows > statement->limit)
+    result->num_rows = statement->limit;
+}
+
+/** batch_columns is the mask of INT columns the aggregates read. */
+static uint32_t batch_columns(Statement *statement) {
+  uint32_t columns = 0;
+  for (uint32_t j = 0; j < statement->num_items; j++) {
+    if (statement->items[j].func != AGG_COUNT)
+      columns |= 1u << statement->items[j].field;
+  }
+  if (statement->grouped)
+    columns |= 1u << statement->group_field;
+  return columns;
+}
+
+ResultSet *aggregate_execute(Statement *statement, Database *db) {
+  Aggregation agg = {
+      .statement = statement,
+      .schema = &db->catalog.tables[statement->table_index].schema,
+  };
+  grow_slots(&agg);
+  // Without GROUP BY there is one group, reported even if no row matches
+  if (!statement->grouped)
+    new_group(&agg, 0, nullptr);
+
+  bool failed = false;
+  uint32_t first, last;
+  AggregateInput input = aggregate_input(statement, db);
+  if (input == AGGREGATE_ROW_COUNTS) {
+    count_only(statement, db, &first, &last);
+    agg.groups[0].count =
+        btree_range_count(db, statement->table_index, first, last);
+    unpin_page_all(db->pager);
+  } else if (input == AGGREGATE_ROWS ||
+             !read_pk_edges(db, statement->table_index, &agg.groups[0])) {
+    Cursor *c = select_open(statement, db);
+    ParallelScan *parallel =
+        c->table_index < INDEX_TREE_BASE
+            ? parallel_scan_open(statement, db, db->scan_threads)
+            : nullptr;
+    if (parallel != nullptr) {
+      free(c);
+      failed = !aggregate_parallel(&agg, parallel, batch_columns(statement));
+      parallel_scan_close(parallel);
+    } else if (c->table_index < INDEX_TREE_BASE) {
+      BatchScan *scan =
+          batch_scan_open(statement, db, c, batch_columns(statement));
+      RowBatch *batch;
+      while ((batch = batch_scan_next(scan)) != nullptr)
+        aggregate_batch(&agg, batch);
+      batch_scan_close(scan);
+    } else {
+      void *row;
+      while ((row = select_next(statement, db, c)) != nullptr)
+        aggregate_row(&agg, row);
+      free(c);
+      unpin_page_all(db->pager);
+    }
+  }
+
+  order_groups(&agg);
+  ResultSet *result = build_result(&agg, db);
+  result->failed = failed;
+  limit_result(result, statement);
+  free(agg.groups);
+  free(agg.slots);
+  return result;
+}
+
+void result_set_free(ResultSet *result) {
+  if (result == nullptr)
+    return;
+  free(result->rows);
+  free(result);
+}
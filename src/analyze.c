@@ -0,0 +1,204 @@
+#include "analyze.h"
+#include "btree.h"
+#include "index.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int compare_keys(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * describe_column fills a column's statistics from the sorted keys of `n`
+ * sampled rows, out of `rows` in the table.
+ */
+static void describe_column(ColumnStats *c, const uint32_t *keys, uint32_t n,
+                            uint32_t rows) {
+  *c = (ColumnStats){};
+  if (n == 0)
+    return;
+  uint32_t distinct = 0;
+  uint32_t once = 0; // Values sampled a single time
+  for (uint32_t i = 0; i < n;) {
+    uint32_t j = i + 1;
+    while (j < n && keys[j] == keys[i])
+      j++;
+    distinct++;
+    once += j - i == 1 ? 1 : 0;
+    i = j;
+  }
+  // A column with no value sampled twice is taken to be unique
+  double estimate = rows;
+  if (once < n)
+    estimate = sqrt((double)rows / n) * once + (distinct - once);
+  c->distinct = estimate < rows ? (uint32_t)estimate : rows;
+  c->min = keys[0];
+  c->max = keys[n - 1];
+  for (uint32_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    uint64_t end = ((uint64_t)(b + 1) * n + HISTOGRAM_BUCKETS - 1) /
+                   HISTOGRAM_BUCKETS;
+    c->bounds[b] = keys[end - 1];
+  }
+}
+
+/**
+ * store_stats writes a table's statistics to its page, taking one if new. In
+ * a file with no page left they are kept in memory only.
+ */
+static void store_stats(Database *db, uint32_t table_index,
+                        const TableStats *stats) {
+  uint32_t pg = db->catalog.stats_pages[table_index];
+  if (pg == 0 && !pager_has_room(db->pager, 1))
+    return;
+  if (pg == 0) {
+    pg = db->pager->num_pages;
+    db->catalog.stats_pages[table_index] = pg;
+    db_save_catalog(db);
+  }
+  void *page = get_page(db->pager, pg);
+  memset(page, 0, PAGE_SIZE);
+  memcpy(page, stats, sizeof(TableStats));
+  mark_page_dirty(db->pager, pg);
+  unpin_page(db->pager, pg);
+}
+
+void analyze_table(Database *db, uint32_t table_index) {
+  Schema *schema = tree_schema(db, table_index);
+  TableStats *stats = calloc(1, sizeof(TableStats));
+  stats->leaves = btree_leaf_count(db, table_index, &stats->depth);
+  stats->rows = btree_row_count(db, table_index);
+  uint32_t *pages = malloc(stats->leaves * sizeof(uint32_t));
+  btree_leaf_pages(db, table_index, pages);
+
+  uint32_t samples = stats->leaves < ANALYZE_SAMPLE_LEAVES
+                         ? stats->leaves
+                         : ANALYZE_SAMPLE_LEAVES;
+  // Keys are gathered column by column, `capacity` apart
+  size_t capacity = (size_t)samples * leaf_node_max_cells(schema);
+  uint32_t *keys = malloc(schema->num_fields * capacity * sizeof(uint32_t));
+  uint32_t n = 0;
+  for (uint32_t s = 0; s < samples; s++) {
+    uint32_t pg = pages[(uint64_t)s * stats->leaves / samples];
+    void *leaf = get_page(db->pager, pg);
+    uint32_t cells = *leaf_node_num_cells(leaf);
+    for (uint32_t i = 0; i < cells && n < capacity; i++, n++) {
+      void *row = leaf_node_value(leaf, i, schema);
+      for (uint32_t f = 0; f < schema->num_fields; f++)
+        keys[f * capacity + n] = index_key(schema, f, row);
+    }
+    unpin_page(db->pager, pg);
+  }
+  stats->sampled = n;
+  // A sample of every row counts its distinct values exactly
+  uint32_t rows = samples == stats->leaves ? n : stats->rows;
+  for (uint32_t f = 0; f < schema->num_fields; f++) {
+    qsort(keys + f * capacity, n, sizeof(uint32_t), compare_keys);
+    describe_column(&stats->columns[f], keys + f * capacity, n, rows);
+  }
+  free(keys);
+  free(pages);
+
+  store_stats(db, table_index, stats);
+  free(db->table_stats[table_index]);
+  db->table_stats[table_index] = stats;
+  unpin_page_all(db->pager);
+}
+
+void analyze_load(Database *db) {
+  for (uint32_t i = 0; i < db->catalog.num_tables; i++) {
+    uint32_t pg = db->catalog.stats_pages[i];
+    if (pg == 0)
+      continue;
+    db->table_stats[i] = malloc(sizeof(TableStats));
+    memcpy(db->table_stats[i], get_page(db->pager, pg), sizeof(TableStats));
+    unpin_page(db->pager, pg);
+  }
+}
+
+void analyze_free(Database *db) {
+  for (uint32_t i = 0; i < MAX_TABLES; i++) {
+    free(db->table_stats[i]);
+    db->table_stats[i] = nullptr;
+  }
+}
+
+/**
+ * share_below returns the share of keys at or below `key`, taking keys to be
+ * spread evenly within each bucket.
+ */
+static double share_below(const ColumnStats *c, uint32_t key) {
+  if (key < c->min)
+    return 0;
+  if (key >= c->max)
+    return 1;
+  double low = c->min;
+  for (uint32_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    if (key < c->bounds[b])
+      return (b + (key - low) / (c->bounds[b] - low)) / HISTOGRAM_BUCKETS;
+    low = c->bounds[b];
+  }
+  return 1;
+}
+
+double estimate_range(const TableStats *stats, uint32_t field,
+                      const KeyRange *range) {
+  if (stats->sampled == 0)
+    return 1;
+  uint32_t first, last;
+  key_range_bounds(range, &first, &last);
+  if (first > last)
+    return 0;
+  const ColumnStats *c = &stats->columns[field];
+  double share =
+      share_below(c, last) - (first == 0 ? 0 : share_below(c, first - 1));
+  // A key sampled often spans buckets of its own; a rarer one is taken to
+  // be as common as the average
+  if (first == last && share < 1.0 / c->distinct)
+    share = 1.0 / c->distinct;
+  return share < 0 ? 0 : share > 1 ? 1 : share;
+}
+
+static double term_share(const TableStats *stats, const Schema *schema,
+                         const PredicateTerm *t) {
+  if (schema->fields[t->field].type == FIELD_TEXT && t->op != CMP_EQ &&
+      t->op != CMP_NE)
+    return 1.0 / 3; // Hashes keep no order to read a range from
+  KeyRange range = {};
+  key_range_narrow(&range, t->op == CMP_NE ? CMP_EQ : t->op, t->value);
+  double share = estimate_range(stats, t->field, &range);
+  return t->op == CMP_NE ? 1 - share : share;
+}
+
+double estimate_filter(const TableStats *stats, const Schema *schema,
+                       const Predicate *predicate) {
+  double missed = 1; // Share of rows no AND group keeps
+  double group = 1;
+  for (uint32_t i = 0; i < predicate->num_terms; i++) {
+    const PredicateTerm *t = &predicate->terms[i];
+    group *= term_share(stats, schema, t);
+    if (t->ends_group || i + 1 == predicate->num_terms) {
+      missed *= 1 - group;
+      group = 1;
+    }
+  }
+  return predicate->num_terms == 0 ? 1 : 1 - missed;
+}
+
+double estimate_cost(Database *db, const TableStats *stats, uint32_t tree,
+                     double share) {
+  double descent = stats->depth - 1;
+  if (tree < INDEX_TREE_BASE) {
+    double leaves = share * stats->leaves;
+    return descent + (leaves < 1 ? 1 : leaves);
+  }
+  // Index leaves fill as the table's do, with more, smaller cells
+  uint32_t table = db->catalog.indexes[tree - INDEX_TREE_BASE].table_index;
+  double leaves = share * stats->leaves *
+                  leaf_node_max_cells(tree_schema(db, table)) /
+                  leaf_node_max_cells(tree_schema(db, tree));
+  double lookups = share * stats->rows * stats->depth;
+  return descent + (leaves < 1 ? 1 : leaves) + lookups;
+}
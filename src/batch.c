@@ -0,0 +1,293 @@
+#include "batch.h"
+#include "btree.h"
+#include "pager.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct BatchScan {
+  Database *db;
+  Schema *schema;
+  const Predicate *predicate;
+  Cursor *cursor;
+  uint32_t end_leaf;           // Leaf the walk stops at; 0 past the last
+  uint8_t (*pages)[PAGE_SIZE]; // Leaves read off the Pager, one per slot
+  uint32_t last_key;           // Largest key the scan may return
+  uint32_t wanted;   // Rows still to select under a LIMIT
+  uint32_t stride;   // Most rows the next batch may hold
+  bool done;
+  bool failed;    // pager_peek() could not read a leaf
+  uint64_t reads; // Leaves pager_peek() had to read from the file
+  RowBatch batch;
+  uint8_t group[BATCH_SIZE]; // Rows passing the current AND group so far
+  uint8_t match[BATCH_SIZE]; // Rows passing any finished group
+  uint32_t storage[][BATCH_SIZE]; // One array per decoded column
+};
+
+static inline uint32_t load_u32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+/** scan_new sets up a scan's batch and filter state, not its position. */
+static BatchScan *scan_new(Statement *statement, Database *db,
+                           uint32_t columns) {
+  Schema *schema = &db->catalog.tables[statement->table_index].schema;
+  const Predicate *predicate = &statement->predicate;
+  for (uint32_t i = 0; i < predicate->num_terms; i++)
+    columns |= 1u << predicate->terms[i].field;
+  uint32_t num_columns = 0;
+  for (uint32_t f = 0; f < schema->num_fields; f++) {
+    if (!(columns & (1u << f)) || schema->fields[f].type != FIELD_INT)
+      columns &= ~(1u << f);
+    else
+      num_columns++;
+  }
+
+  BatchScan *scan = malloc(sizeof(BatchScan) +
+                           num_columns * sizeof(uint32_t[BATCH_SIZE]));
+  scan->db = db;
+  scan->schema = schema;
+  scan->predicate = predicate;
+  scan->cursor = nullptr;
+  scan->end_leaf = 0;
+  scan->pages = nullptr;
+  scan->last_key = UINT32_MAX;
+  scan->wanted = UINT32_MAX;
+  scan->stride = BATCH_SIZE;
+  scan->done = false;
+  scan->failed = false;
+  scan->reads = 0;
+  uint32_t next = 0;
+  for (uint32_t f = 0; f < MAX_FIELDS; f++)
+    scan->batch.columns[f] =
+        columns & (1u << f) ? scan->storage[next++] : nullptr;
+  return scan;
+}
+
+BatchScan *batch_scan_open(Statement *statement, Database *db, Cursor *c,
+                           uint32_t columns) {
+  BatchScan *scan = scan_new(statement, db, columns);
+  scan->cursor = c;
+  // select_open() already started the walk at the first key in range
+  uint32_t first;
+  key_range_bounds(&statement->key_range, &first, &scan->last_key);
+  scan->done = first > scan->last_key;
+  return scan;
+}
+
+BatchScan *batch_scan_leaves(Statement *statement, Database *db,
+                             uint32_t first_leaf, uint32_t end_leaf,
+                             uint32_t columns) {
+  BatchScan *scan = scan_new(statement, db, columns);
+  scan->cursor = malloc(sizeof(Cursor));
+  *scan->cursor = (Cursor){.db = db,
+                           .page_num = first_leaf,
+                           .table_index = statement->table_index};
+  scan->end_leaf = end_leaf;
+  scan->pages = malloc(BATCH_MAX_LEAVES * sizeof(*scan->pages));
+  uint32_t first;
+  key_range_bounds(&statement->key_range, &first, &scan->last_key);
+  scan->done = first > scan->last_key;
+  return scan;
+}
+
+void batch_scan_limit(BatchScan *scan, uint32_t limit) {
+  scan->wanted = limit;
+  scan->stride = limit < BATCH_SIZE ? limit : BATCH_SIZE;
+  scan->done |= limit == 0;
+}
+
+/**
+ * decode_cells appends `n` consecutive cells of a leaf to the batch, copying
+ * out the keys and the decoded columns.
+ */
+static void decode_cells(BatchScan *scan, const uint8_t *cell, uint32_t n) {
+  RowBatch *b = &scan->batch;
+  Schema *schema = scan->schema;
+  uint32_t cell_size = leaf_node_cell_size(schema);
+  uint32_t *keys = b->keys + b->count;
+  const uint8_t **rows = b->rows + b->count;
+  for (uint32_t i = 0; i < n; i++) {
+    keys[i] = load_u32(cell + i * cell_size);
+    rows[i] = cell + i * cell_size + sizeof(uint32_t);
+  }
+  for (uint32_t f = 0; f < schema->num_fields; f++) {
+    uint32_t *column = b->columns[f];
+    if (column == nullptr)
+      continue;
+    column += b->count;
+    const uint8_t *value = cell + sizeof(uint32_t) + schema->fields[f].offset;
+    for (uint32_t i = 0; i < n; i++)
+      column[i] = load_u32(value + i * cell_size);
+  }
+}
+
+/** fill_batch decodes rows from the cursor on until the batch is full. */
+static void fill_batch(BatchScan *scan) {
+  RowBatch *b = &scan->batch;
+  Cursor *c = scan->cursor;
+  Pager *pager = scan->db->pager;
+  uint32_t size = scan->stride;
+  b->count = 0;
+  uint32_t leaves = 0;
+  while (!scan->done && b->count < size && leaves < BATCH_MAX_LEAVES) {
+    // A leaf's rows stay in its slot until the batch is done with them
+    void *node = scan->pages != nullptr
+                     ? pager_peek(pager, c->page_num, scan->pages[leaves])
+                     : get_page(pager, c->page_num);
+    if (node == nullptr) {
+      scan->failed = true;
+      scan->done = true;
+      break;
+    }
+    if (scan->pages != nullptr)
+      scan->reads += node == scan->pages[leaves];
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (c->cell_num >= num_cells) {
+      uint32_t next = *leaf_node_next_leaf(node);
+      // Any rows taken from it hold their own pin; runs of leaves emptied by
+      // deletes must not fill the pool
+      if (scan->pages == nullptr)
+        unpin_page(pager, c->page_num);
+      if (next == 0 || next == scan->end_leaf) {
+        scan->done = true;
+        break;
+      }
+      c->page_num = next;
+      c->cell_num = 0;
+      continue;
+    }
+
+    leaves++;
+    uint32_t n = num_cells - c->cell_num;
+    if (n > size - b->count)
+      n = size - b->count;
+    uint32_t start = b->count;
+    decode_cells(scan, leaf_node_cell(node, c->cell_num, scan->schema), n);
+    c->cell_num += n;
+    b->count += n;
+
+    // Keys are sorted, so only the last one needs checking against the bound
+    if (b->keys[b->count - 1] > scan->last_key) {
+      uint32_t end = start;
+      while (b->keys[end] <= scan->last_key)
+        end++;
+      b->count = end;
+      scan->done = true;
+    }
+  }
+  // Peeking scans may run on other threads; their callers count for them
+  if (scan->pages == nullptr)
+    scan->db->rows_scanned += b->count;
+}
+
+/** filter_int ANDs `column op value` into `group` for every row. */
+static void filter_int(const uint32_t *restrict column, uint32_t n,
+                       CompareOp op, uint32_t value, uint8_t *restrict group) {
+  switch (op) {
+  case CMP_EQ:
+    for (uint32_t i = 0; i < n; i++)
+      group[i] &= column[i] == value;
+    break;
+  case CMP_NE:
+    for (uint32_t i = 0; i < n; i++)
+      group[i] &= column[i] != value;
+    break;
+  case CMP_LT:
+    for (uint32_t i = 0; i < n; i++)
+      group[i] &= column[i] < value;
+    break;
+  case CMP_LE:
+    for (uint32_t i = 0; i < n; i++)
+      group[i] &= column[i] <= value;
+    break;
+  case CMP_GT:
+    for (uint32_t i = 0; i < n; i++)
+      group[i] &= column[i] > value;
+    break;
+  case CMP_GE:
+    for (uint32_t i = 0; i < n; i++)
+      group[i] &= column[i] >= value;
+    break;
+  }
+}
+
+/**
+ * filter_batch evaluates the predicate over the whole batch, one term at a
+ * time, and builds the selection vector.
+ */
+static void filter_batch(BatchScan *scan) {
+  RowBatch *b = &scan->batch;
+  const Predicate *predicate = scan->predicate;
+  uint32_t n = b->count;
+  if (predicate->num_terms == 0) {
+    for (uint32_t i = 0; i < n; i++)
+      b->sel[i] = (uint16_t)i;
+    b->num_selected = n;
+    return;
+  }
+
+  uint8_t *group = scan->group;
+  uint8_t *match = scan->match;
+  memset(match, 0, n);
+  memset(group, 1, n);
+  for (uint32_t t = 0; t < predicate->num_terms; t++) {
+    const PredicateTerm *term = &predicate->terms[t];
+    if (b->columns[term->field] != nullptr) {
+      filter_int(b->columns[term->field], n, term->op, term->value, group);
+    } else {
+      // TEXT compares in place; rows already out of the group are skipped
+      for (uint32_t i = 0; i < n; i++)
+        if (group[i])
+          group[i] = term->eval(term, b->rows[i]);
+    }
+    if (term->ends_group) {
+      for (uint32_t i = 0; i < n; i++)
+        match[i] |= group[i];
+      memset(group, 1, n);
+    }
+  }
+
+  // Branch-free compaction: every row is written, only matches advance
+  uint32_t selected = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    b->sel[selected] = (uint16_t)i;
+    selected += match[i];
+  }
+  b->num_selected = selected;
+}
+
+RowBatch *batch_scan_next(BatchScan *scan) {
+  // The previous batch's rows are no longer needed
+  if (scan->pages == nullptr)
+    unpin_page_all(scan->db->pager);
+  fill_batch(scan);
+  if (scan->batch.count == 0)
+    return nullptr;
+  filter_batch(scan);
+  if (scan->wanted != UINT32_MAX) {
+    // Filtered-out rows leave some still wanted; read more per batch so a
+    // selective filter does not crawl a few rows at a time
+    uint32_t selected = scan->batch.num_selected;
+    scan->wanted -= selected < scan->wanted ? selected : scan->wanted;
+    scan->done |= scan->wanted == 0;
+    uint32_t stride = scan->stride * 2;
+    if (stride < scan->wanted)
+      stride = scan->wanted;
+    scan->stride = stride < BATCH_SIZE ? stride : BATCH_SIZE;
+  }
+  return &scan->batch;
+}
+
+uint64_t batch_scan_reads(const BatchScan *scan) { return scan->reads; }
+
+bool batch_scan_failed(const BatchScan *scan) { return scan->failed; }
+
+void batch_scan_close(BatchScan *scan) {
+  if (scan->pages == nullptr)
+    unpin_page_all(scan->db->pager);
+  free(scan->pages);
+  free(scan->cursor);
+  free(scan);
+}
@@ -2,6 +2,7 @@
 #include "database.h"
 #include "schema.h"
 #include "statement.h"
+#include "trace.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +32,9 @@ uint32_t *leaf_node_num_cells(void *node) {
 uint32_t *leaf_node_next_leaf(void *node) {
   return (uint32_t *)((char *)node + LEAF_NODE_NEXT_LEAF_OFFSET);
 }
+uint32_t *leaf_node_prev_leaf(void *node) {
+  return (uint32_t *)((char *)node + LEAF_NODE_PREV_LEAF_OFFSET);
+}
 
 /* Internal Node Accessors */
 uint32_t *internal_node_num_keys(void *node) {
@@ -54,6 +58,18 @@ uint32_t *internal_node_key(void *node, uint32_t key_num) {
   return (uint32_t *)((char *)internal_node_cell(node, key_num) +
                       INTERNAL_NODE_CHILD_SIZE);
 }
+static uint32_t *internal_node_right_count(void *node) {
+  return (uint32_t *)((char *)node + INTERNAL_NODE_RIGHT_COUNT_OFFSET);
+}
+static uint32_t *internal_node_cell_count(void *node, uint32_t cell_num) {
+  return (uint32_t *)((char *)internal_node_cell(node, cell_num) +
+                      INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE);
+}
+uint32_t *internal_node_count(void *node, uint32_t child_num) {
+  if (child_num == *internal_node_num_keys(node))
+    return internal_node_right_count(node);
+  return internal_node_cell_count(node, child_num);
+}
 
 /* Dynamic Cell Accessors */
 uint32_t leaf_node_cell_size(Schema *schema) {
@@ -80,23 +96,36 @@ void initialize_leaf_node(void *node) {
   set_node_root(node, false);
   *leaf_node_num_cells(node) = 0;
   *leaf_node_next_leaf(node) = 0;
+  *leaf_node_prev_leaf(node) = 0;
   *node_parent(node) = 0;
 }
 void initialize_internal_node(void *node) {
   set_node_type(node, NODE_INTERNAL);
   set_node_root(node, false);
   *internal_node_num_keys(node) = 0;
+  *internal_node_right_count(node) = 0;
   *node_parent(node) = 0;
 }
 
+uint32_t node_row_count(void *node) {
+  if (get_node_type(node) == NODE_LEAF)
+    return *leaf_node_num_cells(node);
+  uint32_t num_keys = *internal_node_num_keys(node);
+  uint32_t rows = 0;
+  for (uint32_t i = 0; i <= num_keys; i++)
+    rows += *internal_node_count(node, i);
+  return rows;
+}
+
 static void leaf_node_move_cells(void *dest_node, uint32_t dest_cell_num,
                                  void *src_node, uint32_t src_cell_num,
                                  uint32_t num_cells, Schema *schema) {
   if (num_cells == 0)
     return;
-  memcpy(leaf_node_cell(dest_node, dest_cell_num, schema),
-         leaf_node_cell(src_node, src_cell_num, schema),
-         num_cells * leaf_node_cell_size(schema));
+  // Source and destination overlap when shifting within one node
+  memmove(leaf_node_cell(dest_node, dest_cell_num, schema),
+          leaf_node_cell(src_node, src_cell_num, schema),
+          num_cells * leaf_node_cell_size(schema));
 }
 
 static void internal_node_move_cells(void *dest_node, uint32_t dest_cell_num,
@@ -104,71 +133,146 @@ static void internal_node_move_cells(void *dest_node, uint32_t dest_cell_num,
                                      uint32_t num_cells) {
   if (num_cells == 0)
     return;
-  memcpy(internal_node_cell(dest_node, dest_cell_num),
-         internal_node_cell(src_node, src_cell_num),
-         num_cells * INTERNAL_NODE_CELL_SIZE);
+  memmove(internal_node_cell(dest_node, dest_cell_num),
+          internal_node_cell(src_node, src_cell_num),
+          num_cells * INTERNAL_NODE_CELL_SIZE);
 }
 
-static bool verify_node(Database *db, uint32_t table_index, uint32_t pg,
+static bool verify_node(Database *db, uint32_t tree, uint32_t pg,
                         uint32_t parent_pg, uint32_t *min_key,
-                        uint32_t *max_key) {
-  void *node = get_page(db->pager, pg);
+                        uint32_t *max_key, uint32_t *rows);
+
+/**
+ * verify_child checks the subtree under child `i` of an internal node and the
+ * row count the node keeps for it, adding the rows to `rows`.
+ */
+static bool verify_child(Database *db, uint32_t tree, void *node,
+                         uint32_t pg, uint32_t i, uint32_t *min_key,
+                         uint32_t *max_key, uint32_t *rows) {
+  uint32_t child_pg = *internal_node_child(node, i);
+  uint32_t child_rows;
+  if (!verify_node(db, tree, child_pg, pg, min_key, max_key, &child_rows))
+    return false;
+  if (*internal_node_count(node, i) != child_rows) {
+    fprintf(db->out,
+            "Verify error: node %u counts %u rows under child %u, found %u\n",
+            pg, *internal_node_count(node, i), child_pg, child_rows);
+    return false;
+  }
+  *rows += child_rows;
+  return true;
+}
+
+static bool verify_node_contents(Database *db, uint32_t tree, void *node,
+                                 uint32_t pg, uint32_t parent_pg,
+                                 uint32_t *min_key, uint32_t *max_key,
+                                 uint32_t *rows) {
   NodeType type = get_node_type(node);
 
   if (*node_parent(node) != parent_pg && !is_node_root(node)) {
-    printf("Verify error: node %u has parent %u, expected %u\n", pg,
-           *node_parent(node), parent_pg);
+    fprintf(db->out, "Verify error: node %u has parent %u, expected %u\n", pg,
+            *node_parent(node), parent_pg);
     return false;
   }
 
+  *rows = 0;
   if (type == NODE_LEAF) {
     uint32_t num = *leaf_node_num_cells(node);
+    *rows = num;
     for (uint32_t i = 0; i < num; i++) {
-      uint32_t k =
-          *leaf_node_key(node, i, &db->catalog.tables[table_index].schema);
+      uint32_t k = *leaf_node_key(node, i, tree_schema(db, tree));
       if (min_key && k < *min_key)
         return false;
       if (max_key && k > *max_key)
         return false;
-      if (i > 0 && k < *leaf_node_key(node, i - 1,
-                                      &db->catalog.tables[table_index].schema))
+      if (i > 0 && k < *leaf_node_key(node, i - 1, tree_schema(db, tree)))
         return false;
     }
     return true;
   } else {
     uint32_t num = *internal_node_num_keys(node);
     for (uint32_t i = 0; i < num; i++) {
-      uint32_t child_pg = *internal_node_child(node, i);
       uint32_t k = *internal_node_key(node, i);
-      if (!verify_node(db, table_index, child_pg, pg,
-                       i == 0 ? min_key : nullptr, &k))
+      if (!verify_child(db, tree, node, pg, i, i == 0 ? min_key : nullptr, &k,
+                        rows))
         return false;
       if (i > 0 && k < *internal_node_key(node, i - 1))
         return false;
     }
-    return verify_node(db, table_index, *internal_node_right_child(node), pg,
-                       num > 0 ? internal_node_key(node, num - 1) : min_key,
-                       max_key);
+    return verify_child(db, tree, node, pg, num,
+                        num > 0 ? internal_node_key(node, num - 1) : min_key,
+                        max_key, rows);
   }
 }
 
-bool verify_btree(Database *db, uint32_t table_index) {
-  uint32_t root_pg = db->catalog.tables[table_index].root_page_num;
-  return verify_node(db, table_index, root_pg, 0, nullptr, nullptr);
+static bool verify_node(Database *db, uint32_t tree, uint32_t pg,
+                        uint32_t parent_pg, uint32_t *min_key,
+                        uint32_t *max_key, uint32_t *rows) {
+  void *node = get_page(db->pager, pg);
+  bool ok = verify_node_contents(db, tree, node, pg, parent_pg, min_key,
+                                 max_key, rows);
+  // Only the current root-to-node path stays pinned, so trees larger than the
+  // buffer pool can still be checked.
+  unpin_page(db->pager, pg);
+  return ok;
+}
+
+/**
+ * verify_leaf_links follows the leaves from the first by their next links,
+ * checking that each links back to the one before and that together they
+ * hold all `rows` rows.
+ */
+static bool verify_leaf_links(Database *db, uint32_t tree, uint32_t rows) {
+  uint32_t pg = tree_root_page(db, tree);
+  void *node = get_page(db->pager, pg);
+  while (get_node_type(node) != NODE_LEAF) {
+    uint32_t child_pg = *internal_node_child(node, 0);
+    unpin_page(db->pager, pg);
+    pg = child_pg;
+    node = get_page(db->pager, pg);
+  }
+  unpin_page(db->pager, pg);
+  uint32_t prev_pg = 0;
+  uint32_t found = 0;
+  while (pg != 0) {
+    node = get_page(db->pager, pg);
+    uint32_t prev = *leaf_node_prev_leaf(node);
+    uint32_t next = *leaf_node_next_leaf(node);
+    found += *leaf_node_num_cells(node);
+    unpin_page(db->pager, pg);
+    if (prev != prev_pg) {
+      fprintf(db->out, "Verify error: leaf %u links back to %u, expected %u\n",
+              pg, prev, prev_pg);
+      return false;
+    }
+    prev_pg = pg;
+    pg = next;
+  }
+  if (found != rows) {
+    fprintf(db->out, "Verify error: leaves hold %u rows, tree has %u\n", found,
+            rows);
+    return false;
+  }
+  return true;
 }
 
-uint32_t get_node_max_key(Database *db, uint32_t table_index, void *node) {
+bool verify_btree(Database *db, uint32_t tree) {
+  uint32_t root_pg = tree_root_page(db, tree);
+  uint32_t rows;
+  return verify_node(db, tree, root_pg, 0, nullptr, nullptr, &rows) &&
+         verify_leaf_links(db, tree, rows);
+}
+
+uint32_t get_node_max_key(Database *db, uint32_t tree, void *node) {
   NodeType type = get_node_type(node);
   if (type == NODE_INTERNAL) {
     uint32_t right_child_pg = *internal_node_right_child(node);
-    return get_node_max_key(db, table_index,
-                            get_page(db->pager, right_child_pg));
+    return get_node_max_key(db, tree, get_page(db->pager, right_child_pg));
   } else if (type == NODE_LEAF) {
     uint32_t num = *leaf_node_num_cells(node);
     if (num == 0)
       return 0;
-    return *leaf_node_key(node, num - 1,
-                          &db->catalog.tables[table_index].schema);
+    return *leaf_node_key(node, num - 1, tree_schema(db, tree));
   }
   return 0;
 }
@@ -188,39 +292,144 @@ uint32_t internal_node_find_child(void *node, uint32_t key) {
   return min_idx;
 }
 
-Cursor *find_node(Database *db, uint32_t table_index, uint32_t pg,
-                  uint32_t key) {
+/** leaf_node_find_cell returns the position of the first key >= `key`. */
+static uint32_t leaf_node_find_cell(void *node, Schema *schema, uint32_t key) {
+  uint32_t min_idx = 0;
+  uint32_t max_idx = *leaf_node_num_cells(node);
+  while (min_idx != max_idx) {
+    uint32_t idx = (min_idx + max_idx) / 2;
+    uint32_t key_at_index = *leaf_node_key(node, idx, schema);
+    if (key_at_index >= key)
+      max_idx = idx;
+    else
+      min_idx = idx + 1;
+  }
+  return min_idx;
+}
+
+Cursor *find_node(Database *db, uint32_t tree, uint32_t pg, uint32_t key) {
+  TRACE_BEGIN(span, TRACE_FIND_NODE);
   void *node = get_page(db->pager, pg);
-  NodeType type = get_node_type(node);
-  if (type == NODE_LEAF) {
-    Cursor *c = malloc(sizeof(Cursor));
-    c->db = db;
-    c->page_num = pg;
-    c->table_index = table_index;
-    uint32_t num_cells = *leaf_node_num_cells(node);
-    uint32_t min_idx = 0;
-    uint32_t max_idx = num_cells;
-    while (min_idx != max_idx) {
-      uint32_t idx = (min_idx + max_idx) / 2;
-      uint32_t key_at_index =
-          *leaf_node_key(node, idx, &db->catalog.tables[table_index].schema);
-      if (key_at_index >= key)
-        max_idx = idx;
-      else
-        min_idx = idx + 1;
-    }
-    c->cell_num = min_idx;
-    return c;
-  } else {
+  while (get_node_type(node) == NODE_INTERNAL) {
+    pg = *internal_node_child(node, internal_node_find_child(node, key));
+    node = get_page(db->pager, pg);
+  }
+  Cursor *c = malloc(sizeof(Cursor));
+  c->db = db;
+  c->page_num = pg;
+  c->table_index = tree;
+  c->cell_num = leaf_node_find_cell(node, tree_schema(db, tree), key);
+  TRACE_END(span);
+  return c;
+}
+
+uint32_t btree_row_count(Database *db, uint32_t tree) {
+  return node_row_count(get_page(db->pager, tree_root_page(db, tree)));
+}
+
+/**
+ * list_leaves adds up the leaves under an internal node `levels` up, storing
+ * their page numbers in key order at `pages` unless it is nullptr.
+ */
+static uint32_t list_leaves(Database *db, uint32_t pg, uint32_t levels,
+                            uint32_t *pages) {
+  void *node = get_page(db->pager, pg);
+  uint32_t children = *internal_node_num_keys(node) + 1;
+  uint32_t leaves = 0;
+  for (uint32_t i = 0; i < children; i++) {
+    uint32_t child = *internal_node_child(node, i);
+    if (levels > 1)
+      leaves += list_leaves(db, child, levels - 1,
+                            pages != nullptr ? pages + leaves : nullptr);
+    else if (pages != nullptr)
+      pages[leaves++] = child;
+    else
+      leaves++;
+  }
+  unpin_page(db->pager, pg);
+  return leaves;
+}
+
+/** tree_depth returns the levels of a tree, reading its leftmost path. */
+static uint32_t tree_depth(Database *db, uint32_t tree) {
+  uint32_t pg = tree_root_page(db, tree);
+  uint32_t depth = 1;
+  void *node = get_page(db->pager, pg);
+  while (get_node_type(node) == NODE_INTERNAL) {
+    uint32_t child = *internal_node_child(node, 0);
+    unpin_page(db->pager, pg);
+    pg = child;
+    node = get_page(db->pager, pg);
+    depth++;
+  }
+  unpin_page(db->pager, pg);
+  return depth;
+}
+
+uint32_t btree_insert_pages(Database *db, uint32_t tree) {
+  return tree_depth(db, tree) + 1;
+}
+
+uint32_t btree_leaf_count(Database *db, uint32_t tree, uint32_t *depth) {
+  *depth = tree_depth(db, tree);
+  if (*depth == 1)
+    return 1;
+  return list_leaves(db, tree_root_page(db, tree), *depth - 1, nullptr);
+}
+
+uint32_t btree_leaf_pages(Database *db, uint32_t tree, uint32_t *pages) {
+  uint32_t depth = tree_depth(db, tree);
+  if (depth > 1)
+    return list_leaves(db, tree_root_page(db, tree), depth - 1, pages);
+  pages[0] = tree_root_page(db, tree);
+  return 1;
+}
+
+uint32_t btree_rank(Database *db, uint32_t tree, uint32_t key) {
+  void *node = get_page(db->pager, tree_root_page(db, tree));
+  uint32_t rank = 0;
+  while (get_node_type(node) == NODE_INTERNAL) {
     uint32_t child_idx = internal_node_find_child(node, key);
-    uint32_t child_pg = *internal_node_child(node, child_idx);
-    return find_node(db, table_index, child_pg, key);
+    for (uint32_t i = 0; i < child_idx; i++)
+      rank += *internal_node_count(node, i);
+    node = get_page(db->pager, *internal_node_child(node, child_idx));
+  }
+  return rank + leaf_node_find_cell(node, tree_schema(db, tree), key);
+}
+
+uint32_t btree_range_count(Database *db, uint32_t tree, uint32_t first,
+                           uint32_t last) {
+  if (first > last)
+    return 0;
+  uint32_t end = last == UINT32_MAX ? btree_row_count(db, tree)
+                                    : btree_rank(db, tree, last + 1);
+  return end - btree_rank(db, tree, first);
+}
+
+Cursor *find_node_by_rank(Database *db, uint32_t tree, uint32_t rank) {
+  uint32_t pg = tree_root_page(db, tree);
+  void *node = get_page(db->pager, pg);
+  while (get_node_type(node) == NODE_INTERNAL) {
+    uint32_t num_keys = *internal_node_num_keys(node);
+    uint32_t i = 0;
+    while (i < num_keys && rank >= *internal_node_count(node, i)) {
+      rank -= *internal_node_count(node, i);
+      i++;
+    }
+    pg = *internal_node_child(node, i);
+    node = get_page(db->pager, pg);
   }
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  Cursor *c = malloc(sizeof(Cursor));
+  c->db = db;
+  c->page_num = pg;
+  c->cell_num = rank < num_cells ? rank : num_cells;
+  c->table_index = tree;
+  return c;
 }
 
-void create_new_root(Database *db, uint32_t table_index,
-                     uint32_t right_child_pg) {
-  uint32_t root_pg = db->catalog.tables[table_index].root_page_num;
+void create_new_root(Database *db, uint32_t tree, uint32_t right_child_pg) {
+  uint32_t root_pg = tree_root_page(db, tree);
   void *root = get_page(db->pager, root_pg);
   void *right_child = get_page(db->pager, right_child_pg);
   uint32_t left_child_pg = db->pager->num_pages;
@@ -233,24 +442,58 @@ void create_new_root(Database *db, uint32_t table_index,
   set_node_root(root, true);
   *internal_node_num_keys(root) = 1;
   *internal_node_child(root, 0) = left_child_pg;
-  uint32_t left_child_max_key = get_node_max_key(db, table_index, left_child);
+  uint32_t left_child_max_key = get_node_max_key(db, tree, left_child);
   *internal_node_key(root, 0) = left_child_max_key;
   *internal_node_right_child(root) = right_child_pg;
+  *internal_node_count(root, 0) = node_row_count(left_child);
+  *internal_node_count(root, 1) = node_row_count(right_child);
   *node_parent(left_child) = root_pg;
   *node_parent(right_child) = root_pg;
 
+  // A split root leaf moved to the left child, which the right now follows
+  if (get_node_type(left_child) == NODE_LEAF) {
+    *leaf_node_prev_leaf(right_child) = left_child_pg;
+    mark_page_dirty(db->pager, right_child_pg);
+  }
+  // The old root's children now live under the left child
+  if (get_node_type(left_child) == NODE_INTERNAL) {
+    for (uint32_t i = 0; i <= *internal_node_num_keys(left_child); i++) {
+      uint32_t cpg = *internal_node_child(left_child, i);
+      *node_parent(get_page(db->pager, cpg)) = left_child_pg;
+      mark_page_dirty(db->pager, cpg);
+      unpin_page(db->pager, cpg);
+    }
+  }
+
   mark_page_dirty(db->pager, root_pg);
   mark_page_dirty(db->pager, left_child_pg);
 }
 
-void internal_node_insert(Database *db, uint32_t table_index,
-                          uint32_t parent_pg, uint32_t child_pg);
+/**
+ * internal_node_child_index returns the position of child page `child_pg` in
+ * `node` (num_keys for the right child), or UINT32_MAX if it is not a child.
+ * Children are located by page rather than by key because an index tree can
+ * hold the same key in several siblings.
+ */
+static uint32_t internal_node_child_index(void *node, uint32_t child_pg) {
+  uint32_t num_keys = *internal_node_num_keys(node);
+  for (uint32_t i = 0; i <= num_keys; i++) {
+    if (*internal_node_child(node, i) == child_pg)
+      return i;
+  }
+  return UINT32_MAX;
+}
+
+void internal_node_insert(Database *db, uint32_t tree, uint32_t parent_pg,
+                          uint32_t child_pg, uint32_t left_pg);
 
-void internal_node_split_and_insert(Database *db, uint32_t table_index,
-                                    uint32_t parent_pg, uint32_t child_pg) {
+void internal_node_split_and_insert(Database *db, uint32_t tree,
+                                    uint32_t parent_pg, uint32_t child_pg,
+                                    uint32_t left_pg) {
+  TRACE_BEGIN(span, TRACE_INTERNAL_SPLIT);
   uint32_t old_pg = parent_pg;
   void *old_node = get_page(db->pager, old_pg);
-  uint32_t old_max_key = get_node_max_key(db, table_index, old_node);
+  db->splits++;
 
   uint32_t new_pg = db->pager->num_pages;
   void *new_node = get_page(db->pager, new_pg);
@@ -264,95 +507,155 @@ void internal_node_split_and_insert(Database *db, uint32_t table_index,
   internal_node_move_cells(new_node, 0, old_node, split_idx + 1,
                            *internal_node_num_keys(new_node));
   *internal_node_right_child(new_node) = *internal_node_right_child(old_node);
+  *internal_node_right_count(new_node) = *internal_node_right_count(old_node);
   *internal_node_right_child(old_node) =
       *internal_node_child(old_node, split_idx);
+  *internal_node_right_count(old_node) =
+      *internal_node_cell_count(old_node, split_idx);
   *internal_node_num_keys(old_node) = split_idx;
+  mark_page_dirty(db->pager, old_pg);
+  mark_page_dirty(db->pager, new_pg);
 
   // Update parents of children that moved
   for (uint32_t i = 0; i <= *internal_node_num_keys(new_node); i++) {
     uint32_t cpg = *internal_node_child(new_node, i);
     *node_parent(get_page(db->pager, cpg)) = new_pg;
     mark_page_dirty(db->pager, cpg);
+    unpin_page(db->pager, cpg); // Up to 340 children won't fit in the pool
   }
 
-  uint32_t child_max_key =
-      get_node_max_key(db, table_index, get_page(db->pager, child_pg));
-  if (child_max_key < get_node_max_key(db, table_index, old_node)) {
-    internal_node_insert(db, table_index, old_pg, child_pg);
+  // The new child goes next to its left sibling, in whichever half that is
+  if (internal_node_child_index(old_node, left_pg) != UINT32_MAX) {
+    internal_node_insert(db, tree, old_pg, child_pg, left_pg);
   } else {
-    internal_node_insert(db, table_index, new_pg, child_pg);
+    internal_node_insert(db, tree, new_pg, child_pg, left_pg);
   }
 
   if (is_node_root(old_node)) {
-    create_new_root(db, table_index, new_pg);
+    create_new_root(db, tree, new_pg);
   } else {
     uint32_t p_pg = *node_parent(old_node);
     void *parent = get_page(db->pager, p_pg);
-    uint32_t idx = internal_node_find_child(parent, old_max_key);
-    *internal_node_key(parent, idx) =
-        get_node_max_key(db, table_index, old_node);
-    internal_node_insert(db, table_index, p_pg, new_pg);
+    uint32_t idx = internal_node_child_index(parent, old_pg);
+    if (idx < *internal_node_num_keys(parent)) {
+      *internal_node_key(parent, idx) = get_node_max_key(db, tree, old_node);
+      mark_page_dirty(db->pager, p_pg);
+    }
+    internal_node_insert(db, tree, p_pg, new_pg, old_pg);
   }
+  TRACE_END(span);
 }
 
-void internal_node_insert(Database *db, uint32_t table_index,
-                          uint32_t parent_pg, uint32_t child_pg) {
+/**
+ * internal_node_insert adds `child_pg` to `parent_pg` directly after its left
+ * sibling `left_pg`, whose separator the caller has already updated. The row
+ * counts of both are taken afresh from the children.
+ */
+void internal_node_insert(Database *db, uint32_t tree, uint32_t parent_pg,
+                          uint32_t child_pg, uint32_t left_pg) {
   void *parent = get_page(db->pager, parent_pg);
   void *child = get_page(db->pager, child_pg);
-  uint32_t child_max_key = get_node_max_key(db, table_index, child);
-  uint32_t index = internal_node_find_child(parent, child_max_key);
 
   uint32_t num_keys = *internal_node_num_keys(parent);
   if (num_keys >= INTERNAL_NODE_MAX_KEYS) {
-    internal_node_split_and_insert(db, table_index, parent_pg, child_pg);
+    internal_node_split_and_insert(db, tree, parent_pg, child_pg, left_pg);
     return;
   }
 
-  uint32_t right_child_pg = *internal_node_right_child(parent);
-  void *right_child = get_page(db->pager, right_child_pg);
-
-  if (child_max_key > get_node_max_key(db, table_index, right_child)) {
-    // New child becomes the new right child
-    *internal_node_child(parent, num_keys) = right_child_pg;
-    *internal_node_key(parent, num_keys) =
-        get_node_max_key(db, table_index, right_child);
+  uint32_t index = internal_node_child_index(parent, left_pg);
+  void *left = get_page(db->pager, left_pg);
+  if (index == num_keys) {
+    // New child becomes the new right child. Write through the cell rather
+    // than internal_node_child(), which aliases the right child at num_keys.
+    *internal_node_cell(parent, num_keys) = left_pg;
+    *internal_node_key(parent, num_keys) = get_node_max_key(db, tree, left);
+    *internal_node_cell_count(parent, num_keys) = node_row_count(left);
     *internal_node_right_child(parent) = child_pg;
+    *internal_node_right_count(parent) = node_row_count(child);
   } else {
-    // Shift keys/children to make room
-    for (uint32_t i = num_keys; i > index; i--) {
-      *internal_node_cell(parent, i) = *internal_node_cell(parent, i - 1);
-    }
-    *internal_node_child(parent, index) = child_pg;
-    *internal_node_key(parent, index) = child_max_key;
+    // Shift whole cells (child, key and count) to make room
+    memmove(internal_node_cell(parent, index + 2),
+            internal_node_cell(parent, index + 1),
+            (num_keys - index - 1) * INTERNAL_NODE_CELL_SIZE);
+    *internal_node_cell(parent, index + 1) = child_pg;
+    *internal_node_key(parent, index + 1) = get_node_max_key(db, tree, child);
+    *internal_node_cell_count(parent, index + 1) = node_row_count(child);
+    *internal_node_cell_count(parent, index) = node_row_count(left);
   }
   *internal_node_num_keys(parent) += 1;
   *node_parent(child) = parent_pg;
   mark_page_dirty(db->pager, parent_pg);
 }
 
-void leaf_node_split_and_insert(Cursor *c, uint32_t key, Statement *s) {
+/**
+ * internal_node_child_near is internal_node_child_index() for a child that
+ * holds `key`. The search starts where the key routes to, which is where the
+ * child normally is; duplicate keys in index trees can only put it further
+ * right.
+ */
+static uint32_t internal_node_child_near(void *node, uint32_t child_pg,
+                                         uint32_t key) {
+  uint32_t num_keys = *internal_node_num_keys(node);
+  for (uint32_t i = internal_node_find_child(node, key); i <= num_keys; i++) {
+    if (*internal_node_child(node, i) == child_pg)
+      return i;
+  }
+  return internal_node_child_index(node, child_pg);
+}
+
+/**
+ * update_counts walks from node `pg` up to the root, fixing the row count
+ * every ancestor keeps for the child on the path. With a `delta` the counts
+ * move by it; with zero they are recomputed from the children, as after a
+ * split. `key` is a key under `pg`.
+ */
+static void update_counts(Database *db, uint32_t pg, uint32_t key,
+                          int32_t delta) {
+  void *node = get_page(db->pager, pg);
+  while (!is_node_root(node)) {
+    uint32_t parent_pg = *node_parent(node);
+    void *parent = get_page(db->pager, parent_pg);
+    uint32_t *count =
+        internal_node_count(parent, internal_node_child_near(parent, pg, key));
+    *count = delta != 0 ? *count + (uint32_t)delta : node_row_count(node);
+    mark_page_dirty(db->pager, parent_pg);
+    pg = parent_pg;
+    node = parent;
+  }
+}
+
+static void leaf_node_split_and_insert(Cursor *c, uint32_t key,
+                                       const void *row) {
+  TRACE_BEGIN(span, TRACE_LEAF_SPLIT);
+  c->db->splits++;
   void *old_node = get_page(c->db->pager, c->page_num);
-  uint32_t old_max_key = get_node_max_key(c->db, c->table_index, old_node);
   uint32_t new_pg = c->db->pager->num_pages;
   void *new_node = get_page(c->db->pager, new_pg);
   initialize_leaf_node(new_node);
   *node_parent(new_node) = *node_parent(old_node);
-  *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
+  uint32_t after_pg = *leaf_node_next_leaf(old_node);
+  *leaf_node_next_leaf(new_node) = after_pg;
+  *leaf_node_prev_leaf(new_node) = c->page_num;
   *leaf_node_next_leaf(old_node) = new_pg;
+  if (after_pg != 0) {
+    *leaf_node_prev_leaf(get_page(c->db->pager, after_pg)) = new_pg;
+    mark_page_dirty(c->db->pager, after_pg);
+  }
 
-  Schema *schema = &c->db->catalog.tables[c->table_index].schema;
+  Schema *schema = tree_schema(c->db, c->table_index);
   uint32_t max_cells = leaf_node_max_cells(schema);
   uint32_t split_idx = (max_cells + 1) / 2;
 
-  // Use a temporary buffer to avoid corruption during split
-  void *temp_cells = malloc(PAGE_SIZE);
+  // Use a temporary buffer to avoid corruption during split. It must hold
+  // max_cells + 1 cells, which can be more than a page's worth.
   uint32_t total_cells = max_cells + 1;
+  void *temp_cells = malloc(total_cells * leaf_node_cell_size(schema));
 
   for (uint32_t i = 0; i < total_cells; i++) {
     void *dest = (char *)temp_cells + i * leaf_node_cell_size(schema);
     if (i == c->cell_num) {
       *(uint32_t *)dest = key;
-      serialize_row(schema, s, (char *)dest + sizeof(uint32_t));
+      memcpy((char *)dest + sizeof(uint32_t), row, schema->row_size);
     } else {
       uint32_t src_idx = (i > c->cell_num) ? i - 1 : i;
       memcpy(dest, leaf_node_cell(old_node, src_idx, schema),
@@ -379,22 +682,29 @@ void leaf_node_split_and_insert(Cursor *c, uint32_t key, Statement *s) {
   else {
     uint32_t parent_pg = *node_parent(old_node);
     void *parent = get_page(c->db->pager, parent_pg);
-    uint32_t old_node_idx = internal_node_find_child(parent, old_max_key);
+    uint32_t old_node_idx = internal_node_child_index(parent, c->page_num);
     if (old_node_idx < *internal_node_num_keys(parent)) {
       *internal_node_key(parent, old_node_idx) =
           get_node_max_key(c->db, c->table_index, old_node);
       mark_page_dirty(c->db->pager, parent_pg);
     }
-    internal_node_insert(c->db, c->table_index, parent_pg, new_pg);
+    internal_node_insert(c->db, c->table_index, parent_pg, new_pg,
+                         c->page_num);
+    // The splits above counted their own levels; the rest of the path
+    // gained a row
+    update_counts(c->db, c->page_num, key, 0);
   }
+  TRACE_END(span);
 }
 
-void leaf_node_insert(Cursor *c, uint32_t key, Statement *s) {
+void leaf_node_insert_row(Cursor *c, uint32_t key, const void *row) {
+  TRACE_BEGIN(span, TRACE_LEAF_INSERT);
   void *node = get_page(c->db->pager, c->page_num);
   uint32_t num = *leaf_node_num_cells(node);
-  Schema *schema = &c->db->catalog.tables[c->table_index].schema;
+  Schema *schema = tree_schema(c->db, c->table_index);
   if (num >= leaf_node_max_cells(schema)) {
-    leaf_node_split_and_insert(c, key, s);
+    leaf_node_split_and_insert(c, key, row);
+    TRACE_END(span);
     return;
   }
   if (c->cell_num < num) {
@@ -403,18 +713,219 @@ void leaf_node_insert(Cursor *c, uint32_t key, Statement *s) {
   }
   *leaf_node_num_cells(node) += 1;
   *leaf_node_key(node, c->cell_num, schema) = key;
-  serialize_row(schema, s, leaf_node_value(node, c->cell_num, schema));
+  memcpy(leaf_node_value(node, c->cell_num, schema), row, schema->row_size);
   mark_page_dirty(c->db->pager, c->page_num);
+  update_counts(c->db, c->page_num, key, 1);
+  TRACE_END(span);
+}
+
+void leaf_node_insert(Cursor *c, uint32_t key, Statement *s) {
+  char row[MAX_FIELDS * TEXT_FIELD_SIZE];
+  serialize_row(tree_schema(c->db, c->table_index), s, row);
+  leaf_node_insert_row(c, key, row);
 }
 
 void leaf_node_delete(Cursor *c) {
   void *node = get_page(c->db->pager, c->page_num);
   uint32_t num = *leaf_node_num_cells(node);
-  Schema *schema = &c->db->catalog.tables[c->table_index].schema;
+  Schema *schema = tree_schema(c->db, c->table_index);
   if (c->cell_num >= num)
     return;
+  uint32_t key = *leaf_node_key(node, c->cell_num, schema);
   leaf_node_move_cells(node, c->cell_num, node, c->cell_num + 1,
                        num - c->cell_num - 1, schema);
   *leaf_node_num_cells(node) -= 1;
   mark_page_dirty(c->db->pager, c->page_num);
+  update_counts(c->db, c->page_num, key, -1);
+}
+
+// Internal nodes before they kept row counts (format 0): the same header
+// without the right child's count, and cells of a child and a key
+constexpr size_t V0_INTERNAL_NODE_HEADER_SIZE =
+    INTERNAL_NODE_RIGHT_CHILD_OFFSET + INTERNAL_NODE_RIGHT_CHILD_SIZE;
+constexpr size_t V0_INTERNAL_NODE_CELL_SIZE =
+    INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
+// Leaves before they linked back to the previous leaf (formats 0 and 1)
+constexpr size_t V1_LEAF_NODE_HEADER_SIZE = LEAF_NODE_PREV_LEAF_OFFSET;
+
+typedef struct {
+  uint32_t count;
+  uint32_t pages[TABLE_MAX_PAGES];
+} PageList;
+
+/**
+ * collect walks a tree written in format `version`, listing its leaves in key
+ * order and its internal pages root first.
+ */
+static void collect(Pager *pager, uint32_t pg, uint32_t version,
+                    PageList *leaves, PageList *internals) {
+  void *node = get_page(pager, pg);
+  if (get_node_type(node) == NODE_LEAF) {
+    leaves->pages[leaves->count++] = pg;
+    unpin_page(pager, pg);
+    return;
+  }
+  internals->pages[internals->count++] = pg;
+  uint32_t num_keys = *internal_node_num_keys(node);
+  for (uint32_t i = 0; i <= num_keys; i++) {
+    uint32_t child_pg = *internal_node_child(node, i);
+    if (version == 0 && i < num_keys)
+      memcpy(&child_pg,
+             (char *)node + V0_INTERNAL_NODE_HEADER_SIZE +
+                 i * V0_INTERNAL_NODE_CELL_SIZE,
+             sizeof(child_pg));
+    collect(pager, child_pg, version, leaves, internals);
+  }
+  unpin_page(pager, pg);
+}
+
+/**
+ * relink_leaves moves the cells of format 0/1 leaves past the longer header.
+ * A full leaf can then hold one cell too many; it goes to a new leaf that is
+ * added to the list after it. Every leaf is then linked both ways.
+ */
+static void relink_leaves(Database *db, uint32_t tree, PageList *leaves,
+                          uint32_t version) {
+  Pager *pager = db->pager;
+  Schema *schema = tree_schema(db, tree);
+  uint32_t cell_size = leaf_node_cell_size(schema);
+  uint32_t max_cells = leaf_node_max_cells(schema);
+  if (version < 2) {
+    PageList *old = malloc(sizeof(PageList));
+    memcpy(old, leaves, sizeof(PageList));
+    leaves->count = 0;
+    for (uint32_t i = 0; i < old->count; i++) {
+      uint32_t pg = old->pages[i];
+      char *node = get_page(pager, pg);
+      uint32_t num = *leaf_node_num_cells(node);
+      leaves->pages[leaves->count++] = pg;
+      if (num > max_cells) {
+        uint32_t new_pg = pager->num_pages;
+        void *overflow = get_page(pager, new_pg);
+        initialize_leaf_node(overflow);
+        *node_parent(overflow) = *node_parent(node);
+        *leaf_node_num_cells(overflow) = num - max_cells;
+        memcpy(leaf_node_cell(overflow, 0, schema),
+               node + V1_LEAF_NODE_HEADER_SIZE + max_cells * cell_size,
+               (num - max_cells) * cell_size);
+        mark_page_dirty(pager, new_pg);
+        unpin_page(pager, new_pg);
+        leaves->pages[leaves->count++] = new_pg;
+        num = max_cells;
+        *leaf_node_num_cells(node) = num;
+      }
+      memmove(leaf_node_cell(node, 0, schema), node + V1_LEAF_NODE_HEADER_SIZE,
+              num * cell_size);
+      mark_page_dirty(pager, pg);
+      unpin_page(pager, pg);
+    }
+    free(old);
+  }
+  for (uint32_t i = 0; i < leaves->count; i++) {
+    uint32_t pg = leaves->pages[i];
+    void *node = get_page(pager, pg);
+    *leaf_node_prev_leaf(node) = i > 0 ? leaves->pages[i - 1] : 0;
+    *leaf_node_next_leaf(node) =
+        i + 1 < leaves->count ? leaves->pages[i + 1] : 0;
+    mark_page_dirty(pager, pg);
+    unpin_page(pager, pg);
+  }
+}
+
+void btree_upgrade(Database *db, uint32_t tree, uint32_t version) {
+  Pager *pager = db->pager;
+  uint32_t root_pg = tree_root_page(db, tree);
+  void *root = get_page(pager, root_pg);
+  bool root_is_leaf = get_node_type(root) == NODE_LEAF;
+  bool root_overflows =
+      root_is_leaf && version < 2 &&
+      *leaf_node_num_cells(root) > leaf_node_max_cells(tree_schema(db, tree));
+  PageList *leaves = malloc(sizeof(PageList));
+  PageList *spare = malloc(sizeof(PageList));
+  leaves->count = 0;
+  spare->count = 0;
+  if (root_is_leaf && !root_overflows) {
+    // A root leaf that keeps its cells needs no internal level
+    leaves->pages[leaves->count++] = root_pg;
+    unpin_page(pager, root_pg);
+    relink_leaves(db, tree, leaves, version);
+    free(leaves);
+    free(spare);
+    return;
+  }
+  if (root_overflows) {
+    // A full root leaf splits; its cells move out and the root becomes the
+    // internal node above them
+    uint32_t pg = pager->num_pages;
+    void *leaf = get_page(pager, pg);
+    memcpy(leaf, root, PAGE_SIZE);
+    set_node_root(leaf, false);
+    mark_page_dirty(pager, pg);
+    unpin_page(pager, pg);
+    leaves->pages[leaves->count++] = pg;
+    spare->pages[spare->count++] = root_pg;
+  } else {
+    collect(pager, root_pg, version, leaves, spare);
+  }
+  unpin_page(pager, root_pg);
+  relink_leaves(db, tree, leaves, version);
+
+  // One level at a time, children are described by page, largest key and
+  // row count. Empty leaves take the key of the leaf before them.
+  uint32_t n = leaves->count;
+  uint32_t *pages = leaves->pages;
+  uint32_t *keys = malloc(n * sizeof(uint32_t));
+  uint32_t *counts = malloc(n * sizeof(uint32_t));
+  uint32_t max_key = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    void *leaf = get_page(pager, pages[i]);
+    counts[i] = *leaf_node_num_cells(leaf);
+    if (counts[i] > 0)
+      max_key = *leaf_node_key(leaf, counts[i] - 1, tree_schema(db, tree));
+    keys[i] = max_key;
+    unpin_page(pager, pages[i]);
+  }
+
+  // Old internal pages are reused, the root last; a deeper tree takes new ones
+  uint32_t next_spare = 1;
+  while (n > 1) {
+    uint32_t fanout = INTERNAL_NODE_MAX_KEYS + 1;
+    uint32_t num_nodes = (n + fanout - 1) / fanout;
+    uint32_t first = 0;
+    for (uint32_t j = 0; j < num_nodes; j++) {
+      uint32_t end = (uint32_t)((uint64_t)n * (j + 1) / num_nodes);
+      uint32_t pg = root_pg;
+      if (num_nodes > 1)
+        pg = next_spare < spare->count ? spare->pages[next_spare++]
+                                       : pager->num_pages;
+      void *node = get_page(pager, pg);
+      initialize_internal_node(node);
+      set_node_root(node, num_nodes == 1);
+      *internal_node_num_keys(node) = end - first - 1;
+      uint32_t rows = 0;
+      for (uint32_t k = first; k < end; k++) {
+        uint32_t i = k - first;
+        *internal_node_child(node, i) = pages[k];
+        if (i < end - first - 1)
+          *internal_node_key(node, i) = keys[k];
+        *internal_node_count(node, i) = counts[k];
+        rows += counts[k];
+        *node_parent(get_page(pager, pages[k])) = pg;
+        mark_page_dirty(pager, pages[k]);
+        unpin_page(pager, pages[k]);
+      }
+      mark_page_dirty(pager, pg);
+      unpin_page(pager, pg);
+      // The level above is written over the front of the arrays
+      pages[j] = pg;
+      keys[j] = keys[end - 1];
+      counts[j] = rows;
+      first = end;
+    }
+    n = num_nodes;
+  }
+  free(keys);
+  free(counts);
+  free(leaves);
+  free(spare);
 }
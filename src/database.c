@@ -1,6 +1,9 @@
 #include "database.h"
+#include "analyze.h"
 #include "btree.h"
 #include "os_portability.h"
+#include "plan_cache.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -10,16 +13,59 @@ void db_save_catalog(Database *db) {
   mark_page_dirty(db->pager, 0);
 }
 
-Database *db_open(const char *filename) {
-  Pager *p = pager_open(filename);
+// Index rows hold the primary key of the row a key came from
+static Schema index_schema = {
+    .num_fields = 1,
+    .fields = {{.name = "pk", .type = FIELD_INT, .size = 4, .offset = 0}},
+    .row_size = 4,
+};
+
+Schema *tree_schema(Database *db, uint32_t tree) {
+  if (tree >= INDEX_TREE_BASE)
+    return &index_schema;
+  return &db->catalog.tables[tree].schema;
+}
+
+uint32_t tree_root_page(Database *db, uint32_t tree) {
+  if (tree >= INDEX_TREE_BASE)
+    return db->catalog.indexes[tree - INDEX_TREE_BASE].root_page_num;
+  return db->catalog.tables[tree].root_page_num;
+}
+
+// db_attach builds the database state over an open pager
+static Database *db_attach(Pager *p) {
   Database *db = malloc(sizeof(Database));
   db->pager = p;
   db->print_mode = PRINT_PLAIN;
+  db->out = stdout;
+  db->schema_version = 0;
+  db->sort_memory = SORT_MEMORY_DEFAULT;
+  db->join_memory = JOIN_MEMORY_DEFAULT;
+  db->scan_threads = os_cpu_count();
+  db->script_depth = 0;
+  db->show_timer = false;
+  db->show_stats = false;
+  db->splits = 0;
+  db->rows_scanned = 0;
+  db->plan_cache = plan_cache_create();
+  for (uint32_t i = 0; i < MAX_TABLES; i++)
+    db->table_stats[i] = nullptr;
   if (p->num_pages > 0) {
     void *page0 = get_page(p, 0);
     memcpy(&db->catalog, page0, sizeof(Catalog));
+    uint32_t version = db->catalog.format_version;
+    if (version < CATALOG_FORMAT_VERSION) {
+      for (uint32_t i = 0; i < db->catalog.num_tables; i++)
+        btree_upgrade(db, i, version);
+      for (uint32_t i = 0; i < db->catalog.num_indexes; i++)
+        btree_upgrade(db, INDEX_TREE_BASE + i, version);
+      db->catalog.format_version = CATALOG_FORMAT_VERSION;
+      db_save_catalog(db);
+      unpin_page_all(p);
+    }
+    analyze_load(db);
   } else {
-    db->catalog.num_tables = 0;
+    db->catalog = (Catalog){.format_version = CATALOG_FORMAT_VERSION};
     void *page0 = get_page(p, 0);
     memset(page0, 0, PAGE_SIZE);
     mark_page_dirty(p, 0);
@@ -27,6 +73,15 @@ Database *db_open(const char *filename) {
   return db;
 }
 
+Database *db_open(const char *filename) {
+  return db_attach(pager_open(filename));
+}
+
+Database *db_try_open(const char *filename) {
+  Pager *p = pager_try_open(filename);
+  return p == nullptr ? nullptr : db_attach(p);
+}
+
 void db_close(Database *db) {
   db_save_catalog(db);
   for (uint32_t i = 0; i < db->pager->num_pages; i++) {
@@ -37,14 +92,57 @@ void db_close(Database *db) {
   }
   close(db->pager->file_descriptor);
   free(db->pager);
+  plan_cache_free(db->plan_cache);
+  analyze_free(db);
   free(db);
 }
 
+DbStats db_stats(Database *db) {
+  Pager *p = db->pager;
+  return (DbStats){
+      .fetches = p->fetches,
+      .hits = p->hits,
+      .reads = p->reads,
+      .writes = p->writes,
+      .evictions = p->evictions,
+      .splits = db->splits,
+      .rows_scanned = db->rows_scanned,
+      .pinned_peak = p->pinned_peak,
+  };
+}
+
+DbStats db_stats_since(Database *db, const DbStats *before) {
+  DbStats now = db_stats(db);
+  return (DbStats){
+      .fetches = now.fetches - before->fetches,
+      .hits = now.hits - before->hits,
+      .reads = now.reads - before->reads,
+      .writes = now.writes - before->writes,
+      .evictions = now.evictions - before->evictions,
+      .splits = now.splits - before->splits,
+      .rows_scanned = now.rows_scanned - before->rows_scanned,
+      .pinned_peak = now.pinned_peak,
+  };
+}
+
+void db_reset_stats(Database *db) {
+  Pager *p = db->pager;
+  p->fetches = 0;
+  p->hits = 0;
+  p->reads = 0;
+  p->writes = 0;
+  p->evictions = 0;
+  // The peak starts again from the pins held now
+  p->pinned_peak = p->num_pinned;
+  db->splits = 0;
+  db->rows_scanned = 0;
+}
+
 Cursor *table_start(Database *db, uint32_t table_index) {
-  if (table_index >= db->catalog.num_tables)
+  if (table_index < INDEX_TREE_BASE && table_index >= db->catalog.num_tables)
     return nullptr;
 
-  uint32_t pg = db->catalog.tables[table_index].root_page_num;
+  uint32_t pg = tree_root_page(db, table_index);
   void *node = get_page(db->pager, pg);
   while (get_node_type(node) != NODE_LEAF) {
     pg = *internal_node_child(node, 0);
@@ -58,6 +156,21 @@ Cursor *table_start(Database *db, uint32_t table_index) {
   return c;
 }
 
+Cursor *table_end(Database *db, uint32_t tree) {
+  uint32_t pg = tree_root_page(db, tree);
+  void *node = get_page(db->pager, pg);
+  while (get_node_type(node) != NODE_LEAF) {
+    pg = *internal_node_right_child(node);
+    node = get_page(db->pager, pg);
+  }
+  Cursor *c = malloc(sizeof(Cursor));
+  c->db = db;
+  c->page_num = pg;
+  c->cell_num = *leaf_node_num_cells(node);
+  c->table_index = tree;
+  return c;
+}
+
 int find_table(Database *db, const char *name) {
   for (uint32_t i = 0; i < db->catalog.num_tables; i++) {
     if (strcmp(db->catalog.tables[i].name, name) == 0) {
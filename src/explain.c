@@ -0,0 +1,353 @@
+#include "explain.h"
+#include "aggregate.h"
+#include "analyze.h"
+#include "btree.h"
+#include "join.h"
+#include "parallel.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/** plan_line writes an operator `level` steps in from the left margin. */
+static void plan_line(Database *db, uint32_t level, const char *format,
+                      ...) {
+  fprintf(db->out, "%*s", (int)(level * 2), "");
+  va_list args;
+  va_start(args, format);
+  vfprintf(db->out, format, args);
+  va_end(args);
+  fputc('\n', db->out);
+}
+
+static const char *field_name(Database *db, uint32_t table, uint32_t field) {
+  return db->catalog.tables[table].schema.fields[field].name;
+}
+
+/**
+ * walk_pages expects a walk over `rows` of a tree's rows to read the path
+ * down to its first leaf, then as many leaves as that many rows fill on
+ * average.
+ */
+static uint64_t walk_pages(Database *db, uint32_t tree, uint64_t rows) {
+  uint32_t depth;
+  uint32_t leaves = btree_leaf_count(db, tree, &depth);
+  uint32_t total = btree_row_count(db, tree);
+  unpin_page_all(db->pager);
+  uint64_t spanned = total > 0 ? (rows * leaves + total - 1) / total : 0;
+  return depth - 1 + (spanned > 0 ? spanned : 1);
+}
+
+static uint32_t tree_depth(Database *db, uint32_t tree) {
+  uint32_t depth;
+  btree_leaf_count(db, tree, &depth);
+  unpin_page_all(db->pager);
+  return depth;
+}
+
+/**
+ * format_bounds writes the key range select_plan() gave a walk on `field`:
+ * the key when there is one, else the ends it has. TEXT keys are hashes and
+ * only '=' bounds them, so the value is taken from the WHERE term instead.
+ */
+static void format_bounds(Database *db, const Statement *s, uint32_t field,
+                          char *out, size_t size) {
+  const KeyRange *r = &s->key_range;
+  const char *name = field_name(db, s->table_index, field);
+  uint32_t first, last;
+  key_range_bounds(r, &first, &last);
+  if (db->catalog.tables[s->table_index].schema.fields[field].type ==
+      FIELD_TEXT) {
+    for (uint32_t i = 0; i < s->predicate.num_terms; i++) {
+      const PredicateTerm *t = &s->predicate.terms[i];
+      if (t->field == field && t->op == CMP_EQ) {
+        snprintf(out, size, "%s = '%s'", name, t->text);
+        return;
+      }
+    }
+  }
+  if (r->has_lower && r->has_upper && first == last)
+    snprintf(out, size, "%s = %u", name, first);
+  else if (r->has_lower && r->has_upper)
+    snprintf(out, size, "%s %u..%u", name, first, last);
+  else if (r->has_lower)
+    snprintf(out, size, "%s >= %u", name, first);
+  else if (r->has_upper)
+    snprintf(out, size, "%s <= %u", name, last);
+  else
+    snprintf(out, size, "%s", name);
+}
+
+/**
+ * has_filter tells whether the WHERE clause drops rows the walk of `tree`
+ * reads: it does unless it only bounds the primary key walked.
+ */
+static bool has_filter(Database *db, const Statement *s, uint32_t tree) {
+  uint32_t first, last;
+  return s->predicate.num_terms > 0 &&
+         !(tree < INDEX_TREE_BASE &&
+           predicate_key_range(&s->predicate,
+                               &db->catalog.tables[s->table_index].schema,
+                               &first, &last));
+}
+
+/**
+ * print_read writes how a SELECT reads its table, walking `tree` as
+ * select_plan() chose. A walk stops after `cap` rows (a LIMIT nothing comes
+ * between). `threads` above 1 is a parallel scan; `scanned`, if given, is
+ * how many rows the walk actually read.
+ */
+static void print_read(Database *db, uint32_t level, Statement *s,
+                       uint32_t tree, uint64_t cap, uint32_t threads,
+                       const uint64_t *scanned) {
+  const char *table = db->catalog.tables[s->table_index].name;
+  const KeyRange *r = &s->key_range;
+  bool bounded = r->has_lower || r->has_upper;
+  uint32_t first, last;
+  key_range_bounds(r, &first, &last);
+  bool point = r->has_lower && r->has_upper && first == last;
+  uint64_t rows = !bounded      ? btree_row_count(db, tree)
+                  : first <= last ? btree_range_count(db, tree, first, last)
+                                  : 0;
+  unpin_page_all(db->pager);
+  if (rows > cap)
+    rows = cap;
+  uint64_t pages = walk_pages(db, tree, rows);
+
+  char what[TABLE_NAME_MAX * 2 + TEXT_FIELD_SIZE + 64];
+  char bounds[TEXT_FIELD_SIZE + 64];
+  if (tree < INDEX_TREE_BASE) {
+    format_bounds(db, s, 0, bounds, sizeof(bounds));
+    if (bounded)
+      snprintf(what, sizeof(what), "%s %s (%s)",
+               point ? "POINT SEEK" : "RANGE SEEK", table, bounds);
+    else
+      snprintf(what, sizeof(what), "FULL SCAN %s", table);
+  } else {
+    IndexDefinition *idx = &db->catalog.indexes[tree - INDEX_TREE_BASE];
+    format_bounds(db, s, idx->field_index, bounds, sizeof(bounds));
+    snprintf(what, sizeof(what), "%s %s ON %s (%s)",
+             point     ? "INDEX SEEK"
+             : bounded ? "INDEX RANGE SCAN"
+                       : "INDEX SCAN",
+             idx->name, table, bounds);
+    // Each row is then looked up by its primary key
+    pages += rows * tree_depth(db, s->table_index);
+  }
+
+  char extra[64] = "";
+  if (s->reverse)
+    strcat(extra, " BACKWARD");
+  if (threads > 1)
+    snprintf(extra + strlen(extra), sizeof(extra) - strlen(extra),
+             " (parallel, %u threads)", threads);
+  char actual[48] = "";
+  if (scanned != nullptr)
+    snprintf(actual, sizeof(actual), " (actual rows=%" PRIu64 ")", *scanned);
+  plan_line(db, level, "%s%s: ~%" PRIu64 " rows, ~%" PRIu64 " pages%s", what,
+            extra, rows, pages, actual);
+}
+
+static void print_limit(Database *db, uint32_t *level,
+                        const Statement *statement) {
+  if (statement->limit != UINT32_MAX && statement->offset > 0)
+    plan_line(db, (*level)++, "LIMIT %u OFFSET %u", statement->limit,
+              statement->offset);
+  else if (statement->limit != UINT32_MAX)
+    plan_line(db, (*level)++, "LIMIT %u", statement->limit);
+  else if (statement->offset > 0)
+    plan_line(db, (*level)++, "OFFSET %u", statement->offset);
+}
+
+/**
+ * filtered_rows estimates the rows of an analyzed table a WHERE clause keeps,
+ * out of those the table holds now.
+ */
+static uint64_t filtered_rows(Database *db, const Statement *s,
+                              const TableStats *stats) {
+  uint32_t rows = btree_row_count(db, s->table_index);
+  unpin_page_all(db->pager);
+  double share = estimate_filter(
+      stats, &db->catalog.tables[s->table_index].schema, &s->predicate);
+  // Rows that may match at all are estimated as at least one
+  uint64_t kept = (uint64_t)(share * rows + 0.5);
+  return kept == 0 && share > 0 ? 1 : kept;
+}
+
+static void print_filter(Database *db, uint32_t *level, const Statement *s) {
+  uint32_t terms = s->predicate.num_terms;
+  const TableStats *stats = db->table_stats[s->table_index];
+  // A join's terms number the joined row's columns
+  if (stats != nullptr && !s->joined)
+    plan_line(db, (*level)++, "FILTER (%u term%s): ~%" PRIu64 " rows", terms,
+              terms == 1 ? "" : "s", filtered_rows(db, s, stats));
+  else
+    plan_line(db, (*level)++, "FILTER (%u term%s)", terms,
+              terms == 1 ? "" : "s");
+}
+
+/**
+ * estimate_output estimates the rows a SELECT on an analyzed table returns:
+ * those its WHERE clause keeps, or its groups, less the OFFSET and up to the
+ * LIMIT.
+ */
+static uint64_t estimate_output(Database *db, const Statement *s,
+                                const TableStats *stats) {
+  uint64_t rows = s->num_items == 0 ? filtered_rows(db, s, stats)
+                  : s->grouped      ? stats->columns[s->group_field].distinct
+                                    : 1;
+  rows = rows > s->offset ? rows - s->offset : 0;
+  return rows < s->limit ? rows : s->limit;
+}
+
+static void explain_aggregate(Statement *statement, Database *db,
+                              uint32_t level, const uint64_t *scanned) {
+  Schema result;
+  aggregate_schema(statement, db, &result);
+  char items[MAX_FIELDS * (FIELD_NAME_MAX + 2)] = "";
+  for (uint32_t i = 0; i < result.num_fields; i++) {
+    if (i > 0)
+      strcat(items, ", ");
+    strcat(items, result.fields[i].name);
+  }
+  uint32_t table = statement->table_index;
+  if (statement->ordered)
+    plan_line(db, level++, "SORT GROUPS BY %s%s",
+              field_name(db, table, statement->order_field),
+              statement->order_desc ? " DESC" : "");
+  if (statement->grouped)
+    plan_line(db, level++, "GROUP BY %s: %s",
+              field_name(db, table, statement->group_field), items);
+  else
+    plan_line(db, level++, "AGGREGATE %s", items);
+
+  const char *name = db->catalog.tables[table].name;
+  switch (aggregate_input(statement, db)) {
+  case AGGREGATE_ROW_COUNTS:
+    // One descent for each end of the range, or just the root for all rows
+    plan_line(db, level, "ROW COUNTS %s: ~%u pages", name,
+              statement->predicate.num_terms > 0 ? 2 * tree_depth(db, table)
+                                                 : 1);
+    return;
+  case AGGREGATE_KEY_EDGES:
+    plan_line(db, level, "KEY EDGES %s: ~%u pages", name,
+              2 * tree_depth(db, table));
+    return;
+  case AGGREGATE_ROWS:
+    break;
+  }
+  uint32_t tree = select_plan(statement, db);
+  uint32_t threads = 1;
+  if (tree < INDEX_TREE_BASE) {
+    ParallelScan *parallel =
+        parallel_scan_open(statement, db, db->scan_threads);
+    if (parallel != nullptr) {
+      threads = parallel_scan_threads(parallel);
+      parallel_scan_close(parallel);
+    }
+    unpin_page_all(db->pager);
+  }
+  if (has_filter(db, statement, tree))
+    print_filter(db, &level, statement);
+  print_read(db, level, statement, tree, UINT64_MAX, threads, scanned);
+}
+
+static void explain_join(Statement *statement, Database *db, uint32_t level) {
+  Schema joined;
+  join_schema(statement, db, &joined);
+  uint32_t left_fields = db->catalog.tables[statement->table_index]
+                             .schema.num_fields;
+  if (statement->ordered)
+    plan_line(db, level++, "SORT BY %s%s",
+              joined.fields[statement->order_field].name,
+              statement->order_desc ? " DESC" : "");
+  if (statement->predicate.num_terms > 0)
+    print_filter(db, &level, statement);
+
+  bool inner_left;
+  JoinMethod method = join_plan(statement, db, &inner_left);
+  unpin_page_all(db->pager);
+  plan_line(db, level++, "%s ON %s = %s",
+            method == JOIN_HASH ? "HASH JOIN" : "INDEX NESTED-LOOP JOIN",
+            joined.fields[statement->join_left_field].name,
+            joined.fields[left_fields + statement->join_right_field].name);
+
+  Statement outer, inner;
+  join_side_scan(statement, db, inner_left, &outer);
+  join_side_scan(statement, db, !inner_left, &inner);
+  print_read(db, level, &outer, select_plan(&outer, db), UINT64_MAX, 1,
+             nullptr);
+  uint32_t inner_field =
+      inner_left ? statement->join_left_field : statement->join_right_field;
+  const char *inner_name = db->catalog.tables[inner.table_index].name;
+  if (method == JOIN_HASH) {
+    plan_line(db, level, "HASH TABLE ON %s.%s",
+              inner_name, field_name(db, inner.table_index, inner_field));
+    print_read(db, level + 1, &inner, select_plan(&inner, db), UINT64_MAX,
+               1, nullptr);
+  } else {
+    plan_line(db, level, "POINT SEEK %s (%s) per row: ~1 rows, ~%u pages",
+              inner_name, field_name(db, inner.table_index, 0),
+              tree_depth(db, inner.table_index));
+  }
+}
+
+static void print_actual(Database *db, const ExplainActual *actual) {
+  const DbStats *s = &actual->stats;
+  fprintf(db->out,
+          "Execution: %" PRIu64 " rows in %.3f ms (first row after %.3f "
+          "ms)\n",
+          actual->rows, actual->total_ms, actual->first_ms);
+  fprintf(db->out,
+          "Pages: %" PRIu64 " fetched (%" PRIu64 " hits, %" PRIu64
+          " misses), %" PRIu64 " read, %" PRIu64 " written\n",
+          s->fetches, s->hits, s->fetches - s->hits, s->reads, s->writes);
+  fprintf(db->out, "Rows scanned: %" PRIu64 "\n", s->rows_scanned);
+  if (actual->sort_runs > 0)
+    fprintf(db->out, "Sort: %u runs spilled to disk\n", actual->sort_runs);
+  if (actual->partitions > 0)
+    fprintf(db->out, "Join: %u partitions spilled to disk\n",
+            actual->partitions);
+}
+
+void explain_select(Statement *statement, Database *db,
+                    const ExplainActual *actual) {
+  uint32_t level = 0;
+  const TableStats *stats = db->table_stats[statement->table_index];
+  char estimate[32] = "";
+  if (stats != nullptr && !statement->joined)
+    snprintf(estimate, sizeof(estimate), ": ~%" PRIu64 " rows",
+             estimate_output(db, statement, stats));
+  if (actual != nullptr)
+    plan_line(db, level++, "SELECT%s (actual rows=%" PRIu64 ")", estimate,
+              actual->rows);
+  else
+    plan_line(db, level++, "SELECT%s", estimate);
+  print_limit(db, &level, statement);
+  const uint64_t *scanned =
+      actual != nullptr ? &actual->stats.rows_scanned : nullptr;
+
+  if (statement->num_items > 0) {
+    explain_aggregate(statement, db, level, scanned);
+  } else if (statement->joined) {
+    explain_join(statement, db, level);
+  } else {
+    uint32_t tree = select_plan(statement, db);
+    Cursor walk = {.db = db, .table_index = tree};
+    bool sort = select_needs_sort(statement, &walk);
+    if (sort)
+      plan_line(db, level++, "SORT BY %s%s",
+                field_name(db, statement->table_index, statement->order_field),
+                statement->order_desc ? " DESC" : "");
+    bool filter = has_filter(db, statement, tree);
+    if (filter)
+      print_filter(db, &level, statement);
+    // Unsorted and unfiltered, the walk ends with the LIMIT
+    uint64_t cap = sort || filter || statement->limit == UINT32_MAX
+                       ? UINT64_MAX
+                       : (uint64_t)statement->offset + statement->limit;
+    print_read(db, level, statement, tree, cap, 1, scanned);
+  }
+  if (actual != nullptr)
+    print_actual(db, actual);
+}
@@ -0,0 +1,414 @@
+#include "import.h"
+#include "btree.h"
+#include "index.h"
+#include "os_portability.h"
+#include "parallel.h"
+#include "schema.h"
+#include <stdbit.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMPORT_SSE2
+#endif
+
+/** A stretch of the file, parsed by one thread. */
+typedef struct {
+  const char *begin;
+  const char *end;
+  const Schema *schema;
+  uint32_t stride;  // Bytes per parsed row: its key, then the row
+  uint8_t *rows;
+  uint64_t *order;  // key << 32 | row number, sorted
+  uint32_t count;
+  uint32_t capacity;
+  uint64_t quotes;  // Set by count_quotes()
+  ImportResult result;
+} Chunk;
+
+/** How next_field() found a field to end. */
+typedef enum : uint8_t {
+  STOP_COMMA,
+  STOP_RECORD_END,
+  STOP_TOO_LONG,
+  STOP_BAD_QUOTE
+} FieldStop;
+
+#ifndef IMPORT_SSE2
+constexpr uint64_t SWAR_ONES = 0x0101010101010101u;
+constexpr uint64_t SWAR_HIGHS = 0x8080808080808080u;
+#endif
+
+/**
+ * find_delimiter returns the first ',' or '\n' in [p, end), or end. With SSE2
+ * it compares 16 bytes at a time; elsewhere 8 at a time in a word, finding
+ * the block that holds a match and leaving the last few bytes to the loop.
+ */
+static const char *find_delimiter(const char *p, const char *end) {
+#ifdef IMPORT_SSE2
+  const __m128i commas = _mm_set1_epi8(',');
+  const __m128i newlines = _mm_set1_epi8('\n');
+  for (; end - p >= 16; p += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)p);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(bytes, commas), _mm_cmpeq_epi8(bytes, newlines)));
+    if (mask != 0)
+      return p + stdc_trailing_zeros(mask);
+  }
+#else
+  for (; end - p >= 8; p += 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    uint64_t commas = word ^ (SWAR_ONES * ',');
+    uint64_t newlines = word ^ (SWAR_ONES * '\n');
+    // Sets the high bit of a zero byte (and maybe of bytes after one)
+    if ((((commas - SWAR_ONES) & ~commas) |
+         ((newlines - SWAR_ONES) & ~newlines)) &
+        SWAR_HIGHS)
+      break;
+  }
+#endif
+  while (p < end && *p != ',' && *p != '\n')
+    p++;
+  return p;
+}
+
+/**
+ * next_field reads the field at *pos, unquoting it into `text` if it is
+ * quoted, and moves *pos past the comma or line break after it. A CR before
+ * the line break is dropped.
+ */
+static FieldStop next_field(const char **pos, const char *end,
+                            char (*text)[TEXT_FIELD_SIZE], const char **value,
+                            size_t *len) {
+  const char *p = *pos;
+  if (p < end && *p == '"') {
+    *value = *text;
+    *len = 0;
+    const char *from = p + 1;
+    for (;;) {
+      const char *quote = memchr(from, '"', (size_t)(end - from));
+      if (quote == nullptr)
+        return STOP_BAD_QUOTE;
+      bool doubled = quote + 1 < end && quote[1] == '"';
+      size_t part = (size_t)(quote - from) + (doubled ? 1 : 0);
+      if (*len + part >= TEXT_FIELD_SIZE)
+        return STOP_TOO_LONG;
+      memcpy(*text + *len, from, part);
+      *len += part;
+      if (!doubled) {
+        p = quote + 1;
+        break;
+      }
+      from = quote + 2;
+    }
+  } else {
+    const char *stop = find_delimiter(p, end);
+    *value = p;
+    *len = (size_t)(stop - p);
+    p = stop;
+    if (*len > 0 && p[-1] == '\r' && (p == end || *p == '\n')) {
+      (*len)--;
+      p--;
+    }
+  }
+  if (p < end && *p == '\r' && (p + 1 == end || p[1] == '\n'))
+    p++;
+  if (p < end && *p == ',') {
+    *pos = p + 1;
+    return STOP_COMMA;
+  }
+  if (p < end && *p != '\n')
+    return STOP_BAD_QUOTE; // Text after a closing quote
+  *pos = p < end ? p + 1 : p;
+  return STOP_RECORD_END;
+}
+
+/** parse_int reads an INT the way INSERT does: a sign, then only digits. */
+static bool parse_int(const char *value, size_t len, uint32_t *out) {
+  size_t i = len > 0 && (value[0] == '-' || value[0] == '+') ? 1 : 0;
+  if (i == len)
+    return false;
+  uint32_t n = 0;
+  for (; i < len; i++) {
+    if (value[i] < '0' || value[i] > '9')
+      return false;
+    n = n * 10 + (uint32_t)(value[i] - '0');
+  }
+  *out = value[0] == '-' ? 0u - n : n;
+  return true;
+}
+
+/**
+ * parse_record serializes the record at *pos into `row`, sets its B-Tree key
+ * and moves *pos to the next record.
+ */
+static ImportResult parse_record(const Schema *schema, const char **pos,
+                                 const char *end, uint32_t *key,
+                                 uint8_t *row) {
+  memset(row, 0, schema->row_size);
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    const Field *f = &schema->fields[i];
+    char text[TEXT_FIELD_SIZE];
+    const char *value;
+    size_t len;
+    FieldStop stop = next_field(pos, end, &text, &value, &len);
+    if (stop == STOP_BAD_QUOTE)
+      return IMPORT_BAD_QUOTE;
+    if (stop == STOP_TOO_LONG)
+      return f->type == FIELD_TEXT ? IMPORT_STRING_TOO_LONG
+                                   : IMPORT_NOT_A_NUMBER;
+    if ((stop == STOP_RECORD_END) != (i + 1 == schema->num_fields))
+      return IMPORT_COLUMN_COUNT;
+    if (f->type == FIELD_INT) {
+      uint32_t n;
+      if (!parse_int(value, len, &n))
+        return IMPORT_NOT_A_NUMBER;
+      memcpy(row + f->offset, &n, sizeof(n));
+      if (i == 0)
+        *key = n;
+    } else {
+      if (len >= f->size)
+        return IMPORT_STRING_TOO_LONG;
+      memcpy(row + f->offset, value, len);
+      if (i == 0)
+        *key = hash_string_n(value, len);
+    }
+  }
+  return IMPORT_SUCCESS;
+}
+
+/**
+ * skip_header moves *begin past the first record if its fields are the
+ * table's column names.
+ */
+static bool skip_header(const Schema *schema, const char **begin,
+                        const char *end) {
+  const char *p = *begin;
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    char text[TEXT_FIELD_SIZE];
+    const char *value;
+    size_t len;
+    FieldStop stop = next_field(&p, end, &text, &value, &len);
+    const char *name = schema->fields[i].name;
+    if (stop != (i + 1 == schema->num_fields ? STOP_RECORD_END : STOP_COMMA) ||
+        len != strlen(name) || strncasecmp(value, name, len) != 0)
+      return false;
+  }
+  *begin = p;
+  return true;
+}
+
+/** count_quotes counts the double quotes in a chunk. */
+static int count_quotes(void *arg) {
+  Chunk *chunk = arg;
+  chunk->quotes = 0;
+  for (const char *p = chunk->begin;
+       (p = memchr(p, '"', (size_t)(chunk->end - p))) != nullptr; p++)
+    chunk->quotes++;
+  return 0;
+}
+
+static int compare_entries(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * parse_chunk parses every record of a chunk, stopping at the first that
+ * fails, and sorts the rows by key. Rows with equal keys stay in file order.
+ */
+static int parse_chunk(void *arg) {
+  Chunk *chunk = arg;
+  const char *p = chunk->begin;
+  while (p < chunk->end) {
+    if (*p == '\n' || (*p == '\r' && p + 1 < chunk->end && p[1] == '\n')) {
+      p += *p == '\r' ? 2 : 1; // A blank line
+      continue;
+    }
+    if (chunk->count == chunk->capacity) {
+      chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+      chunk->rows =
+          realloc(chunk->rows, (size_t)chunk->capacity * chunk->stride);
+    }
+    uint8_t *slot = chunk->rows + (size_t)chunk->count * chunk->stride;
+    uint32_t key = 0;
+    chunk->result = parse_record(chunk->schema, &p, chunk->end, &key,
+                                 slot + sizeof(uint32_t));
+    if (chunk->result != IMPORT_SUCCESS)
+      return 0;
+    memcpy(slot, &key, sizeof(key));
+    chunk->count++;
+  }
+  chunk->order = malloc((chunk->count + 1) * sizeof(uint64_t));
+  for (uint32_t i = 0; i < chunk->count; i++) {
+    uint32_t key;
+    memcpy(&key, chunk->rows + (size_t)i * chunk->stride, sizeof(key));
+    chunk->order[i] = (uint64_t)key << 32 | i;
+  }
+  qsort(chunk->order, chunk->count, sizeof(uint64_t), compare_entries);
+  return 0;
+}
+
+/**
+ * run_chunks runs `work` on every chunk, the first on the calling thread. A
+ * chunk whose thread fails to start is done by the caller afterwards.
+ */
+static void run_chunks(Chunk *chunks, uint32_t num_chunks, thrd_start_t work) {
+  thrd_t ids[PARALLEL_MAX_THREADS];
+  bool started[PARALLEL_MAX_THREADS] = {};
+  for (uint32_t c = 1; c < num_chunks; c++)
+    started[c] = thrd_create(&ids[c], work, &chunks[c]) == thrd_success;
+  work(&chunks[0]);
+  for (uint32_t c = 1; c < num_chunks; c++) {
+    if (started[c])
+      thrd_join(ids[c], nullptr);
+    else
+      work(&chunks[c]);
+  }
+}
+
+/**
+ * split_chunks moves each chunk's start forward to just after a line break
+ * outside quotes. Whether a point is inside a quoted field follows from the
+ * parity of the quotes before it, counted a chunk per thread.
+ */
+static void split_chunks(Chunk *chunks, uint32_t num_chunks,
+                         const char *end) {
+  run_chunks(chunks, num_chunks, count_quotes);
+  uint64_t quotes = 0;
+  for (uint32_t c = 1; c < num_chunks; c++) {
+    quotes += chunks[c - 1].quotes;
+    bool quoted = quotes & 1;
+    const char *p = chunks[c].begin;
+    while (p < end && (quoted || *p != '\n')) {
+      if (*p == '"')
+        quoted = !quoted;
+      p++;
+    }
+    p = p < end ? p + 1 : end;
+    // No earlier break point means the same one as the chunk before
+    if (p < chunks[c - 1].begin)
+      p = chunks[c - 1].begin;
+    chunks[c - 1].end = p;
+    chunks[c].begin = p;
+  }
+}
+
+/**
+ * insert_sorted merges the chunks' sorted rows and inserts them in key
+ * order. Of rows with the same key the first in the file wins. Returns false
+ * if the file runs out of pages first.
+ */
+static bool insert_sorted(Database *db, uint32_t table_index, Chunk *chunks,
+                          uint32_t num_chunks, ImportStats *stats) {
+  TableDefinition *td = &db->catalog.tables[table_index];
+  uint32_t next[PARALLEL_MAX_THREADS] = {};
+  bool inserted_any = false;
+  uint32_t last_key = 0;
+  for (;;) {
+    uint32_t best = UINT32_MAX;
+    uint64_t best_entry = 0;
+    for (uint32_t c = 0; c < num_chunks; c++) {
+      if (next[c] == chunks[c].count)
+        continue;
+      uint64_t entry = chunks[c].order[next[c]];
+      // Ties go to the earlier chunk, which is earlier in the file
+      if (best == UINT32_MAX || entry >> 32 < best_entry >> 32) {
+        best = c;
+        best_entry = entry;
+      }
+    }
+    if (best == UINT32_MAX)
+      break;
+    next[best]++;
+    uint32_t key = (uint32_t)(best_entry >> 32);
+    const uint8_t *row = chunks[best].rows +
+                         (size_t)(uint32_t)best_entry * chunks[best].stride +
+                         sizeof(uint32_t);
+    if (inserted_any && key == last_key) {
+      stats->duplicates++;
+      continue;
+    }
+    inserted_any = true;
+    last_key = key;
+
+    Cursor *c = find_node(db, table_index, td->root_page_num, key);
+    void *node = get_page(db->pager, c->page_num);
+    if (c->cell_num < *leaf_node_num_cells(node) &&
+        *leaf_node_key(node, c->cell_num, &td->schema) == key) {
+      stats->duplicates++;
+    } else if (!pager_has_room(db->pager,
+                               btree_insert_pages(db, table_index) +
+                                   index_insert_pages(db, table_index))) {
+      free(c);
+      unpin_page_all(db->pager);
+      return false;
+    } else {
+      leaf_node_insert_row(c, key, row);
+      index_insert_row(db, table_index, key, row);
+      stats->rows++;
+    }
+    free(c);
+    unpin_page_all(db->pager);
+  }
+  return true;
+}
+
+ImportResult import_csv(Database *db, uint32_t table_index, const char *path,
+                        uint32_t num_threads, ImportStats *stats) {
+  *stats = (ImportStats){};
+  size_t size;
+  const char *data = os_map_file(path, &size);
+  if (data == nullptr)
+    return IMPORT_CANNOT_OPEN;
+  const Schema *schema = &db->catalog.tables[table_index].schema;
+  const char *begin = data;
+  const char *end = data + size;
+  uint64_t record = skip_header(schema, &begin, end) ? 1 : 0;
+
+  size_t length = (size_t)(end - begin);
+  uint32_t num_chunks = num_threads;
+  if (num_chunks > PARALLEL_MAX_THREADS)
+    num_chunks = PARALLEL_MAX_THREADS;
+  if (num_chunks > length / IMPORT_MIN_CHUNK)
+    num_chunks = (uint32_t)(length / IMPORT_MIN_CHUNK);
+  if (num_chunks == 0)
+    num_chunks = 1;
+  Chunk *chunks = calloc(num_chunks, sizeof(Chunk));
+  for (uint32_t c = 0; c < num_chunks; c++) {
+    chunks[c] = (Chunk){
+        .begin = begin + (size_t)((uint64_t)length * c / num_chunks),
+        .end = begin + (size_t)((uint64_t)length * (c + 1) / num_chunks),
+        .schema = schema,
+        .stride = (uint32_t)sizeof(uint32_t) + schema->row_size,
+    };
+  }
+  if (num_chunks > 1)
+    split_chunks(chunks, num_chunks, end);
+  run_chunks(chunks, num_chunks, parse_chunk);
+  stats->threads = num_chunks;
+
+  // Chunks before the first that failed parsed all their records
+  ImportResult result = IMPORT_SUCCESS;
+  for (uint32_t c = 0; c < num_chunks && result == IMPORT_SUCCESS; c++) {
+    record += chunks[c].count;
+    result = chunks[c].result;
+  }
+  if (result == IMPORT_SUCCESS) {
+    if (!insert_sorted(db, table_index, chunks, num_chunks, stats))
+      result = IMPORT_TABLE_FULL;
+  } else
+    stats->record = record + 1;
+
+  for (uint32_t c = 0; c < num_chunks; c++) {
+    free(chunks[c].rows);
+    free(chunks[c].order);
+  }
+  free(chunks);
+  os_unmap_file(data, size);
+  return result;
+}
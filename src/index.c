@@ -0,0 +1,239 @@
+#include "index.h"
+#include "btree.h"
+#include "schema.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int find_index(Database *db, const char *name) {
+  for (uint32_t i = 0; i < db->catalog.num_indexes; i++) {
+    if (strcmp(db->catalog.indexes[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+int find_column_index(Database *db, uint32_t table_index, uint32_t field) {
+  for (uint32_t i = 0; i < db->catalog.num_indexes; i++) {
+    IndexDefinition *idx = &db->catalog.indexes[i];
+    if (idx->table_index == table_index && idx->field_index == field)
+      return i;
+  }
+  return -1;
+}
+
+uint32_t index_key(Schema *schema, uint32_t field, const void *row) {
+  Field *f = &schema->fields[field];
+  if (f->type == FIELD_TEXT)
+    return hash_string((const char *)row + f->offset);
+  uint32_t value;
+  memcpy(&value, (const char *)row + f->offset, sizeof(value));
+  return value;
+}
+
+/**
+ * insert_position returns a cursor just past the last cell with key `key`, so
+ * that equal keys stay in insertion order.
+ */
+static Cursor *insert_position(Database *db, uint32_t tree, uint32_t key) {
+  if (key < UINT32_MAX)
+    return find_node(db, tree, tree_root_page(db, tree), key + 1);
+  // Nothing sorts after UINT32_MAX: append to the last leaf
+  return table_end(db, tree);
+}
+
+static void index_insert(Database *db, uint32_t tree, uint32_t key,
+                         uint32_t pk) {
+  Cursor *c = insert_position(db, tree, key);
+  leaf_node_insert_row(c, key, &pk);
+  free(c);
+}
+
+static void index_delete(Database *db, uint32_t tree, uint32_t key,
+                         uint32_t pk) {
+  Schema *schema = tree_schema(db, tree);
+  Cursor *c = find_node(db, tree, tree_root_page(db, tree), key);
+  // Equal keys may span several leaves; look for the one naming this row
+  while (true) {
+    void *node = get_page(db->pager, c->page_num);
+    if (c->cell_num >= *leaf_node_num_cells(node)) {
+      uint32_t next = *leaf_node_next_leaf(node);
+      if (next == 0)
+        break;
+      c->page_num = next;
+      c->cell_num = 0;
+      continue;
+    }
+    if (*leaf_node_key(node, c->cell_num, schema) != key)
+      break;
+    uint32_t cell_pk;
+    memcpy(&cell_pk, leaf_node_value(node, c->cell_num, schema),
+           sizeof(cell_pk));
+    if (cell_pk == pk) {
+      leaf_node_delete(c);
+      break;
+    }
+    c->cell_num++;
+  }
+  free(c);
+}
+
+bool index_build(Database *db, uint32_t index) {
+  IndexDefinition *idx = &db->catalog.indexes[index];
+  Schema *schema = &db->catalog.tables[idx->table_index].schema;
+  Cursor *c = table_start(db, idx->table_index);
+  bool fits = true;
+  while (true) {
+    // Each insert may touch a new path; only the scanned leaf must stay put
+    unpin_page_all(db->pager);
+    void *node = get_page(db->pager, c->page_num);
+    if (c->cell_num >= *leaf_node_num_cells(node)) {
+      uint32_t next = *leaf_node_next_leaf(node);
+      if (next == 0)
+        break;
+      c->page_num = next;
+      c->cell_num = 0;
+      continue;
+    }
+    uint32_t pk = *leaf_node_key(node, c->cell_num, schema);
+    uint32_t key = index_key(schema, idx->field_index,
+                             leaf_node_value(node, c->cell_num, schema));
+    c->cell_num++;
+    uint32_t pages = btree_insert_pages(db, INDEX_TREE_BASE + index);
+    fits = pager_has_room(db->pager, pages);
+    if (!fits)
+      break;
+    index_insert(db, INDEX_TREE_BASE + index, key, pk);
+  }
+  free(c);
+  unpin_page_all(db->pager);
+  return fits;
+}
+
+uint32_t index_insert_pages(Database *db, uint32_t table_index) {
+  uint32_t pages = 0;
+  for (uint32_t i = 0; i < db->catalog.num_indexes; i++) {
+    if (db->catalog.indexes[i].table_index == table_index)
+      pages += btree_insert_pages(db, INDEX_TREE_BASE + i);
+  }
+  return pages;
+}
+
+void index_insert_row(Database *db, uint32_t table_index, uint32_t pk,
+                      const void *row) {
+  Schema *schema = &db->catalog.tables[table_index].schema;
+  for (uint32_t i = 0; i < db->catalog.num_indexes; i++) {
+    IndexDefinition *idx = &db->catalog.indexes[i];
+    if (idx->table_index == table_index)
+      index_insert(db, INDEX_TREE_BASE + i,
+                   index_key(schema, idx->field_index, row), pk);
+  }
+}
+
+void index_delete_row(Database *db, uint32_t table_index, uint32_t pk,
+                      const void *row) {
+  Schema *schema = &db->catalog.tables[table_index].schema;
+  for (uint32_t i = 0; i < db->catalog.num_indexes; i++) {
+    IndexDefinition *idx = &db->catalog.indexes[i];
+    if (idx->table_index == table_index)
+      index_delete(db, INDEX_TREE_BASE + i,
+                   index_key(schema, idx->field_index, row), pk);
+  }
+}
+
+void index_update_row(Database *db, uint32_t table_index, uint32_t old_pk,
+                      const void *old_row, uint32_t pk, const void *row) {
+  Schema *schema = &db->catalog.tables[table_index].schema;
+  for (uint32_t i = 0; i < db->catalog.num_indexes; i++) {
+    IndexDefinition *idx = &db->catalog.indexes[i];
+    if (idx->table_index != table_index)
+      continue;
+    uint32_t old_key = index_key(schema, idx->field_index, old_row);
+    uint32_t key = index_key(schema, idx->field_index, row);
+    if (old_key != key || old_pk != pk) {
+      index_delete(db, INDEX_TREE_BASE + i, old_key, old_pk);
+      index_insert(db, INDEX_TREE_BASE + i, key, pk);
+    }
+  }
+}
+
+void *index_fetch_row(Database *db, uint32_t table_index, uint32_t pk,
+                      uint32_t *page) {
+  Schema *schema = &db->catalog.tables[table_index].schema;
+  Cursor *c =
+      find_node(db, table_index, tree_root_page(db, table_index), pk);
+  void *node = get_page(db->pager, c->page_num);
+  void *row = nullptr;
+  if (c->cell_num < *leaf_node_num_cells(node) &&
+      *leaf_node_key(node, c->cell_num, schema) == pk)
+    row = leaf_node_value(node, c->cell_num, schema);
+  if (page != nullptr)
+    *page = c->page_num;
+  free(c);
+  return row;
+}
+
+/**
+ * count_cells walks a tree's leaves. For an index it also checks that every
+ * cell points at a table row with the key it is filed under.
+ */
+static bool count_cells(Database *db, uint32_t tree, IndexDefinition *idx,
+                        uint32_t *count) {
+  Schema *schema = tree_schema(db, tree);
+  Schema *table_schema =
+      idx ? &db->catalog.tables[idx->table_index].schema : nullptr;
+  Cursor *c = table_start(db, tree);
+  bool ok = true;
+  *count = 0;
+  while (ok) {
+    unpin_page_all(db->pager);
+    void *node = get_page(db->pager, c->page_num);
+    if (c->cell_num >= *leaf_node_num_cells(node)) {
+      uint32_t next = *leaf_node_next_leaf(node);
+      if (next == 0)
+        break;
+      c->page_num = next;
+      c->cell_num = 0;
+      continue;
+    }
+    (*count)++;
+    if (idx != nullptr) {
+      uint32_t key = *leaf_node_key(node, c->cell_num, schema);
+      uint32_t pk;
+      memcpy(&pk, leaf_node_value(node, c->cell_num, schema), sizeof(pk));
+      void *row = index_fetch_row(db, idx->table_index, pk, nullptr);
+      if (row == nullptr ||
+          index_key(table_schema, idx->field_index, row) != key) {
+        fprintf(db->out,
+                "Verify error: index %s has a stale entry for row %u\n",
+                idx->name, pk);
+        ok = false;
+      }
+    }
+    c->cell_num++;
+  }
+  free(c);
+  unpin_page_all(db->pager);
+  return ok;
+}
+
+bool verify_indexes(Database *db, uint32_t table_index) {
+  uint32_t rows;
+  if (!count_cells(db, table_index, nullptr, &rows))
+    return false;
+  for (uint32_t i = 0; i < db->catalog.num_indexes; i++) {
+    IndexDefinition *idx = &db->catalog.indexes[i];
+    if (idx->table_index != table_index)
+      continue;
+    uint32_t entries;
+    if (!verify_btree(db, INDEX_TREE_BASE + i) ||
+        !count_cells(db, INDEX_TREE_BASE + i, idx, &entries))
+      return false;
+    if (entries != rows) {
+      fprintf(db->out, "Verify error: index %s has %u entries for %u rows\n",
+              idx->name, entries, rows);
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,434 @@
+#include "join.h"
+#include "btree.h"
+#include "index.h"
+#include "pager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+constexpr uint32_t NO_ENTRY = UINT32_MAX;
+constexpr uint32_t JOIN_MAX_PARTITIONS = 32;
+
+/**
+ * A table taking part in a join: where its row goes in the joined row, and
+ * the SELECT that reads it, carrying the WHERE terms on its columns alone.
+ */
+typedef struct {
+  Statement scan;
+  Cursor *cursor;
+  const Schema *schema;
+  uint32_t field;      // Join column
+  uint32_t out_offset; // Of its row in the joined row
+} JoinSide;
+
+/** Rows of the build side, chained by the hash of their join column. */
+typedef struct {
+  uint8_t *rows;
+  uint32_t row_size;
+  uint32_t count;
+  uint32_t allocated;
+  uint32_t *next;
+  uint32_t *buckets;
+  uint32_t mask;
+} HashTable;
+
+struct Join {
+  Statement *statement;
+  Database *db;
+  JoinMethod method;
+  JoinSide outer; // Scanned, or probing the hash table
+  JoinSide inner; // Probed through its primary key, or the hash table's
+  uint8_t *out;   // Joined row handed out
+  HashTable table;
+  uint32_t match; // Next hash table row to compare with the probe row
+
+  // Partitions of a spilled hash join, and the one being joined
+  uint32_t num_partitions;
+  FILE *build_files[JOIN_MAX_PARTITIONS];
+  FILE *probe_files[JOIN_MAX_PARTITIONS];
+  uint32_t partition;
+  bool failed; // A partition file could not be created, written or read
+};
+
+void join_schema(const Statement *statement, Database *db, Schema *schema) {
+  const uint32_t tables[] = {statement->table_index, statement->join_table};
+  *schema = (Schema){};
+  for (uint32_t t = 0; t < 2; t++) {
+    const TableDefinition *table = &db->catalog.tables[tables[t]];
+    for (uint32_t i = 0; i < table->schema.num_fields; i++) {
+      Field *f = &schema->fields[schema->num_fields++];
+      *f = table->schema.fields[i];
+      f->offset += schema->row_size;
+      // Names that do not fit qualified stay bare
+      size_t table_len = strlen(table->name);
+      size_t field_len = strlen(f->name);
+      if (table_len + 1 + field_len < FIELD_NAME_MAX) {
+        memmove(f->name + table_len + 1, f->name, field_len + 1);
+        memcpy(f->name, table->name, table_len);
+        f->name[table_len] = '.';
+      }
+    }
+    schema->row_size += table->schema.row_size;
+  }
+}
+
+/**
+ * side_open prepares the scan of one table of a join, whose columns are
+ * fields `first` on of the joined row. The WHERE terms on those columns come
+ * along when the clause has no OR.
+ */
+void join_side_scan(const Statement *statement, Database *db, bool right,
+                    Statement *scan) {
+  uint32_t table = right ? statement->join_table : statement->table_index;
+  const Schema *schema = &db->catalog.tables[table].schema;
+  // The right table's fields and bytes come after the left's
+  const Schema *left = &db->catalog.tables[statement->table_index].schema;
+  uint32_t first = right ? left->num_fields : 0;
+  uint32_t out_offset = right ? left->row_size : 0;
+  *scan = (Statement){
+      .type = STATEMENT_SELECT, .table_index = table, .limit = UINT32_MAX};
+
+  const Predicate *predicate = &statement->predicate;
+  for (uint32_t i = 0; i + 1 < predicate->num_terms; i++) {
+    if (predicate->terms[i].ends_group)
+      return;
+  }
+  Predicate *own = &scan->predicate;
+  for (uint32_t i = 0; i < predicate->num_terms; i++) {
+    PredicateTerm t = predicate->terms[i];
+    if (t.field < first || t.field >= first + schema->num_fields)
+      continue;
+    t.field = (uint8_t)(t.field - first);
+    t.offset = (uint16_t)(t.offset - out_offset);
+    t.ends_group = false;
+    own->terms[own->num_terms++] = t;
+  }
+  for (uint32_t i = 0; i < own->num_terms; i++)
+    own->terms[i].next_group = (uint8_t)own->num_terms;
+  if (own->num_terms > 0)
+    own->terms[own->num_terms - 1].ends_group = true;
+}
+
+static void side_open(Join *j, JoinSide *side, bool right) {
+  Database *db = j->db;
+  const Statement *statement = j->statement;
+  uint32_t table = right ? statement->join_table : statement->table_index;
+  side->schema = &db->catalog.tables[table].schema;
+  side->field =
+      right ? statement->join_right_field : statement->join_left_field;
+  side->out_offset =
+      right ? db->catalog.tables[statement->table_index].schema.row_size : 0;
+  join_side_scan(statement, db, right, &side->scan);
+}
+
+/** side_next reads the side's next row into its place in the joined row. */
+static bool side_next(Join *j, JoinSide *side) {
+  if (side->cursor == nullptr)
+    side->cursor = select_open(&side->scan, j->db);
+  const void *row = select_next(&side->scan, j->db, side->cursor);
+  if (row == nullptr) {
+    free(side->cursor);
+    side->cursor = nullptr;
+    unpin_page_all(j->db->pager);
+    return false;
+  }
+  memcpy(j->out + side->out_offset, row, side->schema->row_size);
+  // The row is copied; nothing else needs its leaf pinned
+  unpin_page_all(j->db->pager);
+  return true;
+}
+
+static inline const uint8_t *side_value(const JoinSide *side,
+                                        const uint8_t *row) {
+  return row + side->schema->fields[side->field].offset;
+}
+
+/** values_equal compares the join columns of two rows. */
+static bool values_equal(const Join *j, const uint8_t *outer_row,
+                         const uint8_t *inner_row) {
+  const Field *f = &j->outer.schema->fields[j->outer.field];
+  const uint8_t *a = side_value(&j->outer, outer_row);
+  const uint8_t *b = side_value(&j->inner, inner_row);
+  if (f->type == FIELD_INT)
+    return memcmp(a, b, sizeof(uint32_t)) == 0;
+  return strncmp((const char *)a, (const char *)b, f->size) == 0;
+}
+
+/** join_key is a row's join column as a B-Tree key: the hash for TEXT. */
+static inline uint32_t join_key(const JoinSide *side, const uint8_t *row) {
+  return index_key((Schema *)side->schema, side->field, row);
+}
+
+/** mix spreads a key's bits; buckets use its low bits, partitions its high. */
+static inline uint32_t mix(uint32_t k) {
+  k ^= k >> 16;
+  k *= 0x7feb352du;
+  k ^= k >> 15;
+  k *= 0x846ca68bu;
+  k ^= k >> 16;
+  return k;
+}
+
+static void table_add(HashTable *t, const void *row) {
+  if (t->count == t->allocated) {
+    t->allocated = t->allocated > 0 ? t->allocated * 2 : 256;
+    t->rows = realloc(t->rows, (size_t)t->allocated * t->row_size);
+  }
+  memcpy(t->rows + (size_t)t->count++ * t->row_size, row, t->row_size);
+}
+
+/** table_chain links the rows added to the table into hash chains. */
+static void table_chain(HashTable *t, const JoinSide *side) {
+  uint32_t buckets = 1;
+  while (buckets < t->count)
+    buckets *= 2;
+  t->mask = buckets - 1;
+  t->buckets = realloc(t->buckets, buckets * sizeof(uint32_t));
+  t->next = realloc(t->next, (t->count > 0 ? t->count : 1) * sizeof(uint32_t));
+  for (uint32_t b = 0; b < buckets; b++)
+    t->buckets[b] = NO_ENTRY;
+  // Chained back to front, so matches come out in the order rows were added
+  for (uint32_t i = t->count; i-- > 0;) {
+    uint32_t b = mix(join_key(side, t->rows + (size_t)i * t->row_size)) &
+                 t->mask;
+    t->next[i] = t->buckets[b];
+    t->buckets[b] = i;
+  }
+}
+
+static inline uint32_t partition_of(const Join *j, uint32_t key) {
+  return (uint32_t)(((uint64_t)mix(key) * j->num_partitions) >> 32);
+}
+
+/** spill_row writes a row to a partition file, or fails the join. */
+static void spill_row(Join *j, FILE *file, const void *row, uint32_t size) {
+  if (!j->failed && fwrite(row, size, 1, file) != 1)
+    j->failed = true;
+}
+
+/**
+ * spill switches a hash join to partitions once its table would outgrow the
+ * memory budget, moving the rows read so far out to their partitions. The
+ * join fails if the partition files cannot all be created.
+ */
+static void spill(Join *j) {
+  uint32_t size = j->table.row_size;
+  size_t per_row = size + 3 * sizeof(uint32_t);
+  // Sized by the whole table, so each partition should fit in the budget
+  size_t total = (size_t)btree_row_count(j->db, j->inner.scan.table_index) *
+                 per_row;
+  size_t wanted = 2 * (total / (j->db->join_memory + 1) + 1);
+  j->num_partitions =
+      wanted > JOIN_MAX_PARTITIONS ? JOIN_MAX_PARTITIONS : (uint32_t)wanted;
+  for (uint32_t p = 0; p < j->num_partitions; p++) {
+    j->build_files[p] = tmpfile();
+    j->probe_files[p] = tmpfile();
+    j->failed |= j->build_files[p] == nullptr || j->probe_files[p] == nullptr;
+  }
+  if (j->failed)
+    return;
+  for (uint32_t i = 0; i < j->table.count; i++) {
+    const uint8_t *row = j->table.rows + (size_t)i * size;
+    spill_row(j, j->build_files[partition_of(j, join_key(&j->inner, row))],
+              row, size);
+  }
+  j->table.count = 0;
+}
+
+/**
+ * load_partition reads partition `p`'s build rows into the hash table. The
+ * join fails if they cannot all be read back.
+ */
+static void load_partition(Join *j, uint32_t p) {
+  HashTable *t = &j->table;
+  t->count = 0;
+  FILE *build = j->build_files[p];
+  uint8_t *row = j->out + j->inner.out_offset;
+  if (fseek(build, 0, SEEK_SET) != 0) {
+    j->failed = true;
+    return;
+  }
+  while (fread(row, t->row_size, 1, build) == 1)
+    table_add(t, row);
+  table_chain(t, &j->inner);
+  j->failed |= ferror(build) || fseek(j->probe_files[p], 0, SEEK_SET) != 0;
+  j->partition = p;
+}
+
+/** hash_build reads the build side, spilling both sides if it is too big. */
+static void hash_build(Join *j) {
+  HashTable *t = &j->table;
+  size_t per_row = t->row_size + 3 * sizeof(uint32_t);
+  uint8_t *row = j->out + j->inner.out_offset;
+  while (!j->failed && side_next(j, &j->inner)) {
+    if (j->num_partitions == 0 &&
+        (size_t)(t->count + 1) * per_row > j->db->join_memory)
+      spill(j);
+    if (j->num_partitions == 0)
+      table_add(t, row);
+    else
+      spill_row(j, j->build_files[partition_of(j, join_key(&j->inner, row))],
+                row, t->row_size);
+  }
+  if (j->num_partitions == 0) {
+    table_chain(t, &j->inner);
+    return;
+  }
+  uint32_t probe_size = j->outer.schema->row_size;
+  row = j->out + j->outer.out_offset;
+  while (!j->failed && side_next(j, &j->outer))
+    spill_row(j, j->probe_files[partition_of(j, join_key(&j->outer, row))],
+              row, probe_size);
+  // Buffered rows must reach the files before they are read back
+  for (uint32_t p = 0; p < j->num_partitions && !j->failed; p++)
+    j->failed = fflush(j->build_files[p]) != 0 ||
+                fflush(j->probe_files[p]) != 0;
+  if (!j->failed)
+    load_partition(j, 0);
+}
+
+/** next_probe_row reads the next probe row, partition after partition. */
+static bool next_probe_row(Join *j) {
+  if (j->num_partitions == 0)
+    return side_next(j, &j->outer);
+  uint8_t *row = j->out + j->outer.out_offset;
+  uint32_t size = j->outer.schema->row_size;
+  while (!j->failed) {
+    FILE *probe = j->probe_files[j->partition];
+    if (fread(row, size, 1, probe) == 1)
+      return true;
+    j->failed = ferror(probe);
+    if (j->failed || j->partition + 1 == j->num_partitions)
+      return false;
+    load_partition(j, j->partition + 1);
+  }
+  return false;
+}
+
+static const void *next_hashed(Join *j) {
+  HashTable *t = &j->table;
+  const uint8_t *probe = j->out + j->outer.out_offset;
+  while (true) {
+    while (j->match != NO_ENTRY) {
+      const uint8_t *row = t->rows + (size_t)j->match * t->row_size;
+      j->match = t->next[j->match];
+      if (!values_equal(j, probe, row))
+        continue;
+      memcpy(j->out + j->inner.out_offset, row, t->row_size);
+      if (predicate_matches(&j->statement->predicate, j->out))
+        return j->out;
+    }
+    if (!next_probe_row(j))
+      return nullptr;
+    j->match = t->buckets[mix(join_key(&j->outer, probe)) & t->mask];
+  }
+}
+
+static const void *next_probed(Join *j) {
+  Database *db = j->db;
+  const uint8_t *outer = j->out + j->outer.out_offset;
+  while (side_next(j, &j->outer)) {
+    const uint8_t *row = index_fetch_row(db, j->inner.scan.table_index,
+                                         join_key(&j->outer, outer), nullptr);
+    if (row == nullptr || !values_equal(j, outer, row)) {
+      unpin_page_all(db->pager);
+      continue;
+    }
+    memcpy(j->out + j->inner.out_offset, row, j->inner.schema->row_size);
+    unpin_page_all(db->pager);
+    if (predicate_matches(&j->statement->predicate, j->out))
+      return j->out;
+  }
+  return nullptr;
+}
+
+JoinMethod join_plan(const Statement *statement, Database *db,
+                     bool *inner_left) {
+  // Probing a primary key needs no memory; with keys on both sides, the
+  // larger table is probed. A hash table is built on the smaller one.
+  uint32_t left_rows = btree_row_count(db, statement->table_index);
+  uint32_t right_rows = btree_row_count(db, statement->join_table);
+  bool left_key = statement->join_left_field == 0;
+  bool right_key = statement->join_right_field == 0;
+  if (left_key || right_key) {
+    *inner_left = left_key && (!right_key || left_rows > right_rows);
+    return JOIN_INDEX_LOOP;
+  }
+  *inner_left = left_rows < right_rows;
+  return JOIN_HASH;
+}
+
+Join *join_open(Statement *statement, Database *db) {
+  Join *j = calloc(1, sizeof(Join));
+  j->statement = statement;
+  j->db = db;
+  j->match = NO_ENTRY;
+  uint32_t left = statement->table_index;
+  uint32_t right = statement->join_table;
+  const Schema *left_schema = &db->catalog.tables[left].schema;
+  j->out = malloc(left_schema->row_size +
+                  db->catalog.tables[right].schema.row_size);
+
+  bool inner_left;
+  j->method = join_plan(statement, db, &inner_left);
+  side_open(j, inner_left ? &j->inner : &j->outer, false);
+  side_open(j, inner_left ? &j->outer : &j->inner, true);
+
+  if (j->method == JOIN_HASH) {
+    j->table.row_size = j->inner.schema->row_size;
+    hash_build(j);
+  }
+  if (!statement->ordered) {
+    for (uint32_t i = 0; i < statement->offset; i++) {
+      if (join_next(j) == nullptr)
+        break;
+    }
+  }
+  return j;
+}
+
+const void *join_next(Join *join) {
+  return join->method == JOIN_HASH ? next_hashed(join) : next_probed(join);
+}
+
+JoinMethod join_method(const Join *join) { return join->method; }
+
+uint32_t join_partitions(const Join *join) { return join->num_partitions; }
+
+bool join_failed(const Join *join) { return join->failed; }
+
+void join_close(Join *join) {
+  if (join == nullptr)
+    return;
+  free(join->outer.cursor);
+  free(join->inner.cursor);
+  unpin_page_all(join->db->pager);
+  for (uint32_t p = 0; p < join->num_partitions; p++) {
+    if (join->build_files[p] != nullptr)
+      fclose(join->build_files[p]);
+    if (join->probe_files[p] != nullptr)
+      fclose(join->probe_files[p]);
+  }
+  free(join->table.rows);
+  free(join->table.next);
+  free(join->table.buckets);
+  free(join->out);
+  free(join);
+}
+
+Sorter *join_sorted(Statement *statement, Database *db) {
+  Schema schema;
+  join_schema(statement, db, &schema);
+  Sorter *sorter =
+      sorter_open(db, &schema, statement->order_field, statement->order_desc,
+                  statement->offset, statement->limit);
+  Join *join = join_open(statement, db);
+  const void *row;
+  while ((row = join_next(join)) != nullptr)
+    sorter_add(sorter, row);
+  if (join_failed(join))
+    sorter_fail(sorter);
+  join_close(join);
+  sorter_finish(sorter);
+  return sorter;
+}
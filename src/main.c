@@ -2,20 +2,65 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "btree.h"
 #include "database.h"
-#include "statement.h"
+#include "repl.h"
+#include "server.h"
 #include "os_portability.h"
 
 #define MAX_LINE_LEN 1024
 
+static void print_usage(const char *prog) {
+  printf("Usage: %s <database file> [-f <script> [--stop-on-error]]\n"
+         "       %s <database file> [--serve <socket path> [--workers N]]\n"
+         "--stop-on-error ends a script at its first failing statement; the\n"
+         "changes made before it are not undone.\n",
+         prog, prog);
+}
+
 int main(int argc, char *argv[]) {
-  if (argc < 2) {
+  const char *filename = nullptr;
+  const char *socket_path = nullptr;
+  uint32_t num_workers = SERVER_DEFAULT_WORKERS;
+  const char *script_path = nullptr;
+  bool stop_on_error = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      script_path = argv[++i];
+    } else if (strcmp(argv[i], "--stop-on-error") == 0) {
+      stop_on_error = true;
+    } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      num_workers = (uint32_t)atoi(argv[++i]);
+    } else if (argv[i][0] == '-') {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    } else {
+      filename = argv[i];
+    }
+  }
+
+  if (filename == nullptr) {
     printf("Must supply a database filename.\n");
     exit(EXIT_FAILURE);
   }
 
-  Database *db = db_open(argv[1]);
+  Database *db = db_open(filename);
+
+  if (socket_path != nullptr) {
+    int rc = server_run(db, socket_path, num_workers);
+    db_close(db);
+    return rc == 0 ? 0 : EXIT_FAILURE;
+  }
+
+  // A script runs on its own, with no prompt or line limit
+  if (script_path != nullptr) {
+    ReplResult result = repl_execute_script(db, script_path, stop_on_error);
+    db_close(db);
+    return result == REPL_ERROR ? EXIT_FAILURE : 0;
+  }
+
   char line[MAX_LINE_LEN];
 
   // Check if stdin is a terminal for raw mode
@@ -39,95 +84,8 @@ int main(int argc, char *argv[]) {
     if (len == 0) continue;
     if (is_tty) terminal_history_add(line);
 
-    // Meta-commands
-    if (line[0] == '.') {
-      if (strcmp(line, ".exit") == 0) {
-        break;
-      }
-      if (strcmp(line, ".tables") == 0 || strcmp(line, ".table") == 0) {
-        for (uint32_t i = 0; i < db->catalog.num_tables; i++) {
-          printf("%s (%u columns)\n", db->catalog.tables[i].name,
-                 db->catalog.tables[i].schema.num_fields);
-        }
-        continue;
-      }
-      if (strncmp(line, ".mode ", 6) == 0) {
-        char *mode = line + 6;
-        if (strcmp(mode, "box") == 0) {
-          db->print_mode = PRINT_BOX;
-        } else if (strcmp(mode, "plain") == 0) {
-          db->print_mode = PRINT_PLAIN;
-        } else {
-          printf("Unrecognized mode '%s'\n", mode);
-        }
-        continue;
-      }
-      if (strncmp(line, ".check ", 7) == 0) {
-        char *table_name = line + 7;
-        int idx = find_table(db, table_name);
-        if (idx == -1) {
-          printf("Error: Table not found.\n");
-        } else {
-          if (verify_btree(db, idx)) {
-            printf("B-Tree integrity: OK\n");
-          } else {
-            printf("B-Tree integrity: CORRUPT\n");
-          }
-        }
-        continue;
-      }
-      printf("Unrecognized meta-command '%s'\n", line);
-      continue;
-    }
-
-    Statement statement = {};
-    PrepareResult prepare_result = prepare_statement(line, &statement, db);
-
-    switch (prepare_result) {
-    case PREPARE_SUCCESS: {
-      ExecuteResult execute_result = execute_statement(&statement, db);
-      switch (execute_result) {
-      case EXECUTE_SUCCESS:
-        break;
-      case EXECUTE_TABLE_FULL:
-        printf("Error: Table full.\n");
-        break;
-      case EXECUTE_DUPLICATE_KEY:
-        printf("Error: Duplicate key.\n");
-        break;
-      case EXECUTE_KEY_NOT_FOUND:
-        printf("Error: Key not found.\n");
-        break;
-      case EXECUTE_UNKNOWN_ERROR:
-        printf("Unknown error.\n");
-        break;
-      }
-      break;
-    }
-    case PREPARE_SYNTAX_ERROR:
-      printf("Syntax error. Could not parse statement.\n");
-      break;
-    case PREPARE_UNRECOGNIZED_STATEMENT:
-      printf("Unrecognized keyword at start of '%s'.\n", line);
-      break;
-    case PREPARE_NO_SCHEMA:
-      printf("Error: No table created. Use CREATE TABLE first.\n");
+    if (repl_execute_line(db, line) == REPL_EXIT)
       break;
-    case PREPARE_NO_TABLE:
-      printf("Error: Table not found.\n");
-      break;
-    case PREPARE_TABLE_ALREADY_EXISTS:
-      printf("Error: Table already exists.\n");
-      break;
-    case PREPARE_CATALOG_FULL:
-      printf("Error: Catalog full. Cannot create more tables.\n");
-      break;
-    case PREPARE_STRING_TOO_LONG:
-      printf("Error: String value too long.\n");
-      break;
-    }
-
-    free_statement(&statement);
   }
 
   db_close(db);
@@ -7,6 +7,34 @@
 #include <termios.h>
 #include <unistd.h>
 #include <poll.h>
+#include <sys/mman.h>
+
+uint32_t os_cpu_count() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (uint32_t)n : 1;
+}
+
+const char *os_map_file(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return nullptr;
+  }
+  *size = (size_t)st.st_size;
+  // mmap() refuses a length of 0
+  void *data = *size > 0 ? mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0)
+                         : (void *)"";
+  close(fd);
+  return data == MAP_FAILED ? nullptr : data;
+}
+
+void os_unmap_file(const char *data, size_t size) {
+  if (size > 0)
+    munmap((void *)data, size);
+}
 
 #define MAX_HISTORY 100
 typedef struct {
@@ -145,6 +173,52 @@ int terminal_read_line(char *buf, size_t size) {
 }
 
 #else
+uint32_t os_cpu_count() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+const char *os_map_file(const char *path, size_t *size) {
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return nullptr;
+  LARGE_INTEGER length;
+  if (!GetFileSizeEx(file, &length)) {
+    CloseHandle(file);
+    return nullptr;
+  }
+  *size = (size_t)length.QuadPart;
+  if (*size == 0) {
+    CloseHandle(file);
+    return "";
+  }
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (mapping == nullptr)
+    return nullptr;
+  // The view keeps the mapping alive
+  const char *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  return data;
+}
+
+void os_unmap_file(const char *data, size_t size) {
+  if (size > 0)
+    UnmapViewOfFile(data);
+}
+
+int os_pread(int fd, void *buf, size_t count, int64_t offset) {
+  OVERLAPPED at = {.Offset = (DWORD)offset,
+                   .OffsetHigh = (DWORD)(offset >> 32)};
+  DWORD done = 0;
+  if (!ReadFile((HANDLE)_get_osfhandle(fd), buf, (DWORD)count, &done, &at))
+    return -1;
+  return (int)done;
+}
+
 // Windows stubs (or minimal implementation)
 void terminal_enable_raw_mode() {}
 void terminal_disable_raw_mode() {}
@@ -1,15 +1,27 @@
+#ifdef __linux__
+#define _GNU_SOURCE // pread
+#endif
+
 #include "pager.h"
 #include "os_portability.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdckdint.h>
 
 Pager *pager_open(const char *filename) {
-  int fd = open(filename, DB_OPEN_FLAGS, S_IWUSR | S_IRUSR);
-  if (fd == -1) {
+  Pager *p = pager_try_open(filename);
+  if (p == nullptr) {
     printf("Unable to open file\n");
     exit(EXIT_FAILURE);
   }
+  return p;
+}
+
+Pager *pager_try_open(const char *filename) {
+  int fd = open(filename, DB_OPEN_FLAGS, S_IWUSR | S_IRUSR);
+  if (fd == -1)
+    return nullptr;
   off_t len = lseek(fd, 0, SEEK_END);
   Pager *p = malloc(sizeof(Pager));
   p->file_descriptor = fd;
@@ -17,28 +29,53 @@ Pager *pager_open(const char *filename) {
   p->num_pages = len / PAGE_SIZE;
   p->num_pages_in_memory = 0;
   p->timer = 0;
+  p->fetches = 0;
+  p->reads = 0;
+  p->hits = 0;
+  p->evictions = 0;
+  p->writes = 0;
+  p->num_pinned = 0;
+  p->pinned_peak = 0;
   for (int i = 0; i < TABLE_MAX_PAGES; i++) {
     p->pages[i] = nullptr;
     p->last_used[i] = 0;
     p->is_dirty[i] = false;
     p->pinned[i] = 0;
+    p->held[i] = 0;
   }
   return p;
 }
 
-void pin_page(Pager *p, uint32_t pg) { p->pinned[pg]++; }
+void pin_page(Pager *p, uint32_t pg) {
+  if (p->pinned[pg]++ == 0 && ++p->num_pinned > p->pinned_peak)
+    p->pinned_peak = p->num_pinned;
+}
 
 void unpin_page(Pager *p, uint32_t pg) {
-  if (p->pinned[pg] > 0)
-    p->pinned[pg]--;
+  if (p->pinned[pg] > p->held[pg] && --p->pinned[pg] == 0)
+    p->num_pinned--;
 }
 
 void unpin_page_all(Pager *p) {
+  p->num_pinned = 0;
   for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    p->pinned[i] = 0;
+    p->pinned[i] = p->held[i];
+    p->num_pinned += p->held[i] > 0 ? 1 : 0;
   }
 }
 
+void pager_hold(Pager *p, uint32_t pg) {
+  pin_page(p, pg);
+  p->held[pg]++;
+}
+
+void pager_release(Pager *p, uint32_t pg) {
+  if (p->held[pg] == 0)
+    return;
+  p->held[pg]--;
+  unpin_page(p, pg);
+}
+
 void pager_flush(Pager *p, uint32_t pg) {
   if (p->pages[pg] && p->is_dirty[pg]) {
     uint64_t offset;
@@ -49,13 +86,21 @@ void pager_flush(Pager *p, uint32_t pg) {
     lseek(p->file_descriptor, (off_t)offset, SEEK_SET);
     write(p->file_descriptor, p->pages[pg], PAGE_SIZE);
     p->is_dirty[pg] = false;
+    p->writes++;
   }
 }
 
 void mark_page_dirty(Pager *p, uint32_t pg) { p->is_dirty[pg] = true; }
 
 void *get_page(Pager *p, uint32_t pg) {
+  if (pg >= TABLE_MAX_PAGES) {
+    printf("Tried to fetch page number out of bounds. %u >= %d\n", pg,
+           TABLE_MAX_PAGES);
+    exit(EXIT_FAILURE);
+  }
+  TRACE_BEGIN(span, TRACE_GET_PAGE);
   p->timer++;
+  p->fetches++;
   if (p->pages[pg] == nullptr) {
     // Evict a page if the buffer pool is full
     if (p->num_pages_in_memory >= MAX_PAGES_IN_MEMORY) {
@@ -79,6 +124,7 @@ void *get_page(Pager *p, uint32_t pg) {
       free(p->pages[victim]);
       p->pages[victim] = nullptr;
       p->num_pages_in_memory--;
+      p->evictions++;
     }
 
     void *page = malloc(PAGE_SIZE);
@@ -90,18 +136,37 @@ void *get_page(Pager *p, uint32_t pg) {
       }
       lseek(p->file_descriptor, (off_t)offset, SEEK_SET);
       read(p->file_descriptor, page, PAGE_SIZE);
+      p->reads++;
     }
     p->pages[pg] = page;
     p->is_dirty[pg] = false;
     p->num_pages_in_memory++;
     if (pg >= p->num_pages)
       p->num_pages = pg + 1;
+  } else {
+    p->hits++;
   }
   p->last_used[pg] = p->timer;
   pin_page(p, pg);
+  TRACE_END(span);
   return p->pages[pg];
 }
 
+void *pager_peek(Pager *p, uint32_t pg, void *buffer) {
+  if (pg >= TABLE_MAX_PAGES) {
+    printf("Tried to fetch page number out of bounds. %u >= %d\n", pg,
+           TABLE_MAX_PAGES);
+    exit(EXIT_FAILURE);
+  }
+  if (p->pages[pg] != nullptr)
+    return p->pages[pg];
+  // Evicted pages were flushed first, so the file has their latest contents
+  if (pread(p->file_descriptor, buffer, PAGE_SIZE, (off_t)pg * PAGE_SIZE) !=
+      PAGE_SIZE)
+    return nullptr;
+  return buffer;
+}
+
 void pager_close(Pager *p) {
   for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
     if (p->pages[i]) {
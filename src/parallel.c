@@ -0,0 +1,258 @@
+#include "parallel.h"
+#include "btree.h"
+#include <stdlib.h>
+#include <threads.h>
+
+/** A worker's run of tasks: it pops from `front`, thieves from `back`. */
+typedef struct {
+  mtx_t lock;
+  uint32_t front;
+  uint32_t back; // One past the last task left
+} TaskRun;
+
+struct ParallelScan {
+  Statement *statement;
+  Database *db;
+  uint32_t num_threads;
+  uint32_t num_tasks;
+  uint32_t *first_leaf; // Per task; the next task's is where it stops
+  TaskRun runs[PARALLEL_MAX_THREADS];
+  // Set by parallel_scan_run
+  uint32_t columns;
+  ParallelConsumer consume;
+  void *arg;
+  mtx_t steal_lock;
+  uint32_t steals;
+  // Rows and file reads of finished tasks, under steal_lock
+  uint64_t rows;
+  uint64_t reads;
+  bool failed; // A task could not read a leaf, under steal_lock
+};
+
+typedef struct {
+  ParallelScan *scan;
+  uint32_t worker;
+} Worker;
+
+/**
+ * split_tree lists the subtrees of a table's B-Tree that make up the tasks,
+ * expanding a level of internal nodes at a time. Returns their root pages,
+ * in key order.
+ */
+static uint32_t *split_tree(Database *db, uint32_t tree, uint32_t wanted,
+                            uint32_t *count) {
+  uint32_t *nodes = malloc(sizeof(uint32_t));
+  nodes[0] = tree_root_page(db, tree);
+  *count = 1;
+  while (*count < wanted) {
+    // The tree is balanced, so every node on a level has the same type
+    if (get_node_type(get_page(db->pager, nodes[0])) == NODE_LEAF)
+      break;
+    uint32_t children = 0;
+    for (uint32_t i = 0; i < *count; i++) {
+      children += *internal_node_num_keys(get_page(db->pager, nodes[i])) + 1;
+      unpin_page(db->pager, nodes[i]);
+    }
+    uint32_t *level = malloc(children * sizeof(uint32_t));
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < *count; i++) {
+      void *node = get_page(db->pager, nodes[i]);
+      uint32_t num_keys = *internal_node_num_keys(node);
+      for (uint32_t k = 0; k <= num_keys; k++)
+        level[n++] = *internal_node_child(node, k);
+      unpin_page(db->pager, nodes[i]);
+    }
+    free(nodes);
+    nodes = level;
+    *count = children;
+  }
+  unpin_page_all(db->pager);
+  return nodes;
+}
+
+/** leftmost_leaf follows first children down to the subtree's first leaf. */
+static uint32_t leftmost_leaf(Database *db, uint32_t page) {
+  void *node = get_page(db->pager, page);
+  while (get_node_type(node) == NODE_INTERNAL) {
+    page = *internal_node_child(node, 0);
+    node = get_page(db->pager, page);
+  }
+  unpin_page_all(db->pager);
+  return page;
+}
+
+ParallelScan *parallel_scan_open(Statement *statement, Database *db,
+                                 uint32_t num_threads) {
+  const KeyRange *range = &statement->key_range;
+  if (num_threads < 2 || range->has_lower || range->has_upper ||
+      statement->table_index >= INDEX_TREE_BASE)
+    return nullptr;
+  uint32_t rows = btree_row_count(db, statement->table_index);
+  unpin_page_all(db->pager);
+  if (rows < PARALLEL_MIN_ROWS)
+    return nullptr;
+  if (num_threads > PARALLEL_MAX_THREADS)
+    num_threads = PARALLEL_MAX_THREADS;
+
+  uint32_t wanted = num_threads * PARALLEL_TASKS_PER_THREAD;
+  uint32_t num_subtrees;
+  uint32_t *first_leaf =
+      split_tree(db, statement->table_index, wanted, &num_subtrees);
+  if (num_subtrees < 2) {
+    free(first_leaf);
+    return nullptr;
+  }
+  // A level can hold far more subtrees than wanted; neighbours share a task
+  uint32_t num_tasks = num_subtrees < wanted ? num_subtrees : wanted;
+  for (uint32_t t = 0; t < num_tasks; t++) {
+    uint32_t subtree = (uint32_t)((uint64_t)num_subtrees * t / num_tasks);
+    first_leaf[t] = leftmost_leaf(db, first_leaf[subtree]);
+  }
+
+  ParallelScan *scan = malloc(sizeof(ParallelScan));
+  scan->statement = statement;
+  scan->db = db;
+  scan->num_threads = num_threads < num_tasks ? num_threads : num_tasks;
+  scan->num_tasks = num_tasks;
+  scan->first_leaf = first_leaf;
+  scan->steals = 0;
+  for (uint32_t w = 0; w < scan->num_threads; w++)
+    mtx_init(&scan->runs[w].lock, mtx_plain);
+  mtx_init(&scan->steal_lock, mtx_plain);
+  return scan;
+}
+
+uint32_t parallel_scan_tasks(const ParallelScan *scan) {
+  return scan->num_tasks;
+}
+
+uint32_t parallel_scan_threads(const ParallelScan *scan) {
+  return scan->num_threads;
+}
+
+uint32_t parallel_scan_steals(const ParallelScan *scan) {
+  return scan->steals;
+}
+
+/** take_own pops the next task of a worker's own run, or UINT32_MAX. */
+static uint32_t take_own(TaskRun *run) {
+  mtx_lock(&run->lock);
+  uint32_t task = run->front < run->back ? run->front++ : UINT32_MAX;
+  mtx_unlock(&run->lock);
+  return task;
+}
+
+/**
+ * steal takes the last task of the run with the most left, or returns
+ * UINT32_MAX once every run is empty. Sizes are read unlocked to pick the
+ * victim and checked again under its lock.
+ */
+static uint32_t steal(ParallelScan *scan, uint32_t thief) {
+  for (;;) {
+    uint32_t victim = UINT32_MAX;
+    uint32_t most = 0;
+    for (uint32_t w = 0; w < scan->num_threads; w++) {
+      TaskRun *run = &scan->runs[w];
+      mtx_lock(&run->lock);
+      uint32_t left = run->back - run->front;
+      mtx_unlock(&run->lock);
+      if (w != thief && left > most) {
+        most = left;
+        victim = w;
+      }
+    }
+    if (victim == UINT32_MAX)
+      return UINT32_MAX;
+    TaskRun *run = &scan->runs[victim];
+    mtx_lock(&run->lock);
+    uint32_t task = run->front < run->back ? --run->back : UINT32_MAX;
+    mtx_unlock(&run->lock);
+    if (task != UINT32_MAX) {
+      mtx_lock(&scan->steal_lock);
+      scan->steals++;
+      mtx_unlock(&scan->steal_lock);
+      return task;
+    }
+  }
+}
+
+static void run_task(ParallelScan *scan, uint32_t worker, uint32_t task) {
+  uint32_t end = task + 1 < scan->num_tasks ? scan->first_leaf[task + 1] : 0;
+  BatchScan *batches =
+      batch_scan_leaves(scan->statement, scan->db, scan->first_leaf[task],
+                        end, scan->columns);
+  RowBatch *batch;
+  uint64_t rows = 0;
+  while ((batch = batch_scan_next(batches)) != nullptr) {
+    rows += batch->count;
+    scan->consume(scan->arg, worker, task, batch);
+  }
+  mtx_lock(&scan->steal_lock);
+  scan->rows += rows;
+  scan->reads += batch_scan_reads(batches);
+  scan->failed |= batch_scan_failed(batches);
+  mtx_unlock(&scan->steal_lock);
+  batch_scan_close(batches);
+}
+
+/** stopped tells whether a task has failed, so no more need to run. */
+static bool stopped(ParallelScan *scan) {
+  mtx_lock(&scan->steal_lock);
+  bool failed = scan->failed;
+  mtx_unlock(&scan->steal_lock);
+  return failed;
+}
+
+static int work(void *arg) {
+  Worker *worker = arg;
+  ParallelScan *scan = worker->scan;
+  uint32_t task;
+  while (!stopped(scan) &&
+         (task = take_own(&scan->runs[worker->worker])) != UINT32_MAX)
+    run_task(scan, worker->worker, task);
+  while (!stopped(scan) && (task = steal(scan, worker->worker)) != UINT32_MAX)
+    run_task(scan, worker->worker, task);
+  return 0;
+}
+
+bool parallel_scan_run(ParallelScan *scan, uint32_t columns,
+                       ParallelConsumer consume, void *arg) {
+  scan->columns = columns;
+  scan->consume = consume;
+  scan->arg = arg;
+  scan->steals = 0;
+  scan->rows = 0;
+  scan->reads = 0;
+  scan->failed = false;
+  uint32_t threads = scan->num_threads;
+  for (uint32_t w = 0; w < threads; w++) {
+    scan->runs[w].front = (uint32_t)((uint64_t)scan->num_tasks * w / threads);
+    scan->runs[w].back =
+        (uint32_t)((uint64_t)scan->num_tasks * (w + 1) / threads);
+  }
+
+  Worker workers[PARALLEL_MAX_THREADS];
+  thrd_t ids[PARALLEL_MAX_THREADS];
+  uint32_t started = 1;
+  for (uint32_t w = 0; w < threads; w++)
+    workers[w] = (Worker){.scan = scan, .worker = w};
+  // A thread that fails to start leaves its run to be stolen
+  for (uint32_t w = 1; w < threads; w++) {
+    if (thrd_create(&ids[started], work, &workers[w]) == thrd_success)
+      started++;
+  }
+  work(&workers[0]);
+  for (uint32_t i = 1; i < started; i++)
+    thrd_join(ids[i], nullptr);
+  scan->db->rows_scanned += scan->rows;
+  scan->db->pager->reads += scan->reads;
+  return !scan->failed;
+}
+
+void parallel_scan_close(ParallelScan *scan) {
+  for (uint32_t w = 0; w < scan->num_threads; w++)
+    mtx_destroy(&scan->runs[w].lock);
+  mtx_destroy(&scan->steal_lock);
+  free(scan->first_leaf);
+  free(scan);
+}
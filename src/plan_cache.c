@@ -0,0 +1,175 @@
+#include "plan_cache.h"
+#include "schema.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+PlanCache *plan_cache_create() { return calloc(1, sizeof(PlanCache)); }
+
+void plan_cache_free(PlanCache *cache) { free(cache); }
+
+void plan_cache_clear(PlanCache *cache) {
+  for (uint32_t i = 0; i < PLAN_CACHE_SLOTS; i++)
+    cache->entries[i].valid = false;
+  cache->last_hit = nullptr;
+  cache->stats = (PlanCacheStats){};
+}
+
+static PrepareResult timed_prepare(PlanCache *cache, char *line,
+                                   Statement *statement, Database *db) {
+  uint64_t start = now_ns();
+  PrepareResult result = prepare_statement(line, statement, db);
+  cache->stats.parse_ns += now_ns() - start;
+  cache->stats.parses++;
+  return result;
+}
+
+/**
+ * is_cacheable decides whether a plan prepared from normalized text `sql` can
+ * serve every line that matches it: each literal must have become a parameter,
+ * and every '?' in the text must be one of them, because match_normalized()
+ * reads any '?' as a literal.
+ */
+static bool is_cacheable(const Statement *plan, const char *sql,
+                         uint32_t num_literals) {
+  if (plan->type != STATEMENT_INSERT && plan->type != STATEMENT_SELECT &&
+      plan->type != STATEMENT_UPDATE && plan->type != STATEMENT_DELETE)
+    return false;
+  uint32_t markers = 0;
+  for (const char *c = sql; *c; c++)
+    markers += *c == '?';
+  return plan->num_params == num_literals && markers == num_literals;
+}
+
+/**
+ * bind_literals copies the plan into `statement` and binds each literal to the
+ * parameter it was replaced by.
+ */
+static PrepareResult bind_literals(Database *db, PlanCacheEntry *entry,
+                                   Token *literals, uint32_t num_literals,
+                                   Statement *statement) {
+  statement_copy(statement, &entry->plan);
+  for (uint32_t i = 0; i < num_literals; i++) {
+    PrepareResult result =
+        bind_parameter_token(statement, db, i, literals[i]);
+    if (result != PREPARE_SUCCESS)
+      return result;
+  }
+  // Every placeholder now holds one of the line's literals
+  statement->num_params = 0;
+  return PREPARE_SUCCESS;
+}
+
+/**
+ * prefix_hash picks the slot for a line: it hashes the text before the first
+ * literal, which a line and its normalized form have in common. Digits, signs
+ * and quotes may start a literal; '?' marks one in normalized text.
+ */
+static uint32_t prefix_hash(const char *text) {
+  uint32_t hash = 5381;
+  for (const char *c = text; *c; c++) {
+    if (*c == '\'' || *c == '?' || *c == '+' || *c == '-' ||
+        (*c >= '0' && *c <= '9'))
+      break;
+    hash = ((hash << 5) + hash) + *c;
+  }
+  return hash;
+}
+
+static bool match_entry(Database *db, PlanCacheEntry *entry, const char *line,
+                        Token *literals, uint32_t *num_literals) {
+  return entry->valid && entry->schema_version == db->schema_version &&
+         match_normalized(line, entry->sql, literals, MAX_PARAMS,
+                          num_literals);
+}
+
+PrepareResult plan_cache_prepare(Database *db, char *line,
+                                 Statement *statement) {
+  PlanCache *cache = db->plan_cache;
+  Token literals[MAX_PARAMS];
+  uint32_t num_literals;
+
+  // Only a sample of hits is timed; reading the clock costs about as much as
+  // a hit itself
+  bool timed = (cache->stats.hits & (PLAN_CACHE_TIMING_SAMPLE - 1)) == 0;
+  uint64_t start = timed ? now_ns() : 0;
+
+  // Scripts tend to repeat one shape, so try the last hit before hashing
+  PlanCacheEntry *entry = cache->last_hit;
+  if (entry == nullptr ||
+      !match_entry(db, entry, line, literals, &num_literals)) {
+    entry = &cache->entries[prefix_hash(line) % PLAN_CACHE_SLOTS];
+    if (!match_entry(db, entry, line, literals, &num_literals))
+      entry = nullptr;
+  }
+  if (entry != nullptr) {
+    cache->last_hit = entry;
+    PrepareResult result =
+        bind_literals(db, entry, literals, num_literals, statement);
+    cache->stats.hits++;
+    if (timed) {
+      cache->stats.sampled_hit_ns += now_ns() - start;
+      cache->stats.sampled_hits++;
+    }
+    return result;
+  }
+
+  // Prepare the normalized text. It only becomes a plan if every literal
+  // turned into a parameter; otherwise the line is parsed as written.
+  entry = &cache->entries[prefix_hash(line) % PLAN_CACHE_SLOTS];
+  char sql[PLAN_CACHE_SQL_MAX];
+  Statement plan = {};
+  if (!normalize_statement(line, sql, sizeof(sql), literals, MAX_PARAMS,
+                           &num_literals) ||
+      timed_prepare(cache, sql, &plan, db) != PREPARE_SUCCESS ||
+      !is_cacheable(&plan, sql, num_literals)) {
+    cache->stats.uncacheable++;
+    return timed_prepare(cache, line, statement, db);
+  }
+
+  cache->stats.misses++;
+  entry->valid = true;
+  entry->schema_version = db->schema_version;
+  memcpy(entry->sql, sql, sizeof(sql));
+  statement_copy(&entry->plan, &plan);
+  return bind_literals(db, entry, literals, num_literals, statement);
+}
+
+void plan_cache_print_stats(Database *db) {
+  PlanCache *cache = db->plan_cache;
+  PlanCacheStats *s = &cache->stats;
+  uint32_t cached = 0;
+  for (uint32_t i = 0; i < PLAN_CACHE_SLOTS; i++) {
+    if (cache->entries[i].valid &&
+        cache->entries[i].schema_version == db->schema_version)
+      cached++;
+  }
+
+  uint64_t lookups = s->hits + s->misses + s->uncacheable;
+  double ratio = lookups ? 100.0 * (double)s->hits / (double)lookups : 0;
+  double parse_avg = s->parses ? (double)s->parse_ns / (double)s->parses : 0;
+  double hit_avg = s->sampled_hits ? (double)s->sampled_hit_ns /
+                                       (double)s->sampled_hits
+                                 : 0;
+  double saved_ms = (double)s->hits * (parse_avg - hit_avg) / 1e6;
+
+  fprintf(db->out, "Plan cache: %u of %u slots in use\n", cached,
+          PLAN_CACHE_SLOTS);
+  fprintf(db->out,
+          "  Lookups: %llu (%llu hits, %llu misses, %llu uncacheable), "
+          "hit ratio %.1f%%\n",
+          (unsigned long long)lookups, (unsigned long long)s->hits,
+          (unsigned long long)s->misses, (unsigned long long)s->uncacheable,
+          ratio);
+  fprintf(db->out,
+          "  Parse time saved: %.3f ms (parse %.0f ns vs. hit %.0f ns per "
+          "statement)\n",
+          saved_ms, parse_avg, hit_avg);
+}
@@ -0,0 +1,567 @@
+#include "repl.h"
+#include "btree.h"
+#include "database.h"
+#include "import.h"
+#include "index.h"
+#include "plan_cache.h"
+#include "statement.h"
+#include "trace.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** import_command runs `.import FILE TABLE`; the table name comes last. */
+static ReplResult import_command(Database *db, char *args) {
+  char *space = strrchr(args, ' ');
+  if (space == nullptr || space == args) {
+    fprintf(db->out, "Usage: .import FILE TABLE\n");
+    return REPL_ERROR;
+  }
+  *space = '\0';
+  int table = find_table(db, space + 1);
+  if (table == -1) {
+    fprintf(db->out, "Error: Table not found.\n");
+    return REPL_ERROR;
+  }
+  ImportStats stats;
+  switch (import_csv(db, (uint32_t)table, args, db->scan_threads, &stats)) {
+  case IMPORT_SUCCESS:
+    fprintf(db->out, "Imported %" PRIu64 " rows", stats.rows);
+    if (stats.duplicates > 0)
+      fprintf(db->out, ", skipped %" PRIu64 " duplicate keys",
+              stats.duplicates);
+    fprintf(db->out, ".\n");
+    return REPL_CONTINUE;
+  case IMPORT_CANNOT_OPEN:
+    fprintf(db->out, "Error: Cannot open '%s'.\n", args);
+    break;
+  case IMPORT_COLUMN_COUNT:
+    fprintf(db->out, "Error: Record %" PRIu64 ": wrong number of columns.\n",
+            stats.record);
+    break;
+  case IMPORT_NOT_A_NUMBER:
+    fprintf(db->out, "Error: Record %" PRIu64 ": INT value is not a number.\n",
+            stats.record);
+    break;
+  case IMPORT_STRING_TOO_LONG:
+    fprintf(db->out, "Error: Record %" PRIu64 ": String value too long.\n",
+            stats.record);
+    break;
+  case IMPORT_BAD_QUOTE:
+    fprintf(db->out, "Error: Record %" PRIu64 ": malformed quoted field.\n",
+            stats.record);
+    break;
+  case IMPORT_TABLE_FULL:
+    fprintf(db->out, "Error: Table full after %" PRIu64 " rows.\n",
+            stats.rows);
+    break;
+  }
+  return REPL_ERROR;
+}
+
+/** print_stats prints the counters of `.stats`, or a statement's share. */
+static void print_stats(Database *db, const DbStats *s) {
+  fprintf(db->out,
+          "Page fetches:  %" PRIu64 " (%" PRIu64 " hits, %" PRIu64
+          " misses)\n",
+          s->fetches, s->hits, s->fetches - s->hits);
+  fprintf(db->out, "Pages read:    %" PRIu64 " (%" PRIu64 " bytes)\n",
+          s->reads, s->reads * PAGE_SIZE);
+  fprintf(db->out, "Pages written: %" PRIu64 " (%" PRIu64 " bytes)\n",
+          s->writes, s->writes * PAGE_SIZE);
+  fprintf(db->out, "Evictions:     %" PRIu64 "\n", s->evictions);
+  fprintf(db->out, "Pages pinned:  %u at most\n", s->pinned_peak);
+  fprintf(db->out, "Node splits:   %" PRIu64 "\n", s->splits);
+  fprintf(db->out, "Rows scanned:  %" PRIu64 "\n", s->rows_scanned);
+}
+
+/** on_off parses the argument of `.timer` and `.stats on|off`. */
+static bool on_off(Database *db, const char *arg, bool *flag) {
+  if (strcmp(arg, "on") == 0) {
+    *flag = true;
+  } else if (strcmp(arg, "off") == 0) {
+    *flag = false;
+  } else {
+    fprintf(db->out, "Expected 'on' or 'off', not '%s'\n", arg);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * trace_command runs `.trace FILE [EVERY]`, which starts recording spans
+ * sampled one call in EVERY, and `.trace off`, which writes them to FILE.
+ */
+static ReplResult trace_command(Database *db, char *args) {
+#ifndef SIMPLEDB_TRACING
+  (void)args;
+  fprintf(db->out,
+          "Error: Tracing is not built in (meson configure -Dtracing=true).\n");
+  return REPL_ERROR;
+#else
+  if (strcmp(args, "off") == 0) {
+    uint32_t written, dropped;
+    if (!trace_stop(&written, &dropped)) {
+      fprintf(db->out, "Error: Not tracing.\n");
+      return REPL_ERROR;
+    }
+    fprintf(db->out, "Trace: %u spans written, %u dropped.\n", written,
+            dropped);
+    return REPL_CONTINUE;
+  }
+  uint32_t every = TRACE_SAMPLE_DEFAULT;
+  char *space = strrchr(args, ' ');
+  if (space != nullptr && space[1] >= '0' && space[1] <= '9') {
+    every = (uint32_t)strtoul(space + 1, nullptr, 10);
+    *space = '\0';
+  }
+  if (!trace_start(args, every)) {
+    fprintf(db->out, "Error: Cannot write '%s'.\n", args);
+    return REPL_ERROR;
+  }
+  return REPL_CONTINUE;
+#endif
+}
+
+static ReplResult do_meta_command(Database *db, char *line) {
+  if (strcmp(line, ".exit") == 0) {
+    return REPL_EXIT;
+  }
+  if (strcmp(line, ".tables") == 0 || strcmp(line, ".table") == 0) {
+    for (uint32_t i = 0; i < db->catalog.num_tables; i++) {
+      fprintf(db->out, "%s (%u columns)\n", db->catalog.tables[i].name,
+              db->catalog.tables[i].schema.num_fields);
+    }
+    return REPL_CONTINUE;
+  }
+  if (strcmp(line, ".indexes") == 0) {
+    for (uint32_t i = 0; i < db->catalog.num_indexes; i++) {
+      IndexDefinition *idx = &db->catalog.indexes[i];
+      TableDefinition *td = &db->catalog.tables[idx->table_index];
+      fprintf(db->out, "%s ON %s(%s)\n", idx->name, td->name,
+              td->schema.fields[idx->field_index].name);
+    }
+    return REPL_CONTINUE;
+  }
+  if (strncmp(line, ".mode ", 6) == 0) {
+    char *mode = line + 6;
+    if (strcmp(mode, "box") == 0) {
+      db->print_mode = PRINT_BOX;
+    } else if (strcmp(mode, "plain") == 0) {
+      db->print_mode = PRINT_PLAIN;
+    } else if (strcmp(mode, "csv") == 0) {
+      db->print_mode = PRINT_CSV;
+    } else if (strcmp(mode, "tsv") == 0) {
+      db->print_mode = PRINT_TSV;
+    } else if (strcmp(mode, "binary") == 0) {
+      db->print_mode = PRINT_BINARY;
+    } else {
+      fprintf(db->out, "Unrecognized mode '%s'\n", mode);
+      return REPL_ERROR;
+    }
+    return REPL_CONTINUE;
+  }
+  if (strncmp(line, ".check ", 7) == 0) {
+    char *table_name = line + 7;
+    int idx = find_table(db, table_name);
+    if (idx == -1) {
+      fprintf(db->out, "Error: Table not found.\n");
+      return REPL_ERROR;
+    }
+    // A table's indexes are checked along with it
+    if (verify_btree(db, idx) && verify_indexes(db, idx)) {
+      fprintf(db->out, "B-Tree integrity: OK\n");
+      return REPL_CONTINUE;
+    }
+    fprintf(db->out, "B-Tree integrity: CORRUPT\n");
+    return REPL_ERROR;
+  }
+  if (strncmp(line, ".import ", 8) == 0)
+    return import_command(db, line + 8);
+  if (strncmp(line, ".read ", 6) == 0)
+    return repl_execute_script(db, line + 6, false);
+  if (strncmp(line, ".trace ", 7) == 0)
+    return trace_command(db, line + 7);
+  if (strncmp(line, ".timer ", 7) == 0)
+    return on_off(db, line + 7, &db->show_timer) ? REPL_CONTINUE : REPL_ERROR;
+  if (strcmp(line, ".stats") == 0) {
+    DbStats stats = db_stats(db);
+    print_stats(db, &stats);
+    return REPL_CONTINUE;
+  }
+  if (strcmp(line, ".stats reset") == 0) {
+    db_reset_stats(db);
+    return REPL_CONTINUE;
+  }
+  if (strncmp(line, ".stats ", 7) == 0)
+    return on_off(db, line + 7, &db->show_stats) ? REPL_CONTINUE : REPL_ERROR;
+  if (strcmp(line, ".cache") == 0) {
+    plan_cache_print_stats(db);
+    return REPL_CONTINUE;
+  }
+  if (strcmp(line, ".cache clear") == 0) {
+    plan_cache_clear(db->plan_cache);
+    return REPL_CONTINUE;
+  }
+  fprintf(db->out, "Unrecognized meta-command '%s'\n", line);
+  return REPL_ERROR;
+}
+
+static void print_statement_status(Database *db, Statement *statement) {
+  switch (statement->type) {
+  case STATEMENT_CREATE_INDEX:
+    fprintf(db->out, "Index created.\n");
+    break;
+  case STATEMENT_DELETE:
+    fprintf(db->out, "Deleted.\n");
+    break;
+  case STATEMENT_UPDATE:
+    fprintf(db->out, "Updated.\n");
+    break;
+  case STATEMENT_ANALYZE:
+    fprintf(db->out, "Analyzed.\n");
+    break;
+  case STATEMENT_BEGIN:
+    fprintf(db->out, "Transaction started.\n");
+    break;
+  case STATEMENT_COMMIT:
+    fprintf(db->out, "Transaction committed.\n");
+    break;
+  case STATEMENT_ROLLBACK:
+    fprintf(db->out,
+            "Rollback requested. Note: ROLLBACK is currently not supported in "
+            "this educational version. Every statement is auto-committed.\n");
+    break;
+  default:
+    break;
+  }
+}
+
+static ReplResult execute_sql(Database *db, char *line) {
+  Statement statement = {};
+  PrepareResult prepare_result = plan_cache_prepare(db, line, &statement);
+  if (prepare_result == PREPARE_SUCCESS && statement.num_params > 0) {
+    // There is nothing to bind '?' to when typing SQL directly
+    prepare_result = PREPARE_PARAMETER_OUT_OF_RANGE;
+  }
+
+  ReplResult result = REPL_ERROR;
+  switch (prepare_result) {
+  case PREPARE_SUCCESS: {
+    ExecuteResult execute_result = execute_statement(&statement, db);
+    switch (execute_result) {
+    case EXECUTE_SUCCESS:
+      print_statement_status(db, &statement);
+      result = REPL_CONTINUE;
+      break;
+    case EXECUTE_TABLE_FULL:
+      fprintf(db->out, "Error: Table full.\n");
+      break;
+    case EXECUTE_DUPLICATE_KEY:
+      fprintf(db->out, "Error: Duplicate key.\n");
+      break;
+    case EXECUTE_KEY_NOT_FOUND:
+      fprintf(db->out, "Error: Key not found.\n");
+      break;
+    case EXECUTE_IO_ERROR:
+      fprintf(db->out, "Error: I/O error.\n");
+      break;
+    case EXECUTE_UNKNOWN_ERROR:
+      fprintf(db->out, "Unknown error.\n");
+      break;
+    }
+    break;
+  }
+  case PREPARE_SYNTAX_ERROR:
+    fprintf(db->out, "Syntax error. Could not parse statement.\n");
+    break;
+  case PREPARE_UNRECOGNIZED_STATEMENT:
+    fprintf(db->out, "Unrecognized keyword at start of '%s'.\n", line);
+    break;
+  case PREPARE_NO_SCHEMA:
+    fprintf(db->out, "Error: No table created. Use CREATE TABLE first.\n");
+    break;
+  case PREPARE_NO_TABLE:
+    fprintf(db->out, "Error: Table not found.\n");
+    break;
+  case PREPARE_TABLE_ALREADY_EXISTS:
+    fprintf(db->out, "Error: Table already exists.\n");
+    break;
+  case PREPARE_CATALOG_FULL:
+    fprintf(db->out, "Error: Catalog full. Cannot create more tables.\n");
+    break;
+  case PREPARE_STRING_TOO_LONG:
+    fprintf(db->out, "Error: String value too long.\n");
+    break;
+  case PREPARE_PARAMETER_OUT_OF_RANGE:
+    fprintf(db->out, "Error: Parameters ('?') can only be bound through the "
+                     "library API.\n");
+    break;
+  case PREPARE_NO_COLUMN:
+    fprintf(db->out, "Error: Column not found.\n");
+    break;
+  case PREPARE_INDEX_ALREADY_EXISTS:
+    fprintf(db->out, "Error: Index already exists.\n");
+    break;
+  case PREPARE_INDEX_CATALOG_FULL:
+    fprintf(db->out, "Error: Catalog full. Cannot create more indexes.\n");
+    break;
+  case PREPARE_AGGREGATE_NOT_INT:
+    fprintf(db->out, "Error: SUM, MIN, MAX and AVG need an INT column.\n");
+    break;
+  case PREPARE_NOT_GROUPED:
+    fprintf(db->out, "Error: Column must be aggregated or in GROUP BY.\n");
+    break;
+  case PREPARE_JOIN_TYPE_MISMATCH:
+    fprintf(db->out, "Error: Join columns must have the same type.\n");
+    break;
+  case PREPARE_EXPLAIN_NOT_SELECT:
+    fprintf(db->out, "Error: EXPLAIN only applies to SELECT.\n");
+    break;
+  }
+
+  free_statement(&statement);
+  return result;
+}
+
+static double seconds(const struct timespec *ts) {
+  return (double)ts->tv_sec + (double)ts->tv_nsec / 1e9;
+}
+
+/**
+ * execute_measured runs a statement under `.timer on` or `.stats on` and
+ * reports what it cost: wall-clock and CPU time, the latter including any
+ * scan threads, and the counters it moved.
+ */
+static ReplResult execute_measured(Database *db, char *line) {
+  DbStats before = db_stats(db);
+  // Peak pins are per statement; the running peak is put back afterwards
+  uint32_t peak = db->pager->pinned_peak;
+  db->pager->pinned_peak = db->pager->num_pinned;
+  struct timespec wall_start, wall_end;
+  timespec_get(&wall_start, TIME_UTC);
+  clock_t cpu_start = clock();
+
+  ReplResult result = execute_sql(db, line);
+
+  clock_t cpu_end = clock();
+  timespec_get(&wall_end, TIME_UTC);
+  DbStats delta = db_stats_since(db, &before);
+  if (delta.pinned_peak < peak)
+    db->pager->pinned_peak = peak;
+
+  if (db->show_timer)
+    fprintf(db->out, "Run Time: real %.6f cpu %.6f\n",
+            seconds(&wall_end) - seconds(&wall_start),
+            (double)(cpu_end - cpu_start) / CLOCKS_PER_SEC);
+  if (db->show_stats)
+    print_stats(db, &delta);
+  return result;
+}
+
+ReplResult repl_execute_line(Database *db, char *line) {
+  if (line[0] == '\0')
+    return REPL_CONTINUE;
+
+  // Meta-commands
+  if (line[0] == '.')
+    return do_meta_command(db, line);
+  if (db->show_timer || db->show_stats)
+    return execute_measured(db, line);
+  return execute_sql(db, line);
+}
+
+/** A script being read a chunk at a time. */
+typedef struct {
+  FILE *in;
+  char *buf;
+  size_t len;  // Bytes read into buf
+  size_t pos;  // Where the next statement starts
+  size_t cap;
+  bool eof;
+  uint32_t line; // Line of buf[pos], from 1
+  char *statement; // The last statement found, NUL-terminated
+  size_t statement_cap;
+} Script;
+
+/**
+ * script_fill reads another chunk, first moving what is left unread to the
+ * front of the buffer. Returns false at the end of the input.
+ */
+static bool script_fill(Script *s) {
+  if (s->eof)
+    return false;
+  memmove(s->buf, s->buf + s->pos, s->len - s->pos);
+  s->len -= s->pos;
+  s->pos = 0;
+  if (s->cap - s->len < SCRIPT_CHUNK_SIZE) {
+    while (s->cap - s->len < SCRIPT_CHUNK_SIZE)
+      s->cap *= 2;
+    s->buf = realloc(s->buf, s->cap);
+  }
+  size_t n = fread(s->buf + s->len, 1, SCRIPT_CHUNK_SIZE, s->in);
+  s->len += n;
+  s->eof = n < SCRIPT_CHUNK_SIZE;
+  return n > 0;
+}
+
+static bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/**
+ * script_next returns the next statement, copied into s->statement without
+ * its comments or terminating semicolon, and sets *line to the line it starts
+ * on. Returns nullptr at the end of the script.
+ */
+static char *script_next(Script *s, uint32_t *line) {
+  // Blank space and comment lines come between statements
+  for (;;) {
+    while (s->pos < s->len && is_blank(s->buf[s->pos])) {
+      if (s->buf[s->pos] == '\n')
+        s->line++;
+      s->pos++;
+    }
+    if (s->pos == s->len || (s->buf[s->pos] == '-' && s->pos + 1 == s->len)) {
+      if (script_fill(s))
+        continue;
+      if (s->pos == s->len)
+        return nullptr;
+    }
+    if (s->buf[s->pos] != '-' || s->pos + 1 == s->len ||
+        s->buf[s->pos + 1] != '-')
+      break;
+    const char *newline = memchr(s->buf + s->pos, '\n', s->len - s->pos);
+    if (newline == nullptr) {
+      if (script_fill(s))
+        continue;
+      return nullptr;
+    }
+    s->pos = (size_t)(newline - s->buf);
+  }
+  *line = s->line;
+
+  // A meta-command is a line; SQL runs to a semicolon outside quotes and
+  // comments
+  bool meta = s->buf[s->pos] == '.';
+  size_t end;
+  size_t scanned = s->pos;
+  bool quoted = false;
+  for (;;) {
+    const char *stop = nullptr;
+    const char *p = s->buf + scanned;
+    if (meta) {
+      stop = memchr(p, '\n', s->len - scanned);
+      p = s->buf + s->len;
+    }
+    for (; stop == nullptr && p < s->buf + s->len; p++) {
+      if (*p == '\'') {
+        quoted = !quoted;
+      } else if (*p == ';' && !quoted) {
+        stop = p + 1;
+      } else if (*p == '-' && !quoted) {
+        // A comment may run on past what has been read; rescan it then
+        if (p + 1 == s->buf + s->len)
+          break;
+        if (p[1] != '-')
+          continue;
+        const char *newline = memchr(p, '\n', (size_t)(s->buf + s->len - p));
+        if (newline == nullptr)
+          break;
+        p = newline;
+      }
+    }
+    if (stop != nullptr) {
+      end = (size_t)(stop - s->buf);
+      break;
+    }
+    // Only the text after the statement's start is kept, so rescan offsets
+    // move with it
+    size_t offset = (size_t)(p - s->buf) - s->pos;
+    if (!script_fill(s)) {
+      end = s->len;
+      break;
+    }
+    scanned = s->pos + offset;
+  }
+
+  if (end - s->pos + 1 > s->statement_cap) {
+    s->statement_cap = end - s->pos + 1;
+    s->statement = realloc(s->statement, s->statement_cap);
+  }
+  size_t len = 0;
+  quoted = false;
+  for (size_t i = s->pos; i < end; i++) {
+    char c = s->buf[i];
+    if (c == '\n')
+      s->line++;
+    if (c == '\'') {
+      quoted = !quoted;
+    } else if (!meta && !quoted && c == '-' && i + 1 < end &&
+               s->buf[i + 1] == '-') {
+      // Drop the comment, keeping its line break as the space between words
+      while (i + 1 < end && s->buf[i + 1] != '\n')
+        i++;
+      continue;
+    }
+    s->statement[len++] = c;
+  }
+  while (len > 0 && is_blank(s->statement[len - 1]))
+    len--;
+  if (!meta && len > 0 && s->statement[len - 1] == ';') {
+    len--;
+    while (len > 0 && is_blank(s->statement[len - 1]))
+      len--;
+  }
+  s->statement[len] = '\0';
+  s->pos = end;
+  return s->statement;
+}
+
+ReplResult repl_execute_script(Database *db, const char *path,
+                               bool stop_on_error) {
+  if (db->script_depth >= SCRIPT_MAX_DEPTH) {
+    fprintf(db->out, "Error: Scripts nested too deeply.\n");
+    return REPL_ERROR;
+  }
+  bool from_stdin = strcmp(path, "-") == 0;
+  FILE *in = from_stdin ? stdin : fopen(path, "rb");
+  if (in == nullptr) {
+    fprintf(db->out, "Error: Cannot open '%s'.\n", path);
+    return REPL_ERROR;
+  }
+  db->script_depth++;
+
+  Script script = {.in = in,
+                   .buf = malloc(SCRIPT_CHUNK_SIZE),
+                   .cap = SCRIPT_CHUNK_SIZE,
+                   .line = 1};
+  ReplResult result = REPL_CONTINUE;
+  char *statement;
+  uint32_t line;
+  while ((statement = script_next(&script, &line)) != nullptr) {
+    if (statement[0] == '\0')
+      continue;
+    ReplResult r = repl_execute_line(db, statement);
+    if (r == REPL_EXIT) {
+      result = REPL_EXIT;
+      break;
+    }
+    if (r == REPL_ERROR) {
+      result = REPL_ERROR;
+      if (stop_on_error) {
+        fprintf(db->out, "Error: Stopped at line %u of '%s'.\n", line, path);
+        break;
+      }
+    }
+  }
+
+  db->script_depth--;
+  free(script.buf);
+  free(script.statement);
+  if (!from_stdin)
+    fclose(in);
+  return result;
+}
@@ -1,5 +1,6 @@
 #include "schema.h"
 #include "statement.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -21,6 +22,7 @@ void deserialize_field(Schema *schema, uint32_t field_idx, void *src,
 }
 
 void serialize_row(Schema *schema, struct Statement *s, void *dest) {
+  TRACE_BEGIN(span, TRACE_SERIALIZE_ROW);
   for (uint32_t i = 0; i < schema->num_fields; i++) {
     if (schema->fields[i].type == FIELD_INT) {
       serialize_field(schema, i, &s->insert_values[i], dest);
@@ -28,6 +30,7 @@ void serialize_row(Schema *schema, struct Statement *s, void *dest) {
       serialize_field(schema, i, s->insert_strings[i], dest);
     }
   }
+  TRACE_END(span);
 }
 
 void deserialize_row(Schema *schema, void *src, struct Statement *s) {
@@ -42,10 +45,13 @@ void deserialize_row(Schema *schema, void *src, struct Statement *s) {
   }
 }
 
-uint32_t hash_string(const char *str) {
+uint32_t hash_string_n(const char *str, size_t len) {
   uint32_t hash = 5381;
-  int c;
-  while ((c = *str++))
-    hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+  for (size_t i = 0; i < len; i++)
+    hash = ((hash << 5) + hash) + str[i]; /* hash * 33 + c */
   return hash;
 }
+
+uint32_t hash_string(const char *str) {
+  return hash_string_n(str, strlen(str));
+}
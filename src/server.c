@@ -0,0 +1,384 @@
+#ifdef __linux__
+#define _GNU_SOURCE // accept4, open_memstream, sigaction
+#endif
+
+#include "server.h"
+#include "os_portability.h"
+#include "repl.h"
+#include <stdio.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <threads.h>
+
+constexpr int SERVER_MAX_EVENTS = 64;
+constexpr int SERVER_POLL_TIMEOUT_MS = 250;
+// How long a response may wait for a client that is not reading
+constexpr int SERVER_WRITE_TIMEOUT_MS = 5000;
+
+/**
+ * Connection holds the request a client is part way through sending. Sockets
+ * are non-blocking: a worker takes what has arrived and hands the connection
+ * back to epoll, so a client that stalls mid-frame holds no worker. It also
+ * keeps the client's own .mode, .timer and .stats settings.
+ */
+typedef struct {
+  int fd;
+  uint8_t header[sizeof(uint32_t)];
+  uint32_t header_got; // Bytes of the length received
+  char *request;       // Allocated once the length is known
+  uint32_t len;
+  uint32_t got;
+  PrintMode print_mode;
+  bool show_timer;
+  bool show_stats;
+} Connection;
+
+typedef enum : uint8_t { FRAME_READY, FRAME_PARTIAL, FRAME_CLOSED } FrameResult;
+
+typedef struct {
+  Database *db;
+  // Serializes statement execution against the shared Database
+  mtx_t db_lock;
+  int epoll_fd;
+  // Ring buffer of connections that are ready to be read by a worker.
+  // EPOLLONESHOT guarantees a connection is queued at most once, so
+  // SERVER_MAX_CONNECTIONS slots can never overflow.
+  Connection *ready[SERVER_MAX_CONNECTIONS];
+  uint32_t ready_head;
+  uint32_t ready_count;
+  mtx_t ready_lock;
+  cnd_t ready_cond;
+  bool stopping;
+  uint32_t num_connections;
+} Server;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int sig) {
+  (void)sig;
+  stop_requested = 1;
+}
+
+/**
+ * read_some reads into buf until *got reaches len, returning FRAME_PARTIAL if
+ * the socket runs dry first.
+ */
+static FrameResult read_some(int fd, void *buf, uint32_t *got, uint32_t len) {
+  char *p = buf;
+  while (*got < len) {
+    ssize_t n = read(fd, p + *got, len - *got);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return FRAME_PARTIAL;
+    if (n <= 0)
+      return FRAME_CLOSED;
+    *got += (uint32_t)n;
+  }
+  return FRAME_READY;
+}
+
+/** read_frame carries on receiving the connection's next request. */
+static FrameResult read_frame(Connection *c) {
+  FrameResult r =
+      read_some(c->fd, c->header, &c->header_got, sizeof(c->header));
+  if (r != FRAME_READY)
+    return r;
+  if (c->request == nullptr) {
+    uint32_t header;
+    memcpy(&header, c->header, sizeof(header));
+    c->len = ntohl(header);
+    if (c->len > SERVER_MAX_FRAME)
+      return FRAME_CLOSED;
+    c->request = malloc(c->len + 1);
+    c->got = 0;
+  }
+  r = read_some(c->fd, c->request, &c->got, c->len);
+  if (r == FRAME_READY)
+    c->request[c->len] = '\0';
+  return r;
+}
+
+static bool write_full(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+      if (poll(&pfd, 1, SERVER_WRITE_TIMEOUT_MS) <= 0)
+        return false;
+      continue;
+    }
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static bool write_frame(int fd, const char *payload, uint32_t len) {
+  uint32_t header = htonl(len);
+  return write_full(fd, &header, sizeof(header)) &&
+         write_full(fd, payload, len);
+}
+
+static void ready_push(Server *srv, Connection *c) {
+  mtx_lock(&srv->ready_lock);
+  uint32_t tail = (srv->ready_head + srv->ready_count) % SERVER_MAX_CONNECTIONS;
+  srv->ready[tail] = c;
+  srv->ready_count++;
+  cnd_signal(&srv->ready_cond);
+  mtx_unlock(&srv->ready_lock);
+}
+
+// Blocks until a connection is ready; returns null once the server is stopping.
+static Connection *ready_pop(Server *srv) {
+  mtx_lock(&srv->ready_lock);
+  while (srv->ready_count == 0 && !srv->stopping)
+    cnd_wait(&srv->ready_cond, &srv->ready_lock);
+  Connection *c = nullptr;
+  if (srv->ready_count > 0) {
+    c = srv->ready[srv->ready_head];
+    srv->ready_head = (srv->ready_head + 1) % SERVER_MAX_CONNECTIONS;
+    srv->ready_count--;
+  }
+  mtx_unlock(&srv->ready_lock);
+  return c;
+}
+
+static void close_connection(Server *srv, Connection *c) {
+  close(c->fd);
+  free(c->request);
+  free(c);
+  mtx_lock(&srv->ready_lock);
+  srv->num_connections--;
+  mtx_unlock(&srv->ready_lock);
+}
+
+/**
+ * meta_command_allowed tells whether a client may run a meta-command. Those
+ * that touch the server's own files or stdin, or reset what every client
+ * sees, are refused.
+ */
+static bool meta_command_allowed(const char *line) {
+  static const char *const exact[] = {".exit",  ".tables", ".table",
+                                      ".indexes", ".stats", ".cache"};
+  static const char *const prefixes[] = {".check ", ".mode ", ".timer "};
+  for (size_t i = 0; i < sizeof(exact) / sizeof(exact[0]); i++) {
+    if (strcmp(line, exact[i]) == 0)
+      return true;
+  }
+  for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+    if (strncmp(line, prefixes[i], strlen(prefixes[i])) == 0)
+      return true;
+  }
+  return strcmp(line, ".stats on") == 0 || strcmp(line, ".stats off") == 0;
+}
+
+/**
+ * serve_request runs the request the connection has received and sends the
+ * response. Returns false when the connection should be closed.
+ */
+static bool serve_request(Server *srv, Connection *c) {
+  char *request = c->request;
+  size_t len = c->len;
+  while (len > 0 && (request[len - 1] == '\n' || request[len - 1] == '\r'))
+    request[--len] = '\0';
+  // Running only the first line would quietly drop the rest of the request
+  if (strpbrk(request, "\r\n") != nullptr) {
+    static const char refused[] = "Error: A request must be a single line.\n";
+    return write_frame(c->fd, refused, sizeof(refused) - 1);
+  }
+  if (request[0] == '.' && !meta_command_allowed(request)) {
+    static const char refused[] =
+        "Error: Meta-command not allowed over the socket.\n";
+    return write_frame(c->fd, refused, sizeof(refused) - 1);
+  }
+
+  char *response = nullptr;
+  size_t response_len = 0;
+  FILE *capture = open_memstream(&response, &response_len);
+  if (capture == nullptr)
+    return false;
+
+  mtx_lock(&srv->db_lock);
+  // Run it with this client's settings, keeping any it changes
+  Database *db = srv->db;
+  db->out = capture;
+  db->print_mode = c->print_mode;
+  db->show_timer = c->show_timer;
+  db->show_stats = c->show_stats;
+  ReplResult result = repl_execute_line(db, request);
+  c->print_mode = db->print_mode;
+  c->show_timer = db->show_timer;
+  c->show_stats = db->show_stats;
+  db->out = stdout;
+  mtx_unlock(&srv->db_lock);
+
+  fclose(capture);
+  bool ok = write_frame(c->fd, response, (uint32_t)response_len);
+  free(response);
+  return ok && result != REPL_EXIT;
+}
+
+static int worker_main(void *arg) {
+  Server *srv = arg;
+  while (true) {
+    Connection *c = ready_pop(srv);
+    if (c == nullptr)
+      break;
+    // Serve every request that has fully arrived, then wait for more
+    FrameResult r;
+    while ((r = read_frame(c)) == FRAME_READY) {
+      bool keep = serve_request(srv, c);
+      free(c->request);
+      c->request = nullptr;
+      c->header_got = 0;
+      if (!keep)
+        break;
+    }
+    if (r != FRAME_PARTIAL) {
+      close_connection(srv, c);
+      continue;
+    }
+    // Re-arm the connection so the acceptor reports its next bytes
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = c};
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) == -1)
+      close_connection(srv, c);
+  }
+  return 0;
+}
+
+static void accept_connections(Server *srv, int listen_fd) {
+  while (true) {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1)
+      return; // EAGAIN: backlog drained
+
+    mtx_lock(&srv->ready_lock);
+    bool full = srv->num_connections >= SERVER_MAX_CONNECTIONS;
+    if (!full)
+      srv->num_connections++;
+    mtx_unlock(&srv->ready_lock);
+
+    if (full) {
+      close(fd);
+      continue;
+    }
+    Connection *c = calloc(1, sizeof(Connection));
+    c->fd = fd;
+    c->print_mode = PRINT_PLAIN;
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = c};
+    if (epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+      close_connection(srv, c);
+  }
+}
+
+static int open_listener(const char *socket_path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    printf("Socket path too long: %s\n", socket_path);
+    return -1;
+  }
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    printf("Unable to create socket: %s\n", strerror(errno));
+    return -1;
+  }
+  remove(socket_path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(fd, SOMAXCONN) == -1) {
+    printf("Unable to listen on %s: %s\n", socket_path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int server_run(Database *db, const char *socket_path, uint32_t num_workers) {
+  if (num_workers == 0)
+    num_workers = 1;
+
+  int listen_fd = open_listener(socket_path);
+  if (listen_fd == -1)
+    return -1;
+
+  Server *srv = calloc(1, sizeof(Server));
+  srv->db = db;
+  mtx_init(&srv->db_lock, mtx_plain);
+  mtx_init(&srv->ready_lock, mtx_plain);
+  cnd_init(&srv->ready_cond);
+  srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  // Connections are registered with their Connection, the listener with null
+  struct epoll_event listen_ev = {.events = EPOLLIN, .data.ptr = nullptr};
+  epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_ev);
+
+  struct sigaction sa = {.sa_handler = handle_stop_signal};
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  thrd_t *workers = malloc(num_workers * sizeof(thrd_t));
+  for (uint32_t i = 0; i < num_workers; i++)
+    thrd_create(&workers[i], worker_main, srv);
+
+  printf("Listening on %s with %u workers.\n", socket_path, num_workers);
+  fflush(stdout);
+
+  struct epoll_event events[SERVER_MAX_EVENTS];
+  while (!stop_requested) {
+    int n = epoll_wait(srv->epoll_fd, events, SERVER_MAX_EVENTS,
+                       SERVER_POLL_TIMEOUT_MS);
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.ptr == nullptr)
+        accept_connections(srv, listen_fd);
+      else
+        ready_push(srv, events[i].data.ptr);
+    }
+  }
+
+  mtx_lock(&srv->ready_lock);
+  srv->stopping = true;
+  cnd_broadcast(&srv->ready_cond);
+  mtx_unlock(&srv->ready_lock);
+  for (uint32_t i = 0; i < num_workers; i++)
+    thrd_join(workers[i], nullptr);
+
+  printf("Server stopped.\n");
+  free(workers);
+  close(listen_fd);
+  remove(socket_path);
+  close(srv->epoll_fd);
+  cnd_destroy(&srv->ready_cond);
+  mtx_destroy(&srv->ready_lock);
+  mtx_destroy(&srv->db_lock);
+  free(srv);
+  return 0;
+}
+
+#else
+
+int server_run(Database *db, const char *socket_path, uint32_t num_workers) {
+  (void)db;
+  (void)socket_path;
+  (void)num_workers;
+  printf("Server mode is only supported on Linux.\n");
+  return -1;
+}
+
+#endif
@@ -0,0 +1,363 @@
+#include "simpledb.h"
+#include "aggregate.h"
+#include "database.h"
+#include "index.h"
+#include "join.h"
+#include "pager.h"
+#include "schema.h"
+#include "sort.h"
+#include "statement.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct sdb {
+  Database *db;
+  char errmsg[128];
+};
+
+struct sdb_stmt {
+  sdb *conn;
+  Statement statement;
+  // Bitmask of parameters that have not been bound yet
+  uint32_t unbound;
+  // Open SELECT scan and its current row (nullptr when not stepping)
+  Cursor *cursor;
+  void *row;
+  // Page held for a row read in place (0, the catalog's, when none)
+  uint32_t held_page;
+  // An aggregate SELECT's rows, computed on the first step, and their layout.
+  // Scans count their rows in next_row too, against the LIMIT.
+  ResultSet *result;
+  uint32_t next_row;
+  Schema result_schema;
+  // Rows of a SELECT whose ORDER BY needs a sort, sorted on the first step
+  Sorter *sorter;
+  // A join's rows, laid out in result_schema
+  Join *join;
+  // Scratch space for sdb_column_text() on INT columns
+  char text_buf[16];
+};
+
+static void set_error(sdb *conn, const char *msg) {
+  snprintf(conn->errmsg, sizeof(conn->errmsg), "%s", msg);
+}
+
+static const char *prepare_error_message(PrepareResult result) {
+  switch (result) {
+  case PREPARE_SUCCESS:
+    return "not an error";
+  case PREPARE_SYNTAX_ERROR:
+    return "Syntax error. Could not parse statement.";
+  case PREPARE_UNRECOGNIZED_STATEMENT:
+    return "Unrecognized statement.";
+  case PREPARE_NO_SCHEMA:
+  case PREPARE_NO_TABLE:
+    return "Table not found.";
+  case PREPARE_TABLE_ALREADY_EXISTS:
+    return "Table already exists.";
+  case PREPARE_CATALOG_FULL:
+    return "Catalog full. Cannot create more tables.";
+  case PREPARE_STRING_TOO_LONG:
+    return "String value too long.";
+  case PREPARE_PARAMETER_OUT_OF_RANGE:
+    return "Parameter index out of range.";
+  case PREPARE_NO_COLUMN:
+    return "Column not found.";
+  case PREPARE_INDEX_ALREADY_EXISTS:
+    return "Index already exists.";
+  case PREPARE_INDEX_CATALOG_FULL:
+    return "Catalog full. Cannot create more indexes.";
+  case PREPARE_AGGREGATE_NOT_INT:
+    return "SUM, MIN, MAX and AVG need an INT column.";
+  case PREPARE_NOT_GROUPED:
+    return "Column must be aggregated or in GROUP BY.";
+  case PREPARE_JOIN_TYPE_MISMATCH:
+    return "Join columns must have the same type.";
+  case PREPARE_EXPLAIN_NOT_SELECT:
+    return "EXPLAIN only applies to SELECT.";
+  }
+  return "Unknown error.";
+}
+
+static int bind_result(sdb_stmt *stmt, int param, PrepareResult result) {
+  if (result == PREPARE_PARAMETER_OUT_OF_RANGE)
+    return SDB_RANGE;
+  if (result != PREPARE_SUCCESS) {
+    set_error(stmt->conn, prepare_error_message(result));
+    return SDB_ERROR;
+  }
+  stmt->unbound &= ~(1u << (param - 1));
+  return SDB_OK;
+}
+
+/** hold_row holds the page a scan's row is on, releasing the last row's. */
+static void hold_row(sdb_stmt *stmt, uint32_t page) {
+  Pager *pager = stmt->conn->db->pager;
+  if (page != 0)
+    pager_hold(pager, page);
+  if (stmt->held_page != 0)
+    pager_release(pager, stmt->held_page);
+  stmt->held_page = page;
+}
+
+static void close_scan(sdb_stmt *stmt) {
+  result_set_free(stmt->result);
+  stmt->result = nullptr;
+  sorter_close(stmt->sorter);
+  stmt->sorter = nullptr;
+  join_close(stmt->join);
+  stmt->join = nullptr;
+  stmt->row = nullptr;
+  hold_row(stmt, 0);
+  if (stmt->cursor == nullptr)
+    return;
+  free(stmt->cursor);
+  stmt->cursor = nullptr;
+  // Pages other statements' rows are on stay held
+  unpin_page_all(stmt->conn->db->pager);
+}
+
+/**
+ * finish_scan closes a scan that has run out of rows: SDB_DONE, or SDB_ERROR
+ * if they ran out because a sort's or join's temporary file could not be
+ * written or read.
+ */
+static int finish_scan(sdb_stmt *stmt) {
+  bool failed = (stmt->sorter != nullptr && sorter_failed(stmt->sorter)) ||
+                (stmt->join != nullptr && join_failed(stmt->join));
+  close_scan(stmt);
+  if (!failed)
+    return SDB_DONE;
+  set_error(stmt->conn, "I/O error.");
+  return SDB_ERROR;
+}
+
+static Schema *stmt_schema(sdb_stmt *stmt) {
+  if (stmt->statement.num_items > 0 || stmt->statement.joined)
+    return &stmt->result_schema;
+  return &stmt->conn->db->catalog.tables[stmt->statement.table_index].schema;
+}
+
+int sdb_open(const char *filename, sdb **out) {
+  sdb *conn = calloc(1, sizeof(sdb));
+  conn->db = db_try_open(filename);
+  *out = conn;
+  if (conn->db == nullptr) {
+    snprintf(conn->errmsg, sizeof(conn->errmsg), "Unable to open %s: %s",
+             filename, strerror(errno));
+    return SDB_ERROR;
+  }
+  return SDB_OK;
+}
+
+int sdb_close(sdb *conn) {
+  if (conn->db != nullptr)
+    db_close(conn->db);
+  free(conn);
+  return SDB_OK;
+}
+
+const char *sdb_errmsg(sdb *conn) { return conn->errmsg; }
+
+int sdb_prepare(sdb *conn, const char *sql, sdb_stmt **out) {
+  *out = nullptr;
+  sdb_stmt *stmt = calloc(1, sizeof(sdb_stmt));
+  // prepare_statement() works on a mutable line, like the REPL's buffer
+  char *line = strdup(sql);
+  PrepareResult result = prepare_statement(line, &stmt->statement, conn->db);
+  free(line);
+  if (result != PREPARE_SUCCESS || stmt->statement.explain != EXPLAIN_NONE) {
+    // A plan is printed, not stepped through
+    set_error(conn, result != PREPARE_SUCCESS
+                        ? prepare_error_message(result)
+                        : "EXPLAIN is only available in the REPL.");
+    free_statement(&stmt->statement);
+    free(stmt);
+    return SDB_ERROR;
+  }
+  stmt->conn = conn;
+  stmt->unbound = (1u << stmt->statement.num_params) - 1;
+  if (stmt->statement.num_items > 0)
+    aggregate_schema(&stmt->statement, conn->db, &stmt->result_schema);
+  if (stmt->statement.joined)
+    join_schema(&stmt->statement, conn->db, &stmt->result_schema);
+  *out = stmt;
+  return SDB_OK;
+}
+
+int sdb_bind_int(sdb_stmt *stmt, int param, uint32_t value) {
+  if (param < 1)
+    return SDB_RANGE;
+  close_scan(stmt);
+  return bind_result(stmt, param,
+                     bind_parameter_int(&stmt->statement, stmt->conn->db,
+                                        (uint32_t)param - 1, value));
+}
+
+int sdb_bind_text(sdb_stmt *stmt, int param, const char *value) {
+  if (param < 1)
+    return SDB_RANGE;
+  close_scan(stmt);
+  return bind_result(stmt, param,
+                     bind_parameter_text(&stmt->statement, stmt->conn->db,
+                                         (uint32_t)param - 1, value));
+}
+
+int sdb_step(sdb_stmt *stmt) {
+  Database *db = stmt->conn->db;
+  Statement *s = &stmt->statement;
+  if (stmt->unbound != 0) {
+    set_error(stmt->conn, "Not all parameters are bound.");
+    return SDB_MISUSE;
+  }
+
+  if (s->type == STATEMENT_SELECT && s->num_items > 0) {
+    if (stmt->result == nullptr) {
+      stmt->result = aggregate_execute(s, db);
+      stmt->next_row = 0;
+      if (stmt->result->failed) {
+        close_scan(stmt);
+        set_error(stmt->conn, "I/O error.");
+        return SDB_ERROR;
+      }
+    }
+    if (stmt->next_row == stmt->result->num_rows) {
+      close_scan(stmt);
+      return SDB_DONE;
+    }
+    stmt->row = stmt->result->rows +
+                stmt->next_row++ * stmt->result_schema.row_size;
+    return SDB_ROW;
+  }
+  if (s->type == STATEMENT_SELECT && s->joined) {
+    if (stmt->join == nullptr && stmt->sorter == nullptr) {
+      stmt->next_row = 0;
+      if (s->ordered)
+        stmt->sorter = join_sorted(s, db);
+      else
+        stmt->join = join_open(s, db);
+    }
+    if (stmt->sorter != nullptr)
+      stmt->row = (void *)sorter_next(stmt->sorter);
+    else
+      stmt->row = stmt->next_row++ < s->limit
+                      ? (void *)join_next(stmt->join)
+                      : nullptr;
+    if (stmt->row == nullptr)
+      return finish_scan(stmt);
+    return SDB_ROW;
+  }
+  if (s->type == STATEMENT_SELECT) {
+    if (stmt->cursor == nullptr && stmt->sorter == nullptr) {
+      stmt->cursor = select_open(s, db);
+      stmt->next_row = 0;
+      if (select_needs_sort(s, stmt->cursor)) {
+        stmt->sorter = select_sorted(s, db, stmt->cursor);
+        stmt->cursor = nullptr;
+      }
+    }
+    if (stmt->sorter != nullptr)
+      stmt->row = (void *)sorter_next(stmt->sorter);
+    else
+      stmt->row = stmt->next_row++ < s->limit
+                      ? select_next(s, db, stmt->cursor)
+                      : nullptr;
+    if (stmt->row == nullptr)
+      return finish_scan(stmt);
+    if (stmt->cursor != nullptr)
+      hold_row(stmt, stmt->cursor->row_page);
+    return SDB_ROW;
+  }
+
+  // A prepared CREATE may be stepped again after the object exists
+  if (s->type == STATEMENT_CREATE_TABLE &&
+      find_table(db, s->table_name) != -1) {
+    set_error(stmt->conn, prepare_error_message(PREPARE_TABLE_ALREADY_EXISTS));
+    return SDB_ERROR;
+  }
+  if (s->type == STATEMENT_CREATE_INDEX) {
+    PrepareResult result = PREPARE_SUCCESS;
+    if (find_index(db, s->index_name) != -1)
+      result = PREPARE_INDEX_ALREADY_EXISTS;
+    else if (db->catalog.num_indexes >= MAX_INDEXES)
+      result = PREPARE_INDEX_CATALOG_FULL;
+    if (result != PREPARE_SUCCESS) {
+      set_error(stmt->conn, prepare_error_message(result));
+      return SDB_ERROR;
+    }
+  }
+
+  switch (execute_statement(s, db)) {
+  case EXECUTE_SUCCESS:
+    return SDB_DONE;
+  case EXECUTE_DUPLICATE_KEY:
+    set_error(stmt->conn, "Duplicate key.");
+    return SDB_CONSTRAINT;
+  case EXECUTE_KEY_NOT_FOUND:
+    set_error(stmt->conn, "Key not found.");
+    return SDB_NOTFOUND;
+  case EXECUTE_TABLE_FULL:
+    set_error(stmt->conn, "Table full.");
+    return SDB_ERROR;
+  case EXECUTE_IO_ERROR:
+    set_error(stmt->conn, "I/O error.");
+    return SDB_ERROR;
+  case EXECUTE_UNKNOWN_ERROR:
+    break;
+  }
+  set_error(stmt->conn, "Unknown error.");
+  return SDB_ERROR;
+}
+
+int sdb_reset(sdb_stmt *stmt) {
+  close_scan(stmt);
+  return SDB_OK;
+}
+
+int sdb_finalize(sdb_stmt *stmt) {
+  if (stmt == nullptr)
+    return SDB_OK;
+  close_scan(stmt);
+  free_statement(&stmt->statement);
+  free(stmt);
+  return SDB_OK;
+}
+
+int sdb_column_count(sdb_stmt *stmt) {
+  if (stmt->statement.type != STATEMENT_SELECT)
+    return 0;
+  return (int)stmt_schema(stmt)->num_fields;
+}
+
+const char *sdb_column_name(sdb_stmt *stmt, int col) {
+  if (col < 0 || col >= sdb_column_count(stmt))
+    return nullptr;
+  return stmt_schema(stmt)->fields[col].name;
+}
+
+uint32_t sdb_column_int(sdb_stmt *stmt, int col) {
+  if (stmt->row == nullptr || col < 0 || col >= sdb_column_count(stmt))
+    return 0;
+  Schema *schema = stmt_schema(stmt);
+  if (schema->fields[col].type == FIELD_TEXT)
+    return (uint32_t)atoi(sdb_column_text(stmt, col));
+  uint32_t value;
+  deserialize_field(schema, (uint32_t)col, stmt->row, &value);
+  return value;
+}
+
+const char *sdb_column_text(sdb_stmt *stmt, int col) {
+  if (stmt->row == nullptr || col < 0 || col >= sdb_column_count(stmt))
+    return nullptr;
+  Schema *schema = stmt_schema(stmt);
+  Field *f = &schema->fields[col];
+  if (f->type == FIELD_INT) {
+    snprintf(stmt->text_buf, sizeof(stmt->text_buf), "%u",
+             sdb_column_int(stmt, col));
+    return stmt->text_buf;
+  }
+  // Text fields are stored NUL-terminated within their fixed size
+  return (const char *)stmt->row + f->offset;
+}
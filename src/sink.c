@@ -0,0 +1,69 @@
+#ifdef __linux__
+#define _GNU_SOURCE // fileno
+#endif
+
+#include "sink.h"
+#include "os_portability.h"
+#include <errno.h>
+
+void sink_open(ResultSink *sink, FILE *out) {
+  sink->out = out;
+  sink->fd = fileno(out);
+  sink->len = 0;
+}
+
+void sink_flush(ResultSink *sink) {
+  if (sink->len == 0)
+    return;
+  const char *p = sink->buf;
+  size_t left = sink->len;
+  sink->len = 0;
+  if (sink->fd < 0) {
+    fwrite(p, 1, left, sink->out);
+    return;
+  }
+  // Whatever was printed to the stream before must come out first
+  fflush(sink->out);
+  while (left > 0) {
+    int n = (int)write(sink->fd, p, (unsigned)left);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return;
+    p += n;
+    left -= (size_t)n;
+  }
+}
+
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+char *format_uint(uint32_t value, char *end) {
+  while (value >= 100) {
+    uint32_t pair = value % 100 * 2;
+    value /= 100;
+    *--end = digit_pairs[pair + 1];
+    *--end = digit_pairs[pair];
+  }
+  if (value >= 10) {
+    *--end = digit_pairs[value * 2 + 1];
+    *--end = digit_pairs[value * 2];
+  } else {
+    *--end = (char)('0' + value);
+  }
+  return end;
+}
+
+void sink_repeat(ResultSink *sink, const char *bytes, size_t len,
+                 uint32_t times) {
+  for (uint32_t i = 0; i < times; i++)
+    sink_bytes(sink, bytes, len);
+}
@@ -0,0 +1,406 @@
+#include "sort.h"
+#include "batch.h"
+#include "pager.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Records are a sequence number, which breaks ties in input order, followed
+// by the row
+constexpr uint32_t SEQ_SIZE = sizeof(uint32_t);
+
+/** A sorted run in the temporary file, read back through a small buffer. */
+typedef struct {
+  long start;      // File offset of the first record
+  uint32_t length; // Records in the run
+  uint32_t unread; // Records not yet read into the buffer
+  uint8_t *buf;
+  uint32_t count; // Records in the buffer
+  uint32_t pos;   // Current record in the buffer
+} Run;
+
+struct Sorter {
+  uint32_t field_offset;
+  uint32_t field_size;
+  bool text;
+  bool desc;
+  bool top_n; // Keep only the first `keep` records, in a heap
+  uint32_t offset;
+  uint32_t keep; // offset + limit
+  uint32_t record_size;
+  size_t budget;
+  uint32_t seq;
+  uint8_t *scratch; // Record being added
+
+  // Records in memory and their order (a heap while adding in top-N mode)
+  uint8_t *records;
+  uint32_t *order;
+  uint32_t count;
+  uint32_t allocated;
+  uint32_t capacity; // Records the budget allows
+
+  // Runs spilled to the temporary file, merged through a heap of run numbers
+  FILE *file;
+  Run *runs;
+  uint32_t num_runs;
+  uint32_t max_runs;
+  uint32_t *heap;
+  uint32_t heap_size;
+  uint32_t run_buffer; // Records in each run's read buffer
+  bool advance_top; // The top run's record was handed out
+  bool failed;      // A run could not be written or read back
+
+  uint32_t next;    // Next record in memory to hand out
+  uint32_t emitted; // Records handed out, counting the skipped offset
+};
+
+static inline uint8_t *record(const Sorter *s, uint32_t i) {
+  return s->records + (size_t)i * s->record_size;
+}
+
+/** compare_records orders two records by the column, then by arrival. */
+static int compare_records(const Sorter *s, const uint8_t *a,
+                           const uint8_t *b) {
+  const uint8_t *va = a + SEQ_SIZE + s->field_offset;
+  const uint8_t *vb = b + SEQ_SIZE + s->field_offset;
+  int c;
+  if (s->text) {
+    c = strncmp((const char *)va, (const char *)vb, s->field_size);
+  } else {
+    uint32_t x, y;
+    memcpy(&x, va, sizeof(x));
+    memcpy(&y, vb, sizeof(y));
+    c = (x > y) - (x < y);
+  }
+  if (s->desc)
+    c = -c;
+  if (c != 0)
+    return c;
+  uint32_t x, y;
+  memcpy(&x, a, sizeof(x));
+  memcpy(&y, b, sizeof(y));
+  return (x > y) - (x < y);
+}
+
+static inline void swap(uint32_t *a, uint32_t *b) {
+  uint32_t t = *a;
+  *a = *b;
+  *b = t;
+}
+
+/**
+ * sift_down restores a heap of record numbers whose root sorts last, from
+ * position `i` down.
+ */
+static void sift_down(const Sorter *s, uint32_t *heap, uint32_t n,
+                      uint32_t i) {
+  while (true) {
+    uint32_t last = i;
+    uint32_t left = 2 * i + 1;
+    uint32_t right = left + 1;
+    if (left < n &&
+        compare_records(s, record(s, heap[left]), record(s, heap[last])) > 0)
+      last = left;
+    if (right < n &&
+        compare_records(s, record(s, heap[right]), record(s, heap[last])) > 0)
+      last = right;
+    if (last == i)
+      return;
+    swap(&heap[i], &heap[last]);
+    i = last;
+  }
+}
+
+static void sift_up(const Sorter *s, uint32_t *heap, uint32_t i) {
+  while (i > 0) {
+    uint32_t parent = (i - 1) / 2;
+    if (compare_records(s, record(s, heap[i]), record(s, heap[parent])) <= 0)
+      return;
+    swap(&heap[i], &heap[parent]);
+    i = parent;
+  }
+}
+
+/** sort_records heapsorts the record numbers in place, without recursion. */
+static void sort_records(const Sorter *s, uint32_t *order, uint32_t n) {
+  for (uint32_t i = n / 2; i-- > 0;)
+    sift_down(s, order, n, i);
+  for (uint32_t end = n; end > 1; end--) {
+    swap(&order[0], &order[end - 1]);
+    sift_down(s, order, end - 1, 0);
+  }
+}
+
+Sorter *sorter_open(Database *db, const Schema *schema, uint32_t field,
+                    bool desc, uint32_t offset, uint32_t limit) {
+  Sorter *s = calloc(1, sizeof(Sorter));
+  s->field_offset = schema->fields[field].offset;
+  s->field_size = schema->fields[field].size;
+  s->text = schema->fields[field].type == FIELD_TEXT;
+  s->desc = desc;
+  s->offset = offset;
+  s->keep = limit > UINT32_MAX - offset ? UINT32_MAX : offset + limit;
+  s->record_size = SEQ_SIZE + schema->row_size;
+  s->budget = db->sort_memory;
+  s->scratch = malloc(s->record_size);
+
+  size_t per_record = s->record_size + sizeof(uint32_t);
+  size_t capacity = s->budget / per_record;
+  if (capacity < 2)
+    capacity = 2;
+  if (capacity > UINT32_MAX)
+    capacity = UINT32_MAX;
+  s->top_n = s->keep <= capacity;
+  s->capacity = s->top_n ? s->keep : (uint32_t)capacity;
+  return s;
+}
+
+/** reserve makes room for one more record in memory. */
+static void reserve(Sorter *s) {
+  if (s->count < s->allocated)
+    return;
+  // Grow gradually, so small sorts do not claim the whole budget
+  uint32_t allocated = s->allocated > 0 ? s->allocated * 2 : 256;
+  if (allocated > s->capacity)
+    allocated = s->capacity;
+  s->records = realloc(s->records, (size_t)allocated * s->record_size);
+  s->order = realloc(s->order, allocated * sizeof(uint32_t));
+  s->allocated = allocated;
+}
+
+/**
+ * spill writes the records in memory to the temporary file as a run. The
+ * sorter fails if the file cannot be created or written.
+ */
+static void spill(Sorter *s) {
+  if (s->file == nullptr)
+    s->file = tmpfile();
+  if (s->file == nullptr || fseek(s->file, 0, SEEK_END) != 0) {
+    s->failed = true;
+    return;
+  }
+  if (s->num_runs == s->max_runs) {
+    s->max_runs = s->max_runs > 0 ? s->max_runs * 2 : 8;
+    s->runs = realloc(s->runs, s->max_runs * sizeof(Run));
+  }
+  sort_records(s, s->order, s->count);
+  s->runs[s->num_runs++] = (Run){.start = ftell(s->file), .length = s->count};
+  for (uint32_t i = 0; i < s->count && !s->failed; i++) {
+    const uint8_t *rec = record(s, s->order[i]);
+    s->failed = fwrite(rec, s->record_size, 1, s->file) != 1;
+  }
+  s->count = 0;
+}
+
+static void set_record(const Sorter *s, uint8_t *rec, uint32_t seq,
+                       const void *row) {
+  memcpy(rec, &seq, SEQ_SIZE);
+  memcpy(rec + SEQ_SIZE, row, s->record_size - SEQ_SIZE);
+}
+
+void sorter_add(Sorter *s, const void *row) {
+  if (s->failed)
+    return;
+  uint32_t seq = s->seq++;
+  if (s->top_n) {
+    if (s->keep == 0)
+      return;
+    if (s->count < s->keep) {
+      reserve(s);
+      set_record(s, record(s, s->count), seq, row);
+      s->order[s->count] = s->count;
+      sift_up(s, s->order, s->count++);
+      return;
+    }
+    // Full: the new row replaces the last kept one if it sorts before it
+    set_record(s, s->scratch, seq, row);
+    uint8_t *last = record(s, s->order[0]);
+    if (compare_records(s, s->scratch, last) < 0) {
+      memcpy(last, s->scratch, s->record_size);
+      sift_down(s, s->order, s->count, 0);
+    }
+    return;
+  }
+
+  if (s->count == s->capacity) {
+    spill(s);
+    if (s->failed)
+      return;
+  }
+  reserve(s);
+  set_record(s, record(s, s->count), seq, row);
+  s->order[s->count] = s->count;
+  s->count++;
+}
+
+static inline uint8_t *run_record(const Sorter *s, const Run *run) {
+  return run->buf + (size_t)run->pos * s->record_size;
+}
+
+/**
+ * run_fill reads the next records of a run; false when it is used up, or
+ * when they cannot be read back, which fails the sorter.
+ */
+static bool run_fill(Sorter *s, Run *run) {
+  if (run->unread == 0)
+    return false;
+  uint32_t n = run->unread < s->run_buffer ? run->unread : s->run_buffer;
+  long read = (long)(run->length - run->unread) * (long)s->record_size;
+  if (fseek(s->file, run->start + read, SEEK_SET) != 0 ||
+      fread(run->buf, s->record_size, n, s->file) != n) {
+    s->failed = true;
+    return false;
+  }
+  run->count = n;
+  run->pos = 0;
+  run->unread -= n;
+  return true;
+}
+
+/** Merge heap of run numbers: the run with the first record on top. */
+static bool run_before(const Sorter *s, uint32_t a, uint32_t b) {
+  return compare_records(s, run_record(s, &s->runs[a]),
+                         run_record(s, &s->runs[b])) < 0;
+}
+
+static void merge_sift_down(Sorter *s, uint32_t i) {
+  while (true) {
+    uint32_t first = i;
+    uint32_t left = 2 * i + 1;
+    uint32_t right = left + 1;
+    if (left < s->heap_size && run_before(s, s->heap[left], s->heap[first]))
+      first = left;
+    if (right < s->heap_size && run_before(s, s->heap[right], s->heap[first]))
+      first = right;
+    if (first == i)
+      return;
+    swap(&s->heap[i], &s->heap[first]);
+    i = first;
+  }
+}
+
+/** start_merge loads the head of every run and builds the merge heap. */
+static void start_merge(Sorter *s) {
+  s->heap_size = 0;
+  for (uint32_t r = 0; r < s->num_runs; r++) {
+    Run *run = &s->runs[r];
+    if (run->buf == nullptr)
+      run->buf = malloc((size_t)s->run_buffer * s->record_size);
+    run->unread = run->length;
+    if (run_fill(s, run))
+      s->heap[s->heap_size++] = r;
+  }
+  for (uint32_t i = s->heap_size / 2; i-- > 0;)
+    merge_sift_down(s, i);
+  s->advance_top = false;
+}
+
+void sorter_finish(Sorter *s) {
+  if (s->failed)
+    return;
+  if (s->num_runs == 0) {
+    sort_records(s, s->order, s->count);
+    return;
+  }
+  if (s->count > 0)
+    spill(s);
+  // Buffered records must reach the file before the runs are read back
+  if (s->failed || fflush(s->file) != 0) {
+    s->failed = true;
+    return;
+  }
+  // The in-memory buffer is no longer needed; the run buffers take its place
+  free(s->records);
+  free(s->order);
+  s->records = nullptr;
+  s->order = nullptr;
+  s->allocated = 0;
+  s->heap = malloc(s->num_runs * sizeof(uint32_t));
+  // The runs share the budget for their read buffers
+  s->run_buffer = (uint32_t)(s->budget / s->num_runs / s->record_size);
+  if (s->run_buffer == 0)
+    s->run_buffer = 1;
+  start_merge(s);
+}
+
+/** next_record returns the next record in sorted order. */
+static const uint8_t *next_record(Sorter *s) {
+  if (s->failed)
+    return nullptr;
+  if (s->num_runs == 0)
+    return s->next < s->count ? record(s, s->order[s->next++]) : nullptr;
+
+  if (s->advance_top) {
+    Run *run = &s->runs[s->heap[0]];
+    if (++run->pos == run->count && !run_fill(s, run))
+      s->heap[0] = s->heap[--s->heap_size];
+    merge_sift_down(s, 0);
+  }
+  if (s->heap_size == 0 || s->failed)
+    return nullptr;
+  s->advance_top = true;
+  return run_record(s, &s->runs[s->heap[0]]);
+}
+
+const void *sorter_next(Sorter *s) {
+  while (s->emitted < s->keep) {
+    const uint8_t *rec = next_record(s);
+    if (rec == nullptr)
+      return nullptr;
+    if (s->emitted++ >= s->offset)
+      return rec + SEQ_SIZE;
+  }
+  return nullptr;
+}
+
+void sorter_rewind(Sorter *s) {
+  s->next = 0;
+  s->emitted = 0;
+  if (s->num_runs > 0 && !s->failed)
+    start_merge(s);
+}
+
+uint32_t sorter_runs(const Sorter *s) { return s->num_runs; }
+
+bool sorter_failed(const Sorter *s) { return s->failed; }
+
+void sorter_fail(Sorter *s) { s->failed = true; }
+
+void sorter_close(Sorter *s) {
+  if (s == nullptr)
+    return;
+  for (uint32_t r = 0; r < s->num_runs; r++)
+    free(s->runs[r].buf);
+  if (s->file != nullptr)
+    fclose(s->file);
+  free(s->runs);
+  free(s->heap);
+  free(s->records);
+  free(s->order);
+  free(s->scratch);
+  free(s);
+}
+
+Sorter *select_sorted(Statement *statement, Database *db, Cursor *c) {
+  Sorter *sorter = sorter_open(
+      db, &db->catalog.tables[statement->table_index].schema,
+      statement->order_field, statement->order_desc, statement->offset,
+      statement->limit);
+  if (c->table_index < INDEX_TREE_BASE) {
+    BatchScan *scan = batch_scan_open(statement, db, c, 0);
+    RowBatch *batch;
+    while ((batch = batch_scan_next(scan)) != nullptr) {
+      for (uint32_t i = 0; i < batch->num_selected; i++)
+        sorter_add(sorter, batch->rows[batch->sel[i]]);
+    }
+    batch_scan_close(scan);
+  } else {
+    void *row;
+    while ((row = select_next(statement, db, c)) != nullptr)
+      sorter_add(sorter, row);
+    free(c);
+    unpin_page_all(db->pager);
+  }
+  sorter_finish(sorter);
+  return sorter;
+}
@@ -1,178 +1,602 @@
 #include "statement.h"
+#include "aggregate.h"
+#include "analyze.h"
+#include "batch.h"
 #include "btree.h"
 #include "database.h"
+#include "explain.h"
+#include "index.h"
+#include "join.h"
 #include "schema.h"
+#include "sink.h"
+#include "sort.h"
 #include "os_portability.h"
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+// Character classes for the tokenizer. A table lookup per byte keeps the
+// scanning loops tight; SQL text is ASCII so no locale is involved.
+enum : uint8_t {
+  CHAR_SPACE = 1 << 0, // Skipped between tokens
+  CHAR_PUNCT = 1 << 1, // A token on its own
+  CHAR_STOP = 1 << 2,  // Ends a word
+};
+
+static const uint8_t char_class[256] = {
+    ['\0'] = CHAR_STOP,
+    [' '] = CHAR_SPACE | CHAR_STOP,
+    ['\t'] = CHAR_SPACE | CHAR_STOP,
+    ['\n'] = CHAR_SPACE | CHAR_STOP,
+    ['\v'] = CHAR_SPACE | CHAR_STOP,
+    ['\f'] = CHAR_SPACE | CHAR_STOP,
+    ['\r'] = CHAR_SPACE | CHAR_STOP,
+    ['('] = CHAR_PUNCT | CHAR_STOP,
+    [')'] = CHAR_PUNCT | CHAR_STOP,
+    [','] = CHAR_PUNCT | CHAR_STOP,
+    ['='] = CHAR_PUNCT | CHAR_STOP,
+    [';'] = CHAR_PUNCT | CHAR_STOP,
+    ['>'] = CHAR_PUNCT | CHAR_STOP,
+    ['<'] = CHAR_PUNCT | CHAR_STOP,
+    ['!'] = CHAR_PUNCT | CHAR_STOP,
+};
+
+static inline uint8_t class_of(char c) { return char_class[(unsigned char)c]; }
+
+static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static const char *skip_whitespace(const char *str) {
+  while (class_of(*str) & CHAR_SPACE)
+    str++;
+  return str;
+}
 
-typedef struct {
-  char *tokens[128];
-  uint32_t num_tokens;
-} PrepareContext;
+static Token consume_token(const char **str) {
+  const char *s = skip_whitespace(*str);
+  if (*s == '\0')
+    return (Token){.ptr = nullptr, .len = 0};
 
-static void free_context(PrepareContext *ctx) {
-  for (uint32_t i = 0; i < ctx->num_tokens; i++) {
-    free(ctx->tokens[i]);
+  const char *start = s;
+  if (class_of(*s) & CHAR_PUNCT) {
+    *str = s + 1;
+    return (Token){.ptr = start, .len = 1};
+  }
+  if (*s == '\'') {
+    start = ++s;
+    while (*s && *s != '\'')
+      s++;
+    Token token = {.ptr = start, .len = (uint32_t)(s - start), .quoted = true};
+    *str = *s == '\'' ? s + 1 : s;
+    return token;
   }
-  ctx->num_tokens = 0;
+  while (!(class_of(*s) & CHAR_STOP))
+    s++;
+  *str = s;
+  return (Token){.ptr = start, .len = (uint32_t)(s - start)};
 }
 
-static char *skip_whitespace(char *str) {
-  while (*str && isspace(*str))
-    str++;
-  return str;
+/** token_is compares a token with a keyword or name, ignoring case. */
+static bool token_is(Token token, const char *word) {
+  return token.ptr != nullptr && strncasecmp(token.ptr, word, token.len) == 0 &&
+         word[token.len] == '\0';
 }
 
-static char *consume_token_ctx(char **str, PrepareContext *ctx) {
-  char *s = skip_whitespace(*str);
-  if (*s == '\0')
+static bool expect_token(const char **str, const char *expected) {
+  return token_is(consume_token(str), expected);
+}
+
+/** token_to_uint parses a number the way atoi() would, without a NUL. */
+static uint32_t token_to_uint(Token token) {
+  uint32_t i = 0;
+  while (i < token.len && (class_of(token.ptr[i]) & CHAR_SPACE))
+    i++;
+  bool negative = false;
+  if (i < token.len && (token.ptr[i] == '-' || token.ptr[i] == '+'))
+    negative = token.ptr[i++] == '-';
+  uint32_t value = 0;
+  for (; i < token.len && is_digit(token.ptr[i]); i++)
+    value = value * 10 + (uint32_t)(token.ptr[i] - '0');
+  return negative ? 0u - value : value;
+}
+
+static void token_copy(Token token, char *dest, size_t size) {
+  size_t len = token.len < size - 1 ? token.len : size - 1;
+  memcpy(dest, token.ptr, len);
+  dest[len] = '\0';
+}
+
+static bool is_parameter(Token token) {
+  return !token.quoted && token.len == 1 && token.ptr[0] == '?';
+}
+
+static bool add_parameter(Statement *statement, ParamTarget target,
+                          uint32_t field_idx) {
+  if (statement->num_params >= MAX_PARAMS)
+    return false;
+  statement->params[statement->num_params++] =
+      (Parameter){.target = target, .field_idx = (uint8_t)field_idx};
+  return true;
+}
+
+/**
+ * text_value_slot returns the buffer holding TEXT field `i`, carving one of the
+ * field's size out of the statement arena the first time. Rebinding a
+ * parameter reuses the same slot, so the arena never grows past one slot per
+ * field.
+ */
+static char *text_value_slot(Statement *statement, Schema *schema,
+                             uint32_t i) {
+  StatementArena *arena = &statement->arena;
+  char *slot = statement->insert_strings[i];
+  if (slot >= arena->buf && slot < arena->buf + arena->used)
+    return slot;
+  uint32_t size = schema->fields[i].size;
+  if (arena->used + size > STATEMENT_ARENA_SIZE)
     return nullptr;
+  slot = arena->buf + arena->used;
+  arena->used += size;
+  statement->insert_strings[i] = slot;
+  return slot;
+}
+
+static PrepareResult set_text_value(Statement *statement, Schema *schema,
+                                    uint32_t i, const char *value,
+                                    size_t len) {
+  if (len >= schema->fields[i].size)
+    return PREPARE_STRING_TOO_LONG;
+  char *slot = text_value_slot(statement, schema, i);
+  if (slot == nullptr)
+    return PREPARE_STRING_TOO_LONG;
+  memcpy(slot, value, len);
+  slot[len] = '\0';
+  if (i == 0)
+    statement->insert_values[i] = hash_string_n(value, len);
+  return PREPARE_SUCCESS;
+}
 
-  char *token = nullptr;
-  char *start = s;
+/** key_from_token turns a WHERE literal into a B-Tree key. */
+static uint32_t key_from_token(Schema *schema, Token token) {
+  if (schema->num_fields > 0 && schema->fields[0].type == FIELD_TEXT)
+    return hash_string_n(token.ptr, token.len);
+  return token_to_uint(token);
+}
 
-  if (*s == '(' || *s == ')' || *s == ',' || *s == '=' || *s == ';' ||
-      *s == '>' || *s == '<') {
-    *str = s + 1;
-    token = malloc(2);
-    token[0] = *s;
-    token[1] = '\0';
-  } else if (*s == '\'') {
-    s++;
-    start = s;
-    while (*s && *s != '\'')
-      s++;
-    size_t len = s - start;
-    token = malloc(len + 1);
-    memcpy(token, start, len);
-    token[len] = '\0';
-    if (*s == '\'')
-      s++;
-    *str = s;
-  } else {
-    while (*s && !isspace(*s) && *s != '(' && *s != ')' && *s != ',' &&
-           *s != '=' && *s != ';')
-      s++;
-    size_t len = s - start;
-    token = malloc(len + 1);
-    memcpy(token, start, len);
-    token[len] = '\0';
-    *str = s;
+static int find_field(Schema *schema, Token name) {
+  int found = -1;
+  uint32_t matches = 0;
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    const char *field = schema->fields[i].name;
+    if (token_is(name, field))
+      return (int)i;
+    // A join's columns are `table.column`; the column alone names one that
+    // only one of the tables has
+    const char *dot = strchr(field, '.');
+    if (dot != nullptr && token_is(name, dot + 1)) {
+      found = (int)i;
+      matches++;
+    }
   }
+  return matches == 1 ? found : -1;
+}
 
-  if (token) {
-    if (ctx->num_tokens < 128) {
-      ctx->tokens[ctx->num_tokens++] = token;
+/* Predicate term evaluators, one per column type and operator */
+static inline uint32_t term_int(const PredicateTerm *t, const uint8_t *row) {
+  uint32_t value;
+  memcpy(&value, row + t->offset, sizeof(value));
+  return value;
+}
+static bool int_eq(const PredicateTerm *t, const uint8_t *row) {
+  return term_int(t, row) == t->value;
+}
+static bool int_ne(const PredicateTerm *t, const uint8_t *row) {
+  return term_int(t, row) != t->value;
+}
+static bool int_lt(const PredicateTerm *t, const uint8_t *row) {
+  return term_int(t, row) < t->value;
+}
+static bool int_le(const PredicateTerm *t, const uint8_t *row) {
+  return term_int(t, row) <= t->value;
+}
+static bool int_gt(const PredicateTerm *t, const uint8_t *row) {
+  return term_int(t, row) > t->value;
+}
+static bool int_ge(const PredicateTerm *t, const uint8_t *row) {
+  return term_int(t, row) >= t->value;
+}
+
+static inline int term_cmp(const PredicateTerm *t, const uint8_t *row) {
+  return strcmp((const char *)row + t->offset, t->text);
+}
+static bool text_eq(const PredicateTerm *t, const uint8_t *row) {
+  return term_cmp(t, row) == 0;
+}
+static bool text_ne(const PredicateTerm *t, const uint8_t *row) {
+  return term_cmp(t, row) != 0;
+}
+static bool text_lt(const PredicateTerm *t, const uint8_t *row) {
+  return term_cmp(t, row) < 0;
+}
+static bool text_le(const PredicateTerm *t, const uint8_t *row) {
+  return term_cmp(t, row) <= 0;
+}
+static bool text_gt(const PredicateTerm *t, const uint8_t *row) {
+  return term_cmp(t, row) > 0;
+}
+static bool text_ge(const PredicateTerm *t, const uint8_t *row) {
+  return term_cmp(t, row) >= 0;
+}
+
+// Indexed by CompareOp
+static const TermEval int_evals[] = {int_eq, int_ne, int_lt,
+                                     int_le, int_gt, int_ge};
+static const TermEval text_evals[] = {text_eq, text_ne, text_lt,
+                                      text_le, text_gt, text_ge};
+
+bool predicate_matches(const Predicate *predicate, const void *row) {
+  uint32_t i = 0;
+  while (i < predicate->num_terms) {
+    const PredicateTerm *t = &predicate->terms[i];
+    if (t->eval(t, row)) {
+      if (t->ends_group)
+        return true;
+      i++;
     } else {
-      free(token);
-      return nullptr;
+      i = t->next_group; // Skip the rest of this AND group
     }
   }
-  return token;
+  return predicate->num_terms == 0;
+}
+
+void key_range_narrow(KeyRange *range, CompareOp op, uint32_t value) {
+  bool lower = op == CMP_EQ || op == CMP_GT || op == CMP_GE;
+  bool upper = op == CMP_EQ || op == CMP_LT || op == CMP_LE;
+  bool inclusive = op == CMP_EQ || op == CMP_GE || op == CMP_LE;
+  // A bound replaces one it is tighter than; at the same key, excluding it
+  // is tighter
+  if (lower &&
+      (!range->has_lower || value > range->lower ||
+       (value == range->lower && !inclusive))) {
+    range->has_lower = true;
+    range->lower = value;
+    range->lower_inclusive = inclusive;
+  }
+  if (upper &&
+      (!range->has_upper || value < range->upper ||
+       (value == range->upper && !inclusive))) {
+    range->has_upper = true;
+    range->upper = value;
+    range->upper_inclusive = inclusive;
+  }
+}
+
+void key_range_bounds(const KeyRange *range, uint32_t *first,
+                      uint32_t *last) {
+  *first = 0;
+  *last = UINT32_MAX;
+  bool empty = false;
+  if (range->has_lower) {
+    empty |= !range->lower_inclusive && range->lower == UINT32_MAX;
+    *first = range->lower + (range->lower_inclusive ? 0 : 1);
+  }
+  if (range->has_upper) {
+    empty |= !range->upper_inclusive && range->upper == 0;
+    *last = range->upper - (range->upper_inclusive ? 0 : 1);
+  }
+  if (empty) {
+    *first = 1;
+    *last = 0;
+  }
 }
 
-static bool expect_token_ctx(char **str, const char *expected,
-                             PrepareContext *ctx) {
-  char *token = consume_token_ctx(str, ctx);
-  if (token == nullptr)
+bool predicate_key_range(const Predicate *predicate, const Schema *schema,
+                         uint32_t *first, uint32_t *last) {
+  *first = 0;
+  *last = UINT32_MAX;
+  if (schema->fields[0].type != FIELD_INT)
     return false;
-  return (strcasecmp(token, expected) == 0);
+  KeyRange range = {};
+  for (uint32_t i = 0; i < predicate->num_terms; i++) {
+    const PredicateTerm *t = &predicate->terms[i];
+    if (t->field != 0 || t->op == CMP_NE ||
+        (t->ends_group && i + 1 < predicate->num_terms))
+      return false;
+    key_range_narrow(&range, t->op, t->value);
+  }
+  key_range_bounds(&range, first, last);
+  return true;
 }
 
-static PrepareResult prepare_insert(char *line, Statement *statement,
-                                    Database *db, PrepareContext *ctx) {
-  statement->type = STATEMENT_INSERT;
-  char *curr = line;
+/**
+ * set_term_value stores the value a predicate term compares against. TEXT
+ * values get an arena slot of their own, reused when the term is rebound.
+ */
+static PrepareResult set_term_value(Statement *statement, Schema *schema,
+                                    uint32_t term, Token value) {
+  PredicateTerm *t = &statement->predicate.terms[term];
+  Field *f = &schema->fields[t->field];
+  if (f->type == FIELD_INT) {
+    t->value = token_to_uint(value);
+    return PREPARE_SUCCESS;
+  }
+  if (value.len >= f->size)
+    return PREPARE_STRING_TOO_LONG;
+
+  StatementArena *arena = &statement->arena;
+  char *slot = (char *)t->text;
+  if (slot < arena->buf || slot >= arena->buf + arena->used) {
+    if (arena->used + f->size > STATEMENT_ARENA_SIZE)
+      return PREPARE_STRING_TOO_LONG;
+    slot = arena->buf + arena->used;
+    arena->used += f->size;
+    t->text = slot;
+  }
+  memcpy(slot, value.ptr, value.len);
+  slot[value.len] = '\0';
+  t->value = hash_string_n(value.ptr, value.len);
+  return PREPARE_SUCCESS;
+}
 
-  if (!expect_token_ctx(&curr, "insert", ctx))
-    return PREPARE_UNRECOGNIZED_STATEMENT;
-  if (!expect_token_ctx(&curr, "into", ctx))
-    return PREPARE_SYNTAX_ERROR;
+/** consume_operator reads a comparison, which may span two tokens. */
+static bool consume_operator(const char **curr, CompareOp *op) {
+  Token token = consume_token(curr);
+  if (token.ptr == nullptr)
+    return false;
+  // Two-character operators are only joined when written without a space
+  const char *after = *curr;
+  Token next = consume_token(&after);
+  bool joined = next.ptr == token.ptr + 1 && !next.quoted;
+  if (token_is(token, "=")) {
+    *op = CMP_EQ;
+    return true;
+  }
+  if (token_is(token, "!")) {
+    *op = CMP_NE;
+    *curr = after;
+    return joined && token_is(next, "=");
+  }
+  if (token_is(token, "<")) {
+    *op = CMP_LT;
+    if (joined && token_is(next, "=")) {
+      *op = CMP_LE;
+      *curr = after;
+    } else if (joined && token_is(next, ">")) {
+      *op = CMP_NE;
+      *curr = after;
+    }
+    return true;
+  }
+  if (token_is(token, ">")) {
+    *op = CMP_GT;
+    if (joined && token_is(next, "=")) {
+      *op = CMP_GE;
+      *curr = after;
+    }
+    return true;
+  }
+  return false;
+}
 
-  char *table_name = consume_token_ctx(&curr, ctx);
-  if (table_name == nullptr)
+/**
+ * prepare_term adds a term `field op value` to the predicate, reading the
+ * value, or a '?' to bind it later.
+ */
+static PrepareResult prepare_term(const char **curr, Statement *statement,
+                                  Schema *schema, uint8_t field,
+                                  CompareOp op) {
+  Predicate *predicate = &statement->predicate;
+  if (predicate->num_terms >= MAX_PREDICATE_TERMS)
+    return PREPARE_SYNTAX_ERROR;
+  uint32_t term = predicate->num_terms++;
+  PredicateTerm *t = &predicate->terms[term];
+  t->field = field;
+  t->offset = (uint16_t)schema->fields[field].offset;
+  t->op = op;
+  t->eval = schema->fields[field].type == FIELD_INT ? int_evals[op]
+                                                    : text_evals[op];
+
+  Token val = consume_token(curr);
+  if (val.ptr == nullptr)
     return PREPARE_SYNTAX_ERROR;
+  if (is_parameter(val))
+    return add_parameter(statement, PARAM_PREDICATE, term)
+               ? PREPARE_SUCCESS
+               : PREPARE_SYNTAX_ERROR;
+  return set_term_value(statement, schema, term, val);
+}
 
-  int table_index = find_table(db, table_name);
-  if (table_index == -1) {
-    return PREPARE_NO_TABLE;
+/**
+ * prepare_where compiles `column op value {AND|OR column op value}` into the
+ * statement's predicate.
+ */
+static PrepareResult prepare_where(const char **curr, Statement *statement,
+                                   Schema *schema) {
+  Predicate *predicate = &statement->predicate;
+  while (true) {
+    Token column = consume_token(curr);
+    if (column.ptr == nullptr || column.quoted ||
+        (class_of(column.ptr[0]) & CHAR_PUNCT))
+      return PREPARE_SYNTAX_ERROR;
+    int field = find_field(schema, column);
+    if (field == -1)
+      return PREPARE_NO_COLUMN;
+
+    // `column BETWEEN a AND b` is `column >= a AND column <= b`
+    const char *after = *curr;
+    bool between = token_is(consume_token(&after), "between");
+    CompareOp op = CMP_GE;
+    if (between)
+      *curr = after;
+    else if (!consume_operator(curr, &op))
+      return PREPARE_SYNTAX_ERROR;
+    PrepareResult result =
+        prepare_term(curr, statement, schema, (uint8_t)field, op);
+    if (result == PREPARE_SUCCESS && between)
+      result = expect_token(curr, "and")
+                   ? prepare_term(curr, statement, schema, (uint8_t)field,
+                                  CMP_LE)
+                   : PREPARE_SYNTAX_ERROR;
+    if (result != PREPARE_SUCCESS)
+      return result;
+    PredicateTerm *t = &predicate->terms[predicate->num_terms - 1];
+
+    after = *curr;
+    Token next = consume_token(&after);
+    if (token_is(next, "and")) {
+      *curr = after;
+    } else if (token_is(next, "or")) {
+      t->ends_group = true;
+      *curr = after;
+    } else {
+      t->ends_group = true;
+      break;
+    }
   }
-  strncpy(statement->table_name, table_name, TABLE_NAME_MAX - 1);
-  statement->table_name[TABLE_NAME_MAX - 1] = '\0';
+
+  // A false term skips to the first term of the next group
+  uint32_t group_start = 0;
+  for (uint32_t i = 0; i < predicate->num_terms; i++) {
+    if (!predicate->terms[i].ends_group)
+      continue;
+    for (uint32_t j = group_start; j <= i; j++)
+      predicate->terms[j].next_group = (uint8_t)(i + 1);
+    group_start = i + 1;
+  }
+  return PREPARE_SUCCESS;
+}
+
+static PrepareResult use_table(Statement *statement, Database *db,
+                               Token name) {
+  if (name.ptr == nullptr)
+    return PREPARE_SYNTAX_ERROR;
+  if (name.len >= TABLE_NAME_MAX)
+    return PREPARE_NO_TABLE;
+  token_copy(name, statement->table_name, TABLE_NAME_MAX);
+  int table_index = find_table(db, statement->table_name);
+  if (table_index == -1)
+    return PREPARE_NO_TABLE;
   statement->table_index = (uint32_t)table_index;
+  return PREPARE_SUCCESS;
+}
+
+static PrepareResult prepare_insert(const char *line, Statement *statement,
+                                    Database *db) {
+  statement->type = STATEMENT_INSERT;
+  const char *curr = line;
+
+  if (!expect_token(&curr, "insert"))
+    return PREPARE_UNRECOGNIZED_STATEMENT;
+  if (!expect_token(&curr, "into"))
+    return PREPARE_SYNTAX_ERROR;
+
+  PrepareResult result = use_table(statement, db, consume_token(&curr));
+  if (result != PREPARE_SUCCESS)
+    return result;
 
   Schema *schema = &db->catalog.tables[statement->table_index].schema;
 
-  if (!expect_token_ctx(&curr, "values", ctx))
+  if (!expect_token(&curr, "values"))
     return PREPARE_SYNTAX_ERROR;
-  if (!expect_token_ctx(&curr, "(", ctx))
+  if (!expect_token(&curr, "("))
     return PREPARE_SYNTAX_ERROR;
 
   for (uint32_t i = 0; i < schema->num_fields; i++) {
-    char *token = consume_token_ctx(&curr, ctx);
-    if (token == nullptr)
+    Token token = consume_token(&curr);
+    if (token.ptr == nullptr)
       return PREPARE_SYNTAX_ERROR;
 
-    if (schema->fields[i].type == FIELD_INT) {
-      statement->insert_values[i] = atoi(token);
+    if (is_parameter(token)) {
+      if (!add_parameter(statement, PARAM_FIELD_VALUE, i))
+        return PREPARE_SYNTAX_ERROR;
+    } else if (schema->fields[i].type == FIELD_INT) {
+      statement->insert_values[i] = token_to_uint(token);
     } else {
-      if (strlen(token) >= schema->fields[i].size) {
-        return PREPARE_STRING_TOO_LONG;
-      }
-      // We must copy the string because PrepareContext will free the token
-      statement->insert_strings[i] = strdup(token);
-      if (i == 0) {
-        statement->insert_values[i] = hash_string(token);
-      }
+      result = set_text_value(statement, schema, i, token.ptr, token.len);
+      if (result != PREPARE_SUCCESS)
+        return result;
     }
 
     if (i < schema->num_fields - 1) {
-      if (!expect_token_ctx(&curr, ",", ctx))
+      if (!expect_token(&curr, ","))
         return PREPARE_SYNTAX_ERROR;
     }
   }
 
-  if (!expect_token_ctx(&curr, ")", ctx))
+  if (!expect_token(&curr, ")"))
     return PREPARE_SYNTAX_ERROR;
 
   return PREPARE_SUCCESS;
 }
 
-static PrepareResult prepare_create(char *line, Statement *statement,
-                                    Database *db, PrepareContext *ctx) {
+static PrepareResult prepare_create_index(const char *curr,
+                                          Statement *statement,
+                                          Database *db) {
+  statement->type = STATEMENT_CREATE_INDEX;
+
+  Token index_name = consume_token(&curr);
+  if (index_name.ptr == nullptr || index_name.len >= TABLE_NAME_MAX)
+    return PREPARE_SYNTAX_ERROR;
+  token_copy(index_name, statement->index_name, TABLE_NAME_MAX);
+  if (find_index(db, statement->index_name) != -1)
+    return PREPARE_INDEX_ALREADY_EXISTS;
+  if (db->catalog.num_indexes >= MAX_INDEXES)
+    return PREPARE_INDEX_CATALOG_FULL;
+
+  if (!expect_token(&curr, "on"))
+    return PREPARE_SYNTAX_ERROR;
+  PrepareResult result = use_table(statement, db, consume_token(&curr));
+  if (result != PREPARE_SUCCESS)
+    return result;
+  if (!expect_token(&curr, "("))
+    return PREPARE_SYNTAX_ERROR;
+
+  Token column = consume_token(&curr);
+  if (column.ptr == nullptr)
+    return PREPARE_SYNTAX_ERROR;
+  int field = find_field(&db->catalog.tables[statement->table_index].schema,
+                         column);
+  if (field == -1)
+    return PREPARE_NO_COLUMN;
+  statement->index_field = (uint32_t)field;
+
+  if (!expect_token(&curr, ")"))
+    return PREPARE_SYNTAX_ERROR;
+  return PREPARE_SUCCESS;
+}
+
+static PrepareResult prepare_create(const char *line, Statement *statement,
+                                    Database *db) {
   statement->type = STATEMENT_CREATE_TABLE;
   statement->new_schema.num_fields = 0;
   statement->new_schema.row_size = 0;
 
-  char *curr = line;
-  if (!expect_token_ctx(&curr, "create", ctx))
+  const char *curr = line;
+  if (!expect_token(&curr, "create"))
     return PREPARE_UNRECOGNIZED_STATEMENT;
-  if (!expect_token_ctx(&curr, "table", ctx))
+  Token object = consume_token(&curr);
+  if (token_is(object, "index"))
+    return prepare_create_index(curr, statement, db);
+  if (!token_is(object, "table"))
     return PREPARE_SYNTAX_ERROR;
 
-  char *table_name = consume_token_ctx(&curr, ctx);
-  if (table_name == nullptr)
+  Token table_name = consume_token(&curr);
+  if (table_name.ptr == nullptr)
     return PREPARE_SYNTAX_ERROR;
 
-  if (find_table(db, table_name) != -1) {
+  token_copy(table_name, statement->table_name, TABLE_NAME_MAX);
+  if (find_table(db, statement->table_name) != -1) {
     return PREPARE_TABLE_ALREADY_EXISTS;
   }
   if (db->catalog.num_tables >= MAX_TABLES) {
     return PREPARE_CATALOG_FULL;
   }
 
-  strncpy(statement->table_name, table_name, TABLE_NAME_MAX - 1);
-  statement->table_name[TABLE_NAME_MAX - 1] = '\0';
-
-  if (!expect_token_ctx(&curr, "(", ctx))
+  if (!expect_token(&curr, "("))
     return PREPARE_SYNTAX_ERROR;
 
   while (true) {
-    char *name = consume_token_ctx(&curr, ctx);
-    if (name == nullptr || strcmp(name, ")") == 0) {
+    Token name = consume_token(&curr);
+    if (name.ptr == nullptr || token_is(name, ")")) {
       break;
     }
 
@@ -182,34 +606,33 @@ static PrepareResult prepare_create(char *line, Statement *statement,
 
     Field *f =
         &statement->new_schema.fields[statement->new_schema.num_fields++];
-    if (strlen(name) >= FIELD_NAME_MAX) {
+    if (name.len >= FIELD_NAME_MAX) {
       return PREPARE_SYNTAX_ERROR;
     }
-    strncpy(f->name, name, FIELD_NAME_MAX - 1);
-    f->name[FIELD_NAME_MAX - 1] = '\0';
+    token_copy(name, f->name, FIELD_NAME_MAX);
 
-    char *type = consume_token_ctx(&curr, ctx);
-    if (type == nullptr)
+    Token type = consume_token(&curr);
+    if (type.ptr == nullptr)
       return PREPARE_SYNTAX_ERROR;
 
-    if (strcasecmp(type, "int") == 0) {
+    if (token_is(type, "int")) {
       f->type = FIELD_INT;
       f->size = 4;
     } else {
       f->type = FIELD_TEXT;
-      f->size = 32;
+      f->size = TEXT_FIELD_SIZE;
     }
 
     f->offset = statement->new_schema.row_size;
     statement->new_schema.row_size += f->size;
 
-    char *next = consume_token_ctx(&curr, ctx);
-    if (next == nullptr)
+    Token next = consume_token(&curr);
+    if (next.ptr == nullptr)
       return PREPARE_SYNTAX_ERROR;
-    if (strcmp(next, ")") == 0) {
+    if (token_is(next, ")")) {
       break;
     }
-    if (strcmp(next, ",") != 0) {
+    if (!token_is(next, ",")) {
       return PREPARE_SYNTAX_ERROR;
     }
   }
@@ -217,231 +640,506 @@ static PrepareResult prepare_create(char *line, Statement *statement,
   return PREPARE_SUCCESS;
 }
 
-static PrepareResult prepare_select(char *line, Statement *statement,
-                                    Database *db, PrepareContext *ctx) {
-  statement->type = STATEMENT_SELECT;
-  char *curr = line;
-
-  if (!expect_token_ctx(&curr, "select", ctx))
-    return PREPARE_UNRECOGNIZED_STATEMENT;
-  if (!expect_token_ctx(&curr, "*", ctx))
-    return PREPARE_SYNTAX_ERROR;
-  if (!expect_token_ctx(&curr, "from", ctx))
-    return PREPARE_SYNTAX_ERROR;
-
-  char *table_name = consume_token_ctx(&curr, ctx);
-  if (table_name == nullptr)
-    return PREPARE_SYNTAX_ERROR;
-
-  int table_index = find_table(db, table_name);
-  if (table_index == -1) {
-    return PREPARE_NO_TABLE;
+/**
+ * prepare_select_list parses `*` or a list of `func(column)`, `COUNT(*)` and
+ * bare column items. The column names are returned as tokens, to be looked up
+ * once the table is known; COUNT(*) gets a null token.
+ */
+static PrepareResult prepare_select_list(const char **curr,
+                                         Statement *statement,
+                                         Token *columns) {
+  static const struct {
+    const char *name;
+    AggregateFunc func;
+  } funcs[] = {{"count", AGG_COUNT}, {"sum", AGG_SUM}, {"min", AGG_MIN},
+               {"max", AGG_MAX},     {"avg", AGG_AVG}};
+
+  const char *after = *curr;
+  if (token_is(consume_token(&after), "*")) {
+    *curr = after;
+    return PREPARE_SUCCESS;
   }
-  strncpy(statement->table_name, table_name, TABLE_NAME_MAX - 1);
-  statement->table_name[TABLE_NAME_MAX - 1] = '\0';
-  statement->table_index = (uint32_t)table_index;
+  while (true) {
+    if (statement->num_items >= MAX_SELECT_ITEMS)
+      return PREPARE_SYNTAX_ERROR;
+    SelectItem *item = &statement->items[statement->num_items];
+    Token name = consume_token(curr);
+    if (name.ptr == nullptr || name.quoted ||
+        (class_of(name.ptr[0]) & CHAR_PUNCT))
+      return PREPARE_SYNTAX_ERROR;
 
-  Schema *schema = &db->catalog.tables[statement->table_index].schema;
+    Token column = name;
+    item->func = AGG_GROUP;
+    after = *curr;
+    if (token_is(consume_token(&after), "(")) {
+      *curr = after;
+      uint32_t f = 0;
+      while (f < sizeof(funcs) / sizeof(funcs[0]) &&
+             !token_is(name, funcs[f].name))
+        f++;
+      if (f == sizeof(funcs) / sizeof(funcs[0]))
+        return PREPARE_SYNTAX_ERROR;
+      item->func = funcs[f].func;
+      column = consume_token(curr);
+      if (column.ptr == nullptr || !expect_token(curr, ")"))
+        return PREPARE_SYNTAX_ERROR;
+      if (token_is(column, "*")) {
+        if (item->func != AGG_COUNT)
+          return PREPARE_SYNTAX_ERROR;
+        column = (Token){};
+      }
+    }
+    columns[statement->num_items++] = column;
 
-  char *where = consume_token_ctx(&curr, ctx);
-  if (where == nullptr || strcmp(where, ";") == 0) {
-    statement->where_condition = WHERE_NONE;
-    return PREPARE_SUCCESS;
+    after = *curr;
+    if (!token_is(consume_token(&after), ","))
+      return PREPARE_SUCCESS;
+    *curr = after;
   }
+}
 
-  if (strcasecmp(where, "where") != 0) {
-    return PREPARE_SYNTAX_ERROR;
+/**
+ * resolve_select_list looks up the columns of an aggregate SELECT. SUM, MIN,
+ * MAX and AVG need INT columns, and a bare column must be the GROUP BY one.
+ */
+static PrepareResult resolve_select_list(Statement *statement, Schema *schema,
+                                         const Token *columns) {
+  if (statement->num_items == 0)
+    return statement->grouped ? PREPARE_SYNTAX_ERROR : PREPARE_SUCCESS;
+  for (uint32_t i = 0; i < statement->num_items; i++) {
+    SelectItem *item = &statement->items[i];
+    if (columns[i].ptr == nullptr) {
+      item->field = COUNT_ALL;
+      continue;
+    }
+    int field = find_field(schema, columns[i]);
+    if (field == -1)
+      return PREPARE_NO_COLUMN;
+    item->field = (uint8_t)field;
+    if (item->func == AGG_GROUP &&
+        (!statement->grouped || item->field != statement->group_field))
+      return PREPARE_NOT_GROUPED;
+    if (item->func != AGG_GROUP && item->func != AGG_COUNT &&
+        schema->fields[field].type != FIELD_INT)
+      return PREPARE_AGGREGATE_NOT_INT;
   }
+  // Groups can only be ordered by the column they are grouped on
+  if (statement->ordered &&
+      (!statement->grouped || statement->order_field != statement->group_field))
+    return PREPARE_NOT_GROUPED;
+  return PREPARE_SUCCESS;
+}
 
-  consume_token_ctx(&curr, ctx); // Skip column name
-  char *op = consume_token_ctx(&curr, ctx);
-  if (op == nullptr)
+/**
+ * prepare_count reads the number after LIMIT or OFFSET, or a '?' to bind it
+ * later.
+ */
+static bool prepare_count(Token token, Statement *statement,
+                          ParamTarget target, uint32_t *count) {
+  if (is_parameter(token))
+    return add_parameter(statement, target, 0);
+  // Quoted numbers are read like those bound to INT columns
+  if (token.ptr == nullptr || (!token.quoted && !is_digit(token.ptr[0])))
+    return false;
+  *count = token_to_uint(token);
+  return true;
+}
+
+/**
+ * prepare_join reads `table ON column = column` after JOIN, one column from
+ * each table, and lays out the joined row in `schema`.
+ */
+static PrepareResult prepare_join(const char **curr, Statement *statement,
+                                  Database *db, Schema *schema) {
+  Token name = consume_token(curr);
+  if (name.ptr == nullptr || name.len >= TABLE_NAME_MAX)
+    return PREPARE_NO_TABLE;
+  char table_name[TABLE_NAME_MAX];
+  token_copy(name, table_name, TABLE_NAME_MAX);
+  int table = find_table(db, table_name);
+  if (table == -1)
+    return PREPARE_NO_TABLE;
+  // Without aliases, the columns of a table joined to itself have no names
+  // of their own
+  if ((uint32_t)table == statement->table_index ||
+      db->catalog.tables[statement->table_index].schema.num_fields +
+              db->catalog.tables[table].schema.num_fields >
+          MAX_FIELDS)
     return PREPARE_SYNTAX_ERROR;
+  statement->joined = true;
+  statement->join_table = (uint32_t)table;
+  join_schema(statement, db, schema);
 
-  if (strcmp(op, "=") == 0) {
-    statement->where_condition = WHERE_EQUALS;
-  } else if (strcmp(op, ">") == 0) {
-    statement->where_condition = WHERE_GREATER_THAN;
-  } else if (strcmp(op, "<") == 0) {
-    statement->where_condition = WHERE_LESS_THAN;
-  } else {
+  if (!expect_token(curr, "on"))
+    return PREPARE_SYNTAX_ERROR;
+  int a = find_field(schema, consume_token(curr));
+  if (!expect_token(curr, "="))
     return PREPARE_SYNTAX_ERROR;
+  int b = find_field(schema, consume_token(curr));
+  if (a == -1 || b == -1)
+    return PREPARE_NO_COLUMN;
+  uint32_t left_fields =
+      db->catalog.tables[statement->table_index].schema.num_fields;
+  if (a > b) {
+    int t = a;
+    a = b;
+    b = t;
   }
+  if ((uint32_t)a >= left_fields || (uint32_t)b < left_fields)
+    return PREPARE_SYNTAX_ERROR;
+  if (schema->fields[a].type != schema->fields[b].type)
+    return PREPARE_JOIN_TYPE_MISMATCH;
+  statement->join_left_field = (uint8_t)a;
+  statement->join_right_field = (uint8_t)(b - left_fields);
+  return PREPARE_SUCCESS;
+}
 
-  char *val = consume_token_ctx(&curr, ctx);
-  if (val == nullptr)
+static PrepareResult prepare_select(const char *line, Statement *statement,
+                                    Database *db) {
+  statement->type = STATEMENT_SELECT;
+  const char *curr = line;
+
+  if (!expect_token(&curr, "select"))
+    return PREPARE_UNRECOGNIZED_STATEMENT;
+  Token columns[MAX_SELECT_ITEMS];
+  PrepareResult result = prepare_select_list(&curr, statement, columns);
+  if (result != PREPARE_SUCCESS)
+    return result;
+  if (!expect_token(&curr, "from"))
     return PREPARE_SYNTAX_ERROR;
 
-  if (schema->num_fields > 0 && schema->fields[0].type == FIELD_TEXT) {
-    statement->where_key = hash_string(val);
-  } else {
-    statement->where_key = atoi(val);
-  }
+  result = use_table(statement, db, consume_token(&curr));
+  if (result != PREPARE_SUCCESS)
+    return result;
 
-  return PREPARE_SUCCESS;
+  Schema *schema = &db->catalog.tables[statement->table_index].schema;
+  Schema joined;
+
+  Token next = consume_token(&curr);
+  if (token_is(next, "inner")) {
+    next = consume_token(&curr);
+    if (!token_is(next, "join"))
+      return PREPARE_SYNTAX_ERROR;
+  }
+  if (token_is(next, "join")) {
+    // Joins return whole rows
+    if (statement->num_items > 0)
+      return PREPARE_SYNTAX_ERROR;
+    result = prepare_join(&curr, statement, db, &joined);
+    if (result != PREPARE_SUCCESS)
+      return result;
+    schema = &joined;
+    next = consume_token(&curr);
+  }
+  if (token_is(next, "where")) {
+    result = prepare_where(&curr, statement, schema);
+    if (result != PREPARE_SUCCESS)
+      return result;
+    next = consume_token(&curr);
+  }
+  if (token_is(next, "group")) {
+    if (statement->joined || !expect_token(&curr, "by"))
+      return PREPARE_SYNTAX_ERROR;
+    int field = find_field(schema, consume_token(&curr));
+    if (field == -1)
+      return PREPARE_NO_COLUMN;
+    statement->grouped = true;
+    statement->group_field = (uint8_t)field;
+    next = consume_token(&curr);
+  }
+  if (token_is(next, "order")) {
+    if (!expect_token(&curr, "by"))
+      return PREPARE_SYNTAX_ERROR;
+    int field = find_field(schema, consume_token(&curr));
+    if (field == -1)
+      return PREPARE_NO_COLUMN;
+    statement->ordered = true;
+    statement->order_field = (uint8_t)field;
+    next = consume_token(&curr);
+    if (token_is(next, "asc") || token_is(next, "desc")) {
+      statement->order_desc = token_is(next, "desc");
+      next = consume_token(&curr);
+    }
+  }
+  statement->limit = UINT32_MAX;
+  statement->offset = 0;
+  if (token_is(next, "limit")) {
+    if (!prepare_count(consume_token(&curr), statement, PARAM_LIMIT,
+                       &statement->limit))
+      return PREPARE_SYNTAX_ERROR;
+    next = consume_token(&curr);
+    if (token_is(next, "offset")) {
+      if (!prepare_count(consume_token(&curr), statement, PARAM_OFFSET,
+                         &statement->offset))
+        return PREPARE_SYNTAX_ERROR;
+      next = consume_token(&curr);
+    }
+  }
+  if (next.ptr != nullptr && !token_is(next, ";"))
+    return PREPARE_SYNTAX_ERROR;
+  return resolve_select_list(statement, schema, columns);
 }
 
-static PrepareResult prepare_delete(char *line, Statement *statement,
-                                    Database *db, PrepareContext *ctx) {
+static PrepareResult prepare_delete(const char *line, Statement *statement,
+                                    Database *db) {
   statement->type = STATEMENT_DELETE;
-  char *curr = line;
+  const char *curr = line;
 
-  if (!expect_token_ctx(&curr, "delete", ctx))
+  if (!expect_token(&curr, "delete"))
     return PREPARE_UNRECOGNIZED_STATEMENT;
-  if (!expect_token_ctx(&curr, "from", ctx))
+  if (!expect_token(&curr, "from"))
     return PREPARE_SYNTAX_ERROR;
 
-  char *table_name = consume_token_ctx(&curr, ctx);
-  if (table_name == nullptr)
-    return PREPARE_SYNTAX_ERROR;
-
-  int table_index = find_table(db, table_name);
-  if (table_index == -1) {
-    return PREPARE_NO_TABLE;
-  }
-  strncpy(statement->table_name, table_name, TABLE_NAME_MAX - 1);
-  statement->table_name[TABLE_NAME_MAX - 1] = '\0';
-  statement->table_index = (uint32_t)table_index;
+  PrepareResult result = use_table(statement, db, consume_token(&curr));
+  if (result != PREPARE_SUCCESS)
+    return result;
 
   Schema *schema = &db->catalog.tables[statement->table_index].schema;
 
-  if (!expect_token_ctx(&curr, "where", ctx))
+  if (!expect_token(&curr, "where"))
     return PREPARE_SYNTAX_ERROR;
-  consume_token_ctx(&curr, ctx); // Skip column name
-  if (!expect_token_ctx(&curr, "=", ctx))
+  consume_token(&curr); // Skip column name
+  if (!expect_token(&curr, "="))
     return PREPARE_SYNTAX_ERROR;
 
-  char *val = consume_token_ctx(&curr, ctx);
-  if (val == nullptr)
+  Token val = consume_token(&curr);
+  if (val.ptr == nullptr)
     return PREPARE_SYNTAX_ERROR;
 
-  if (schema->num_fields > 0 && schema->fields[0].type == FIELD_TEXT) {
-    statement->delete_id = hash_string(val);
+  if (is_parameter(val)) {
+    if (!add_parameter(statement, PARAM_KEY, 0))
+      return PREPARE_SYNTAX_ERROR;
   } else {
-    statement->delete_id = atoi(val);
+    statement->delete_id = key_from_token(schema, val);
   }
 
   return PREPARE_SUCCESS;
 }
 
-static PrepareResult prepare_update(char *line, Statement *statement,
-                                    Database *db, PrepareContext *ctx) {
+static PrepareResult prepare_update(const char *line, Statement *statement,
+                                    Database *db) {
   statement->type = STATEMENT_UPDATE;
   for (int i = 0; i < MAX_FIELDS; i++)
     statement->update_mask[i] = false;
 
-  char *curr = line;
-  if (!expect_token_ctx(&curr, "update", ctx))
+  const char *curr = line;
+  if (!expect_token(&curr, "update"))
     return PREPARE_UNRECOGNIZED_STATEMENT;
 
-  char *table_name = consume_token_ctx(&curr, ctx);
-  if (table_name == nullptr)
-    return PREPARE_SYNTAX_ERROR;
-
-  int table_index = find_table(db, table_name);
-  if (table_index == -1) {
-    return PREPARE_NO_TABLE;
-  }
-  strncpy(statement->table_name, table_name, TABLE_NAME_MAX - 1);
-  statement->table_name[TABLE_NAME_MAX - 1] = '\0';
-  statement->table_index = (uint32_t)table_index;
+  PrepareResult result = use_table(statement, db, consume_token(&curr));
+  if (result != PREPARE_SUCCESS)
+    return result;
 
   Schema *schema = &db->catalog.tables[statement->table_index].schema;
 
-  if (!expect_token_ctx(&curr, "set", ctx))
+  if (!expect_token(&curr, "set"))
     return PREPARE_SYNTAX_ERROR;
 
   while (true) {
-    char *name = consume_token_ctx(&curr, ctx);
-    if (name == nullptr)
+    Token name = consume_token(&curr);
+    if (name.ptr == nullptr)
       return PREPARE_SYNTAX_ERROR;
 
-    int field_idx = -1;
-    for (uint32_t i = 0; i < schema->num_fields; i++) {
-      if (strcasecmp(name, schema->fields[i].name) == 0) {
-        field_idx = i;
-        break;
-      }
-    }
-
+    int field_idx = find_field(schema, name);
     if (field_idx == -1)
       return PREPARE_SYNTAX_ERROR;
 
-    if (!expect_token_ctx(&curr, "=", ctx))
+    if (!expect_token(&curr, "="))
       return PREPARE_SYNTAX_ERROR;
 
-    char *val = consume_token_ctx(&curr, ctx);
-    if (val == nullptr)
+    Token val = consume_token(&curr);
+    if (val.ptr == nullptr)
       return PREPARE_SYNTAX_ERROR;
 
     statement->update_mask[field_idx] = true;
-    if (schema->fields[field_idx].type == FIELD_INT) {
-      statement->insert_values[field_idx] = atoi(val);
+    if (is_parameter(val)) {
+      if (!add_parameter(statement, PARAM_FIELD_VALUE, field_idx))
+        return PREPARE_SYNTAX_ERROR;
+    } else if (schema->fields[field_idx].type == FIELD_INT) {
+      statement->insert_values[field_idx] = token_to_uint(val);
     } else {
-      if (strlen(val) >= schema->fields[field_idx].size) {
-        return PREPARE_STRING_TOO_LONG;
-      }
-      statement->insert_strings[field_idx] = strdup(val);
+      result = set_text_value(statement, schema, field_idx, val.ptr, val.len);
+      if (result != PREPARE_SUCCESS)
+        return result;
     }
 
-    char *next = consume_token_ctx(&curr, ctx);
-    if (next == nullptr)
+    Token next = consume_token(&curr);
+    if (next.ptr == nullptr)
       return PREPARE_SYNTAX_ERROR;
-    if (strcasecmp(next, "where") == 0) {
+    if (token_is(next, "where")) {
       break;
     }
-    if (strcmp(next, ",") != 0) {
+    if (!token_is(next, ",")) {
       return PREPARE_SYNTAX_ERROR;
     }
   }
 
-  consume_token_ctx(&curr, ctx); // Skip column name (assume it's the PK)
-  if (!expect_token_ctx(&curr, "=", ctx))
+  consume_token(&curr); // Skip column name (assume it's the PK)
+  if (!expect_token(&curr, "="))
     return PREPARE_SYNTAX_ERROR;
 
-  char *val = consume_token_ctx(&curr, ctx);
-  if (val == nullptr)
+  Token val = consume_token(&curr);
+  if (val.ptr == nullptr)
     return PREPARE_SYNTAX_ERROR;
 
-  if (schema->num_fields > 0 && schema->fields[0].type == FIELD_TEXT) {
-    statement->update_key = hash_string(val);
+  if (is_parameter(val)) {
+    if (!add_parameter(statement, PARAM_KEY, 0))
+      return PREPARE_SYNTAX_ERROR;
   } else {
-    statement->update_key = atoi(val);
+    statement->update_key = key_from_token(schema, val);
+  }
+
+  return PREPARE_SUCCESS;
+}
+
+/**
+ * prepare_explain parses `EXPLAIN [ANALYZE] SELECT ...`: the SELECT is
+ * prepared as usual and marked to have its plan printed.
+ */
+static PrepareResult prepare_explain(const char *line, Statement *statement,
+                                     Database *db) {
+  const char *curr = line;
+  if (!expect_token(&curr, "explain"))
+    return PREPARE_UNRECOGNIZED_STATEMENT;
+  ExplainMode mode = EXPLAIN_PLAN;
+  const char *after = curr;
+  if (token_is(consume_token(&after), "analyze")) {
+    mode = EXPLAIN_ANALYZE;
+    curr = after;
   }
+  after = curr;
+  if (!token_is(consume_token(&after), "select"))
+    return PREPARE_EXPLAIN_NOT_SELECT;
+  PrepareResult result = prepare_select(curr, statement, db);
+  statement->explain = mode;
+  return result;
+}
 
+/**
+ * prepare_analyze parses `ANALYZE [table]`; without a table, every table is
+ * analyzed.
+ */
+static PrepareResult prepare_analyze(const char *line, Statement *statement,
+                                     Database *db) {
+  statement->type = STATEMENT_ANALYZE;
+  statement->table_name[0] = '\0';
+  const char *curr = line;
+  if (!expect_token(&curr, "analyze"))
+    return PREPARE_UNRECOGNIZED_STATEMENT;
+  Token name = consume_token(&curr);
+  if (name.ptr == nullptr || token_is(name, ";"))
+    return PREPARE_SUCCESS;
+  PrepareResult result = use_table(statement, db, name);
+  if (result != PREPARE_SUCCESS)
+    return result;
+  Token next = consume_token(&curr);
+  if (next.ptr != nullptr && !token_is(next, ";"))
+    return PREPARE_SYNTAX_ERROR;
   return PREPARE_SUCCESS;
 }
 
 PrepareResult prepare_statement(char *line, Statement *statement,
                                 Database *db) {
-  PrepareContext ctx = {.num_tokens = 0};
-  PrepareResult result;
-
-  if (strncasecmp(line, "create", 6) == 0) {
-    result = prepare_create(line, statement, db, &ctx);
+  if (strncasecmp(line, "explain", 7) == 0) {
+    return prepare_explain(line, statement, db);
+  } else if (strncasecmp(line, "analyze", 7) == 0) {
+    return prepare_analyze(line, statement, db);
+  } else if (strncasecmp(line, "create", 6) == 0) {
+    return prepare_create(line, statement, db);
   } else if (strncasecmp(line, "insert", 6) == 0) {
-    result = prepare_insert(line, statement, db, &ctx);
+    return prepare_insert(line, statement, db);
   } else if (strncasecmp(line, "select", 6) == 0) {
-    result = prepare_select(line, statement, db, &ctx);
+    return prepare_select(line, statement, db);
   } else if (strncasecmp(line, "delete", 6) == 0) {
-    result = prepare_delete(line, statement, db, &ctx);
+    return prepare_delete(line, statement, db);
   } else if (strncasecmp(line, "update", 6) == 0) {
-    result = prepare_update(line, statement, db, &ctx);
+    return prepare_update(line, statement, db);
   } else if (strcasecmp(line, "begin") == 0) {
     statement->type = STATEMENT_BEGIN;
-    result = PREPARE_SUCCESS;
+    return PREPARE_SUCCESS;
   } else if (strcasecmp(line, "commit") == 0) {
     statement->type = STATEMENT_COMMIT;
-    result = PREPARE_SUCCESS;
+    return PREPARE_SUCCESS;
   } else if (strcasecmp(line, "rollback") == 0) {
     statement->type = STATEMENT_ROLLBACK;
-    result = PREPARE_SUCCESS;
-  } else {
-    result = PREPARE_UNRECOGNIZED_STATEMENT;
+    return PREPARE_SUCCESS;
   }
+  return PREPARE_UNRECOGNIZED_STATEMENT;
+}
 
-  free_context(&ctx);
-  return result;
+static bool is_number(Token token) {
+  uint32_t i = token.ptr[0] == '-' || token.ptr[0] == '+' ? 1 : 0;
+  return i < token.len && is_digit(token.ptr[i]);
+}
+
+bool normalize_statement(const char *line, char *out, size_t size,
+                         Token *literals, uint32_t max_literals,
+                         uint32_t *num_literals) {
+  const char *curr = line;
+  const char *copied = line; // Input before this is already in `out`
+  size_t used = 0;
+  *num_literals = 0;
+  while (true) {
+    Token token = consume_token(&curr);
+    if (token.ptr == nullptr)
+      break;
+    if (!token.quoted && !is_number(token))
+      continue;
+    if (*num_literals >= max_literals)
+      return false;
+    literals[(*num_literals)++] = token;
+
+    const char *start = token.quoted ? token.ptr - 1 : token.ptr;
+    size_t len = (size_t)(start - copied);
+    if (used + len + 1 >= size)
+      return false;
+    memcpy(out + used, copied, len);
+    used += len;
+    out[used++] = '?';
+    copied = curr;
+  }
+  size_t len = strlen(copied);
+  if (used + len >= size)
+    return false;
+  memcpy(out + used, copied, len + 1);
+  return true;
+}
+
+bool match_normalized(const char *line, const char *sql, Token *literals,
+                      uint32_t max_literals, uint32_t *num_literals) {
+  const char *s = line;
+  *num_literals = 0;
+  for (const char *k = sql; *k; k++) {
+    if (*k != '?') {
+      if (*s++ != *k)
+        return false;
+      continue;
+    }
+
+    // A literal goes here: a quoted string or a number, as the tokenizer
+    // would read it
+    Token literal;
+    if (*s == '\'') {
+      const char *start = ++s;
+      while (*s && *s != '\'')
+        s++;
+      literal = (Token){
+          .ptr = start, .len = (uint32_t)(s - start), .quoted = true};
+      if (*s == '\'')
+        s++;
+    } else {
+      const char *start = s;
+      while (!(class_of(*s) & CHAR_STOP))
+        s++;
+      literal = (Token){.ptr = start, .len = (uint32_t)(s - start)};
+      if (literal.len == 0 || !is_number(literal))
+        return false;
+    }
+    if (*num_literals >= max_literals)
+      return false;
+    literals[(*num_literals)++] = literal;
+  }
+  return *s == '\0';
 }
 
 static ExecuteResult execute_insert(Statement *statement, Database *db) {
@@ -453,217 +1151,690 @@ static ExecuteResult execute_insert(Statement *statement, Database *db) {
   if (c->cell_num < *leaf_node_num_cells(node)) {
     uint32_t key_at_index = *leaf_node_key(node, c->cell_num, &td->schema);
     if (key_at_index == statement->insert_values[0]) {
-      free_statement(statement);
       free(c);
       unpin_page_all(db->pager);
       return EXECUTE_DUPLICATE_KEY;
     }
   }
+  if (!pager_has_room(db->pager, btree_insert_pages(db, table_index) +
+                                     index_insert_pages(db, table_index))) {
+    free(c);
+    unpin_page_all(db->pager);
+    return EXECUTE_TABLE_FULL;
+  }
 
-  leaf_node_insert(c, statement->insert_values[0], statement);
-
-  free_statement(statement);
+  char row[MAX_FIELDS * TEXT_FIELD_SIZE];
+  serialize_row(&td->schema, statement, row);
+  leaf_node_insert_row(c, statement->insert_values[0], row);
   free(c);
+  index_insert_row(db, table_index, statement->insert_values[0], row);
+
   unpin_page_all(db->pager);
   return EXECUTE_SUCCESS;
 }
 
-static void print_box_header(Schema *schema, uint32_t *widths) {
-  printf("┌");
+/** print_box_rule draws a horizontal rule with the given corners/joints. */
+static void print_box_rule(ResultSink *out, Schema *schema,
+                           const uint32_t *widths, const char *left,
+                           const char *joint, const char *right) {
+  // Box-drawing characters are three bytes of UTF-8 each
+  sink_bytes(out, left, 3);
   for (uint32_t i = 0; i < schema->num_fields; i++) {
-    for (uint32_t j = 0; j < widths[i] + 2; j++)
-      printf("─");
+    sink_repeat(out, "─", 3, widths[i] + 2);
     if (i < schema->num_fields - 1)
-      printf("┬");
+      sink_bytes(out, joint, 3);
   }
-  printf("┐\n");
+  sink_bytes(out, right, 3);
+  sink_char(out, '\n');
+}
 
-  printf("│");
+/** print_box_cell writes ` value │`, the value padded to `width`. */
+static void print_box_cell(ResultSink *out, const char *value, size_t len,
+                           uint32_t width) {
+  sink_char(out, ' ');
+  sink_bytes(out, value, len);
+  sink_fill(out, ' ', len < width ? width - len : 0);
+  sink_bytes(out, " │", 4);
+}
+
+static void print_box_header(ResultSink *out, Schema *schema,
+                             const uint32_t *widths) {
+  print_box_rule(out, schema, widths, "┌", "┬", "┐");
+  sink_bytes(out, "│", 3);
   for (uint32_t i = 0; i < schema->num_fields; i++) {
-    printf(" %-*s │", widths[i], schema->fields[i].name);
+    const char *name = schema->fields[i].name;
+    print_box_cell(out, name, strlen(name), widths[i]);
   }
-  printf("\n");
+  sink_char(out, '\n');
+  print_box_rule(out, schema, widths, "├", "┼", "┤");
+}
 
-  printf("├");
-  for (uint32_t i = 0; i < schema->num_fields; i++) {
-    for (uint32_t j = 0; j < widths[i] + 2; j++)
-      printf("─");
-    if (i < schema->num_fields - 1)
-      printf("┼");
+static void print_box_footer(ResultSink *out, Schema *schema,
+                             const uint32_t *widths) {
+  print_box_rule(out, schema, widths, "└", "┴", "┘");
+}
+
+/**
+ * field_range gathers the terms of a single AND group on `field` into the key
+ * range they allow. TEXT keys are hashes, so only '=' bounds them. Returns
+ * how well the range narrows a walk: 4 for one key, 2 for both ends, 1 for
+ * one end and 0 when no term applies.
+ */
+static int field_range(const Predicate *predicate, const Schema *schema,
+                       uint32_t field, KeyRange *range) {
+  *range = (KeyRange){};
+  for (uint32_t i = 0; i < predicate->num_terms; i++) {
+    const PredicateTerm *t = &predicate->terms[i];
+    if (t->field != field || t->op == CMP_NE)
+      continue;
+    if (schema->fields[field].type == FIELD_TEXT && t->op != CMP_EQ)
+      continue;
+    key_range_narrow(range, t->op, t->value);
   }
-  printf("┤\n");
+  if (range->has_lower && range->has_upper)
+    return range->lower == range->upper && range->lower_inclusive &&
+                   range->upper_inclusive
+               ? 4
+               : 2;
+  return range->has_lower || range->has_upper ? 1 : 0;
 }
 
-static void print_box_footer(Schema *schema, uint32_t *widths) {
-  printf("└");
-  for (uint32_t i = 0; i < schema->num_fields; i++) {
-    for (uint32_t j = 0; j < widths[i] + 2; j++)
-      printf("─");
-    if (i < schema->num_fields - 1)
-      printf("┴");
+/**
+ * choose_access_path picks the B-Tree a SELECT walks and the range of its
+ * keys: the primary key or an indexed column, whichever the terms narrow
+ * best (one key before both ends before one end), else the whole table.
+ * Once the table is analyzed, the walk estimated to fetch the fewest pages
+ * wins instead, so a wide index range loses to a full scan. Terms can only
+ * bound the walk when the predicate is a single AND group.
+ */
+static uint32_t choose_access_path(Statement *statement, Database *db) {
+  Predicate *predicate = &statement->predicate;
+  Schema *schema = &db->catalog.tables[statement->table_index].schema;
+  const TableStats *stats = db->table_stats[statement->table_index];
+  uint32_t tree = statement->table_index;
+  int best_rank = 0;
+  double best_cost = stats != nullptr ? estimate_cost(db, stats, tree, 1.0) : 0;
+
+  statement->key_range = (KeyRange){};
+  for (uint32_t i = 0; i + 1 < predicate->num_terms; i++) {
+    if (predicate->terms[i].ends_group)
+      return tree; // OR: no range bounds every match
+  }
+  for (uint32_t field = 0; field < schema->num_fields; field++) {
+    int index =
+        field == 0 ? -1 : find_column_index(db, statement->table_index, field);
+    if (field != 0 && index == -1)
+      continue;
+    KeyRange range;
+    int rank = field_range(predicate, schema, field, &range);
+    if (rank == 0)
+      continue;
+    uint32_t candidate = field == 0 ? statement->table_index
+                                    : INDEX_TREE_BASE + (uint32_t)index;
+    // The table beats an index at equal footing
+    rank += field == 0 ? 1 : 0;
+    if (stats != nullptr) {
+      // Equal costs go to the narrower range, which tests fewer rows
+      double cost = estimate_cost(db, stats, candidate,
+                                  estimate_range(stats, field, &range));
+      if (cost > best_cost || (cost == best_cost && rank <= best_rank))
+        continue;
+      best_cost = cost;
+    } else if (rank <= best_rank) {
+      continue;
+    }
+    best_rank = rank;
+    statement->key_range = range;
+    tree = candidate;
+  }
+  if (best_rank == 0) {
+    // With a LIMIT, an index already in ORDER BY order saves sorting the
+    // whole table for its first rows
+    int index = statement->ordered && statement->order_field != 0
+                    ? find_column_index(db, statement->table_index,
+                                        statement->order_field)
+                    : -1;
+    if (index != -1 && statement->limit != UINT32_MAX &&
+        schema->fields[statement->order_field].type == FIELD_INT)
+      tree = INDEX_TREE_BASE + (uint32_t)index;
   }
-  printf("┘\n");
+  return tree;
 }
 
-static ExecuteResult execute_select(Statement *statement, Database *db) {
-  uint32_t table_index = statement->table_index;
-  TableDefinition *td = &db->catalog.tables[table_index];
+/**
+ * tree_in_order tells whether walking `tree`, backward for DESC, returns a
+ * SELECT's rows in its ORDER BY order. TEXT keys are hashes, so only INT keys
+ * qualify.
+ */
+static bool tree_in_order(const Statement *statement, Database *db,
+                          uint32_t tree) {
+  if (!statement->ordered || statement->num_items > 0)
+    return true; // Aggregates order their groups themselves
+  Schema *schema = &db->catalog.tables[statement->table_index].schema;
+  if (schema->fields[statement->order_field].type != FIELD_INT)
+    return false;
+  if (tree < INDEX_TREE_BASE)
+    return statement->order_field == 0;
+  return db->catalog.indexes[tree - INDEX_TREE_BASE].field_index ==
+         statement->order_field;
+}
+
+bool select_needs_sort(const Statement *statement, const Cursor *c) {
+  return !tree_in_order(statement, c->db, c->table_index);
+}
+
+/**
+ * reverse_start returns a cursor for a backward walk: its cell_num counts the
+ * cells of the leaf still to be returned, so it sits just past the last key
+ * the bound admits.
+ */
+static Cursor *reverse_start(Statement *statement, Database *db,
+                             uint32_t tree) {
+  uint32_t first, last;
+  key_range_bounds(&statement->key_range, &first, &last);
+  if (last == UINT32_MAX)
+    return table_end(db, tree);
+  return find_node(db, tree, tree_root_page(db, tree), last + 1);
+}
+
+uint32_t select_plan(Statement *statement, Database *db) {
+  uint32_t tree = choose_access_path(statement, db);
+  statement->reverse = statement->ordered && statement->order_desc &&
+                       statement->num_items == 0 &&
+                       tree_in_order(statement, db, tree);
+  return tree;
+}
+
+Cursor *select_open(Statement *statement, Database *db) {
+  uint32_t tree = select_plan(statement, db);
+  bool in_order = tree_in_order(statement, db, tree);
+  // Aggregates read every row, and their OFFSET applies to the result; so
+  // does a sort's
+  uint32_t offset =
+      statement->num_items == 0 && in_order ? statement->offset : 0;
+  uint32_t first, last;
+  if (offset > 0 && tree == statement->table_index &&
+      predicate_key_range(&statement->predicate, tree_schema(db, tree), &first,
+                          &last)) {
+    if (!statement->reverse)
+      return find_node_by_rank(db, tree,
+                               btree_rank(db, tree, first) + offset);
+    // Backward, the walk starts after the row `offset` places before the end
+    uint32_t end = last == UINT32_MAX ? btree_row_count(db, tree)
+                                      : btree_rank(db, tree, last + 1);
+    return find_node_by_rank(db, tree, end > offset ? end - offset : 0);
+  }
+
   Cursor *c;
-  if (statement->where_condition == WHERE_NONE ||
-      statement->where_condition == WHERE_LESS_THAN) {
-    c = table_start(db, table_index);
+  if (statement->reverse) {
+    c = reverse_start(statement, db, tree);
+  } else if (statement->key_range.has_lower) {
+    key_range_bounds(&statement->key_range, &first, &last);
+    c = find_node(db, tree, tree_root_page(db, tree), first);
   } else {
-    c = find_node(db, table_index, td->root_page_num, statement->where_key);
+    c = table_start(db, tree);
+  }
+  for (uint32_t i = 0; i < offset; i++) {
+    if (select_next(statement, db, c) == nullptr)
+      break;
   }
+  return c;
+}
 
-  if (db->print_mode == PRINT_BOX) {
-    // In a real DB we wouldn't load everything into memory, but for education
-    // and small tables it's fine.
-    uint32_t widths[MAX_FIELDS];
-    for (uint32_t i = 0; i < td->schema.num_fields; i++) {
-      widths[i] = (uint32_t)strlen(td->schema.fields[i].name);
-    }
-
-    // First pass: calculate widths
-    Cursor *temp_c = malloc(sizeof(Cursor));
-    memcpy(temp_c, c, sizeof(Cursor));
-    while (true) {
-      void *node = get_page(db->pager, temp_c->page_num);
-      if (temp_c->cell_num >= *leaf_node_num_cells(node)) {
-        uint32_t next = *leaf_node_next_leaf(node);
-        if (next == 0)
-          break;
-        temp_c->page_num = next;
-        temp_c->cell_num = 0;
-        continue;
+/**
+ * next_cell steps the cursor to the next cell in the walk's direction,
+ * crossing to the next or previous leaf as needed. Returns the cell's leaf and
+ * sets `cell`, or returns nullptr when the walk has run off the end.
+ */
+static void *next_cell(const Statement *statement, Database *db, Cursor *c,
+                       uint32_t *cell) {
+  while (true) {
+    void *node = get_page(db->pager, c->page_num);
+    if (statement->reverse) {
+      if (c->cell_num > 0) {
+        *cell = --c->cell_num;
+        return node;
       }
+      uint32_t prev = *leaf_node_prev_leaf(node);
+      if (prev == 0)
+        return nullptr;
+      unpin_page_all(db->pager); // Leaving this leaf; nothing else is held
+      c->page_num = prev;
+      c->cell_num = *leaf_node_num_cells(get_page(db->pager, prev));
+      continue;
+    }
+    if (c->cell_num < *leaf_node_num_cells(node)) {
+      *cell = c->cell_num++;
+      return node;
+    }
+    uint32_t next = *leaf_node_next_leaf(node);
+    if (next == 0)
+      return nullptr;
+    unpin_page_all(db->pager);
+    c->page_num = next;
+    c->cell_num = 0;
+  }
+}
 
-      uint32_t key = *leaf_node_key(node, temp_c->cell_num, &td->schema);
-      if (statement->where_condition == WHERE_EQUALS &&
-          key != statement->where_key)
-        break;
-      if (statement->where_condition == WHERE_GREATER_THAN &&
-          key <= statement->where_key) {
-        temp_c->cell_num++;
+void *select_next(Statement *statement, Database *db, Cursor *c) {
+  Schema *schema = tree_schema(db, c->table_index);
+  bool by_index = c->table_index >= INDEX_TREE_BASE;
+  uint32_t first, last;
+  key_range_bounds(&statement->key_range, &first, &last);
+  while (true) {
+    // Rows fetched through an index pin a table path each; release them
+    if (by_index)
+      unpin_page_all(db->pager);
+    uint32_t cell;
+    void *node = next_cell(statement, db, c, &cell);
+    if (node == nullptr)
+      return nullptr;
+
+    // The walk started at the near end of the range; check the far one
+    uint32_t key = *leaf_node_key(node, cell, schema);
+    if (statement->reverse ? key < first : key > last)
+      return nullptr;
+    db->rows_scanned++;
+
+    void *row = leaf_node_value(node, cell, schema);
+    c->row_page = c->page_num;
+    if (by_index) {
+      uint32_t pk;
+      memcpy(&pk, row, sizeof(pk));
+      row = index_fetch_row(db, statement->table_index, pk, &c->row_page);
+      if (row == nullptr)
         continue;
-      }
-      if (statement->where_condition == WHERE_LESS_THAN &&
-          key >= statement->where_key)
-        break;
+    }
+    // The bound only narrows the walk; every term is still checked, which
+    // also settles TEXT hash collisions
+    if (!predicate_matches(&statement->predicate, row))
+      continue;
+    return row;
+  }
+}
 
-      void *val = leaf_node_value(node, temp_c->cell_num, &td->schema);
-      for (uint32_t i = 0; i < td->schema.num_fields; i++) {
-        char buf[64];
-        if (td->schema.fields[i].type == FIELD_INT) {
-          uint32_t v;
-          deserialize_field(&td->schema, i, val, &v);
-          snprintf(buf, sizeof(buf), "%u", v);
-        } else {
-          deserialize_field(&td->schema, i, val, buf);
-        }
-        uint32_t len = (uint32_t)strlen(buf);
-        if (len > widths[i])
-          widths[i] = len;
-      }
-      temp_c->cell_num++;
+/**
+ * SelectRows hands out a SELECT's rows one at a time for printing. Scans of
+ * the table run in batches, so the WHERE clause is applied a column at a time;
+ * walks of an index, and backward walks, go through select_next(). An aggregate SELECT hands out
+ * the rows of its result set, a join its joined rows, and an ORDER BY that
+ * needs a sort those of its sorter.
+ */
+typedef struct {
+  Statement *statement;
+  Database *db;
+  Schema *schema;    // Layout of the rows handed out
+  Cursor *cursor;    // Index walks
+  BatchScan *scan;   // Table walks
+  RowBatch *batch;
+  ResultSet *result; // Aggregates
+  Sorter *sorter;    // ORDER BY
+  Join *join;        // Joins, laid out in joined
+  Schema joined;
+  uint32_t next;     // Next selected row of the batch or result
+  uint32_t returned; // Scanned rows handed out, up to the LIMIT
+} SelectRows;
+
+static void select_rows_open(SelectRows *rows, Statement *statement,
+                             Database *db) {
+  *rows = (SelectRows){
+      .statement = statement,
+      .db = db,
+      .schema = &db->catalog.tables[statement->table_index].schema,
+  };
+  if (statement->num_items > 0) {
+    rows->result = aggregate_execute(statement, db);
+    rows->schema = &rows->result->schema;
+    return;
+  }
+  if (statement->joined) {
+    join_schema(statement, db, &rows->joined);
+    rows->schema = &rows->joined;
+    if (statement->ordered)
+      rows->sorter = join_sorted(statement, db);
+    else
+      rows->join = join_open(statement, db);
+    return;
+  }
+  Cursor *c = select_open(statement, db);
+  if (select_needs_sort(statement, c))
+    rows->sorter = select_sorted(statement, db, c);
+  else if (c->table_index < INDEX_TREE_BASE && !statement->reverse) {
+    rows->scan = batch_scan_open(statement, db, c, 0);
+    if (statement->limit != UINT32_MAX)
+      batch_scan_limit(rows->scan, statement->limit);
+  } else
+    rows->cursor = c;
+}
+
+static const void *select_rows_next(SelectRows *rows) {
+  if (rows->result != nullptr) {
+    if (rows->next == rows->result->num_rows)
+      return nullptr;
+    return rows->result->rows + rows->next++ * rows->schema->row_size;
+  }
+  if (rows->sorter != nullptr)
+    return sorter_next(rows->sorter);
+  if (rows->returned == rows->statement->limit)
+    return nullptr;
+  rows->returned++;
+  if (rows->join != nullptr)
+    return join_next(rows->join);
+  if (rows->scan == nullptr)
+    return select_next(rows->statement, rows->db, rows->cursor);
+  while (rows->batch == nullptr ||
+         rows->next == rows->batch->num_selected) {
+    rows->batch = batch_scan_next(rows->scan);
+    rows->next = 0;
+    if (rows->batch == nullptr)
+      return nullptr;
+  }
+  return rows->batch->rows[rows->batch->sel[rows->next++]];
+}
+
+/** select_rows_failed tells whether the rows were cut short by an I/O error. */
+static bool select_rows_failed(const SelectRows *rows) {
+  return (rows->result != nullptr && rows->result->failed) ||
+         (rows->sorter != nullptr && sorter_failed(rows->sorter)) ||
+         (rows->join != nullptr && join_failed(rows->join));
+}
+
+static void select_rows_close(SelectRows *rows) {
+  if (rows->scan != nullptr)
+    batch_scan_close(rows->scan);
+  free(rows->cursor);
+  join_close(rows->join);
+  result_set_free(rows->result);
+  sorter_close(rows->sorter);
+  unpin_page_all(rows->db->pager);
+}
+
+/**
+ * max_field_width is the most characters a value of field `i` can print as:
+ * ten digits for an INT, the stored length for a TEXT.
+ */
+static uint32_t max_field_width(const Schema *schema, uint32_t i) {
+  return schema->fields[i].type == FIELD_INT ? 10 : TEXT_FIELD_SIZE - 1;
+}
+
+/**
+ * field_text points `text` at the printed form of field `i` of a row and
+ * returns its length. INTs are formatted into `digits`; TEXT is read in place.
+ */
+static size_t field_text(const Schema *schema, uint32_t i, const void *row,
+                         char (*digits)[10], const char **text) {
+  const Field *f = &schema->fields[i];
+  const char *value = (const char *)row + f->offset;
+  if (f->type == FIELD_INT) {
+    uint32_t v;
+    memcpy(&v, value, sizeof(v));
+    *text = format_uint(v, *digits + sizeof(*digits));
+    return (size_t)(*digits + sizeof(*digits) - *text);
+  }
+  *text = value;
+  const char *end = memchr(value, '\0', f->size);
+  return end != nullptr ? (size_t)(end - value) : f->size;
+}
+
+static void print_box_row(ResultSink *out, Schema *schema,
+                          const uint32_t *widths, const void *row) {
+  sink_bytes(out, "│", 3);
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    char digits[10];
+    const char *text;
+    size_t len = field_text(schema, i, row, &digits, &text);
+    print_box_cell(out, text, len, widths[i]);
+  }
+  sink_char(out, '\n');
+}
+
+static void print_plain_row(ResultSink *out, Schema *schema, const void *row) {
+  sink_char(out, '(');
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    const Field *f = &schema->fields[i];
+    if (f->type == FIELD_INT) {
+      uint32_t v;
+      memcpy(&v, (const char *)row + f->offset, sizeof(v));
+      sink_uint(out, v);
+    } else {
+      sink_text(out, (const char *)row + f->offset, f->size);
     }
-    free(temp_c);
+    if (i < schema->num_fields - 1)
+      sink_bytes(out, ", ", 2);
+  }
+  sink_bytes(out, ")\n", 2);
+}
 
-    print_box_header(&td->schema, widths);
+/** csv_special tells whether a CSV value holding `c` must be quoted. */
+static inline bool csv_special(char c) {
+  return c == ',' || c == '"' || c == '\r' || c == '\n';
+}
 
-    // Second pass: print rows
-    while (true) {
-      void *node = get_page(db->pager, c->page_num);
-      if (c->cell_num >= *leaf_node_num_cells(node)) {
-        uint32_t next = *leaf_node_next_leaf(node);
-        if (next == 0)
-          break;
-        c->page_num = next;
-        c->cell_num = 0;
-        continue;
-      }
+/** print_csv_text writes a TEXT value, quoted if it must be (RFC 4180). */
+static void print_csv_text(ResultSink *out, const char *text, size_t len) {
+  size_t plain = 0;
+  while (plain < len && !csv_special(text[plain]))
+    plain++;
+  if (plain == len) {
+    sink_bytes(out, text, len);
+    return;
+  }
+  sink_char(out, '"');
+  for (size_t i = 0; i < len; i++) {
+    if (text[i] == '"')
+      sink_char(out, '"'); // Quotes are doubled
+    sink_char(out, text[i]);
+  }
+  sink_char(out, '"');
+}
 
-      uint32_t key = *leaf_node_key(node, c->cell_num, &td->schema);
-      if (statement->where_condition == WHERE_EQUALS &&
-          key != statement->where_key)
-        break;
-      if (statement->where_condition == WHERE_GREATER_THAN &&
-          key <= statement->where_key) {
-        c->cell_num++;
-        continue;
-      }
-      if (statement->where_condition == WHERE_LESS_THAN &&
-          key >= statement->where_key)
-        break;
-
-      void *val = leaf_node_value(node, c->cell_num, &td->schema);
-      printf("│");
-      for (uint32_t i = 0; i < td->schema.num_fields; i++) {
-        char buf[64];
-        if (td->schema.fields[i].type == FIELD_INT) {
-          uint32_t v;
-          deserialize_field(&td->schema, i, val, &v);
-          snprintf(buf, sizeof(buf), "%u", v);
-        } else {
-          deserialize_field(&td->schema, i, val, buf);
-        }
-        printf(" %-*s │", widths[i], buf);
-      }
-      printf("\n");
-      c->cell_num++;
+/** print_tsv_text writes a TEXT value with tabs and line breaks escaped. */
+static void print_tsv_text(ResultSink *out, const char *text, size_t len) {
+  size_t start = 0;
+  for (size_t i = 0; i < len; i++) {
+    char escape;
+    switch (text[i]) {
+    case '\t':
+      escape = 't';
+      break;
+    case '\n':
+      escape = 'n';
+      break;
+    case '\r':
+      escape = 'r';
+      break;
+    case '\\':
+      escape = '\\';
+      break;
+    default:
+      continue;
     }
-    print_box_footer(&td->schema, widths);
-  } else {
-    // PLAIN MODE
-    while (true) {
-      void *node = get_page(db->pager, c->page_num);
-      if (c->cell_num >= *leaf_node_num_cells(node)) {
-        uint32_t next = *leaf_node_next_leaf(node);
-        if (next == 0)
-          break;
-        c->page_num = next;
-        c->cell_num = 0;
-        continue;
-      }
+    sink_bytes(out, text + start, i - start);
+    sink_char(out, '\\');
+    sink_char(out, escape);
+    start = i + 1;
+  }
+  sink_bytes(out, text + start, len - start);
+}
 
-      uint32_t key = *leaf_node_key(node, c->cell_num, &td->schema);
+/**
+ * print_delimited_row writes a CSV or TSV line. `names` prints the column
+ * names instead of a row.
+ */
+static void print_delimited_row(ResultSink *out, Schema *schema,
+                                const void *row, bool tsv, bool names) {
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    if (i > 0)
+      sink_char(out, tsv ? '\t' : ',');
+    const char *text = schema->fields[i].name;
+    size_t len = strlen(text);
+    char digits[10];
+    if (!names)
+      len = field_text(schema, i, row, &digits, &text);
+    if (!names && schema->fields[i].type == FIELD_INT)
+      sink_bytes(out, text, len);
+    else if (tsv)
+      print_tsv_text(out, text, len);
+    else
+      print_csv_text(out, text, len);
+  }
+  sink_char(out, '\n');
+}
 
-      if (statement->where_condition == WHERE_EQUALS) {
-        if (key != statement->where_key)
-          break;
-      } else if (statement->where_condition == WHERE_GREATER_THAN) {
-        if (key <= statement->where_key) {
-          c->cell_num++;
-          continue;
-        }
-      } else if (statement->where_condition == WHERE_LESS_THAN) {
-        if (key >= statement->where_key)
-          break;
-      }
+static void print_binary_header(ResultSink *out, Schema *schema) {
+  sink_u32le(out, schema->num_fields);
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    const Field *f = &schema->fields[i];
+    size_t len = strlen(f->name);
+    sink_char(out, f->type == FIELD_INT ? 0 : 1);
+    sink_char(out, (char)len);
+    sink_bytes(out, f->name, len);
+  }
+}
 
-      void *val = leaf_node_value(node, c->cell_num, &td->schema);
-      printf("(");
-      for (uint32_t i = 0; i < td->schema.num_fields; i++) {
-        if (td->schema.fields[i].type == FIELD_INT) {
-          uint32_t v;
-          deserialize_field(&td->schema, i, val, &v);
-          printf("%u", v);
-        } else {
-          char v[33] = {0};
-          deserialize_field(&td->schema, i, val, v);
-          printf("%s", v);
-        }
-        if (i < td->schema.num_fields - 1)
-          printf(", ");
-      }
-      printf(")\n");
-      c->cell_num++;
+/**
+ * print_binary_row writes a row's length and then its values, straight from
+ * the row's bytes.
+ */
+static void print_binary_row(ResultSink *out, Schema *schema,
+                             const void *row) {
+  const char *bytes = row;
+  size_t lens[MAX_FIELDS];
+  uint32_t size = 0;
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    const Field *f = &schema->fields[i];
+    if (f->type == FIELD_INT) {
+      size += sizeof(uint32_t);
+    } else {
+      const char *end = memchr(bytes + f->offset, '\0', f->size);
+      lens[i] = end != nullptr ? (size_t)(end - bytes - f->offset) : f->size;
+      size += 1 + (uint32_t)lens[i];
     }
   }
-  free(c);
+  sink_u32le(out, size);
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    const Field *f = &schema->fields[i];
+    if (f->type == FIELD_INT) {
+      uint32_t v;
+      memcpy(&v, bytes + f->offset, sizeof(v));
+      sink_u32le(out, v);
+    } else {
+      sink_char(out, (char)lens[i]);
+      sink_bytes(out, bytes + f->offset, lens[i]);
+    }
+  }
+}
+
+static double ms_since(const struct timespec *start) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (double)(now.tv_sec - start->tv_sec) * 1e3 +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * execute_explain prints a SELECT's plan. Under ANALYZE the SELECT runs
+ * first, its rows counted rather than printed.
+ */
+static ExecuteResult execute_explain(Statement *statement, Database *db) {
+  if (statement->explain == EXPLAIN_PLAN) {
+    explain_select(statement, db, nullptr);
+    return EXECUTE_SUCCESS;
+  }
+  ExplainActual actual = {};
+  DbStats before = db_stats(db);
+  struct timespec start;
+  timespec_get(&start, TIME_UTC);
+  SelectRows rows;
+  select_rows_open(&rows, statement, db);
+  if (select_rows_next(&rows) != nullptr) {
+    actual.first_ms = ms_since(&start);
+    actual.rows = 1;
+    while (select_rows_next(&rows) != nullptr)
+      actual.rows++;
+  }
+  actual.sort_runs = rows.sorter != nullptr ? sorter_runs(rows.sorter) : 0;
+  actual.partitions = rows.join != nullptr ? join_partitions(rows.join) : 0;
+  select_rows_close(&rows);
+  actual.total_ms = ms_since(&start);
+  if (actual.rows == 0)
+    actual.first_ms = actual.total_ms;
+  actual.stats = db_stats_since(db, &before);
+  explain_select(statement, db, &actual);
   return EXECUTE_SUCCESS;
 }
 
+static ExecuteResult execute_select(Statement *statement, Database *db) {
+  if (statement->explain != EXPLAIN_NONE)
+    return execute_explain(statement, db);
+  SelectRows rows;
+  select_rows_open(&rows, statement, db);
+  if (select_rows_failed(&rows)) {
+    select_rows_close(&rows);
+    return EXECUTE_IO_ERROR;
+  }
+  Schema *schema = rows.schema;
+  const void *row;
+  ResultSink out;
+  sink_open(&out, db->out);
+
+  if (db->print_mode == PRINT_BOX) {
+    // Widths are measured on the first BOX_BUFFER_ROWS rows. If there are
+    // more, each column gets the widest any of its values can be, so the rows
+    // are still read only once.
+    uint32_t widths[MAX_FIELDS];
+    for (uint32_t i = 0; i < schema->num_fields; i++)
+      widths[i] = (uint32_t)strlen(schema->fields[i].name);
+    uint8_t *buffer = malloc((size_t)BOX_BUFFER_ROWS * schema->row_size);
+    uint32_t buffered = 0;
+    while (buffered < BOX_BUFFER_ROWS &&
+           (row = select_rows_next(&rows)) != nullptr)
+      memcpy(buffer + (size_t)buffered++ * schema->row_size, row,
+             schema->row_size);
+    row = buffered == BOX_BUFFER_ROWS ? select_rows_next(&rows) : nullptr;
+    for (uint32_t i = 0; i < schema->num_fields; i++) {
+      uint32_t widest = row != nullptr ? max_field_width(schema, i) : 0;
+      for (uint32_t r = 0; r < buffered && widest < max_field_width(schema, i);
+           r++) {
+        char digits[10];
+        const char *text;
+        uint32_t len = (uint32_t)field_text(
+            schema, i, buffer + (size_t)r * schema->row_size, &digits, &text);
+        if (len > widest)
+          widest = len;
+      }
+      if (widest > widths[i])
+        widths[i] = widest;
+    }
+
+    print_box_header(&out, schema, widths);
+    for (uint32_t r = 0; r < buffered; r++)
+      print_box_row(&out, schema, widths,
+                    buffer + (size_t)r * schema->row_size);
+    free(buffer);
+    for (; row != nullptr; row = select_rows_next(&rows))
+      print_box_row(&out, schema, widths, row);
+    print_box_footer(&out, schema, widths);
+  } else if (db->print_mode == PRINT_CSV || db->print_mode == PRINT_TSV) {
+    bool tsv = db->print_mode == PRINT_TSV;
+    print_delimited_row(&out, schema, nullptr, tsv, true);
+    while ((row = select_rows_next(&rows)) != nullptr)
+      print_delimited_row(&out, schema, row, tsv, false);
+  } else if (db->print_mode == PRINT_BINARY) {
+    print_binary_header(&out, schema);
+    while ((row = select_rows_next(&rows)) != nullptr)
+      print_binary_row(&out, schema, row);
+    sink_u32le(&out, 0);
+  } else {
+    while ((row = select_rows_next(&rows)) != nullptr)
+      print_plain_row(&out, schema, row);
+  }
+  sink_flush(&out);
+  bool failed = select_rows_failed(&rows);
+  select_rows_close(&rows);
+  return failed ? EXECUTE_IO_ERROR : EXECUTE_SUCCESS;
+}
+
 static ExecuteResult execute_delete(Statement *statement, Database *db) {
   uint32_t table_index = statement->table_index;
   TableDefinition *td = &db->catalog.tables[table_index];
@@ -673,8 +1844,11 @@ static ExecuteResult execute_delete(Statement *statement, Database *db) {
   ExecuteResult res = EXECUTE_SUCCESS;
   if (c->cell_num < *leaf_node_num_cells(node) &&
       *leaf_node_key(node, c->cell_num, &td->schema) == id) {
+    char row[MAX_FIELDS * TEXT_FIELD_SIZE];
+    memcpy(row, leaf_node_value(node, c->cell_num, &td->schema),
+           td->schema.row_size);
     leaf_node_delete(c);
-    printf("Deleted.\n");
+    index_delete_row(db, table_index, id, row);
   } else {
     res = EXECUTE_KEY_NOT_FOUND;
   }
@@ -694,6 +1868,8 @@ static ExecuteResult execute_create(Statement *statement, Database *db) {
   uint32_t root_page_num = db->pager->num_pages;
   if (root_page_num == 0)
     root_page_num = 1; // Page 0 is catalog
+  if (root_page_num >= TABLE_MAX_PAGES)
+    return EXECUTE_TABLE_FULL;
 
   td->root_page_num = root_page_num;
   void *root = get_page(db->pager, root_page_num);
@@ -702,6 +1878,37 @@ static ExecuteResult execute_create(Statement *statement, Database *db) {
   mark_page_dirty(db->pager, root_page_num);
 
   db->catalog.num_tables++;
+  db->schema_version++;
+  db_save_catalog(db);
+
+  return EXECUTE_SUCCESS;
+}
+
+static ExecuteResult execute_create_index(Statement *statement,
+                                          Database *db) {
+  uint32_t index = db->catalog.num_indexes;
+  IndexDefinition *idx = &db->catalog.indexes[index];
+  if (!pager_has_room(db->pager, 1))
+    return EXECUTE_TABLE_FULL;
+
+  strncpy(idx->name, statement->index_name, TABLE_NAME_MAX);
+  idx->table_index = statement->table_index;
+  idx->field_index = statement->index_field;
+
+  // Allocate new root page, as for a table
+  idx->root_page_num = db->pager->num_pages;
+  void *root = get_page(db->pager, idx->root_page_num);
+  initialize_leaf_node(root);
+  set_node_root(root, true);
+  mark_page_dirty(db->pager, idx->root_page_num);
+
+  db->catalog.num_indexes++;
+  if (!index_build(db, index)) {
+    // The pages it took stay allocated; nothing refers to them
+    db->catalog.num_indexes--;
+    return EXECUTE_TABLE_FULL;
+  }
+  db->schema_version++;
   db_save_catalog(db);
 
   return EXECUTE_SUCCESS;
@@ -714,9 +1921,17 @@ static ExecuteResult execute_update(Statement *statement, Database *db) {
       find_node(db, table_index, td->root_page_num, statement->update_key);
   void *node = get_page(db->pager, c->page_num);
   ExecuteResult res = EXECUTE_SUCCESS;
-  if (c->cell_num < *leaf_node_num_cells(node) &&
-      *leaf_node_key(node, c->cell_num, &td->schema) == statement->update_key) {
+  bool found =
+      c->cell_num < *leaf_node_num_cells(node) &&
+      *leaf_node_key(node, c->cell_num, &td->schema) == statement->update_key;
+  // Refiling the row in its indexes could split them
+  if (found &&
+      !pager_has_room(db->pager, index_insert_pages(db, table_index))) {
+    res = EXECUTE_TABLE_FULL;
+  } else if (found) {
     void *val = leaf_node_value(node, c->cell_num, &td->schema);
+    char old_row[MAX_FIELDS * TEXT_FIELD_SIZE];
+    memcpy(old_row, val, td->schema.row_size);
     for (uint32_t i = 0; i < td->schema.num_fields; i++) {
       if (statement->update_mask[i]) {
         if (td->schema.fields[i].type == FIELD_INT) {
@@ -735,17 +1950,27 @@ static ExecuteResult execute_update(Statement *statement, Database *db) {
       }
     }
     mark_page_dirty(db->pager, c->page_num);
-    printf("Updated.\n");
+    index_update_row(db, table_index, statement->update_key, old_row,
+                     *leaf_node_key(node, c->cell_num, &td->schema), val);
   } else {
     res = EXECUTE_KEY_NOT_FOUND;
   }
 
-  free_statement(statement);
   free(c);
   unpin_page_all(db->pager);
   return res;
 }
 
+static ExecuteResult execute_analyze(Statement *statement, Database *db) {
+  if (statement->table_name[0] != '\0') {
+    analyze_table(db, statement->table_index);
+    return EXECUTE_SUCCESS;
+  }
+  for (uint32_t i = 0; i < db->catalog.num_tables; i++)
+    analyze_table(db, i);
+  return EXECUTE_SUCCESS;
+}
+
 ExecuteResult execute_statement(Statement *statement, Database *db) {
   switch (statement->type) {
   case STATEMENT_INSERT:
@@ -758,26 +1983,150 @@ ExecuteResult execute_statement(Statement *statement, Database *db) {
     return execute_update(statement, db);
   case STATEMENT_CREATE_TABLE:
     return execute_create(statement, db);
+  case STATEMENT_CREATE_INDEX:
+    return execute_create_index(statement, db);
   case STATEMENT_BEGIN:
-    printf("Transaction started.\n");
     return EXECUTE_SUCCESS;
   case STATEMENT_COMMIT:
     db_save_catalog(db);
-    printf("Transaction committed.\n");
     return EXECUTE_SUCCESS;
   case STATEMENT_ROLLBACK:
-    printf("Rollback requested. Note: ROLLBACK is currently not supported in "
-           "this educational version. Every statement is auto-committed.\n");
     return EXECUTE_SUCCESS;
+  case STATEMENT_ANALYZE:
+    return execute_analyze(statement, db);
   }
   return EXECUTE_UNKNOWN_ERROR;
 }
 
 void free_statement(Statement *statement) {
+  // TEXT values live in the statement's arena; releasing it is a reset
+  for (int i = 0; i < MAX_FIELDS; i++)
+    statement->insert_strings[i] = nullptr;
+  statement->arena.used = 0;
+}
+
+void statement_copy(Statement *dest, const Statement *src) {
+  // Only copy what is in use: the predicate, the CREATE TABLE schema and the
+  // free part of the arena make up most of the struct
+  memcpy(dest, src, offsetof(Statement, predicate));
+  const Predicate *predicate = &src->predicate;
+  if (src->type == STATEMENT_SELECT) {
+    memcpy(&dest->predicate, predicate,
+           offsetof(Predicate, terms) +
+               predicate->num_terms * sizeof(PredicateTerm));
+  }
+  if (src->type == STATEMENT_CREATE_TABLE)
+    dest->new_schema = src->new_schema;
+  dest->arena.used = src->arena.used;
+  if (src->arena.used == 0)
+    return;
+  memcpy(dest->arena.buf, src->arena.buf, src->arena.used);
   for (int i = 0; i < MAX_FIELDS; i++) {
-    if (statement->insert_strings[i]) {
-      free(statement->insert_strings[i]);
-      statement->insert_strings[i] = nullptr;
+    const char *slot = src->insert_strings[i];
+    if (slot >= src->arena.buf && slot < src->arena.buf + src->arena.used)
+      dest->insert_strings[i] = dest->arena.buf + (slot - src->arena.buf);
+  }
+  if (src->type != STATEMENT_SELECT)
+    return;
+  for (uint32_t i = 0; i < predicate->num_terms; i++) {
+    const char *slot = predicate->terms[i].text;
+    if (slot >= src->arena.buf && slot < src->arena.buf + src->arena.used)
+      dest->predicate.terms[i].text = dest->arena.buf + (slot - src->arena.buf);
+  }
+}
+
+static uint32_t *statement_key(Statement *statement) {
+  switch (statement->type) {
+  case STATEMENT_DELETE:
+    return &statement->delete_id;
+  case STATEMENT_UPDATE:
+    return &statement->update_key;
+  default:
+    return nullptr;
+  }
+}
+
+/**
+ * bound_schema returns the layout of the rows a statement's parameters refer
+ * to: the joined row for a join, else the table's.
+ */
+static Schema *bound_schema(const Statement *statement, Database *db,
+                            Schema *joined) {
+  if (!statement->joined)
+    return &db->catalog.tables[statement->table_index].schema;
+  join_schema(statement, db, joined);
+  return joined;
+}
+
+PrepareResult bind_parameter_token(Statement *statement, Database *db,
+                                   uint32_t param, Token value) {
+  if (param >= statement->num_params)
+    return PREPARE_PARAMETER_OUT_OF_RANGE;
+  Schema joined;
+  Schema *schema = bound_schema(statement, db, &joined);
+  Parameter *p = &statement->params[param];
+
+  if (p->target == PARAM_LIMIT || p->target == PARAM_OFFSET)
+    return bind_parameter_int(statement, db, param, token_to_uint(value));
+  if (p->target == PARAM_PREDICATE)
+    return set_term_value(statement, schema, p->field_idx, value);
+  if (p->target == PARAM_KEY) {
+    uint32_t *key = statement_key(statement);
+    if (key == nullptr)
+      return PREPARE_PARAMETER_OUT_OF_RANGE;
+    *key = key_from_token(schema, value);
+    return PREPARE_SUCCESS;
+  }
+
+  uint32_t i = p->field_idx;
+  if (schema->fields[i].type == FIELD_INT) {
+    statement->insert_values[i] = token_to_uint(value);
+    return PREPARE_SUCCESS;
+  }
+  return set_text_value(statement, schema, i, value.ptr, value.len);
+}
+
+PrepareResult bind_parameter_text(Statement *statement, Database *db,
+                                  uint32_t param, const char *value) {
+  Token token = {.ptr = value, .len = (uint32_t)strlen(value), .quoted = true};
+  return bind_parameter_token(statement, db, param, token);
+}
+
+PrepareResult bind_parameter_int(Statement *statement, Database *db,
+                                 uint32_t param, uint32_t value) {
+  if (param >= statement->num_params)
+    return PREPARE_PARAMETER_OUT_OF_RANGE;
+  Schema joined;
+  Schema *schema = bound_schema(statement, db, &joined);
+  Parameter *p = &statement->params[param];
+
+  if (p->target == PARAM_LIMIT || p->target == PARAM_OFFSET) {
+    *(p->target == PARAM_LIMIT ? &statement->limit : &statement->offset) =
+        value;
+    return PREPARE_SUCCESS;
+  }
+  // Integers bound to INT columns (and INT keys) skip the text round trip
+  uint32_t field = p->field_idx;
+  if (p->target == PARAM_KEY)
+    field = 0;
+  else if (p->target == PARAM_PREDICATE)
+    field = statement->predicate.terms[p->field_idx].field;
+  bool int_target = schema->fields[field].type == FIELD_INT;
+  if (int_target) {
+    if (p->target == PARAM_PREDICATE) {
+      statement->predicate.terms[p->field_idx].value = value;
+    } else if (p->target == PARAM_KEY) {
+      uint32_t *key = statement_key(statement);
+      if (key == nullptr)
+        return PREPARE_PARAMETER_OUT_OF_RANGE;
+      *key = value;
+    } else {
+      statement->insert_values[p->field_idx] = value;
     }
+    return PREPARE_SUCCESS;
   }
+
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u", value);
+  return bind_parameter_text(statement, db, param, buf);
 }
@@ -0,0 +1,254 @@
+#ifdef __linux__
+#define _GNU_SOURCE // syscall
+#endif
+
+#include "trace.h"
+
+#ifndef SIMPLEDB_TRACING
+
+bool trace_start(const char *path, uint32_t sample_every) {
+  (void)path;
+  (void)sample_every;
+  return false;
+}
+
+bool trace_stop(uint32_t *written, uint32_t *dropped) {
+  *written = 0;
+  *dropped = 0;
+  return false;
+}
+
+#else
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  uint64_t counters[TRACE_COUNTERS];
+  uint32_t thread;
+  TraceOp op;
+  bool counted; // The counters were read
+} TraceEvent;
+
+static const char *op_names[TRACE_NUM_OPS] = {
+    "get_page",    "find_node",      "leaf_node_insert",
+    "leaf_split",  "internal_split", "serialize_row",
+};
+static const char *op_categories[TRACE_NUM_OPS] = {
+    "pager", "btree", "btree", "btree", "btree", "schema",
+};
+
+// Threads whose counters can be opened; more are traced without them
+constexpr uint32_t TRACE_MAX_THREADS = 64;
+
+bool trace_on = false;
+uint32_t trace_every[TRACE_NUM_OPS];
+thread_local uint32_t trace_calls[TRACE_NUM_OPS];
+
+static mtx_t trace_lock;
+static once_flag trace_once = ONCE_FLAG_INIT;
+static FILE *trace_file;
+static TraceEvent *events;
+static uint32_t num_events;
+static uint32_t num_dropped;
+static uint64_t trace_origin_ns;
+// Bumped by each trace_start(), so threads open their counters again
+static uint32_t generation;
+static uint32_t num_threads;
+static int counter_fds[TRACE_MAX_THREADS * TRACE_COUNTERS];
+static uint32_t num_counter_fds;
+
+static thread_local uint32_t thread_generation;
+static thread_local uint32_t thread_id;
+static thread_local int thread_group = -1; // Leader of the counter group
+
+static void init_lock() { mtx_init(&trace_lock, mtx_plain); }
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef __linux__
+static int open_counter(uint64_t config, int group) {
+  struct perf_event_attr attr = {};
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.disabled = group == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/**
+ * open_counters opens the calling thread's counter group, leaving
+ * thread_group -1 where the kernel or its settings refuse.
+ */
+static void open_counters() {
+  static const uint64_t configs[TRACE_COUNTERS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES};
+  mtx_lock(&trace_lock);
+  thread_group = -1;
+  if (num_counter_fds + TRACE_COUNTERS <= TRACE_MAX_THREADS * TRACE_COUNTERS) {
+    int fds[TRACE_COUNTERS];
+    uint32_t opened = 0;
+    for (; opened < TRACE_COUNTERS; opened++) {
+      fds[opened] = open_counter(configs[opened], opened == 0 ? -1 : fds[0]);
+      if (fds[opened] == -1)
+        break;
+    }
+    if (opened == TRACE_COUNTERS) {
+      ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+      memcpy(counter_fds + num_counter_fds, fds, sizeof(fds));
+      num_counter_fds += TRACE_COUNTERS;
+      thread_group = fds[0];
+    } else {
+      for (uint32_t i = 0; i < opened; i++)
+        close(fds[i]);
+    }
+  }
+  mtx_unlock(&trace_lock);
+}
+
+static bool read_counters(uint64_t *counters) {
+  struct {
+    uint64_t nr;
+    uint64_t values[TRACE_COUNTERS];
+  } group;
+  if (thread_group == -1 ||
+      read(thread_group, &group, sizeof(group)) != (ssize_t)sizeof(group))
+    return false;
+  memcpy(counters, group.values, sizeof(group.values));
+  return true;
+}
+
+static void close_counters() {
+  for (uint32_t i = 0; i < num_counter_fds; i++)
+    close(counter_fds[i]);
+  num_counter_fds = 0;
+}
+#else
+static void open_counters() {}
+static bool read_counters(uint64_t *counters) {
+  (void)counters;
+  return false;
+}
+static void close_counters() {}
+#endif
+
+TraceSpan trace_sample(TraceOp op) {
+  trace_calls[op] = 0;
+  if (thread_generation != generation) {
+    thread_generation = generation;
+    mtx_lock(&trace_lock);
+    thread_id = ++num_threads;
+    mtx_unlock(&trace_lock);
+    open_counters();
+  }
+  TraceSpan span = {.op = op};
+  span.counted = read_counters(span.counters);
+  // Read last, so the span does not time reading the counters
+  span.start_ns = now_ns();
+  return span;
+}
+
+void trace_record(const TraceSpan *span) {
+  uint64_t end_ns = now_ns();
+  TraceEvent e = {.start_ns = span->start_ns,
+                  .duration_ns = end_ns - span->start_ns,
+                  .thread = thread_id,
+                  .op = span->op};
+  if (span->counted && read_counters(e.counters)) {
+    for (uint32_t i = 0; i < TRACE_COUNTERS; i++)
+      e.counters[i] -= span->counters[i];
+    e.counted = true;
+  }
+  mtx_lock(&trace_lock);
+  if (events != nullptr && num_events < TRACE_MAX_EVENTS)
+    events[num_events++] = e;
+  else
+    num_dropped++;
+  mtx_unlock(&trace_lock);
+}
+
+bool trace_start(const char *path, uint32_t sample_every) {
+  call_once(&trace_once, init_lock);
+  uint32_t written, dropped;
+  trace_stop(&written, &dropped);
+  FILE *file = fopen(path, "w");
+  if (file == nullptr)
+    return false;
+  mtx_lock(&trace_lock);
+  trace_file = file;
+  events = malloc(TRACE_MAX_EVENTS * sizeof(TraceEvent));
+  num_events = 0;
+  num_dropped = 0;
+  num_threads = 0;
+  generation++;
+  trace_origin_ns = now_ns();
+  for (uint32_t op = 0; op < TRACE_NUM_OPS; op++) {
+    bool rare = op == TRACE_LEAF_SPLIT || op == TRACE_INTERNAL_SPLIT;
+    trace_every[op] = rare || sample_every == 0 ? 1 : sample_every;
+  }
+  trace_on = true;
+  mtx_unlock(&trace_lock);
+  return true;
+}
+
+bool trace_stop(uint32_t *written, uint32_t *dropped) {
+  *written = 0;
+  *dropped = 0;
+  if (!trace_on)
+    return false;
+  mtx_lock(&trace_lock);
+  trace_on = false;
+  FILE *f = trace_file;
+  // Chrome trace events: "X" spans with microsecond times
+  fprintf(f, "{\"traceEvents\":[\n");
+  for (uint32_t i = 0; i < num_events; i++) {
+    const TraceEvent *e = &events[i];
+    uint64_t ts = e->start_ns - trace_origin_ns;
+    fprintf(f,
+            "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRIu64
+            ".%03" PRIu64 ",\"dur\":%" PRIu64 ".%03" PRIu64
+            ",\"pid\":1,\"tid\":%u",
+            op_names[e->op], op_categories[e->op], ts / 1000, ts % 1000,
+            e->duration_ns / 1000, e->duration_ns % 1000, e->thread);
+    if (e->counted)
+      fprintf(f,
+              ",\"args\":{\"cycles\":%" PRIu64 ",\"instructions\":%" PRIu64
+              ",\"cache_misses\":%" PRIu64 "}",
+              e->counters[0], e->counters[1], e->counters[2]);
+    fprintf(f, "}%s\n", i + 1 < num_events ? "," : "");
+  }
+  fprintf(f,
+          "],\"displayTimeUnit\":\"ns\",\"otherData\":{\"sample_every\":%u,"
+          "\"dropped\":%u}}\n",
+          trace_every[TRACE_GET_PAGE], num_dropped);
+  fclose(f);
+  trace_file = nullptr;
+  *written = num_events;
+  *dropped = num_dropped;
+  free(events);
+  events = nullptr;
+  close_counters();
+  mtx_unlock(&trace_lock);
+  return true;
+}
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * api_benchmark compares point-lookup latency through the prepared-statement
+ * API (prepare once, bind + step per lookup) with the REPL path (format a SQL
+ * line, parse it, execute it and print the row) on the same database file.
+ *
+ *   ./build/api_benchmark [rows] [lookups]
+ */
+#include "database.h"
+#include "repl.h"
+#include "simpledb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "api_bench.db"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint32_t next_random(uint32_t *state) {
+  // xorshift32: cheap enough not to show up in the measurement
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static void expect(int rc, int want, const char *what) {
+  if (rc != want) {
+    printf("%s failed with %d\n", what, rc);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void load_rows(uint32_t rows) {
+  sdb *db;
+  sdb_stmt *create, *insert;
+  expect(sdb_open(BENCH_FILE, &db), SDB_OK, "sdb_open");
+  expect(sdb_prepare(db, "CREATE TABLE users (id INT, username TEXT)",
+                     &create),
+         SDB_OK, "prepare CREATE");
+  expect(sdb_step(create), SDB_DONE, "CREATE");
+  sdb_finalize(create);
+
+  expect(sdb_prepare(db, "INSERT INTO users VALUES (?, ?)", &insert), SDB_OK,
+         "prepare INSERT");
+  double start = now_s();
+  for (uint32_t id = 0; id < rows; id++) {
+    char name[32];
+    snprintf(name, sizeof(name), "user%u", id);
+    sdb_bind_int(insert, 1, id);
+    sdb_bind_text(insert, 2, name);
+    expect(sdb_step(insert), SDB_DONE, "INSERT");
+  }
+  double elapsed = now_s() - start;
+  sdb_finalize(insert);
+  sdb_close(db);
+  printf("Insert via API: %u rows in %.3f s (%.0f rows/s)\n", rows, elapsed,
+         rows / elapsed);
+}
+
+static double bench_api(uint32_t rows, uint32_t lookups) {
+  sdb *db;
+  sdb_stmt *select;
+  expect(sdb_open(BENCH_FILE, &db), SDB_OK, "sdb_open");
+  expect(sdb_prepare(db, "SELECT * FROM users WHERE id = ?", &select), SDB_OK,
+         "prepare SELECT");
+
+  uint32_t rng = 2463534242u;
+  uint64_t checksum = 0;
+  double start = now_s();
+  for (uint32_t i = 0; i < lookups; i++) {
+    uint32_t id = next_random(&rng) % rows;
+    sdb_bind_int(select, 1, id);
+    while (sdb_step(select) == SDB_ROW) {
+      checksum += sdb_column_int(select, 0);
+      checksum += (uint64_t)strlen(sdb_column_text(select, 1));
+    }
+  }
+  double elapsed = now_s() - start;
+  sdb_finalize(select);
+  sdb_close(db);
+  expect(checksum > 0, true, "lookups returned rows");
+  return elapsed;
+}
+
+static double bench_repl(uint32_t rows, uint32_t lookups) {
+  Database *db = db_open(BENCH_FILE);
+  FILE *sink = fopen(NULL_DEVICE, "w");
+  expect(sink != nullptr, true, "open " NULL_DEVICE);
+  db->out = sink;
+
+  uint32_t rng = 2463534242u;
+  double start = now_s();
+  for (uint32_t i = 0; i < lookups; i++) {
+    char line[128];
+    snprintf(line, sizeof(line), "SELECT * FROM users WHERE id = %u;",
+             next_random(&rng) % rows);
+    repl_execute_line(db, line);
+  }
+  double elapsed = now_s() - start;
+  fclose(sink);
+  db->out = stdout;
+  db_close(db);
+  return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 20000;
+  uint32_t lookups = argc > 2 ? (uint32_t)atoi(argv[2]) : 200000;
+  if (rows == 0 || lookups == 0) {
+    printf("Usage: %s [rows] [lookups]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  remove(BENCH_FILE);
+  load_rows(rows);
+
+  double api = bench_api(rows, lookups);
+  double repl = bench_repl(rows, lookups);
+  printf("Point lookup, %u lookups over %u rows:\n", lookups, rows);
+  printf("  API  (prepare once, bind + step): %8.0f ns/lookup\n",
+         api * 1e9 / lookups);
+  printf("  REPL (parse + execute + print):   %8.0f ns/lookup\n",
+         repl * 1e9 / lookups);
+  printf("  Speedup: %.1fx\n", repl / api);
+
+  remove(BENCH_FILE);
+  return 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * count_benchmark times COUNT(*) and deep OFFSETs answered from the row
+ * counts in the B-Tree's internal nodes against the same queries walking the
+ * leaves. A `score >= 0` term matches every row but is not a key range, so it
+ * forces the walk without changing the answer.
+ *
+ *   ./build/count_benchmark [rows] [rounds]
+ */
+#include "database.h"
+#include "statement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_FILE "count_bench.db"
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void prepare(Database *db, const char *sql, Statement *statement) {
+  char line[256];
+  snprintf(line, sizeof(line), "%s", sql);
+  *statement = (Statement){};
+  if (prepare_statement(line, statement, db) != PREPARE_SUCCESS) {
+    printf("Prepare failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * run executes a query with its output going to `out` and returns the first
+ * number printed: the count, or the key of the first row.
+ */
+static uint32_t run(Database *db, const char *sql, FILE *out) {
+  Statement statement;
+  prepare(db, sql, &statement);
+  rewind(out);
+  db->out = out;
+  if (execute_statement(&statement, db) != EXECUTE_SUCCESS) {
+    printf("Statement failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+  db->out = stdout;
+  fflush(out);
+  rewind(out);
+  free_statement(&statement);
+  unsigned value = 0;
+  return fscanf(out, "(%u", &value) == 1 ? value : UINT32_MAX;
+}
+
+static double bench(Database *db, FILE *out, const char *sql, uint32_t rounds,
+                    uint32_t *value) {
+  double best = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    double start = now_s();
+    *value = run(db, sql, out);
+    double elapsed = now_s() - start;
+    if (best == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+/** compare times a query from the counts and by walking the leaves. */
+static void compare(Database *db, FILE *out, const char *label,
+                    const char *counted, const char *walked, uint32_t rounds) {
+  uint32_t expected, value;
+  double walk = bench(db, out, walked, rounds, &expected);
+  double seek = bench(db, out, counted, rounds, &value);
+  if (value != expected) {
+    printf("Results disagree: %u vs %u\n", value, expected);
+    exit(EXIT_FAILURE);
+  }
+  printf("%s\n", label);
+  printf("  Leaf walk:    %9.3f ms\n", walk * 1e3);
+  printf("  Row counts:   %9.3f ms (%.0fx)\n", seek * 1e3, walk / seek);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 20000;
+  uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 20;
+  if (rows < 100 || rounds == 0) {
+    printf("Usage: %s [rows >= 100] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  remove(BENCH_FILE);
+  Database *db = db_open(BENCH_FILE);
+  FILE *out = tmpfile();
+  run(db, "CREATE TABLE events (id INT, kind INT, score INT, region TEXT)",
+      out);
+  Statement insert;
+  prepare(db, "INSERT INTO events VALUES (?, ?, ?, ?)", &insert);
+  uint32_t rng = 2463534242u;
+  for (uint32_t id = 0; id < rows; id++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    if (bind_parameter_int(&insert, db, 0, id) != PREPARE_SUCCESS ||
+        bind_parameter_int(&insert, db, 1, rng % 10) != PREPARE_SUCCESS ||
+        bind_parameter_int(&insert, db, 2, (rng >> 8) % 1000) !=
+            PREPARE_SUCCESS ||
+        bind_parameter_text(&insert, db, 3, "r") != PREPARE_SUCCESS ||
+        execute_statement(&insert, db) != EXECUTE_SUCCESS) {
+      printf("Insert failed at row %u\n", id);
+      return EXIT_FAILURE;
+    }
+  }
+  free_statement(&insert);
+
+  printf("%u rows (best of %u rounds):\n", rows, rounds);
+  compare(db, out, "COUNT(*):", "SELECT COUNT(*) FROM events",
+          "SELECT COUNT(*) FROM events WHERE score >= 0", rounds);
+
+  char counted[128], walked[160];
+  snprintf(counted, sizeof(counted),
+           "SELECT COUNT(*) FROM events WHERE id >= %u AND id <= %u",
+           rows / 4, rows / 4 * 3);
+  snprintf(walked, sizeof(walked), "%s AND score >= 0", counted);
+  compare(db, out, "COUNT(*) of half the keys:", counted, walked, rounds);
+
+  snprintf(counted, sizeof(counted),
+           "SELECT * FROM events LIMIT 10 OFFSET %u", rows - 50);
+  snprintf(walked, sizeof(walked),
+           "SELECT * FROM events WHERE score >= 0 LIMIT 10 OFFSET %u",
+           rows - 50);
+  compare(db, out, "LIMIT 10 at a deep OFFSET:", counted, walked, rounds);
+
+  fclose(out);
+  db_close(db);
+  remove(BENCH_FILE);
+  return 0;
+}
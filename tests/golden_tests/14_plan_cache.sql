@@ -0,0 +1,26 @@
+CREATE TABLE users (id INT, username TEXT);
+INSERT INTO users VALUES (1, 'Alice');
+INSERT INTO users VALUES (2, 'Bob');
+INSERT INTO users VALUES (3, '3');
+INSERT INTO users VALUES ('4', 'quoted id');
+INSERT INTO users VALUES (2, 'Duplicate');
+INSERT INTO users VALUES (5, 'This username is way too long for our 32 byte limit');
+INSERT INTO users  VALUES (6, 'Extra space');
+INSERT INTO users VALUES (7, '?');
+INSERT INTO users VALUES (8, ?);
+SELECT * FROM users WHERE id = 2;
+SELECT * FROM users WHERE id = 4;
+SELECT * FROM users WHERE id = 9;
+SELECT * FROM users WHERE id > 5;
+UPDATE users SET username = 'Robert' WHERE id = 2;
+UPDATE users SET username = 'Carol' WHERE id = 3;
+UPDATE users SET username = 'Nobody' WHERE id = 42;
+DELETE FROM users WHERE id = 1;
+DELETE FROM users WHERE id = 1;
+CREATE TABLE tags (name TEXT, uses INT);
+INSERT INTO tags VALUES ('red', 10);
+INSERT INTO tags VALUES ('blue', 20);
+SELECT * FROM tags WHERE name = 'blue';
+SELECT * FROM tags WHERE name = 'red';
+SELECT * FROM users;
+.exit
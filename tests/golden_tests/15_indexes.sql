@@ -0,0 +1,28 @@
+CREATE TABLE people (id INT, name TEXT, age INT);
+INSERT INTO people VALUES (1, 'Alice', 30);
+INSERT INTO people VALUES (2, 'Bob', 25);
+INSERT INTO people VALUES (3, 'Carol', 30);
+SELECT * FROM people WHERE age = 30;
+CREATE INDEX people_age ON people(age);
+CREATE INDEX people_name ON people(name);
+CREATE INDEX people_age ON people(age);
+CREATE INDEX people_x ON people(height);
+CREATE INDEX people_y ON nobody(age);
+INSERT INTO people VALUES (4, 'Dave', 30);
+INSERT INTO people VALUES (5, 'Eve', 41);
+SELECT * FROM people WHERE age = 30;
+SELECT * FROM people WHERE age > 29;
+SELECT * FROM people WHERE age < 30;
+SELECT * FROM people WHERE name = 'Bob';
+SELECT * FROM people WHERE name > 'Carol';
+SELECT * FROM people WHERE height = 1;
+UPDATE people SET age = 26 WHERE id = 1;
+DELETE FROM people WHERE id = 3;
+SELECT * FROM people WHERE age = 30;
+SELECT * FROM people WHERE age < 30;
+UPDATE people SET name = 'Robert' WHERE id = 2;
+SELECT * FROM people WHERE name = 'Bob';
+SELECT * FROM people WHERE name = 'Robert';
+.indexes
+.check people
+.exit
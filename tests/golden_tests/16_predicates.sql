@@ -0,0 +1,21 @@
+CREATE TABLE staff (id INT, name TEXT, dept TEXT, salary INT);
+INSERT INTO staff VALUES (1, 'Alice', 'eng', 120);
+INSERT INTO staff VALUES (2, 'Bob', 'ops', 80);
+INSERT INTO staff VALUES (3, 'Carol', 'eng', 95);
+INSERT INTO staff VALUES (4, 'Dave', 'sales', 70);
+INSERT INTO staff VALUES (5, 'Eve', 'eng', 150);
+SELECT * FROM staff WHERE dept = 'eng';
+SELECT * FROM staff WHERE dept != 'eng';
+SELECT * FROM staff WHERE salary >= 95 AND salary <= 120;
+SELECT * FROM staff WHERE dept = 'eng' AND salary < 100 OR dept = 'sales';
+SELECT * FROM staff WHERE name < 'C' OR salary > 140;
+SELECT * FROM staff WHERE id >= 2 AND id <= 3;
+SELECT * FROM staff WHERE id <> 1 AND dept = 'eng';
+SELECT * FROM staff WHERE salary<90;
+CREATE INDEX staff_salary ON staff(salary);
+SELECT * FROM staff WHERE salary >= 95 AND dept = 'eng';
+SELECT * FROM staff WHERE salary <= 80 OR id = 5;
+SELECT * FROM staff WHERE bonus = 1;
+SELECT * FROM staff WHERE salary = 1 AND;
+SELECT * FROM staff WHERE salary =< 1;
+.exit
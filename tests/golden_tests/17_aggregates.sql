@@ -0,0 +1,24 @@
+CREATE TABLE staff (id INT, name TEXT, dept TEXT, salary INT);
+SELECT COUNT(*), SUM(salary), MIN(id), MAX(id) FROM staff;
+INSERT INTO staff VALUES (4, 'Dave', 'sales', 70);
+INSERT INTO staff VALUES (1, 'Alice', 'eng', 120);
+INSERT INTO staff VALUES (2, 'Bob', 'ops', 80);
+INSERT INTO staff VALUES (5, 'Eve', 'eng', 150);
+INSERT INTO staff VALUES (3, 'Carol', 'eng', 95);
+SELECT COUNT(*) FROM staff;
+SELECT MIN(id), MAX(id) FROM staff;
+SELECT COUNT(name), SUM(salary), MIN(salary), MAX(salary), AVG(salary) FROM staff;
+SELECT dept, COUNT(*), SUM(salary), AVG(salary) FROM staff GROUP BY dept;
+SELECT COUNT(*), MAX(salary) FROM staff WHERE salary >= 90 GROUP BY dept;
+SELECT salary, COUNT(*) FROM staff WHERE dept = 'eng' GROUP BY salary;
+SELECT COUNT(*), MIN(salary) FROM staff WHERE id > 5;
+CREATE INDEX staff_salary ON staff(salary);
+SELECT COUNT(*), SUM(id) FROM staff WHERE salary > 75;
+.mode box
+SELECT dept, COUNT(*), MIN(salary) FROM staff GROUP BY dept;
+.mode plain
+SELECT name FROM staff;
+SELECT SUM(name) FROM staff;
+SELECT COUNT(*) FROM staff GROUP BY bonus;
+SELECT * FROM staff GROUP BY dept;
+SELECT SUM(*) FROM staff;
@@ -0,0 +1,102 @@
+CREATE TABLE posts (id INT, title TEXT, author TEXT, tag TEXT, votes INT);
+INSERT INTO posts VALUES (1, 'post1', 'user1', 'tag1', 13);
+INSERT INTO posts VALUES (38, 'post38', 'user3', 'tag2', 44);
+INSERT INTO posts VALUES (75, 'post75', 'user0', 'tag0', 25);
+INSERT INTO posts VALUES (32, 'post32', 'user2', 'tag2', 16);
+INSERT INTO posts VALUES (69, 'post69', 'user4', 'tag0', 47);
+INSERT INTO posts VALUES (26, 'post26', 'user1', 'tag2', 38);
+INSERT INTO posts VALUES (63, 'post63', 'user3', 'tag0', 19);
+INSERT INTO posts VALUES (20, 'post20', 'user0', 'tag2', 10);
+INSERT INTO posts VALUES (57, 'post57', 'user2', 'tag0', 41);
+INSERT INTO posts VALUES (14, 'post14', 'user4', 'tag2', 32);
+INSERT INTO posts VALUES (51, 'post51', 'user1', 'tag0', 13);
+INSERT INTO posts VALUES (8, 'post8', 'user3', 'tag2', 4);
+INSERT INTO posts VALUES (45, 'post45', 'user0', 'tag0', 35);
+INSERT INTO posts VALUES (2, 'post2', 'user2', 'tag2', 26);
+INSERT INTO posts VALUES (39, 'post39', 'user4', 'tag0', 7);
+INSERT INTO posts VALUES (76, 'post76', 'user1', 'tag1', 38);
+INSERT INTO posts VALUES (33, 'post33', 'user3', 'tag0', 29);
+INSERT INTO posts VALUES (70, 'post70', 'user0', 'tag1', 10);
+INSERT INTO posts VALUES (27, 'post27', 'user2', 'tag0', 1);
+INSERT INTO posts VALUES (64, 'post64', 'user4', 'tag1', 32);
+INSERT INTO posts VALUES (21, 'post21', 'user1', 'tag0', 23);
+INSERT INTO posts VALUES (58, 'post58', 'user3', 'tag1', 4);
+INSERT INTO posts VALUES (15, 'post15', 'user0', 'tag0', 45);
+INSERT INTO posts VALUES (52, 'post52', 'user2', 'tag1', 26);
+INSERT INTO posts VALUES (9, 'post9', 'user4', 'tag0', 17);
+INSERT INTO posts VALUES (46, 'post46', 'user1', 'tag1', 48);
+INSERT INTO posts VALUES (3, 'post3', 'user3', 'tag0', 39);
+INSERT INTO posts VALUES (40, 'post40', 'user0', 'tag1', 20);
+INSERT INTO posts VALUES (77, 'post77', 'user2', 'tag2', 1);
+INSERT INTO posts VALUES (34, 'post34', 'user4', 'tag1', 42);
+INSERT INTO posts VALUES (71, 'post71', 'user1', 'tag2', 23);
+INSERT INTO posts VALUES (28, 'post28', 'user3', 'tag1', 14);
+INSERT INTO posts VALUES (65, 'post65', 'user0', 'tag2', 45);
+INSERT INTO posts VALUES (22, 'post22', 'user2', 'tag1', 36);
+INSERT INTO posts VALUES (59, 'post59', 'user4', 'tag2', 17);
+INSERT INTO posts VALUES (16, 'post16', 'user1', 'tag1', 8);
+INSERT INTO posts VALUES (53, 'post53', 'user3', 'tag2', 39);
+INSERT INTO posts VALUES (10, 'post10', 'user0', 'tag1', 30);
+INSERT INTO posts VALUES (47, 'post47', 'user2', 'tag2', 11);
+INSERT INTO posts VALUES (4, 'post4', 'user4', 'tag1', 2);
+INSERT INTO posts VALUES (41, 'post41', 'user1', 'tag2', 33);
+INSERT INTO posts VALUES (78, 'post78', 'user3', 'tag0', 14);
+INSERT INTO posts VALUES (35, 'post35', 'user0', 'tag2', 5);
+INSERT INTO posts VALUES (72, 'post72', 'user2', 'tag0', 36);
+INSERT INTO posts VALUES (29, 'post29', 'user4', 'tag2', 27);
+INSERT INTO posts VALUES (66, 'post66', 'user1', 'tag0', 8);
+INSERT INTO posts VALUES (23, 'post23', 'user3', 'tag2', 49);
+INSERT INTO posts VALUES (60, 'post60', 'user0', 'tag0', 30);
+INSERT INTO posts VALUES (17, 'post17', 'user2', 'tag2', 21);
+INSERT INTO posts VALUES (54, 'post54', 'user4', 'tag0', 2);
+INSERT INTO posts VALUES (11, 'post11', 'user1', 'tag2', 43);
+INSERT INTO posts VALUES (48, 'post48', 'user3', 'tag0', 24);
+INSERT INTO posts VALUES (5, 'post5', 'user0', 'tag2', 15);
+INSERT INTO posts VALUES (42, 'post42', 'user2', 'tag0', 46);
+INSERT INTO posts VALUES (79, 'post79', 'user4', 'tag1', 27);
+INSERT INTO posts VALUES (36, 'post36', 'user1', 'tag0', 18);
+INSERT INTO posts VALUES (73, 'post73', 'user3', 'tag1', 49);
+INSERT INTO posts VALUES (30, 'post30', 'user0', 'tag0', 40);
+INSERT INTO posts VALUES (67, 'post67', 'user2', 'tag1', 21);
+INSERT INTO posts VALUES (24, 'post24', 'user4', 'tag0', 12);
+INSERT INTO posts VALUES (61, 'post61', 'user1', 'tag1', 43);
+INSERT INTO posts VALUES (18, 'post18', 'user3', 'tag0', 34);
+INSERT INTO posts VALUES (55, 'post55', 'user0', 'tag1', 15);
+INSERT INTO posts VALUES (12, 'post12', 'user2', 'tag0', 6);
+INSERT INTO posts VALUES (49, 'post49', 'user4', 'tag1', 37);
+INSERT INTO posts VALUES (6, 'post6', 'user1', 'tag0', 28);
+INSERT INTO posts VALUES (43, 'post43', 'user3', 'tag1', 9);
+INSERT INTO posts VALUES (80, 'post80', 'user0', 'tag2', 40);
+INSERT INTO posts VALUES (37, 'post37', 'user2', 'tag1', 31);
+INSERT INTO posts VALUES (74, 'post74', 'user4', 'tag2', 12);
+INSERT INTO posts VALUES (31, 'post31', 'user1', 'tag1', 3);
+INSERT INTO posts VALUES (68, 'post68', 'user3', 'tag2', 34);
+INSERT INTO posts VALUES (25, 'post25', 'user0', 'tag1', 25);
+INSERT INTO posts VALUES (62, 'post62', 'user2', 'tag2', 6);
+INSERT INTO posts VALUES (19, 'post19', 'user4', 'tag1', 47);
+INSERT INTO posts VALUES (56, 'post56', 'user1', 'tag2', 28);
+INSERT INTO posts VALUES (13, 'post13', 'user3', 'tag1', 19);
+INSERT INTO posts VALUES (50, 'post50', 'user0', 'tag2', 0);
+INSERT INTO posts VALUES (7, 'post7', 'user2', 'tag1', 41);
+INSERT INTO posts VALUES (44, 'post44', 'user4', 'tag2', 22);
+SELECT * FROM posts ORDER BY votes DESC LIMIT 5;
+SELECT * FROM posts ORDER BY votes LIMIT 4 OFFSET 2;
+SELECT * FROM posts ORDER BY id DESC LIMIT 3;
+SELECT * FROM posts ORDER BY id ASC LIMIT 3;
+SELECT * FROM posts WHERE tag = 'tag1' ORDER BY author LIMIT 2;
+SELECT * FROM posts WHERE tag = 'tag0' ORDER BY author LIMIT 6;
+SELECT * FROM posts WHERE id < 10 ORDER BY title DESC;
+CREATE INDEX posts_votes ON posts (votes);
+SELECT * FROM posts ORDER BY votes LIMIT 3;
+SELECT * FROM posts WHERE votes > 45 ORDER BY votes DESC;
+SELECT tag, COUNT(*), SUM(votes) FROM posts GROUP BY tag ORDER BY tag DESC;
+SELECT author, MAX(votes) FROM posts GROUP BY author ORDER BY author LIMIT 2;
+SELECT tag, COUNT(*) FROM posts GROUP BY tag ORDER BY votes;
+.mode box
+SELECT * FROM posts ORDER BY votes DESC LIMIT 3 OFFSET 1;
+.mode plain
+SELECT * FROM posts ORDER BY;
+SELECT * FROM posts ORDER BY nothing;
+SELECT * FROM posts ORDER BY votes SIDEWAYS;
+SELECT * FROM posts LIMIT 2 ORDER BY votes;
+.exit
@@ -0,0 +1,58 @@
+CREATE TABLE posts (id INT, title TEXT, author TEXT, tag TEXT, votes INT);
+INSERT INTO posts VALUES (1, 'post1', 'user1', 'tag1', 13);
+INSERT INTO posts VALUES (38, 'post38', 'user3', 'tag2', 44);
+INSERT INTO posts VALUES (75, 'post75', 'user0', 'tag0', 25);
+INSERT INTO posts VALUES (32, 'post32', 'user2', 'tag2', 16);
+INSERT INTO posts VALUES (69, 'post69', 'user4', 'tag0', 47);
+INSERT INTO posts VALUES (26, 'post26', 'user1', 'tag2', 38);
+INSERT INTO posts VALUES (63, 'post63', 'user3', 'tag0', 19);
+INSERT INTO posts VALUES (20, 'post20', 'user0', 'tag2', 10);
+INSERT INTO posts VALUES (57, 'post57', 'user2', 'tag0', 41);
+INSERT INTO posts VALUES (14, 'post14', 'user4', 'tag2', 32);
+INSERT INTO posts VALUES (51, 'post51', 'user1', 'tag0', 13);
+INSERT INTO posts VALUES (8, 'post8', 'user3', 'tag2', 4);
+INSERT INTO posts VALUES (45, 'post45', 'user0', 'tag0', 35);
+INSERT INTO posts VALUES (2, 'post2', 'user2', 'tag2', 26);
+INSERT INTO posts VALUES (39, 'post39', 'user4', 'tag0', 7);
+INSERT INTO posts VALUES (76, 'post76', 'user1', 'tag1', 38);
+INSERT INTO posts VALUES (33, 'post33', 'user3', 'tag0', 29);
+INSERT INTO posts VALUES (70, 'post70', 'user0', 'tag1', 10);
+INSERT INTO posts VALUES (27, 'post27', 'user2', 'tag0', 1);
+INSERT INTO posts VALUES (64, 'post64', 'user4', 'tag1', 32);
+INSERT INTO posts VALUES (21, 'post21', 'user1', 'tag0', 23);
+INSERT INTO posts VALUES (58, 'post58', 'user3', 'tag1', 4);
+INSERT INTO posts VALUES (15, 'post15', 'user0', 'tag0', 45);
+INSERT INTO posts VALUES (52, 'post52', 'user2', 'tag1', 26);
+INSERT INTO posts VALUES (9, 'post9', 'user4', 'tag0', 17);
+INSERT INTO posts VALUES (46, 'post46', 'user1', 'tag1', 48);
+INSERT INTO posts VALUES (3, 'post3', 'user3', 'tag0', 39);
+INSERT INTO posts VALUES (40, 'post40', 'user0', 'tag1', 20);
+INSERT INTO posts VALUES (77, 'post77', 'user2', 'tag2', 1);
+INSERT INTO posts VALUES (34, 'post34', 'user4', 'tag1', 42);
+INSERT INTO posts VALUES (71, 'post71', 'user1', 'tag2', 23);
+INSERT INTO posts VALUES (28, 'post28', 'user3', 'tag1', 14);
+INSERT INTO posts VALUES (65, 'post65', 'user0', 'tag2', 45);
+INSERT INTO posts VALUES (22, 'post22', 'user2', 'tag1', 36);
+INSERT INTO posts VALUES (59, 'post59', 'user4', 'tag2', 17);
+INSERT INTO posts VALUES (16, 'post16', 'user1', 'tag1', 8);
+INSERT INTO posts VALUES (53, 'post53', 'user3', 'tag2', 39);
+INSERT INTO posts VALUES (10, 'post10', 'user0', 'tag1', 30);
+INSERT INTO posts VALUES (47, 'post47', 'user2', 'tag2', 11);
+INSERT INTO posts VALUES (4, 'post4', 'user4', 'tag1', 2);
+CREATE INDEX posts_votes ON posts (votes);
+SELECT * FROM posts WHERE id BETWEEN 10 AND 14;
+SELECT * FROM posts WHERE id >= 38 AND id < 41;
+SELECT * FROM posts WHERE id > 76 AND id <= 100;
+SELECT * FROM posts WHERE id BETWEEN 20 AND 10;
+SELECT * FROM posts WHERE id BETWEEN 1 AND 40 AND id > 37 AND id <= 39;
+SELECT * FROM posts WHERE id BETWEEN 30 AND 34 ORDER BY id DESC;
+SELECT * FROM posts WHERE votes BETWEEN 40 AND 44;
+SELECT * FROM posts WHERE votes > 45 AND votes < 48 ORDER BY votes;
+SELECT * FROM posts WHERE votes BETWEEN 10 AND 14 AND id BETWEEN 20 AND 30;
+SELECT * FROM posts WHERE author BETWEEN 'user1' AND 'user1';
+SELECT COUNT(*) FROM posts WHERE id BETWEEN 5 AND 24;
+SELECT * FROM posts WHERE id BETWEEN 5 OR id = 6;
+SELECT * FROM posts WHERE id BETWEEN 5;
+SELECT * FROM posts WHERE nope BETWEEN 1 AND 2;
+.check posts
+.exit
@@ -0,0 +1,30 @@
+CREATE TABLE users (id INT, name TEXT, city INT);
+CREATE TABLE orders (oid INT, user_id INT, item TEXT, qty INT);
+CREATE TABLE cities (cid INT, cname TEXT, code INT);
+INSERT INTO users VALUES (1, 'alice', 10);
+INSERT INTO users VALUES (2, 'bob', 20);
+INSERT INTO users VALUES (3, 'carol', 10);
+INSERT INTO orders VALUES (100, 1, 'pen', 2);
+INSERT INTO orders VALUES (101, 2, 'ink', 1);
+INSERT INTO orders VALUES (102, 1, 'pad', 5);
+INSERT INTO orders VALUES (103, 9, 'cup', 3);
+INSERT INTO cities VALUES (1, 'paris', 10);
+INSERT INTO cities VALUES (2, 'rome', 20);
+INSERT INTO cities VALUES (3, 'oslo', 10);
+SELECT * FROM users JOIN orders ON users.id = orders.user_id;
+SELECT * FROM orders JOIN users ON user_id = id;
+SELECT * FROM users JOIN cities ON city = code;
+SELECT * FROM users JOIN cities ON users.city = cities.code WHERE cname = 'paris';
+SELECT * FROM users INNER JOIN orders ON id = user_id WHERE qty > 1 ORDER BY qty DESC;
+SELECT * FROM users JOIN orders ON id = user_id LIMIT 1 OFFSET 1;
+SELECT * FROM users JOIN orders ON id = qty;
+SELECT * FROM users JOIN cities ON name = cname;
+SELECT * FROM users JOIN orders ON name = qty;
+SELECT * FROM users JOIN users ON id = id;
+SELECT * FROM users JOIN orders ON id = city;
+SELECT * FROM users JOIN orders ON id = missing;
+SELECT * FROM users JOIN missing ON id = id;
+SELECT COUNT(*) FROM users JOIN orders ON id = user_id;
+.mode box
+SELECT * FROM users JOIN cities ON city = code WHERE users.id = 2;
+.exit
@@ -0,0 +1,14 @@
+CREATE TABLE people (id INT, name TEXT, age INT);
+INSERT INTO people VALUES (1, 'alice', 30);
+INSERT INTO people VALUES (2, 'Smith, "Jo"', 41);
+INSERT INTO people VALUES (3, 'back\slash', 25);
+.mode csv
+SELECT * FROM people;
+SELECT name, COUNT(*) FROM people WHERE age > 26 GROUP BY name;
+.mode tsv
+SELECT * FROM people;
+SELECT age, COUNT(*) FROM people WHERE id >= 2 GROUP BY age;
+.mode json
+.mode plain
+SELECT * FROM people;
+.exit
@@ -0,0 +1,15 @@
+CREATE TABLE t (id INT, name TEXT);
+INSERT INTO t VALUES (1, 'one');
+INSERT INTO t VALUES (2, 'two');
+INSERT INTO t VALUES (3, 'three');
+.stats reset
+.stats on
+SELECT * FROM t;
+SELECT * FROM t WHERE id = 2;
+.stats off
+.stats
+.stats reset
+.stats
+.stats maybe
+.timer sometimes
+.exit
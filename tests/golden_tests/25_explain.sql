@@ -0,0 +1,26 @@
+CREATE TABLE t (id INT, name TEXT, age INT);
+INSERT INTO t VALUES (1, 'ann', 30);
+INSERT INTO t VALUES (2, 'bob', 40);
+INSERT INTO t VALUES (3, 'cat', 30);
+CREATE INDEX by_age ON t (age);
+CREATE TABLE o (oid INT, uid INT, qty INT);
+INSERT INTO o VALUES (10, 1, 5);
+INSERT INTO o VALUES (11, 3, 7);
+EXPLAIN SELECT * FROM t;
+EXPLAIN SELECT * FROM t WHERE id = 2;
+EXPLAIN SELECT * FROM t WHERE id > 1 AND id <= 3;
+EXPLAIN SELECT * FROM t WHERE age = 30;
+EXPLAIN SELECT * FROM t WHERE age > 30 ORDER BY age DESC LIMIT 1;
+EXPLAIN SELECT * FROM t WHERE name = 'bob';
+EXPLAIN SELECT * FROM t ORDER BY name LIMIT 2 OFFSET 1;
+EXPLAIN SELECT * FROM t ORDER BY id DESC LIMIT 2;
+EXPLAIN SELECT * FROM t LIMIT 2;
+EXPLAIN SELECT COUNT(*) FROM t;
+EXPLAIN SELECT COUNT(*) FROM t WHERE id > 1;
+EXPLAIN SELECT MIN(id), MAX(id) FROM t;
+EXPLAIN SELECT age, COUNT(*) FROM t WHERE name = 'ann' OR age = 40 GROUP BY age ORDER BY age;
+EXPLAIN SELECT * FROM t JOIN o ON t.id = o.uid;
+EXPLAIN SELECT * FROM t JOIN o ON t.age = o.qty WHERE o.oid = 10 ORDER BY qty;
+EXPLAIN INSERT INTO t VALUES (9, 'x', 1);
+EXPLAIN UPDATE t SET age = 1 WHERE id = 1;
+.exit
@@ -0,0 +1,16 @@
+CREATE TABLE t (id INT, name TEXT, age INT);
+INSERT INTO t VALUES (1, 'ann', 30);
+INSERT INTO t VALUES (2, 'bob', 40);
+INSERT INTO t VALUES (3, 'cat', 30);
+INSERT INTO t VALUES (4, 'dan', 30);
+CREATE INDEX by_age ON t (age);
+EXPLAIN SELECT * FROM t WHERE age = 30;
+ANALYZE t;
+EXPLAIN SELECT * FROM t WHERE age = 30;
+EXPLAIN SELECT * FROM t WHERE age = 40;
+EXPLAIN SELECT * FROM t WHERE id = 2 AND name = 'bob';
+EXPLAIN SELECT age, COUNT(*) FROM t GROUP BY age;
+ANALYZE;
+ANALYZE nosuch;
+ANALYZE t t;
+.exit
@@ -0,0 +1,159 @@
+/**
+ * import_benchmark loads the same rows into an empty table two ways: as a
+ * script of INSERT statements run a line at a time through
+ * repl_execute_line(), as piping the script into the REPL does, and as a CSV
+ * file through import_csv(), on one thread and on every processor. The rows
+ * come in a shuffled key order, and one name in eight needs quoting.
+ *
+ *   ./build/import_benchmark [rows] [rounds]
+ *
+ * Table files are capped at TABLE_MAX_PAGES pages, which bounds the default
+ * row count.
+ */
+#include "btree.h"
+#include "database.h"
+#include "import.h"
+#include "os_portability.h"
+#include "repl.h"
+#include "statement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "import_bench.db"
+#define CSV_FILE "import_bench.csv"
+#define SQL_FILE "import_bench.sql"
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static Database *open_empty() {
+  remove(BENCH_FILE);
+  Database *db = db_open(BENCH_FILE);
+  char create[] = "CREATE TABLE t (id INT, name TEXT, score INT)";
+  if (repl_execute_line(db, create) != REPL_CONTINUE ||
+      db->catalog.num_tables != 1) {
+    printf("CREATE TABLE failed\n");
+    exit(EXIT_FAILURE);
+  }
+  return db;
+}
+
+/** write_inputs writes the rows as a CSV file and as an INSERT script. */
+static void write_inputs(uint32_t rows) {
+  uint32_t *ids = malloc(rows * sizeof(uint32_t));
+  for (uint32_t i = 0; i < rows; i++)
+    ids[i] = i;
+  uint32_t seed = 12345;
+  for (uint32_t i = rows - 1; i > 0; i--) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t j = (seed >> 8) % (i + 1);
+    uint32_t t = ids[i];
+    ids[i] = ids[j];
+    ids[j] = t;
+  }
+  FILE *csv = fopen(CSV_FILE, "w");
+  FILE *sql = fopen(SQL_FILE, "w");
+  if (csv == nullptr || sql == nullptr) {
+    printf("Cannot write the input files\n");
+    exit(EXIT_FAILURE);
+  }
+  fprintf(csv, "id,name,score\n");
+  for (uint32_t i = 0; i < rows; i++) {
+    uint32_t id = ids[i];
+    char name[32];
+    snprintf(name, sizeof(name), id % 8 == 0 ? "Smith, user %u" : "user %u",
+             id);
+    fprintf(csv, id % 8 == 0 ? "%u,\"%s\",%u\n" : "%u,%s,%u\n", id, name,
+            id * 7 % 1000);
+    fprintf(sql, "INSERT INTO t VALUES (%u, '%s', %u)\n", id, name,
+            id * 7 % 1000);
+  }
+  fclose(csv);
+  fclose(sql);
+  free(ids);
+}
+
+static void check_rows(Database *db, uint32_t rows) {
+  uint32_t count = btree_row_count(db, 0);
+  unpin_page_all(db->pager);
+  if (count != rows) {
+    printf("Table holds %u rows, expected %u\n", count, rows);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static double bench_script(uint32_t rows) {
+  Database *db = open_empty();
+  FILE *sql = fopen(SQL_FILE, "r");
+  char line[256];
+  double start = now_s();
+  while (fgets(line, sizeof(line), sql) != nullptr) {
+    line[strcspn(line, "\r\n")] = '\0';
+    repl_execute_line(db, line);
+  }
+  double elapsed = now_s() - start;
+  fclose(sql);
+  check_rows(db, rows);
+  db_close(db);
+  return elapsed;
+}
+
+static double bench_import(uint32_t rows, uint32_t threads,
+                           uint32_t *chunks) {
+  Database *db = open_empty();
+  ImportStats stats;
+  double start = now_s();
+  ImportResult result = import_csv(db, 0, CSV_FILE, threads, &stats);
+  double elapsed = now_s() - start;
+  if (result != IMPORT_SUCCESS) {
+    printf("Import failed at record %llu\n",
+           (unsigned long long)stats.record);
+    exit(EXIT_FAILURE);
+  }
+  check_rows(db, rows);
+  *chunks = stats.threads;
+  db_close(db);
+  return elapsed;
+}
+
+static double best_of(double best, double elapsed) {
+  return best == 0 || elapsed < best ? elapsed : best;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 30000;
+  uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 3;
+  if (rows == 0 || rounds == 0) {
+    printf("Usage: %s [rows] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  write_inputs(rows);
+
+  uint32_t threads = os_cpu_count();
+  double script = 0, serial = 0, parallel = 0;
+  uint32_t serial_chunks = 0, parallel_chunks = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    script = best_of(script, bench_script(rows));
+    serial = best_of(serial, bench_import(rows, 1, &serial_chunks));
+    parallel = best_of(parallel, bench_import(rows, threads, &parallel_chunks));
+  }
+
+  printf("Loading %u rows in shuffled key order (best of %u rounds):\n", rows,
+         rounds);
+  printf("  INSERT script:             %9.3f ms (%.2f M rows/s)\n",
+         script * 1e3, rows / script / 1e6);
+  printf("  .import, %2u chunk(s):      %9.3f ms (%.2f M rows/s)\n",
+         serial_chunks, serial * 1e3, rows / serial / 1e6);
+  printf("  .import, %2u chunk(s):      %9.3f ms (%.2f M rows/s)\n",
+         parallel_chunks, parallel * 1e3, rows / parallel / 1e6);
+
+  remove(BENCH_FILE);
+  remove(CSV_FILE);
+  remove(SQL_FILE);
+  return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * index_benchmark compares lookups on a non-key column with and without a
+ * secondary index: the same prepared SELECT is timed as a full table scan,
+ * then again after CREATE INDEX on the column.
+ *
+ *   ./build/index_benchmark [rows] [lookups]
+ */
+#include "simpledb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_FILE "index_bench.db"
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint32_t next_random(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static void expect(int rc, int want, const char *what) {
+  if (rc != want) {
+    printf("%s failed with %d\n", what, rc);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void exec_sql(sdb *db, const char *sql) {
+  sdb_stmt *stmt;
+  expect(sdb_prepare(db, sql, &stmt), SDB_OK, sql);
+  expect(sdb_step(stmt), SDB_DONE, sql);
+  sdb_finalize(stmt);
+}
+
+// Each row gets a distinct code that is not in key order
+static uint32_t code_of(uint32_t id) { return id * 7919u % 1000003u; }
+
+static void load_rows(sdb *db, uint32_t rows) {
+  sdb_stmt *insert;
+  exec_sql(db, "CREATE TABLE items (id INT, code INT, name TEXT)");
+  expect(sdb_prepare(db, "INSERT INTO items VALUES (?, ?, ?)", &insert),
+         SDB_OK, "prepare INSERT");
+  for (uint32_t id = 0; id < rows; id++) {
+    char name[32];
+    snprintf(name, sizeof(name), "item%u", id);
+    sdb_bind_int(insert, 1, id);
+    sdb_bind_int(insert, 2, code_of(id));
+    sdb_bind_text(insert, 3, name);
+    expect(sdb_step(insert), SDB_DONE, "INSERT");
+  }
+  sdb_finalize(insert);
+}
+
+/** bench_lookups returns the seconds per lookup of `code = ?`. */
+static double bench_lookups(sdb *db, uint32_t rows, uint32_t lookups) {
+  sdb_stmt *select;
+  expect(sdb_prepare(db, "SELECT * FROM items WHERE code = ?", &select),
+         SDB_OK, "prepare SELECT");
+  uint32_t rng = 2463534242u;
+  uint32_t found = 0;
+  double start = now_s();
+  for (uint32_t i = 0; i < lookups; i++) {
+    uint32_t id = next_random(&rng) % rows;
+    sdb_bind_int(select, 1, code_of(id));
+    while (sdb_step(select) == SDB_ROW)
+      found += sdb_column_int(select, 0) == id;
+  }
+  double elapsed = now_s() - start;
+  sdb_finalize(select);
+  expect(found, lookups, "every lookup finds its row");
+  return elapsed / lookups;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 20000;
+  uint32_t lookups = argc > 2 ? (uint32_t)atoi(argv[2]) : 20000;
+  if (rows == 0 || lookups == 0) {
+    printf("Usage: %s [rows] [lookups]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  remove(BENCH_FILE);
+  sdb *db;
+  expect(sdb_open(BENCH_FILE, &db), SDB_OK, "sdb_open");
+  load_rows(db, rows);
+
+  // Scans are slow; a fraction of the lookups is enough to time them
+  uint32_t scan_lookups = lookups / 100 > 0 ? lookups / 100 : 1;
+  double scan = bench_lookups(db, rows, scan_lookups);
+
+  double start = now_s();
+  exec_sql(db, "CREATE INDEX items_code ON items(code)");
+  double build = now_s() - start;
+
+  double indexed = bench_lookups(db, rows, lookups);
+  sdb_close(db);
+
+  printf("Lookup on a non-key INT column, %u rows:\n", rows);
+  printf("  Full scan (%u lookups): %10.1f us/lookup\n", scan_lookups,
+         scan * 1e6);
+  printf("  Index     (%u lookups): %10.1f us/lookup\n", lookups,
+         indexed * 1e6);
+  printf("  Speedup: %.0fx (CREATE INDEX took %.1f ms)\n", scan / indexed,
+         build * 1e3);
+
+  remove(BENCH_FILE);
+  return 0;
+}
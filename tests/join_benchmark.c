@@ -0,0 +1,146 @@
+/**
+ * join_benchmark joins a fact table to a dimension table ten times smaller
+ * three ways: a hash join on a column with no index, the same hash join with
+ * a memory budget an eighth of its table's size so that both tables are
+ * partitioned on disk, and an index nested-loop join probing the dimension's
+ * primary key. Every fact row finds one dimension row in each.
+ *
+ *   ./build/join_benchmark [dimension rows] [rounds]
+ *
+ * Table files are capped at TABLE_MAX_PAGES pages, which bounds the default
+ * size; the fact table holds ten times the dimension rows.
+ */
+#include "database.h"
+#include "join.h"
+#include "statement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_FILE "join_bench.db"
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void prepare(Database *db, const char *sql, Statement *statement) {
+  char line[256];
+  snprintf(line, sizeof(line), "%s", sql);
+  *statement = (Statement){};
+  if (prepare_statement(line, statement, db) != PREPARE_SUCCESS) {
+    printf("Prepare failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void run(Database *db, const char *sql) {
+  Statement statement;
+  prepare(db, sql, &statement);
+  if (execute_statement(&statement, db) != EXECUTE_SUCCESS) {
+    printf("Statement failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+  free_statement(&statement);
+}
+
+/** join_rows runs a join to the end and returns the rows it produced. */
+static uint32_t join_rows(Database *db, const char *sql,
+                          uint32_t *partitions) {
+  Statement statement;
+  prepare(db, sql, &statement);
+  Join *join = join_open(&statement, db);
+  uint32_t rows = 0;
+  while (join_next(join) != nullptr)
+    rows++;
+  *partitions = join_partitions(join);
+  join_close(join);
+  free_statement(&statement);
+  return rows;
+}
+
+static double bench(Database *db, const char *sql, uint32_t rounds,
+                    uint32_t expected, uint32_t *partitions) {
+  double best = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    double start = now_s();
+    uint32_t rows = join_rows(db, sql, partitions);
+    double elapsed = now_s() - start;
+    if (rows != expected) {
+      printf("Join returned %u rows, expected %u: %s\n", rows, expected, sql);
+      exit(EXIT_FAILURE);
+    }
+    if (best == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+/**
+ * insert_rows fills a table of `rows` rows. A dimension's k is a unique value
+ * that is not its key; facts point at dimensions in a scattered order.
+ */
+static void insert_rows(Database *db, const char *sql, uint32_t rows,
+                        uint32_t dims, bool facts) {
+  Statement insert;
+  prepare(db, sql, &insert);
+  for (uint32_t id = 0; id < rows; id++) {
+    uint32_t dim = facts ? (uint32_t)((uint64_t)id * 2654435761u % dims) : id;
+    uint32_t values[] = {id, facts ? dim : dim * 7 + 3,
+                         facts ? dim * 7 + 3 : id};
+    for (uint32_t i = 0; i < 3; i++) {
+      if (bind_parameter_int(&insert, db, i, values[i]) != PREPARE_SUCCESS) {
+        printf("Bind failed\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    if (execute_statement(&insert, db) != EXECUTE_SUCCESS) {
+      printf("Insert failed at row %u\n", id);
+      exit(EXIT_FAILURE);
+    }
+  }
+  free_statement(&insert);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t dims = argc > 1 ? (uint32_t)atoi(argv[1]) : 6000;
+  uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 5;
+  if (dims == 0 || rounds == 0) {
+    printf("Usage: %s [dimension rows] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  uint32_t facts = dims * 10;
+
+  remove(BENCH_FILE);
+  Database *db = db_open(BENCH_FILE);
+  run(db, "CREATE TABLE dims (id INT, k INT, v INT)");
+  run(db, "CREATE TABLE facts (id INT, dim INT, k INT)");
+  insert_rows(db, "INSERT INTO dims VALUES (?, ?, ?)", dims, dims, false);
+  insert_rows(db, "INSERT INTO facts VALUES (?, ?, ?)", facts, dims, true);
+
+  const char *hashed = "SELECT * FROM facts JOIN dims ON facts.k = dims.k";
+  uint32_t in_memory_parts, spilled_parts, probed_parts;
+  double in_memory = bench(db, hashed, rounds, facts, &in_memory_parts);
+  size_t budget = db->join_memory;
+  // Rows of the hash table take their row plus three words
+  db->join_memory = (size_t)dims * (12 + 12) / 8;
+  double spilled = bench(db, hashed, rounds, facts, &spilled_parts);
+  db->join_memory = budget;
+  double probed =
+      bench(db, "SELECT * FROM facts JOIN dims ON facts.dim = dims.id", rounds,
+            facts, &probed_parts);
+
+  printf("%u facts JOIN %u dims (best of %u rounds):\n", facts, dims,
+         rounds);
+  printf("  Hash join in memory:       %9.3f ms (%.1f M rows/s)\n",
+         in_memory * 1e3, facts / in_memory / 1e6);
+  printf("  Hash join, %2u partitions:  %9.3f ms (%.1f M rows/s)\n",
+         spilled_parts, spilled * 1e3, facts / spilled / 1e6);
+  printf("  Index nested loop:         %9.3f ms (%.1f M rows/s)\n",
+         probed * 1e3, facts / probed / 1e6);
+
+  db_close(db);
+  remove(BENCH_FILE);
+  return 0;
+}
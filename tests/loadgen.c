@@ -0,0 +1,217 @@
+/**
+ * loadgen drives a running `db <file> --serve <socket>` instance over
+ * persistent connections and reports throughput and latency percentiles.
+ *
+ *   ./build/loadgen /tmp/db.sock --clients 8 --requests 20000 --rows 20000
+ *
+ * The setup phase creates the `loadgen` table and inserts --rows rows over a
+ * single connection; the measured phase runs --clients connections in
+ * parallel, each issuing --requests random point lookups.
+ */
+#define _GNU_SOURCE // clock_gettime, rand_r
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  const char *socket_path;
+  uint32_t rows;
+  uint32_t requests;
+  unsigned int seed;
+  uint64_t *latencies_ns;
+  bool failed;
+} ClientJob;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int connect_to(const char *socket_path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -1;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool io_full(int fd, void *buf, size_t len, bool writing) {
+  char *p = buf;
+  while (len > 0) {
+    ssize_t n = writing ? write(fd, p, len) : read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+/**
+ * request sends one line and reads the response into buf (truncated to
+ * buf_size - 1 bytes). Returns the full response length, or -1 on error.
+ */
+static int64_t request(int fd, const char *line, char *buf, size_t buf_size) {
+  uint32_t len = (uint32_t)strlen(line);
+  uint32_t header = htonl(len);
+  if (!io_full(fd, &header, sizeof(header), true) ||
+      !io_full(fd, (void *)line, len, true))
+    return -1;
+  if (!io_full(fd, &header, sizeof(header), false))
+    return -1;
+  uint32_t resp_len = ntohl(header);
+  uint32_t remaining = resp_len;
+  size_t stored = 0;
+  while (remaining > 0) {
+    char scratch[4096];
+    uint32_t chunk = remaining < sizeof(scratch) ? remaining : sizeof(scratch);
+    if (!io_full(fd, scratch, chunk, false))
+      return -1;
+    if (stored < buf_size - 1) {
+      size_t take = chunk < buf_size - 1 - stored ? chunk : buf_size - 1 - stored;
+      memcpy(buf + stored, scratch, take);
+      stored += take;
+    }
+    remaining -= chunk;
+  }
+  buf[stored] = '\0';
+  return resp_len;
+}
+
+static int client_main(void *arg) {
+  ClientJob *job = arg;
+  int fd = connect_to(job->socket_path);
+  if (fd == -1) {
+    job->failed = true;
+    return 0;
+  }
+  char line[128];
+  char response[256];
+  for (uint32_t i = 0; i < job->requests; i++) {
+    uint32_t id = (uint32_t)rand_r(&job->seed) % job->rows;
+    snprintf(line, sizeof(line), "SELECT * FROM loadgen WHERE id = %u;", id);
+    uint64_t start = now_ns();
+    if (request(fd, line, response, sizeof(response)) < 0) {
+      job->failed = true;
+      break;
+    }
+    job->latencies_ns[i] = now_ns() - start;
+  }
+  close(fd);
+  return 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_us(uint64_t *sorted, size_t n, double p) {
+  size_t idx = (size_t)(p * (double)(n - 1));
+  return (double)sorted[idx] / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    printf("Usage: %s <socket> [--clients N] [--requests N] [--rows N]\n",
+           argv[0]);
+    return EXIT_FAILURE;
+  }
+  const char *socket_path = argv[1];
+  uint32_t clients = 4, requests = 10000, rows = 10000;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--clients") == 0)
+      clients = (uint32_t)atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--requests") == 0)
+      requests = (uint32_t)atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "--rows") == 0)
+      rows = (uint32_t)atoi(argv[i + 1]);
+  }
+  if (clients == 0 || requests == 0 || rows == 0) {
+    printf("--clients, --requests and --rows must be positive.\n");
+    return EXIT_FAILURE;
+  }
+
+  // Setup: create and fill the table (duplicates from a previous run are
+  // reported by the server and ignored here).
+  int fd = connect_to(socket_path);
+  if (fd == -1) {
+    printf("Unable to connect to %s\n", socket_path);
+    return EXIT_FAILURE;
+  }
+  char line[128];
+  char response[256];
+  request(fd, "CREATE TABLE loadgen (id INT, name TEXT);", response,
+          sizeof(response));
+  uint64_t setup_start = now_ns();
+  for (uint32_t id = 0; id < rows; id++) {
+    snprintf(line, sizeof(line), "INSERT INTO loadgen VALUES (%u, 'user%u');",
+             id, id);
+    if (request(fd, line, response, sizeof(response)) < 0) {
+      printf("Connection lost during setup.\n");
+      return EXIT_FAILURE;
+    }
+  }
+  double setup_s = (double)(now_ns() - setup_start) / 1e9;
+  close(fd);
+  printf("Setup: %u inserts in %.3f s (%.0f inserts/s)\n", rows, setup_s,
+         rows / setup_s);
+
+  // Measured phase
+  ClientJob *jobs = calloc(clients, sizeof(ClientJob));
+  thrd_t *threads = malloc(clients * sizeof(thrd_t));
+  uint64_t *latencies = malloc((size_t)clients * requests * sizeof(uint64_t));
+  uint64_t start = now_ns();
+  for (uint32_t c = 0; c < clients; c++) {
+    jobs[c] = (ClientJob){.socket_path = socket_path,
+                          .rows = rows,
+                          .requests = requests,
+                          .seed = 12345u + c,
+                          .latencies_ns = latencies + (size_t)c * requests};
+    thrd_create(&threads[c], client_main, &jobs[c]);
+  }
+  bool failed = false;
+  for (uint32_t c = 0; c < clients; c++) {
+    thrd_join(threads[c], nullptr);
+    failed |= jobs[c].failed;
+  }
+  double elapsed_s = (double)(now_ns() - start) / 1e9;
+
+  if (failed) {
+    printf("One or more clients lost their connection.\n");
+    return EXIT_FAILURE;
+  }
+
+  size_t total = (size_t)clients * requests;
+  qsort(latencies, total, sizeof(uint64_t), compare_u64);
+  printf("Point lookups: %zu requests from %u clients in %.3f s\n", total,
+         clients, elapsed_s);
+  printf("  QPS: %.0f\n", (double)total / elapsed_s);
+  printf("  Latency (us): p50 %.1f  p99 %.1f  max %.1f\n",
+         percentile_us(latencies, total, 0.50),
+         percentile_us(latencies, total, 0.99),
+         percentile_us(latencies, total, 1.0));
+
+  free(latencies);
+  free(threads);
+  free(jobs);
+  return 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * output_benchmark times printing every row of a table to the null device,
+ * in plain and in box mode, two ways: through the ResultSink execute_select()
+ * now writes with, and with a printf per value and per box-drawing character
+ * as it used to. Both read the rows through the same batch scan. The CSV, TSV
+ * and binary formats are timed through the sink, with their output size.
+ *
+ *   ./build/output_benchmark [rows] [rounds]
+ *
+ * Table files are capped at TABLE_MAX_PAGES pages, which bounds the default
+ * row count.
+ */
+#include "batch.h"
+#include "database.h"
+#include "statement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "output_bench.db"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void prepare(Database *db, const char *sql, Statement *statement) {
+  char line[256];
+  snprintf(line, sizeof(line), "%s", sql);
+  *statement = (Statement){};
+  if (prepare_statement(line, statement, db) != PREPARE_SUCCESS) {
+    printf("Prepare failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void run(Database *db, const char *sql) {
+  Statement statement;
+  prepare(db, sql, &statement);
+  if (execute_statement(&statement, db) != EXECUTE_SUCCESS) {
+    printf("Statement failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+  free_statement(&statement);
+}
+
+static void print_rule(FILE *out, const Schema *schema, const uint32_t *widths,
+                       const char *left, const char *joint,
+                       const char *right) {
+  fprintf(out, "%s", left);
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    for (uint32_t j = 0; j < widths[i] + 2; j++)
+      fprintf(out, "─");
+    if (i < schema->num_fields - 1)
+      fprintf(out, "%s", joint);
+  }
+  fprintf(out, "%s\n", right);
+}
+
+/** print_row prints a row with printf, as execute_select() used to. */
+static void print_row(FILE *out, const Schema *schema, const uint32_t *widths,
+                      const uint8_t *row, bool box) {
+  fprintf(out, box ? "│" : "(");
+  for (uint32_t i = 0; i < schema->num_fields; i++) {
+    const Field *f = &schema->fields[i];
+    char buf[64];
+    if (f->type == FIELD_INT) {
+      uint32_t v;
+      memcpy(&v, row + f->offset, sizeof(v));
+      snprintf(buf, sizeof(buf), "%u", v);
+    } else {
+      memcpy(buf, row + f->offset, f->size);
+    }
+    if (box)
+      fprintf(out, " %-*s │", widths[i], buf);
+    else
+      fprintf(out, i < schema->num_fields - 1 ? "%s, " : "%s", buf);
+  }
+  fprintf(out, box ? "\n" : ")\n");
+}
+
+/** with_printf prints every row of the table value by value with printf. */
+static void with_printf(Database *db, bool box) {
+  Statement statement;
+  prepare(db, "SELECT * FROM people", &statement);
+  Schema *schema = &db->catalog.tables[statement.table_index].schema;
+  // A full table is past what box mode measures, so widths are the widest
+  uint32_t widths[MAX_FIELDS];
+  for (uint32_t i = 0; i < schema->num_fields; i++)
+    widths[i] = schema->fields[i].type == FIELD_INT ? 10 : TEXT_FIELD_SIZE - 1;
+  if (box) {
+    print_rule(db->out, schema, widths, "┌", "┬", "┐");
+    print_rule(db->out, schema, widths, "├", "┼", "┤");
+  }
+  BatchScan *scan =
+      batch_scan_open(&statement, db, select_open(&statement, db), 0);
+  RowBatch *batch;
+  while ((batch = batch_scan_next(scan)) != nullptr) {
+    for (uint32_t i = 0; i < batch->num_selected; i++)
+      print_row(db->out, schema, widths, batch->rows[batch->sel[i]], box);
+  }
+  batch_scan_close(scan);
+  if (box)
+    print_rule(db->out, schema, widths, "└", "┴", "┘");
+  fflush(db->out);
+  free_statement(&statement);
+}
+
+static double bench(Database *db, PrintMode mode, bool sink,
+                    uint32_t rounds) {
+  db->print_mode = mode;
+  double best = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    double start = now_s();
+    if (sink)
+      run(db, "SELECT * FROM people");
+    else
+      with_printf(db, mode == PRINT_BOX);
+    double elapsed = now_s() - start;
+    if (best == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+/** output_size returns the bytes a SELECT of every row prints in `mode`. */
+static long output_size(Database *db, PrintMode mode) {
+  FILE *null_device = db->out;
+  db->out = tmpfile();
+  db->print_mode = mode;
+  run(db, "SELECT * FROM people");
+  fflush(db->out);
+  fseek(db->out, 0, SEEK_END);
+  long size = ftell(db->out);
+  fclose(db->out);
+  db->out = null_device;
+  return size;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 40000;
+  uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 5;
+  if (rows == 0 || rounds == 0) {
+    printf("Usage: %s [rows] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  remove(BENCH_FILE);
+  Database *db = db_open(BENCH_FILE);
+  run(db, "CREATE TABLE people (id INT, name TEXT, age INT)");
+  Statement insert;
+  prepare(db, "INSERT INTO people VALUES (?, ?, ?)", &insert);
+  for (uint32_t id = 0; id < rows; id++) {
+    char name[16];
+    snprintf(name, sizeof(name), "person%u", id * 7919 % 100000);
+    if (bind_parameter_int(&insert, db, 0, id) != PREPARE_SUCCESS ||
+        bind_parameter_text(&insert, db, 1, name) != PREPARE_SUCCESS ||
+        bind_parameter_int(&insert, db, 2, 18 + id % 80) != PREPARE_SUCCESS) {
+      printf("Bind failed\n");
+      exit(EXIT_FAILURE);
+    }
+    if (execute_statement(&insert, db) != EXECUTE_SUCCESS) {
+      printf("Insert failed at row %u\n", id);
+      exit(EXIT_FAILURE);
+    }
+  }
+  free_statement(&insert);
+
+  db->out = fopen(NULL_DEVICE, "w");
+  if (db->out == nullptr) {
+    printf("Could not open " NULL_DEVICE "\n");
+    return EXIT_FAILURE;
+  }
+  double plain_printf = bench(db, PRINT_PLAIN, false, rounds);
+  double box_printf = bench(db, PRINT_BOX, false, rounds);
+  printf("Printing %u rows (best of %u rounds):\n", rows, rounds);
+  printf("  Plain  printf: %9.3f ms (%.1f M rows/s)\n", plain_printf * 1e3,
+         rows / plain_printf / 1e6);
+  printf("  Box    printf: %9.3f ms (%.1f M rows/s)\n", box_printf * 1e3,
+         rows / box_printf / 1e6);
+
+  const char *names[] = {"Plain", "Box", "CSV", "TSV", "Binary"};
+  PrintMode modes[] = {PRINT_PLAIN, PRINT_BOX, PRINT_CSV, PRINT_TSV,
+                       PRINT_BINARY};
+  for (uint32_t m = 0; m < 5; m++) {
+    double elapsed = bench(db, modes[m], true, rounds);
+    long size = output_size(db, modes[m]);
+    printf("  %-6s sink:   %9.3f ms (%.1f M rows/s, %.0f MB/s", names[m],
+           elapsed * 1e3, rows / elapsed / 1e6, size / elapsed / 1e6);
+    if (modes[m] == PRINT_PLAIN)
+      printf(", %.1fx", plain_printf / elapsed);
+    if (modes[m] == PRINT_BOX)
+      printf(", %.1fx", box_printf / elapsed);
+    printf(")\n");
+  }
+  fclose(db->out);
+  db->out = stdout;
+
+  db_close(db);
+  remove(BENCH_FILE);
+  return 0;
+}
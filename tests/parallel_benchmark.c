@@ -0,0 +1,139 @@
+/**
+ * parallel_benchmark times a full-table aggregate, one without GROUP BY and
+ * one with a thousand groups, on 1, 2, 4, ... threads up to the number of
+ * processors, and reports each against the single-threaded scan. Most of
+ * the table's leaves do not fit in the cache, so they are read from the file.
+ *
+ *   ./build/parallel_benchmark [rows] [rounds] [max threads]
+ *
+ * Table files are capped at TABLE_MAX_PAGES pages, which bounds the default
+ * row count.
+ */
+#include "aggregate.h"
+#include "database.h"
+#include "os_portability.h"
+#include "statement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "parallel_bench.db"
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void prepare(Database *db, const char *sql, Statement *statement) {
+  char line[256];
+  snprintf(line, sizeof(line), "%s", sql);
+  *statement = (Statement){};
+  if (prepare_statement(line, statement, db) != PREPARE_SUCCESS) {
+    printf("Prepare failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void run(Database *db, const char *sql) {
+  Statement statement;
+  prepare(db, sql, &statement);
+  if (execute_statement(&statement, db) != EXECUTE_SUCCESS) {
+    printf("Statement failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+  free_statement(&statement);
+}
+
+/** aggregate runs an aggregate and returns its first row's bytes, summed. */
+static uint64_t aggregate(Database *db, const char *sql) {
+  Statement statement;
+  prepare(db, sql, &statement);
+  ResultSet *result = aggregate_execute(&statement, db);
+  uint64_t check = 0;
+  for (uint32_t i = 0; i < result->num_rows * result->schema.row_size; i++)
+    check = check * 31 + result->rows[i];
+  result_set_free(result);
+  free_statement(&statement);
+  return check;
+}
+
+/**
+ * bench returns the best time of `rounds` runs on `threads` threads, and
+ * checks the result against the single-threaded one.
+ */
+static double bench(Database *db, const char *sql, uint32_t threads,
+                    uint32_t rounds, uint64_t *expected) {
+  db->scan_threads = threads;
+  double best = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    double start = now_s();
+    uint64_t check = aggregate(db, sql);
+    double elapsed = now_s() - start;
+    if (threads == 1 && r == 0)
+      *expected = check;
+    if (check != *expected) {
+      printf("%u threads returned a different result: %s\n", threads, sql);
+      exit(EXIT_FAILURE);
+    }
+    if (best == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 120000;
+  uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 10;
+  uint32_t max_threads = argc > 3 ? (uint32_t)atoi(argv[3]) : os_cpu_count();
+  if (rows == 0 || rounds == 0 || max_threads == 0) {
+    printf("Usage: %s [rows] [rounds] [max threads]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  remove(BENCH_FILE);
+  Database *db = db_open(BENCH_FILE);
+  run(db, "CREATE TABLE events (id INT, kind INT, score INT)");
+  Statement insert;
+  prepare(db, "INSERT INTO events VALUES (?, ?, ?)", &insert);
+  for (uint32_t id = 0; id < rows; id++) {
+    uint32_t values[] = {id, id * 2654435761u % 1000, id * 7919 % 10007};
+    for (uint32_t i = 0; i < 3; i++) {
+      if (bind_parameter_int(&insert, db, i, values[i]) != PREPARE_SUCCESS) {
+        printf("Bind failed\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    if (execute_statement(&insert, db) != EXECUTE_SUCCESS) {
+      printf("Insert failed at row %u\n", id);
+      exit(EXIT_FAILURE);
+    }
+  }
+  free_statement(&insert);
+
+  const char *queries[] = {
+      "SELECT COUNT(*), SUM(score), MAX(kind) FROM events WHERE score > 10",
+      "SELECT kind, COUNT(*), SUM(score) FROM events GROUP BY kind",
+  };
+  const char *labels[] = {"COUNT/SUM", "GROUP BY"};
+  printf("%u rows (best of %u rounds):\n", rows, rounds);
+  for (uint32_t q = 0; q < 2; q++) {
+    uint64_t expected = 0;
+    double serial = 0;
+    for (uint32_t threads = 1; threads <= max_threads; threads *= 2) {
+      double elapsed = bench(db, queries[q], threads, rounds, &expected);
+      if (threads == 1)
+        serial = elapsed;
+      printf("  %-10s %2u threads: %9.3f ms (%.1f M rows/s, %.2fx)\n",
+             labels[q], threads, elapsed * 1e3, rows / elapsed / 1e6,
+             serial / elapsed);
+      if (threads < max_threads && threads * 2 > max_threads)
+        threads = max_threads / 2; // Finish on max_threads itself
+    }
+  }
+
+  db_close(db);
+  remove(BENCH_FILE);
+  return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * parse_benchmark measures how fast a large INSERT script is turned into
+ * statements, both by prepare_statement() and through the plan cache. Only
+ * preparing is timed: each statement is released without being executed.
+ *
+ *   ./build/parse_benchmark [statements] [rounds]
+ */
+#include "database.h"
+#include "plan_cache.h"
+#include "statement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "parse_bench.db"
+#define LINE_LEN 128
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void run(Database *db, char *line) {
+  Statement statement = {};
+  if (prepare_statement(line, &statement, db) != PREPARE_SUCCESS ||
+      execute_statement(&statement, db) != EXECUTE_SUCCESS) {
+    printf("Setup statement failed: %s\n", line);
+    exit(EXIT_FAILURE);
+  }
+  free_statement(&statement);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t count = argc > 1 ? (uint32_t)atoi(argv[1]) : 200000;
+  uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 5;
+  if (count == 0 || rounds == 0) {
+    printf("Usage: %s [statements] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  remove(BENCH_FILE);
+  Database *db = db_open(BENCH_FILE);
+  char create[] = "CREATE TABLE users (id INT, username TEXT, email TEXT)";
+  run(db, create);
+
+  // The script is generated up front so that only parsing is measured
+  char *script = malloc((size_t)count * LINE_LEN);
+  size_t bytes = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    bytes += (size_t)snprintf(
+        script + (size_t)i * LINE_LEN, LINE_LEN,
+        "INSERT INTO users VALUES (%u, 'user%u', 'user%u@example.com');", i,
+        i, i);
+  }
+
+  printf("Prepared %u INSERT statements (%.1f MB), best of %u rounds:\n",
+         count, bytes / 1e6, rounds);
+  for (int cached = 0; cached <= 1; cached++) {
+    double best = 0;
+    for (uint32_t r = 0; r < rounds; r++) {
+      double start = now_s();
+      for (uint32_t i = 0; i < count; i++) {
+        char *line = script + (size_t)i * LINE_LEN;
+        Statement statement = {};
+        PrepareResult result = cached
+                                   ? plan_cache_prepare(db, line, &statement)
+                                   : prepare_statement(line, &statement, db);
+        if (result != PREPARE_SUCCESS) {
+          printf("Parse failed: %s\n", line);
+          return EXIT_FAILURE;
+        }
+        free_statement(&statement);
+      }
+      double elapsed = now_s() - start;
+      if (best == 0 || elapsed < best)
+        best = elapsed;
+    }
+    printf("  %-18s %9.0f statements/s, %4.0f ns/statement, %6.1f MB/s\n",
+           cached ? "plan cache:" : "prepare_statement:", count / best,
+           best * 1e9 / count, bytes / 1e6 / best);
+  }
+
+  free(script);
+  db_close(db);
+  remove(BENCH_FILE);
+  return 0;
+}
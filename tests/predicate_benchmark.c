@@ -0,0 +1,202 @@
+/**
+ * predicate_benchmark measures a selective scan: every row of a table is
+ * tested against an AND/OR predicate on non-key columns. The compiled
+ * predicate (type-specialized term functions over the row bytes) is compared
+ * with a straightforward interpreter that copies each field out with
+ * deserialize_field() and dispatches on type and operator for every row, over
+ * the same leaf walk. The end-to-end SELECT path is timed as well.
+ *
+ *   ./build/predicate_benchmark [rows] [rounds]
+ */
+#include "btree.h"
+#include "database.h"
+#include "schema.h"
+#include "statement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "predicate_bench.db"
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void prepare(Database *db, const char *sql, Statement *statement) {
+  char line[256];
+  snprintf(line, sizeof(line), "%s", sql);
+  *statement = (Statement){};
+  if (prepare_statement(line, statement, db) != PREPARE_SUCCESS) {
+    printf("Prepare failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void run(Database *db, const char *sql) {
+  Statement statement;
+  prepare(db, sql, &statement);
+  if (execute_statement(&statement, db) != EXECUTE_SUCCESS) {
+    printf("Statement failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+  free_statement(&statement);
+}
+
+/** interpret evaluates a predicate the way an uncompiled executor would. */
+static bool interpret(const Predicate *predicate, Schema *schema, void *row) {
+  bool group = true;
+  for (uint32_t i = 0; i < predicate->num_terms; i++) {
+    const PredicateTerm *t = &predicate->terms[i];
+    if (group) {
+      int cmp;
+      if (schema->fields[t->field].type == FIELD_INT) {
+        uint32_t v;
+        deserialize_field(schema, t->field, row, &v);
+        cmp = v < t->value ? -1 : v > t->value;
+      } else {
+        char v[TEXT_FIELD_SIZE];
+        deserialize_field(schema, t->field, row, v);
+        cmp = strcmp(v, t->text);
+      }
+      switch (t->op) {
+      case CMP_EQ:
+        group = cmp == 0;
+        break;
+      case CMP_NE:
+        group = cmp != 0;
+        break;
+      case CMP_LT:
+        group = cmp < 0;
+        break;
+      case CMP_LE:
+        group = cmp <= 0;
+        break;
+      case CMP_GT:
+        group = cmp > 0;
+        break;
+      case CMP_GE:
+        group = cmp >= 0;
+        break;
+      }
+    }
+    if (t->ends_group) {
+      if (group)
+        return true;
+      group = true;
+    }
+  }
+  return predicate->num_terms == 0;
+}
+
+/** scan walks every leaf cell and counts the rows the predicate accepts. */
+static uint32_t scan(Database *db, Statement *statement, bool compiled) {
+  Schema *schema = &db->catalog.tables[statement->table_index].schema;
+  Cursor *c = table_start(db, statement->table_index);
+  uint32_t matches = 0;
+  while (true) {
+    void *node = get_page(db->pager, c->page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    for (uint32_t i = 0; i < num_cells; i++) {
+      void *row = leaf_node_value(node, i, schema);
+      matches += compiled ? predicate_matches(&statement->predicate, row)
+                          : interpret(&statement->predicate, schema, row);
+    }
+    uint32_t next = *leaf_node_next_leaf(node);
+    unpin_page_all(db->pager);
+    if (next == 0)
+      break;
+    c->page_num = next;
+  }
+  free(c);
+  return matches;
+}
+
+int main(int argc, char *argv[]) {
+  // The default fills about 800 of the file's 1000 pages
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 35000;
+  uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 50;
+  if (rows == 0 || rounds == 0) {
+    printf("Usage: %s [rows] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  remove(BENCH_FILE);
+  Database *db = db_open(BENCH_FILE);
+  run(db, "CREATE TABLE events (id INT, kind INT, score INT, region TEXT)");
+  Statement insert;
+  prepare(db, "INSERT INTO events VALUES (?, ?, ?, ?)", &insert);
+  uint32_t rng = 2463534242u;
+  for (uint32_t id = 0; id < rows; id++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    char region[8];
+    snprintf(region, sizeof(region), "r%u", rng % 16);
+    if (bind_parameter_int(&insert, db, 0, id) != PREPARE_SUCCESS ||
+        bind_parameter_int(&insert, db, 1, rng % 10) != PREPARE_SUCCESS ||
+        bind_parameter_int(&insert, db, 2, (rng >> 8) % 1000) !=
+            PREPARE_SUCCESS ||
+        bind_parameter_text(&insert, db, 3, region) != PREPARE_SUCCESS ||
+        execute_statement(&insert, db) != EXECUTE_SUCCESS) {
+      printf("Insert failed at row %u\n", id);
+      return EXIT_FAILURE;
+    }
+  }
+  free_statement(&insert);
+
+  Statement select;
+  prepare(db,
+          "SELECT * FROM events WHERE kind = 3 AND score >= 900 OR "
+          "region = 'r7' AND score < 10",
+          &select);
+
+  printf("Selective scan over %u rows (best of %u rounds):\n", rows, rounds);
+  uint32_t expected = 0;
+  for (int compiled = 0; compiled <= 1; compiled++) {
+    double best = 0;
+    for (uint32_t r = 0; r < rounds; r++) {
+      double start = now_s();
+      uint32_t matches = scan(db, &select, compiled);
+      double elapsed = now_s() - start;
+      if (expected == 0)
+        expected = matches;
+      if (matches != expected) {
+        printf("Evaluators disagree: %u vs %u matches\n", matches, expected);
+        return EXIT_FAILURE;
+      }
+      if (best == 0 || elapsed < best)
+        best = elapsed;
+    }
+    printf("  %-22s %7.1f M rows/s (%u matches)\n",
+           compiled ? "compiled predicate:" : "interpreted predicate:",
+           rows / best / 1e6, expected);
+  }
+
+  // The whole SELECT path: leaf walk, key bound checks and the predicate
+  double best = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    double start = now_s();
+    Cursor *c = select_open(&select, db);
+    uint32_t matches = 0;
+    while (select_next(&select, db, c) != nullptr)
+      matches++;
+    free(c);
+    unpin_page_all(db->pager);
+    double elapsed = now_s() - start;
+    if (matches != expected) {
+      printf("SELECT returned %u rows, expected %u\n", matches, expected);
+      return EXIT_FAILURE;
+    }
+    if (best == 0 || elapsed < best)
+      best = elapsed;
+  }
+  printf("  %-22s %7.1f M rows/s\n", "select_next():", rows / best / 1e6);
+
+  free_statement(&select);
+  db_close(db);
+  remove(BENCH_FILE);
+  return 0;
+}
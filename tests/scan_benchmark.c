@@ -0,0 +1,159 @@
+/**
+ * scan_benchmark compares the row-at-a-time SELECT loop (select_next(), as
+ * execute_select() used to drive it) with the batch scan over the same table.
+ * Each query counts the matching rows and sums one column, so the batch side
+ * measures decoding, filtering into selection vectors and a columnar
+ * aggregate.
+ *
+ *   ./build/scan_benchmark [rows] [rounds]
+ */
+#include "batch.h"
+#include "database.h"
+#include "statement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "scan_bench.db"
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void prepare(Database *db, const char *sql, Statement *statement) {
+  char line[256];
+  snprintf(line, sizeof(line), "%s", sql);
+  *statement = (Statement){};
+  if (prepare_statement(line, statement, db) != PREPARE_SUCCESS) {
+    printf("Prepare failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+}
+
+typedef struct {
+  uint64_t count;
+  uint64_t sum;
+} ScanResult;
+
+// Field 2 of the table is `score`
+constexpr uint32_t SCORE_FIELD = 2;
+
+static ScanResult scan_rows(Database *db, Statement *select) {
+  Schema *schema = &db->catalog.tables[select->table_index].schema;
+  uint32_t offset = schema->fields[SCORE_FIELD].offset;
+  ScanResult result = {};
+  Cursor *c = select_open(select, db);
+  void *row;
+  while ((row = select_next(select, db, c)) != nullptr) {
+    uint32_t score;
+    memcpy(&score, (char *)row + offset, sizeof(score));
+    result.count++;
+    result.sum += score;
+  }
+  free(c);
+  unpin_page_all(db->pager);
+  return result;
+}
+
+static ScanResult scan_batches(Database *db, Statement *select) {
+  ScanResult result = {};
+  BatchScan *scan =
+      batch_scan_open(select, db, select_open(select, db), 1u << SCORE_FIELD);
+  RowBatch *batch;
+  while ((batch = batch_scan_next(scan)) != nullptr) {
+    const uint32_t *score = batch->columns[SCORE_FIELD];
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < batch->num_selected; i++)
+      sum += score[batch->sel[i]];
+    result.count += batch->num_selected;
+    result.sum += sum;
+  }
+  batch_scan_close(scan);
+  return result;
+}
+
+static void bench(Database *db, const char *sql, uint32_t rows,
+                  uint32_t rounds) {
+  Statement select;
+  prepare(db, sql, &select);
+  printf("%s\n", sql);
+  ScanResult expected = {};
+  for (int batched = 0; batched <= 1; batched++) {
+    double best = 0;
+    for (uint32_t r = 0; r < rounds; r++) {
+      double start = now_s();
+      ScanResult result =
+          batched ? scan_batches(db, &select) : scan_rows(db, &select);
+      double elapsed = now_s() - start;
+      if (!batched && r == 0)
+        expected = result;
+      if (result.count != expected.count || result.sum != expected.sum) {
+        printf("Scans disagree: %llu rows vs %llu\n",
+               (unsigned long long)result.count,
+               (unsigned long long)expected.count);
+        exit(EXIT_FAILURE);
+      }
+      if (best == 0 || elapsed < best)
+        best = elapsed;
+    }
+    printf("  %-16s %7.1f M rows/s (%llu matches)\n",
+           batched ? "batch scan:" : "select_next():", rows / best / 1e6,
+           (unsigned long long)expected.count);
+  }
+  free_statement(&select);
+}
+
+int main(int argc, char *argv[]) {
+  // By default the table fits in the buffer pool, so neither scan waits on
+  // reads; larger tables measure the pager instead
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 4000;
+  uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 500;
+  if (rows == 0 || rounds == 0) {
+    printf("Usage: %s [rows] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  remove(BENCH_FILE);
+  Database *db = db_open(BENCH_FILE);
+  Statement statement;
+  prepare(db, "CREATE TABLE events (id INT, kind INT, score INT, region TEXT)",
+          &statement);
+  if (execute_statement(&statement, db) != EXECUTE_SUCCESS)
+    return EXIT_FAILURE;
+  free_statement(&statement);
+  prepare(db, "INSERT INTO events VALUES (?, ?, ?, ?)", &statement);
+  uint32_t rng = 2463534242u;
+  for (uint32_t id = 0; id < rows; id++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    char region[8];
+    snprintf(region, sizeof(region), "r%u", rng % 16);
+    if (bind_parameter_int(&statement, db, 0, id) != PREPARE_SUCCESS ||
+        bind_parameter_int(&statement, db, 1, rng % 10) != PREPARE_SUCCESS ||
+        bind_parameter_int(&statement, db, 2, (rng >> 8) % 1000) !=
+            PREPARE_SUCCESS ||
+        bind_parameter_text(&statement, db, 3, region) != PREPARE_SUCCESS ||
+        execute_statement(&statement, db) != EXECUTE_SUCCESS) {
+      printf("Insert failed at row %u\n", id);
+      return EXIT_FAILURE;
+    }
+  }
+  free_statement(&statement);
+
+  printf("Scans over %u rows (best of %u rounds):\n", rows, rounds);
+  bench(db, "SELECT * FROM events", rows, rounds);
+  bench(db, "SELECT * FROM events WHERE kind = 3 AND score >= 500", rows,
+        rounds);
+  bench(db,
+        "SELECT * FROM events WHERE kind = 3 AND score >= 900 OR "
+        "region = 'r7' AND score < 10",
+        rows, rounds);
+
+  db_close(db);
+  remove(BENCH_FILE);
+  return 0;
+}
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Server mode over a real socket: framing, refused multi-line requests and
+meta-commands, clients that stall mid-frame without holding a worker, and a
+full file.
+
+    python3 tests/server_test.py ./build/db
+"""
+import os
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+TIMEOUT_S = 3
+
+
+def connect(path):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.settimeout(TIMEOUT_S)
+    sock.connect(path)
+    return sock
+
+
+def recv_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed")
+        data += chunk
+    return data
+
+
+def request(sock, line):
+    payload = line.encode()
+    sock.sendall(struct.pack(">I", len(payload)) + payload)
+    (length,) = struct.unpack(">I", recv_exact(sock, 4))
+    return recv_exact(sock, length).decode()
+
+
+def check(condition, what):
+    if not condition:
+        raise AssertionError(what)
+    print(f"PASS: {what}")
+
+
+def run_tests(sock_path):
+    client = connect(sock_path)
+    request(client, "CREATE TABLE t (id INT, name TEXT);")
+    request(client, "INSERT INTO t VALUES (1, 'alice');")
+    request(client, "INSERT INTO t VALUES (2, 'bob');")
+    out = request(client, "SELECT * FROM t WHERE id = 1;")
+    check("alice" in out and "bob" not in out, "single-line SELECT")
+    out = request(client, "SELECT * FROM t WHERE id = 2;\n")
+    check("bob" in out and "alice" not in out, "trailing newline ignored")
+
+    # The whole frame is the request; running its first line alone would
+    # return every row
+    out = request(client, "SELECT * FROM t\nWHERE id = 1;")
+    check(out.startswith("Error:") and "alice" not in out,
+          "multi-line request refused")
+
+    # Clients stalled mid-frame, as many as there are workers, must not keep
+    # others waiting
+    stalled = [connect(sock_path) for _ in range(2)]
+    for sock in stalled:
+        sock.sendall(b"\x00\x00")
+    time.sleep(0.2)
+    other = connect(sock_path)
+    out = request(other, ".tables")
+    check("t" in out.split(), "request served beside stalled clients")
+
+    # A stalled frame completes where it left off
+    payload = b"SELECT * FROM t WHERE id = 1;"
+    header = struct.pack(">I", len(payload))
+    stalled[0].sendall(header[2:] + payload[:5])
+    time.sleep(0.2)
+    stalled[0].sendall(payload[5:])
+    (length,) = struct.unpack(">I", recv_exact(stalled[0], 4))
+    out = recv_exact(stalled[0], length).decode()
+    check("alice" in out, "partial frame resumed")
+
+    # Several frames in one write are all answered
+    frames = b"".join(struct.pack(">I", len(p)) + p
+                      for p in (b".tables", b"SELECT * FROM t WHERE id = 2;"))
+    other.sendall(frames)
+    answers = []
+    for _ in range(2):
+        (length,) = struct.unpack(">I", recv_exact(other, 4))
+        answers.append(recv_exact(other, length).decode())
+    check("bob" in answers[1], "pipelined frames")
+
+    # Meta-commands that reach the server's files or stdin are refused
+    for line in (".read /etc/hostname", ".read -", ".import /etc/passwd t",
+                 ".trace /tmp/server-trace.json", ".stats reset"):
+        out = request(other, line)
+        check(out.startswith("Error:"), f"{line} refused")
+    check("t" in request(other, ".tables").split(), ".tables allowed")
+
+    # Each client has its own output mode
+    request(other, ".mode csv")
+    out = request(client, "SELECT * FROM t WHERE id = 1;")
+    check(out == "(1, alice)\n", "another client's .mode does not apply")
+    out = request(other, "SELECT * FROM t WHERE id = 1;")
+    check("1,alice" in out, ".mode applies to the client that set it")
+    request(other, ".mode plain")
+
+    # Filling the file is refused like any failed statement; the server lives
+    wide = ", ".join(f"c{i} TEXT" for i in range(15))
+    request(other, f"CREATE TABLE full (id INT, {wide});")
+    row = ", ".join("'x'" for _ in range(15))
+    out = ""
+    for i in range(1, 20000):
+        out = request(other, f"INSERT INTO full VALUES ({i}, {row});")
+        if out:
+            break
+    check(out == "Error: Table full.\n", "full table refuses the insert")
+    out = request(other, "SELECT * FROM t WHERE id = 1;")
+    check("alice" in out, "server up after the table filled")
+
+    check(request(other, ".exit") == "", ".exit answered")
+    check(other.recv(1) == b"", ".exit closes the connection")
+    for sock in stalled + [client]:
+        sock.close()
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(f"Usage: {sys.argv[0]} <db executable>")
+        return 1
+    db_exe = os.path.abspath(sys.argv[1])
+    with tempfile.TemporaryDirectory() as tmp:
+        sock_path = os.path.join(tmp, "db.sock")
+        server = subprocess.Popen(
+            [db_exe, os.path.join(tmp, "server.db"), "--serve", sock_path,
+             "--workers", "2"],
+            stdout=subprocess.PIPE, text=True)
+        try:
+            if "Listening" not in server.stdout.readline():
+                print("Server did not start.")
+                return 1
+            run_tests(sock_path)
+        except (AssertionError, OSError) as e:
+            print(f"FAIL: {e}")
+            return 1
+        finally:
+            server.terminate()
+            server.wait(timeout=TIMEOUT_S)
+    print("All server tests passed.")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
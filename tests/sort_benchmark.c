@@ -0,0 +1,124 @@
+/**
+ * sort_benchmark times ORDER BY on a column with no index three ways: a top-N
+ * query that keeps only its LIMIT rows in a heap, a full sort that fits in
+ * the memory budget, and the same full sort with a budget small enough to
+ * spill sorted runs to disk and merge them.
+ *
+ *   ./build/sort_benchmark [rows] [rounds]
+ */
+#include "database.h"
+#include "statement.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_FILE "sort_bench.db"
+
+static double now_s() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void prepare(Database *db, const char *sql, Statement *statement) {
+  char line[256];
+  snprintf(line, sizeof(line), "%s", sql);
+  *statement = (Statement){};
+  if (prepare_statement(line, statement, db) != PREPARE_SUCCESS) {
+    printf("Prepare failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * run executes a query with its output going to `out` and returns the id of
+ * the first row printed.
+ */
+static uint32_t run(Database *db, const char *sql, FILE *out) {
+  Statement statement;
+  prepare(db, sql, &statement);
+  rewind(out);
+  db->out = out;
+  if (execute_statement(&statement, db) != EXECUTE_SUCCESS) {
+    printf("Statement failed: %s\n", sql);
+    exit(EXIT_FAILURE);
+  }
+  db->out = stdout;
+  fflush(out);
+  rewind(out);
+  free_statement(&statement);
+  unsigned value = 0;
+  return fscanf(out, "(%u", &value) == 1 ? value : UINT32_MAX;
+}
+
+static double bench(Database *db, FILE *out, const char *sql, uint32_t rounds,
+                    uint32_t *first) {
+  double best = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    double start = now_s();
+    *first = run(db, sql, out);
+    double elapsed = now_s() - start;
+    if (best == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 30000;
+  uint32_t rounds = argc > 2 ? (uint32_t)atoi(argv[2]) : 5;
+  if (rows == 0 || rounds == 0) {
+    printf("Usage: %s [rows] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  remove(BENCH_FILE);
+  Database *db = db_open(BENCH_FILE);
+  FILE *out = tmpfile();
+  run(db, "CREATE TABLE events (id INT, kind INT, score INT, region TEXT)",
+      out);
+  Statement insert;
+  prepare(db, "INSERT INTO events VALUES (?, ?, ?, ?)", &insert);
+  uint32_t rng = 2463534242u;
+  for (uint32_t id = 0; id < rows; id++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    if (bind_parameter_int(&insert, db, 0, id) != PREPARE_SUCCESS ||
+        bind_parameter_int(&insert, db, 1, rng % 10) != PREPARE_SUCCESS ||
+        bind_parameter_int(&insert, db, 2, rng >> 4) != PREPARE_SUCCESS ||
+        bind_parameter_text(&insert, db, 3, "r") != PREPARE_SUCCESS ||
+        execute_statement(&insert, db) != EXECUTE_SUCCESS) {
+      printf("Insert failed at row %u\n", id);
+      return EXIT_FAILURE;
+    }
+  }
+  free_statement(&insert);
+
+  uint32_t top_first, full_first, spill_first;
+  double top = bench(db, out, "SELECT * FROM events ORDER BY score LIMIT 10",
+                     rounds, &top_first);
+  double full = bench(db, out, "SELECT * FROM events ORDER BY score", rounds,
+                      &full_first);
+  size_t budget = db->sort_memory;
+  // A quarter of the rows per run
+  db->sort_memory = (size_t)rows * 64 / 4;
+  double spill = bench(db, out, "SELECT * FROM events ORDER BY score", rounds,
+                       &spill_first);
+  db->sort_memory = budget;
+  if (top_first != full_first || spill_first != full_first) {
+    printf("Results disagree: %u, %u, %u\n", top_first, full_first,
+           spill_first);
+    return EXIT_FAILURE;
+  }
+
+  printf("ORDER BY score over %u rows (best of %u rounds):\n", rows, rounds);
+  printf("  Full sort in memory:  %9.3f ms\n", full * 1e3);
+  printf("  Full sort, 4 runs:    %9.3f ms\n", spill * 1e3);
+  printf("  Top 10 heap:          %9.3f ms (%.0fx)\n", top * 1e3, full / top);
+
+  fclose(out);
+  db_close(db);
+  remove(BENCH_FILE);
+  return 0;
+}
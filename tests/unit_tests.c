@@ -1,13 +1,31 @@
+#include "aggregate.h"
+#include "analyze.h"
+#include "batch.h"
 #include "btree.h"
 #include "common.h"
 #include "database.h"
+#include "import.h"
+#include "index.h"
+#include "join.h"
 #include "os_portability.h"
 #include "pager.h"
+#include "parallel.h"
+#include "plan_cache.h"
+#include "repl.h"
+#include "schema.h"
+#include "simpledb.h"
+#include "sink.h"
+#include "sort.h"
 #include "statement.h"
+#include "trace.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __linux__
+#include <signal.h>
+#include <sys/resource.h>
+#endif
 
 #define TEST_FILE "test.db"
 
@@ -173,6 +191,1884 @@ void test_btree_insert_lookup() {
   printf("Passed!\n");
 }
 
+void test_api_prepared_statements() {
+  printf("Running test_api_prepared_statements...\n");
+  sdb *db;
+  sdb_stmt *stmt;
+  int rc = sdb_open(TEST_FILE, &db);
+  assert(rc == SDB_OK);
+  rc = sdb_prepare(db, "CREATE TABLE users (id INT, name TEXT)", &stmt);
+  assert(rc == SDB_OK);
+  assert(sdb_step(stmt) == SDB_DONE);
+  sdb_finalize(stmt);
+
+  // One INSERT, re-executed with new bindings
+  rc = sdb_prepare(db, "INSERT INTO users VALUES (?, ?)", &stmt);
+  assert(rc == SDB_OK);
+  assert(sdb_step(stmt) == SDB_MISUSE); // Nothing bound yet
+  const char *names[] = {"Alice", "Bob", "Carol"};
+  for (uint32_t i = 0; i < 3; i++) {
+    assert(sdb_bind_int(stmt, 1, i + 1) == SDB_OK);
+    assert(sdb_bind_text(stmt, 2, names[i]) == SDB_OK);
+    assert(sdb_step(stmt) == SDB_DONE);
+  }
+  assert(sdb_step(stmt) == SDB_CONSTRAINT); // Same id again
+  assert(sdb_bind_int(stmt, 3, 0) == SDB_RANGE);
+  sdb_finalize(stmt);
+
+  rc = sdb_prepare(db, "SELECT * FROM users WHERE id = ?", &stmt);
+  assert(rc == SDB_OK);
+  assert(sdb_column_count(stmt) == 2);
+  assert(strcmp(sdb_column_name(stmt, 1), "name") == 0);
+  for (uint32_t i = 0; i < 3; i++) {
+    assert(sdb_bind_int(stmt, 1, i + 1) == SDB_OK);
+    assert(sdb_step(stmt) == SDB_ROW);
+    assert(sdb_column_int(stmt, 0) == i + 1);
+    assert(strcmp(sdb_column_text(stmt, 1), names[i]) == 0);
+    assert(sdb_step(stmt) == SDB_DONE);
+  }
+  sdb_finalize(stmt);
+
+  // Full scan returns rows in key order
+  rc = sdb_prepare(db, "SELECT * FROM users", &stmt);
+  assert(rc == SDB_OK);
+  uint32_t count = 0;
+  while (sdb_step(stmt) == SDB_ROW) {
+    assert(sdb_column_int(stmt, 0) == ++count);
+  }
+  assert(count == 3);
+  sdb_finalize(stmt);
+
+  rc = sdb_prepare(db, "SELECT * FROM missing", &stmt);
+  assert(rc == SDB_ERROR);
+  assert(stmt == nullptr);
+
+  sdb_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+void test_api_interleaved_statements() {
+  printf("Running test_api_interleaved_statements...\n");
+  remove(TEST_FILE);
+  sdb *db;
+  sdb_stmt *stmt;
+  assert(sdb_open(TEST_FILE, &db) == SDB_OK);
+  // b spans more pages than the buffer pool holds, so reading it evicts
+  constexpr uint32_t SMALL_ROWS = 300;
+  constexpr uint32_t LARGE_ROWS = 15000;
+  assert(sdb_prepare(db, "CREATE TABLE a (id INT, name TEXT)", &stmt) ==
+         SDB_OK);
+  assert(sdb_step(stmt) == SDB_DONE);
+  sdb_finalize(stmt);
+  assert(sdb_prepare(db, "CREATE TABLE b (id INT, name TEXT)", &stmt) ==
+         SDB_OK);
+  assert(sdb_step(stmt) == SDB_DONE);
+  sdb_finalize(stmt);
+  const char *inserts[] = {"INSERT INTO a VALUES (?, ?)",
+                           "INSERT INTO b VALUES (?, ?)"};
+  for (uint32_t t = 0; t < 2; t++) {
+    assert(sdb_prepare(db, inserts[t], &stmt) == SDB_OK);
+    for (uint32_t id = 1; id <= (t == 0 ? SMALL_ROWS : LARGE_ROWS); id++) {
+      char name[16];
+      snprintf(name, sizeof(name), "%c%u", 'a' + t, id);
+      assert(sdb_bind_int(stmt, 1, id) == SDB_OK);
+      assert(sdb_bind_text(stmt, 2, name) == SDB_OK);
+      assert(sdb_step(stmt) == SDB_DONE);
+    }
+    sdb_finalize(stmt);
+  }
+
+  // A row read in place outlives other statements run to completion
+  sdb_stmt *scan_a, *scan_b, *by_id;
+  assert(sdb_prepare(db, "SELECT * FROM a", &scan_a) == SDB_OK);
+  assert(sdb_prepare(db, "SELECT * FROM b", &scan_b) == SDB_OK);
+  assert(sdb_prepare(db, "SELECT * FROM b WHERE id = ?", &by_id) == SDB_OK);
+  assert(sdb_step(scan_a) == SDB_ROW);
+  const char *first = sdb_column_text(scan_a, 1);
+  assert(strcmp(first, "a1") == 0);
+  uint32_t rows = 0;
+  while (sdb_step(scan_b) == SDB_ROW)
+    rows++;
+  assert(rows == LARGE_ROWS);
+  assert(strcmp(first, "a1") == 0);
+
+  // Both scans step in turn, each from where it was
+  assert(sdb_reset(scan_b) == SDB_OK);
+  assert(sdb_bind_int(by_id, 1, 7) == SDB_OK);
+  assert(sdb_step(by_id) == SDB_ROW);
+  rows = 1;
+  while (sdb_step(scan_a) == SDB_ROW) {
+    char want[16];
+    snprintf(want, sizeof(want), "a%u", ++rows);
+    assert(strcmp(sdb_column_text(scan_a, 1), want) == 0);
+    assert(sdb_step(scan_b) == SDB_ROW);
+    assert(sdb_column_int(scan_b, 0) == rows - 1);
+    assert(strcmp(sdb_column_text(by_id, 1), "b7") == 0);
+  }
+  assert(rows == SMALL_ROWS);
+  sdb_finalize(scan_a);
+  sdb_finalize(scan_b);
+  sdb_finalize(by_id);
+  sdb_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+void test_api_open_error() {
+  printf("Running test_api_open_error...\n");
+  sdb *db;
+  assert(sdb_open("no-such-directory/test.db", &db) == SDB_ERROR);
+  assert(strstr(sdb_errmsg(db), "no-such-directory/test.db") != nullptr);
+  assert(sdb_close(db) == SDB_OK);
+  printf("Passed!\n");
+}
+
+void test_api_table_full() {
+  printf("Running test_api_table_full...\n");
+  remove(TEST_FILE);
+  sdb *db;
+  sdb_stmt *stmt;
+  assert(sdb_open(TEST_FILE, &db) == SDB_OK);
+  // Wide rows fill the file's pages in a few thousand inserts
+  char sql[512] = "CREATE TABLE w (id INT";
+  for (uint32_t i = 0; i < MAX_FIELDS - 1; i++)
+    snprintf(sql + strlen(sql), sizeof(sql) - strlen(sql), ", c%u TEXT", i);
+  strcat(sql, ")");
+  assert(sdb_prepare(db, sql, &stmt) == SDB_OK);
+  assert(sdb_step(stmt) == SDB_DONE);
+  sdb_finalize(stmt);
+  strcpy(sql, "INSERT INTO w VALUES (?");
+  for (uint32_t i = 0; i < MAX_FIELDS - 1; i++)
+    strcat(sql, ", 'x'");
+  strcat(sql, ")");
+  assert(sdb_prepare(db, sql, &stmt) == SDB_OK);
+  int rc = SDB_DONE;
+  uint32_t id = 0;
+  while (rc == SDB_DONE && id < 100000) {
+    assert(sdb_bind_int(stmt, 1, ++id) == SDB_OK);
+    rc = sdb_step(stmt);
+  }
+  assert(rc == SDB_ERROR);
+  assert(strcmp(sdb_errmsg(db), "Table full.") == 0);
+  sdb_finalize(stmt);
+
+  // The rows before the full one are all there
+  assert(sdb_prepare(db, "SELECT * FROM w", &stmt) == SDB_OK);
+  uint32_t rows = 0;
+  while (sdb_step(stmt) == SDB_ROW)
+    rows++;
+  assert(rows == id - 1);
+  sdb_finalize(stmt);
+  sdb_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+static PrepareResult cached_prepare(Database *db, const char *sql,
+                                    Statement *statement) {
+  char line[256];
+  strcpy(line, sql);
+  *statement = (Statement){};
+  return plan_cache_prepare(db, line, statement);
+}
+
+void test_plan_cache() {
+  printf("Running test_plan_cache...\n");
+  Database *db = db_open(TEST_FILE);
+  PlanCache *cache = db->plan_cache;
+  Statement s;
+
+  assert(cached_prepare(db, "CREATE TABLE users (id INT, name TEXT)", &s) ==
+         PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  assert(cache->stats.uncacheable == 1);
+
+  // First of a shape is a miss, later ones bind their own literals
+  assert(cached_prepare(db, "INSERT INTO users VALUES (1, 'Alice')", &s) ==
+         PREPARE_SUCCESS);
+  assert(cache->stats.misses == 1 && cache->stats.hits == 0);
+  assert(s.insert_values[0] == 1 && strcmp(s.insert_strings[1], "Alice") == 0);
+  free_statement(&s);
+  assert(cached_prepare(db, "INSERT INTO users VALUES (2, 'Bob')", &s) ==
+         PREPARE_SUCCESS);
+  assert(cache->stats.hits == 1);
+  assert(s.num_params == 0);
+  assert(s.insert_values[0] == 2 && strcmp(s.insert_strings[1], "Bob") == 0);
+  free_statement(&s);
+
+  // Literal-dependent errors are still reported on a hit
+  assert(cached_prepare(db,
+                        "INSERT INTO users VALUES (3, "
+                        "'This name is far too long for its column')",
+                        &s) == PREPARE_STRING_TOO_LONG);
+  assert(cache->stats.hits == 2);
+
+  // A different shape (here: whitespace) is a separate plan
+  assert(cached_prepare(db, "SELECT * FROM users WHERE id = 7", &s) ==
+         PREPARE_SUCCESS);
+  assert(cached_prepare(db, "SELECT * FROM users WHERE id =  8", &s) ==
+         PREPARE_SUCCESS);
+  assert(s.predicate.num_terms == 1 && s.predicate.terms[0].value == 8);
+  assert(cache->stats.misses == 3);
+
+  // '?' typed into the line is left to the caller, never cached
+  assert(cached_prepare(db, "SELECT * FROM users WHERE id = ?", &s) ==
+         PREPARE_SUCCESS);
+  assert(s.num_params == 1);
+  assert(cache->stats.uncacheable == 2);
+
+  // Creating a table invalidates every plan
+  assert(cached_prepare(db, "CREATE TABLE tags (name TEXT)", &s) ==
+         PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  assert(cached_prepare(db, "SELECT * FROM users WHERE id = 9", &s) ==
+         PREPARE_SUCCESS);
+  assert(cache->stats.misses == 4);
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+/**
+ * check_batch_scan runs a SELECT both as a batch scan and row by row through
+ * select_next(), which must return the same rows in the same order.
+ */
+static uint32_t check_batch_scan(Database *db, const char *sql) {
+  Statement s;
+  assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+  uint32_t expected[4096];
+  uint32_t num_expected = 0;
+  Cursor *c = select_open(&s, db);
+  void *row;
+  while ((row = select_next(&s, db, c)) != nullptr) {
+    assert(num_expected < 4096);
+    memcpy(&expected[num_expected++], row, sizeof(uint32_t));
+  }
+  free(c);
+  unpin_page_all(db->pager);
+
+  // Column 1 is decoded even when the WHERE clause does not read it
+  BatchScan *scan = batch_scan_open(&s, db, select_open(&s, db), 1u << 1);
+  RowBatch *batch;
+  uint32_t n = 0;
+  while ((batch = batch_scan_next(scan)) != nullptr) {
+    assert(batch->count <= BATCH_SIZE && batch->columns[1] != nullptr);
+    for (uint32_t i = 0; i < batch->num_selected; i++) {
+      uint32_t r = batch->sel[i];
+      assert(n < num_expected && batch->keys[r] == expected[n++]);
+      assert(batch->columns[1][r] == batch->keys[r] % 7);
+    }
+  }
+  batch_scan_close(scan);
+  assert(n == num_expected);
+  free_statement(&s);
+  return n;
+}
+
+void test_batch_scan() {
+  printf("Running test_batch_scan...\n");
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  assert(cached_prepare(db, "CREATE TABLE t (id INT, grp INT, name TEXT)",
+                        &s) == PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  // Several batches' worth of rows, inserted out of key order
+  for (uint32_t i = 0; i < 3000; i++) {
+    uint32_t id = i * 7 % 3000;
+    char sql[96];
+    snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%u, %u, 'n%u')", id,
+             id % 7, id % 100);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+
+  assert(check_batch_scan(db, "SELECT * FROM t") == 3000);
+  assert(check_batch_scan(db, "SELECT * FROM t WHERE grp = 3") == 429);
+  assert(check_batch_scan(db, "SELECT * FROM t WHERE grp < 2 OR id >= 2990 "
+                              "AND name <> 'n95'") == 858 + 6);
+  assert(check_batch_scan(db, "SELECT * FROM t WHERE name = 'n42'") == 30);
+  // Key bounds start and stop the walk
+  assert(check_batch_scan(db, "SELECT * FROM t WHERE id = 1234") == 1);
+  assert(check_batch_scan(db, "SELECT * FROM t WHERE id > 1000 AND "
+                              "id <= 2500") == 1500);
+  assert(check_batch_scan(db, "SELECT * FROM t WHERE id < 0") == 0);
+  assert(check_batch_scan(db, "SELECT * FROM t WHERE id >= 2999") == 1);
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+static uint32_t count_rows(sdb_stmt *stmt, uint32_t value) {
+  assert(sdb_bind_int(stmt, 1, value) == SDB_OK);
+  uint32_t count = 0;
+  while (sdb_step(stmt) == SDB_ROW) {
+    assert(sdb_column_int(stmt, 1) == value);
+    count++;
+  }
+  return count;
+}
+
+static void exec_sql(sdb *db, const char *sql) {
+  sdb_stmt *stmt;
+  assert(sdb_prepare(db, sql, &stmt) == SDB_OK);
+  assert(sdb_step(stmt) == SDB_DONE);
+  sdb_finalize(stmt);
+}
+
+void test_secondary_index() {
+  printf("Running test_secondary_index...\n");
+  sdb *db;
+  sdb_stmt *stmt;
+  assert(sdb_open(TEST_FILE, &db) == SDB_OK);
+  exec_sql(db, "CREATE TABLE t (id INT, grp INT, name TEXT)");
+
+  // Few distinct values, so equal keys span several index leaves
+  assert(sdb_prepare(db, "INSERT INTO t VALUES (?, ?, ?)", &stmt) == SDB_OK);
+  for (uint32_t id = 0; id < 3000; id++) {
+    assert(sdb_bind_int(stmt, 1, id) == SDB_OK);
+    assert(sdb_bind_int(stmt, 2, id % 3) == SDB_OK);
+    assert(sdb_bind_text(stmt, 3, id % 2 ? "odd" : "even") == SDB_OK);
+    assert(sdb_step(stmt) == SDB_DONE);
+    if (id == 1499)
+      exec_sql(db, "CREATE INDEX t_grp ON t(grp)"); // Built, then maintained
+  }
+  sdb_finalize(stmt);
+  exec_sql(db, "CREATE INDEX t_name ON t(name)");
+  assert(sdb_prepare(db, "CREATE INDEX t_grp ON t(id)", &stmt) == SDB_ERROR);
+
+  assert(sdb_prepare(db, "SELECT * FROM t WHERE grp = ?", &stmt) == SDB_OK);
+  assert(count_rows(stmt, 0) == 1000);
+  assert(count_rows(stmt, 2) == 1000);
+  assert(count_rows(stmt, 3) == 0);
+
+  exec_sql(db, "DELETE FROM t WHERE id = 0");
+  exec_sql(db, "UPDATE t SET grp = 2 WHERE id = 3");
+  assert(count_rows(stmt, 0) == 998);
+  assert(count_rows(stmt, 2) == 1001);
+  sdb_finalize(stmt);
+
+  assert(sdb_prepare(db, "SELECT * FROM t WHERE name = ?", &stmt) == SDB_OK);
+  assert(sdb_bind_text(stmt, 1, "odd") == SDB_OK);
+  uint32_t odd = 0;
+  while (sdb_step(stmt) == SDB_ROW) {
+    assert(sdb_column_int(stmt, 0) % 2 == 1);
+    odd++;
+  }
+  assert(odd == 1500);
+  sdb_finalize(stmt);
+  sdb_close(db);
+
+  // Indexes persist in the catalog and match the table
+  Database *reopened = db_open(TEST_FILE);
+  assert(reopened->catalog.num_indexes == 2);
+  assert(find_column_index(reopened, 0, 1) == 0);
+  assert(find_column_index(reopened, 0, 0) == -1);
+  assert(verify_indexes(reopened, 0));
+  db_close(reopened);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+void test_predicates() {
+  printf("Running test_predicates...\n");
+  sdb *db;
+  sdb_stmt *stmt;
+  assert(sdb_open(TEST_FILE, &db) == SDB_OK);
+  exec_sql(db, "CREATE TABLE t (id INT, grp INT, name TEXT)");
+  assert(sdb_prepare(db, "INSERT INTO t VALUES (?, ?, ?)", &stmt) == SDB_OK);
+  for (uint32_t id = 0; id < 100; id++) {
+    char name[8];
+    snprintf(name, sizeof(name), "n%02u", id);
+    assert(sdb_bind_int(stmt, 1, id) == SDB_OK);
+    assert(sdb_bind_int(stmt, 2, id % 10) == SDB_OK);
+    assert(sdb_bind_text(stmt, 3, name) == SDB_OK);
+    assert(sdb_step(stmt) == SDB_DONE);
+  }
+  sdb_finalize(stmt);
+
+  // AND binds tighter than OR; every term may be a parameter
+  assert(sdb_prepare(db,
+                     "SELECT * FROM t WHERE grp = ? AND id >= ? OR name < ?",
+                     &stmt) == SDB_OK);
+  assert(sdb_bind_int(stmt, 1, 3) == SDB_OK);
+  assert(sdb_bind_int(stmt, 2, 50) == SDB_OK);
+  assert(sdb_bind_text(stmt, 3, "n02") == SDB_OK);
+  uint32_t count = 0;
+  while (sdb_step(stmt) == SDB_ROW) {
+    uint32_t id = sdb_column_int(stmt, 0);
+    assert((id % 10 == 3 && id >= 50) || id < 2);
+    count++;
+  }
+  assert(count == 5 + 2);
+
+  // Rebinding reuses the compiled predicate
+  assert(sdb_bind_text(stmt, 3, "n00") == SDB_OK);
+  count = 0;
+  while (sdb_step(stmt) == SDB_ROW)
+    count++;
+  assert(count == 5);
+  sdb_finalize(stmt);
+
+  assert(sdb_prepare(db, "SELECT * FROM t WHERE grp<=1 AND name<>'n00'",
+                     &stmt) == SDB_OK);
+  count = 0;
+  while (sdb_step(stmt) == SDB_ROW)
+    count++;
+  assert(count == 19);
+  sdb_finalize(stmt);
+
+  assert(sdb_prepare(db, "SELECT * FROM t WHERE missing = 1", &stmt) ==
+         SDB_ERROR);
+  assert(strcmp(sdb_errmsg(db), "Column not found.") == 0);
+
+  sdb_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+void test_aggregates() {
+  printf("Running test_aggregates...\n");
+  sdb *db;
+  sdb_stmt *stmt;
+  assert(sdb_open(TEST_FILE, &db) == SDB_OK);
+  exec_sql(db, "CREATE TABLE t (id INT, grp INT, name TEXT)");
+  assert(sdb_prepare(db, "INSERT INTO t VALUES (?, ?, ?)", &stmt) == SDB_OK);
+  for (uint32_t id = 1; id <= 3000; id++) {
+    char name[8];
+    snprintf(name, sizeof(name), "n%u", id % 100);
+    assert(sdb_bind_int(stmt, 1, id) == SDB_OK);
+    assert(sdb_bind_int(stmt, 2, id % 7) == SDB_OK);
+    assert(sdb_bind_text(stmt, 3, name) == SDB_OK);
+    assert(sdb_step(stmt) == SDB_DONE);
+  }
+  sdb_finalize(stmt);
+
+  assert(sdb_prepare(db,
+                     "SELECT grp, COUNT(*), SUM(id), MIN(id), MAX(id) "
+                     "FROM t WHERE id <= ? GROUP BY grp",
+                     &stmt) == SDB_OK);
+  assert(sdb_column_count(stmt) == 5);
+  assert(strcmp(sdb_column_name(stmt, 1), "COUNT(*)") == 0);
+  assert(strcmp(sdb_column_name(stmt, 2), "SUM(id)") == 0);
+  assert(sdb_bind_int(stmt, 1, 2100) == SDB_OK);
+  // Groups come out in the order they are first seen: 1, 2, ..., 6, 0
+  for (uint32_t g = 1; g <= 7; g++) {
+    assert(sdb_step(stmt) == SDB_ROW);
+    uint32_t grp = g % 7;
+    uint32_t first = grp == 0 ? 7 : grp;
+    uint32_t last = 2100 - 7 + first;
+    assert(sdb_column_int(stmt, 0) == grp);
+    assert(sdb_column_int(stmt, 1) == 300);
+    assert(sdb_column_int(stmt, 2) == 300 * (first + last) / 2);
+    assert(sdb_column_int(stmt, 3) == first);
+    assert(sdb_column_int(stmt, 4) == last);
+  }
+  assert(sdb_step(stmt) == SDB_DONE);
+  sdb_finalize(stmt);
+
+  // TEXT groups are hashed but compared by value
+  assert(sdb_prepare(db, "SELECT name, COUNT(*) FROM t GROUP BY name",
+                     &stmt) == SDB_OK);
+  uint32_t groups = 0;
+  while (sdb_step(stmt) == SDB_ROW) {
+    assert(sdb_column_int(stmt, 1) == 30);
+    groups++;
+  }
+  assert(groups == 100);
+  sdb_finalize(stmt);
+
+  // MIN/MAX of the key still hold once deletes empty the first leaf
+  assert(sdb_prepare(db, "DELETE FROM t WHERE id = ?", &stmt) == SDB_OK);
+  for (uint32_t id = 1; id <= 200; id++) {
+    assert(sdb_bind_int(stmt, 1, id) == SDB_OK);
+    assert(sdb_step(stmt) == SDB_DONE);
+  }
+  sdb_finalize(stmt);
+  assert(sdb_prepare(db, "SELECT MIN(id), MAX(id), COUNT(*) FROM t", &stmt) ==
+         SDB_OK);
+  assert(sdb_step(stmt) == SDB_ROW);
+  assert(sdb_column_int(stmt, 0) == 201 && sdb_column_int(stmt, 1) == 3000);
+  assert(sdb_column_int(stmt, 2) == 2800);
+  assert(sdb_step(stmt) == SDB_DONE);
+  sdb_finalize(stmt);
+
+  assert(sdb_prepare(db, "SELECT MIN(id), MAX(id) FROM t", &stmt) == SDB_OK);
+  assert(sdb_step(stmt) == SDB_ROW);
+  assert(sdb_column_int(stmt, 0) == 201 && sdb_column_int(stmt, 1) == 3000);
+  sdb_finalize(stmt);
+
+  assert(sdb_prepare(db, "SELECT grp, name FROM t GROUP BY grp", &stmt) ==
+         SDB_ERROR);
+  assert(strcmp(sdb_errmsg(db), "Column must be aggregated or in GROUP BY.") ==
+         0);
+
+  sdb_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+/** first_key returns the first key a SELECT returns, UINT32_MAX for none. */
+static uint32_t first_key(Database *db, const char *sql) {
+  Statement s;
+  assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+  Cursor *c = select_open(&s, db);
+  void *row = select_next(&s, db, c);
+  uint32_t key = UINT32_MAX;
+  if (row != nullptr)
+    memcpy(&key, row, sizeof(key));
+  free(c);
+  unpin_page_all(db->pager);
+  free_statement(&s);
+  return key;
+}
+
+void test_row_counts() {
+  printf("Running test_row_counts...\n");
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  // Wide rows keep leaves small, so internal nodes split too
+  assert(cached_prepare(db,
+                        "CREATE TABLE t (id INT, a TEXT, b TEXT, c TEXT, "
+                        "d TEXT, e TEXT, f TEXT, g TEXT)",
+                        &s) == PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  constexpr uint32_t N = 6000;
+  for (uint32_t i = 0; i < N; i++) {
+    char sql[128];
+    snprintf(sql, sizeof(sql),
+             "INSERT INTO t VALUES (%u, 'a', 'b', 'c', 'd', 'e', 'f', 'g')",
+             i * 7919 % N + 1);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+  void *root = get_page(db->pager, tree_root_page(db, 0));
+  assert(get_node_type(get_page(db->pager, *internal_node_child(root, 0))) ==
+         NODE_INTERNAL);
+  unpin_page_all(db->pager);
+  assert(verify_btree(db, 0));
+  assert(btree_row_count(db, 0) == N);
+  for (uint32_t key = 1; key <= N + 1; key += 97)
+    assert(btree_rank(db, 0, key) == key - 1);
+
+  // Every third row goes; ids left below k number (k - 1) - (k - 1) / 3
+  for (uint32_t id = 3; id <= N; id += 3) {
+    char sql[64];
+    snprintf(sql, sizeof(sql), "DELETE FROM t WHERE id = %u", id);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+  assert(verify_btree(db, 0));
+  assert(btree_row_count(db, 0) == N - N / 3);
+  for (uint32_t key = 1; key <= N + 1; key += 89)
+    assert(btree_rank(db, 0, key) == (key - 1) - (key - 1) / 3);
+  assert(btree_range_count(db, 0, 100, 199) == 67);
+  assert(btree_range_count(db, 0, 7, 6) == 0);
+  Schema *schema = tree_schema(db, 0);
+  for (uint32_t rank = 0; rank < N - N / 3; rank += 101) {
+    Cursor *c = find_node_by_rank(db, 0, rank);
+    uint32_t key =
+        *leaf_node_key(get_page(db->pager, c->page_num), c->cell_num, schema);
+    assert(btree_rank(db, 0, key) == rank);
+    free(c);
+    unpin_page_all(db->pager);
+  }
+
+  // A broken leaf link is reported on the database's output
+  Cursor *mid = find_node_by_rank(db, 0, 1000);
+  uint32_t *prev = leaf_node_prev_leaf(get_page(db->pager, mid->page_num));
+  uint32_t saved = *prev;
+  *prev = saved + 1;
+  FILE *report = tmpfile();
+  db->out = report;
+  assert(!verify_btree(db, 0));
+  db->out = stdout;
+  // The check may have evicted the page; fetch it again to repair it
+  prev = leaf_node_prev_leaf(get_page(db->pager, mid->page_num));
+  *prev = saved;
+  mark_page_dirty(db->pager, mid->page_num);
+  rewind(report);
+  char message[128];
+  assert(fgets(message, sizeof(message), report) != nullptr);
+  assert(strncmp(message, "Verify error: leaf ", 19) == 0);
+  fclose(report);
+  free(mid);
+  unpin_page_all(db->pager);
+  assert(verify_btree(db, 0));
+
+  // OFFSET seeks by rank on key ranges and steps through other filters
+  assert(first_key(db, "SELECT * FROM t LIMIT 5 OFFSET 0") == 1);
+  assert(first_key(db, "SELECT * FROM t LIMIT 5 OFFSET 3000") == 4501);
+  assert(first_key(db, "SELECT * FROM t WHERE id > 100 LIMIT 1 OFFSET 1") ==
+         103);
+  assert(first_key(db, "SELECT * FROM t WHERE id >= 100 AND a = 'a' "
+                       "LIMIT 1 OFFSET 2") == 103);
+  assert(first_key(db, "SELECT * FROM t LIMIT 1 OFFSET 4000") ==
+         UINT32_MAX);
+  assert(first_key(db, "SELECT * FROM t WHERE id < 50 LIMIT 1 OFFSET 40") ==
+         UINT32_MAX);
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+void test_internal_split_flushed() {
+  printf("Running test_internal_split_flushed...\n");
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  assert(cached_prepare(db, "CREATE TABLE t (id INT, name TEXT, score INT)",
+                        &s) == PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  // Enough scattered rows that the root splits with far more pages than the
+  // pool holds, so both halves are evicted before the insert finishes
+  constexpr uint32_t SPLIT_ROWS = 30000;
+  uint32_t *ids = malloc(SPLIT_ROWS * sizeof(uint32_t));
+  for (uint32_t i = 0; i < SPLIT_ROWS; i++)
+    ids[i] = i + 1;
+  uint32_t seed = 12345;
+  for (uint32_t i = SPLIT_ROWS - 1; i > 0; i--) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t j = (seed >> 8) % (i + 1);
+    uint32_t t = ids[i];
+    ids[i] = ids[j];
+    ids[j] = t;
+  }
+  for (uint32_t i = 0; i < SPLIT_ROWS; i++) {
+    char sql[96];
+    uint32_t id = ids[i];
+    snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%u, 'user %u', %u)", id,
+             id, id % 1000);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+  free(ids);
+  void *root = get_page(db->pager, tree_root_page(db, 0));
+  assert(get_node_type(get_page(db->pager, *internal_node_child(root, 0))) ==
+         NODE_INTERNAL);
+  unpin_page_all(db->pager);
+  assert(verify_btree(db, 0));
+  assert(btree_row_count(db, 0) == SPLIT_ROWS);
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+/**
+ * sorted_ids runs an ORDER BY through select_sorted() and collects the ids of
+ * the rows in the order they come out. Returns the number of spilled runs.
+ */
+static uint32_t sorted_ids(Database *db, const char *sql, uint32_t *ids,
+                           uint32_t *n) {
+  Statement s;
+  assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+  Cursor *c = select_open(&s, db);
+  assert(select_needs_sort(&s, c));
+  Sorter *sorter = select_sorted(&s, db, c);
+  uint32_t runs = sorter_runs(sorter);
+  const void *row;
+  *n = 0;
+  while ((row = sorter_next(sorter)) != nullptr)
+    memcpy(&ids[(*n)++], row, sizeof(uint32_t));
+  // A rewound sorter hands out the same rows again
+  sorter_rewind(sorter);
+  for (uint32_t i = 0; i < *n; i++) {
+    row = sorter_next(sorter);
+    assert(row != nullptr && memcmp(row, &ids[i], sizeof(uint32_t)) == 0);
+  }
+  assert(sorter_next(sorter) == nullptr);
+  sorter_close(sorter);
+  free_statement(&s);
+  return runs;
+}
+
+void test_order_by() {
+  printf("Running test_order_by...\n");
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  assert(cached_prepare(db, "CREATE TABLE t (id INT, grp INT, name TEXT)",
+                        &s) == PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  constexpr uint32_t ROWS = 3000;
+  for (uint32_t i = 0; i < ROWS; i++) {
+    uint32_t id = i * 7 % ROWS;
+    char sql[96];
+    snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%u, %u, 'n%u')", id,
+             id % 7, id % 100);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+
+  // A 4 KB budget holds under a hundred rows, so the full sort spills
+  db->sort_memory = 4096;
+  static uint32_t ids[ROWS];
+  uint32_t n;
+  assert(sorted_ids(db, "SELECT * FROM t ORDER BY grp DESC", ids, &n) > 1);
+  assert(n == ROWS);
+  // Groups descend; equal groups keep primary key order
+  for (uint32_t i = 1; i < n; i++) {
+    uint32_t a = ids[i - 1] % 7, b = ids[i] % 7;
+    assert(a > b || (a == b && ids[i - 1] < ids[i]));
+  }
+
+  // Top-N keeps only offset + limit rows and never spills
+  static uint32_t top[ROWS];
+  uint32_t num_top;
+  assert(sorted_ids(db, "SELECT * FROM t ORDER BY grp DESC LIMIT 10 OFFSET 5",
+                    top, &num_top) == 0);
+  assert(num_top == 10 && memcmp(top, ids + 5, sizeof(uint32_t[10])) == 0);
+
+  // TEXT columns sort by value; the filter runs before the sort
+  assert(sorted_ids(db, "SELECT * FROM t WHERE id < 1500 ORDER BY name",
+                    ids, &n) > 1);
+  assert(n == 1500);
+  for (uint32_t i = 1; i < n; i++) {
+    char a[8], b[8];
+    snprintf(a, sizeof(a), "n%u", ids[i - 1] % 100);
+    snprintf(b, sizeof(b), "n%u", ids[i] % 100);
+    assert(strcmp(a, b) < 0 || (strcmp(a, b) == 0 && ids[i - 1] < ids[i]));
+  }
+
+#ifdef __linux__
+  // A run that cannot be written fails the statement rather than dropping
+  // rows; a file size limit of 0 makes every write to the run file fail
+  struct rlimit limit;
+  getrlimit(RLIMIT_FSIZE, &limit);
+  signal(SIGXFSZ, SIG_IGN);
+  setrlimit(RLIMIT_FSIZE, &(struct rlimit){0, limit.rlim_max});
+  assert(cached_prepare(db, "SELECT * FROM t ORDER BY grp", &s) ==
+         PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_IO_ERROR);
+  free_statement(&s);
+  setrlimit(RLIMIT_FSIZE, &limit);
+  signal(SIGXFSZ, SIG_DFL);
+#endif
+
+  // Ascending primary key order and an index on the column need no sort
+  assert(cached_prepare(db, "SELECT * FROM t ORDER BY id LIMIT 3", &s) ==
+         PREPARE_SUCCESS);
+  Cursor *c = select_open(&s, db);
+  assert(!select_needs_sort(&s, c));
+  free(c);
+  free_statement(&s);
+  assert(cached_prepare(db, "CREATE INDEX t_grp ON t (grp)", &s) ==
+         PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  assert(cached_prepare(db, "SELECT * FROM t ORDER BY grp LIMIT 3", &s) ==
+         PREPARE_SUCCESS);
+  c = select_open(&s, db);
+  assert(c->table_index >= INDEX_TREE_BASE && !select_needs_sort(&s, c));
+  free(c);
+  unpin_page_all(db->pager);
+  free_statement(&s);
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+/**
+ * fetches_for runs a statement with its output going to `out` and returns the
+ * number of pages it fetched.
+ */
+static uint64_t fetches_for(Database *db, const char *sql, FILE *out) {
+  Statement s;
+  assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+  uint64_t before = db->pager->fetches;
+  db->out = out;
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  db->out = stdout;
+  free_statement(&s);
+  return db->pager->fetches - before;
+}
+
+void test_limit_stops_scan() {
+  printf("Running test_limit_stops_scan...\n");
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  assert(cached_prepare(db, "CREATE TABLE t (id INT, v INT, name TEXT)",
+                        &s) == PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  constexpr uint32_t NUM_ROWS = 5000;
+  for (uint32_t id = 0; id < NUM_ROWS; id++) {
+    char sql[96];
+    snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%u, %u, 'n%u')", id,
+             id % 10, id);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+
+  // The whole table spans dozens of leaves; a LIMIT reads one or two
+  FILE *out = tmpfile();
+  uint64_t all = fetches_for(db, "SELECT * FROM t", out);
+  assert(all > 40);
+  assert(fetches_for(db, "SELECT * FROM t LIMIT 10", out) <= 4);
+  // A filter keeps some rows out, so a few growing batches are read
+  assert(fetches_for(db, "SELECT * FROM t WHERE v = 7 LIMIT 10", out) <= 16);
+  assert(fetches_for(db, "SELECT * FROM t WHERE id > 2500 LIMIT 10", out) <= 4);
+  rewind(out);
+  fetches_for(db, "SELECT * FROM t WHERE v = 9 LIMIT 3", out);
+  fflush(out);
+  rewind(out);
+  char line[256];
+  for (uint32_t id = 9; id < 30; id += 10)
+    assert(fgets(line, sizeof(line), out) != nullptr &&
+           atoi(line + 1) == (int)id);
+
+  // Box mode reads the rows once, buffering enough to size the columns
+  db->print_mode = PRINT_BOX;
+  out = freopen(nullptr, "w+", out);
+  assert(fetches_for(db, "SELECT * FROM t", out) == all);
+  fflush(out);
+  rewind(out);
+  uint32_t lines = 0;
+  while (fgets(line, sizeof(line), out) != nullptr) {
+    // Past BOX_BUFFER_ROWS rows, columns are as wide as their values can be
+    if (lines == 3)
+      assert(strncmp(line, "│ 0          │ 0          │ n0 ", 37) == 0);
+    lines++;
+  }
+  assert(lines == NUM_ROWS + 4);
+  // A short result is measured exactly
+  out = freopen(nullptr, "w+", out);
+  fetches_for(db, "SELECT * FROM t LIMIT 2", out);
+  fflush(out);
+  rewind(out);
+  assert(fgets(line, sizeof(line), out) && fgets(line, sizeof(line), out));
+  assert(strcmp(line, "│ id │ v │ name │\n") == 0);
+  fclose(out);
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+/**
+ * query_ids runs a SELECT and collects the first column of each row it
+ * prints. Returns the number of pages it fetched.
+ */
+static uint64_t query_ids(Database *db, const char *sql, uint32_t *ids,
+                          uint32_t *n) {
+  FILE *out = tmpfile();
+  uint64_t fetches = fetches_for(db, sql, out);
+  rewind(out);
+  unsigned id;
+  char line[256];
+  *n = 0;
+  while (fgets(line, sizeof(line), out) != nullptr)
+    if (sscanf(line, "(%u", &id) == 1)
+      ids[(*n)++] = id;
+  fclose(out);
+  return fetches;
+}
+
+void test_reverse_scan() {
+  printf("Running test_reverse_scan...\n");
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  assert(cached_prepare(db, "CREATE TABLE t (id INT, v INT, name TEXT)",
+                        &s) == PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  // Scattered inserts split leaves in the middle of the chain
+  constexpr uint32_t KEYS = 5000;
+  for (uint32_t i = 0; i < KEYS; i++) {
+    char sql[96];
+    uint32_t id = i * 2837 % KEYS + 1;
+    snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%u, %u, 'n%u')", id,
+             id % 10, id);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+  // Empty a stretch of leaves; a backward walk steps over them
+  for (uint32_t id = 2001; id <= 2400; id++) {
+    char sql[64];
+    snprintf(sql, sizeof(sql), "DELETE FROM t WHERE id = %u", id);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+  assert(verify_btree(db, 0));
+
+  // The latest rows come from the last leaf alone: one fetch per row
+  // returned after the descent
+  static uint32_t ids[KEYS], expected[KEYS];
+  uint32_t n, num_expected;
+  assert(query_ids(db, "SELECT * FROM t ORDER BY id DESC LIMIT 10", ids,
+                   &n) <= 14);
+  assert(n == 10 && ids[0] == KEYS && ids[9] == KEYS - 9);
+  assert(query_ids(db, "SELECT * FROM t ORDER BY id DESC LIMIT 2 OFFSET 100",
+                   ids, &n) <= 6);
+  assert(n == 2 && ids[0] == KEYS - 100 && ids[1] == KEYS - 101);
+  assert(query_ids(db, "SELECT * FROM t WHERE id < 2410 ORDER BY id DESC "
+                       "LIMIT 12",
+                   ids, &n) <= 32);
+  assert(n == 12 && ids[8] == 2401 && ids[9] == 2000 && ids[11] == 1998);
+
+  // Every bound walked backward gives the forward rows reversed
+  static const char *ops[] = {"<", "<=", ">", ">=", "="};
+  static const uint32_t bounds[] = {0, 1, 700, 2000, 2001, 2200, 2401, KEYS,
+                                    KEYS + 1};
+  for (uint32_t o = 0; o < 5; o++) {
+    for (uint32_t b = 0; b < sizeof(bounds) / sizeof(bounds[0]); b++) {
+      char sql[96];
+      snprintf(sql, sizeof(sql), "SELECT * FROM t WHERE id %s %u", ops[o],
+               bounds[b]);
+      query_ids(db, sql, expected, &num_expected);
+      snprintf(sql, sizeof(sql),
+               "SELECT * FROM t WHERE id %s %u ORDER BY id DESC", ops[o],
+               bounds[b]);
+      query_ids(db, sql, ids, &n);
+      assert(n == num_expected);
+      for (uint32_t i = 0; i < n; i++)
+        assert(ids[i] == expected[n - 1 - i]);
+    }
+  }
+
+  // An index on the column is walked backward too, with no sort
+  assert(cached_prepare(db, "CREATE INDEX t_v ON t (v)", &s) ==
+         PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  assert(cached_prepare(db, "SELECT * FROM t ORDER BY v DESC LIMIT 5", &s) ==
+         PREPARE_SUCCESS);
+  Cursor *c = select_open(&s, db);
+  assert(c->table_index >= INDEX_TREE_BASE && !select_needs_sort(&s, c));
+  free(c);
+  unpin_page_all(db->pager);
+  free_statement(&s);
+  query_ids(db, "SELECT * FROM t ORDER BY v DESC LIMIT 5", ids, &n);
+  assert(n == 5);
+  for (uint32_t i = 0; i < n; i++)
+    assert(ids[i] % 10 == 9);
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+void test_key_ranges() {
+  printf("Running test_key_ranges...\n");
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  assert(cached_prepare(db, "CREATE TABLE t (id INT, v INT, name TEXT)",
+                        &s) == PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  constexpr uint32_t RANGE_KEYS = 3000;
+  for (uint32_t id = 1; id <= RANGE_KEYS; id++) {
+    char sql[96];
+    snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%u, %u, 'n%u')", id,
+             id % 5, id);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+  assert(cached_prepare(db, "CREATE INDEX t_v ON t (v)", &s) ==
+         PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+
+  // Both ends bound the walk: a few leaves, not the rest of the table
+  static uint32_t ids[RANGE_KEYS];
+  uint32_t n;
+  assert(query_ids(db, "SELECT * FROM t WHERE id BETWEEN 1000 AND 1009", ids,
+                   &n) <= 16);
+  assert(n == 10 && ids[0] == 1000 && ids[9] == 1009);
+  assert(query_ids(db, "SELECT * FROM t WHERE id > 999 AND id < 1010", ids,
+                   &n) <= 16);
+  assert(n == 10 && ids[0] == 1000 && ids[9] == 1009);
+  assert(query_ids(db, "SELECT * FROM t WHERE id <= 1009 AND id >= 1000 "
+                       "ORDER BY id DESC",
+                   ids, &n) <= 16);
+  assert(n == 10 && ids[0] == 1009 && ids[9] == 1000);
+
+  // An exclusive bound on an index seeks past the duplicates of its key
+  assert(query_ids(db, "SELECT * FROM t WHERE v > 3 LIMIT 1", ids, &n) <= 16);
+  assert(n == 1 && ids[0] % 5 == 4);
+  assert(query_ids(db, "SELECT * FROM t WHERE v BETWEEN 1 AND 2 AND id < 11",
+                   ids, &n) <= 16);
+  assert(n == 4 && ids[0] == 1 && ids[3] == 7);
+
+  // Edges of the key space
+  query_ids(db, "SELECT * FROM t WHERE id >= 0", ids, &n);
+  assert(n == RANGE_KEYS);
+  query_ids(db, "SELECT * FROM t WHERE id <= 4294967295", ids, &n);
+  assert(n == RANGE_KEYS);
+  query_ids(db, "SELECT * FROM t WHERE id > 4294967295", ids, &n);
+  assert(n == 0);
+  query_ids(db, "SELECT * FROM t WHERE id < 0 ORDER BY id DESC", ids, &n);
+  assert(n == 0);
+  query_ids(db, "SELECT * FROM t WHERE id BETWEEN 5 AND 4", ids, &n);
+  assert(n == 0);
+  query_ids(db, "SELECT * FROM t WHERE id BETWEEN 7 AND 7", ids, &n);
+  assert(n == 1 && ids[0] == 7);
+
+  // BETWEEN takes parameters
+  assert(cached_prepare(db, "SELECT * FROM t WHERE id BETWEEN ? AND ?", &s) ==
+         PREPARE_SUCCESS);
+  assert(bind_parameter_int(&s, db, 0, 2990) == PREPARE_SUCCESS);
+  assert(bind_parameter_int(&s, db, 1, 4000) == PREPARE_SUCCESS);
+  Cursor *c = select_open(&s, db);
+  n = 0;
+  while (select_next(&s, db, c) != nullptr)
+    n++;
+  assert(n == 11);
+  free(c);
+  unpin_page_all(db->pager);
+  free_statement(&s);
+
+  // Every pair of bounds agrees with a plain filter, in both directions
+  static const char *lower_ops[] = {">", ">="};
+  static const char *upper_ops[] = {"<", "<="};
+  static const uint32_t bounds[] = {0, 1, 500, 1501, 2999, RANGE_KEYS,
+                                    RANGE_KEYS + 1};
+  constexpr uint32_t NUM_BOUNDS = sizeof(bounds) / sizeof(bounds[0]);
+  for (uint32_t o = 0; o < 4; o++) {
+    for (uint32_t a = 0; a < NUM_BOUNDS; a++) {
+      for (uint32_t b = 0; b < NUM_BOUNDS; b++) {
+        int64_t lo = (int64_t)bounds[a] + (o & 1 ? 0 : 1);
+        int64_t hi = (int64_t)bounds[b] - (o & 2 ? 0 : 1);
+        lo = lo < 1 ? 1 : lo;
+        hi = hi > RANGE_KEYS ? RANGE_KEYS : hi;
+        uint32_t count = hi >= lo ? (uint32_t)(hi - lo + 1) : 0;
+        char sql[128];
+        snprintf(sql, sizeof(sql),
+                 "SELECT * FROM t WHERE id %s %u AND id %s %u",
+                 lower_ops[o & 1], bounds[a], upper_ops[o >> 1], bounds[b]);
+        query_ids(db, sql, ids, &n);
+        assert(n == count && (n == 0 || (ids[0] == lo && ids[n - 1] == hi)));
+        strcat(sql, " ORDER BY id DESC");
+        query_ids(db, sql, ids, &n);
+        assert(n == count && (n == 0 || (ids[0] == hi && ids[n - 1] == lo)));
+      }
+    }
+  }
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+/**
+ * join_check runs a join and sums `left id * 7919 + right id` over its rows,
+ * which does not depend on the order they come out in.
+ */
+static uint64_t join_check(Database *db, const char *sql, uint32_t *rows,
+                           JoinMethod *method, uint32_t *partitions) {
+  Statement s;
+  assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS && s.joined);
+  Schema schema;
+  join_schema(&s, db, &schema);
+  uint32_t right_id = db->catalog.tables[s.table_index].schema.num_fields;
+  Join *join = join_open(&s, db);
+  uint64_t check = 0;
+  *rows = 0;
+  const void *row;
+  while ((row = join_next(join)) != nullptr) {
+    uint32_t a, b;
+    deserialize_field(&schema, 0, (void *)row, &a);
+    deserialize_field(&schema, right_id, (void *)row, &b);
+    check += (uint64_t)a * 7919 + b;
+    (*rows)++;
+  }
+  *method = join_method(join);
+  *partitions = join_partitions(join);
+  join_close(join);
+  free_statement(&s);
+  return check;
+}
+
+void test_joins() {
+  printf("Running test_joins...\n");
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  const char *setup[] = {"CREATE TABLE a (id INT, k INT, name TEXT)",
+                         "CREATE TABLE b (id INT, k INT, tag TEXT)"};
+  for (uint32_t i = 0; i < 2; i++) {
+    assert(cached_prepare(db, setup[i], &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  }
+  constexpr uint32_t A_ROWS = 2000;
+  constexpr uint32_t B_ROWS = 500;
+  for (uint32_t id = 0; id < A_ROWS + B_ROWS; id++) {
+    char sql[96];
+    if (id < A_ROWS)
+      snprintf(sql, sizeof(sql), "INSERT INTO a VALUES (%u, %u, 'n%u')", id,
+               id % 37, id % 100);
+    else
+      snprintf(sql, sizeof(sql), "INSERT INTO b VALUES (%u, %u, 'n%u')",
+               id - A_ROWS, (id - A_ROWS) % 50, (id - A_ROWS) % 120);
+    assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+    free_statement(&s);
+  }
+
+  // Every pair of rows, by brute force
+  uint64_t on_k = 0, on_id = 0, on_id_swapped = 0, on_text = 0;
+  uint64_t on_k_filtered = 0;
+  uint32_t n_k = 0, n_id = 0, n_text = 0, n_k_filtered = 0;
+  for (uint32_t x = 0; x < A_ROWS; x++) {
+    for (uint32_t y = 0; y < B_ROWS; y++) {
+      uint64_t pair = (uint64_t)x * 7919 + y;
+      if (x % 37 == y % 50) {
+        on_k += pair;
+        n_k++;
+        if (x < 100 && y >= 200) {
+          on_k_filtered += pair;
+          n_k_filtered++;
+        }
+      }
+      if (x % 37 == y) {
+        on_id += pair;
+        on_id_swapped += (uint64_t)y * 7919 + x;
+        n_id++;
+      }
+      if (x % 100 == y % 120) {
+        on_text += pair;
+        n_text++;
+      }
+    }
+  }
+
+  uint32_t n, partitions;
+  JoinMethod method;
+  assert(join_check(db, "SELECT * FROM a JOIN b ON a.k = b.k", &n, &method,
+                    &partitions) == on_k);
+  assert(n == n_k && method == JOIN_HASH && partitions == 0);
+  assert(join_check(db, "SELECT * FROM a JOIN b ON name = tag", &n, &method,
+                    &partitions) == on_text);
+  assert(n == n_text && method == JOIN_HASH);
+  // The terms on each table filter it before the join
+  assert(join_check(db,
+                    "SELECT * FROM a JOIN b ON a.k = b.k WHERE a.id < 100 "
+                    "AND b.id >= 200",
+                    &n, &method, &partitions) == on_k_filtered);
+  assert(n == n_k_filtered);
+
+  // A join column that is a primary key is probed, not hashed
+  assert(join_check(db, "SELECT * FROM a JOIN b ON a.k = b.id", &n, &method,
+                    &partitions) == on_id);
+  assert(n == n_id && method == JOIN_INDEX_LOOP);
+  assert(join_check(db, "SELECT * FROM b JOIN a ON b.id = a.k", &n, &method,
+                    &partitions) == on_id_swapped);
+  assert(n == n_id && method == JOIN_INDEX_LOOP);
+
+  // Over the memory budget, both tables are partitioned on disk
+  size_t budget = db->join_memory;
+  db->join_memory = 4096;
+  assert(join_check(db, "SELECT * FROM a JOIN b ON a.k = b.k", &n, &method,
+                    &partitions) == on_k);
+  assert(n == n_k && partitions > 1);
+  assert(join_check(db, "SELECT * FROM a JOIN b ON name = tag", &n, &method,
+                    &partitions) == on_text);
+  assert(n == n_text && partitions > 1);
+#ifdef __linux__
+  // Partitions that cannot be written fail the join, sorted or not, rather
+  // than dropping rows; a file size limit of 0 makes every write fail
+  struct rlimit limit;
+  getrlimit(RLIMIT_FSIZE, &limit);
+  signal(SIGXFSZ, SIG_IGN);
+  setrlimit(RLIMIT_FSIZE, &(struct rlimit){0, limit.rlim_max});
+  const char *spilled[] = {"SELECT * FROM a JOIN b ON a.k = b.k",
+                           "SELECT * FROM a JOIN b ON a.k = b.k ORDER BY tag"};
+  for (uint32_t q = 0; q < 2; q++) {
+    assert(cached_prepare(db, spilled[q], &s) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_IO_ERROR);
+    free_statement(&s);
+  }
+  setrlimit(RLIMIT_FSIZE, &limit);
+  signal(SIGXFSZ, SIG_DFL);
+#endif
+  db->join_memory = budget;
+
+  // Through the library: parameters bind to the joined columns
+  assert(cached_prepare(db, "SELECT * FROM a JOIN b ON a.k = b.id WHERE a.id "
+                            "BETWEEN ? AND ? AND tag = ?",
+                        &s) == PREPARE_SUCCESS);
+  assert(bind_parameter_int(&s, db, 0, 10) == PREPARE_SUCCESS);
+  assert(bind_parameter_int(&s, db, 1, 20) == PREPARE_SUCCESS);
+  assert(bind_parameter_text(&s, db, 2, "n12") == PREPARE_SUCCESS);
+  Join *join = join_open(&s, db);
+  const void *row = join_next(join);
+  uint32_t id;
+  Schema schema;
+  join_schema(&s, db, &schema);
+  assert(row != nullptr && strcmp(schema.fields[3].name, "b.id") == 0);
+  deserialize_field(&schema, 0, (void *)row, &id);
+  assert(id == 12 && join_next(join) == nullptr);
+  join_close(join);
+  free_statement(&s);
+
+  const char *invalid[] = {
+      "SELECT * FROM a JOIN b ON id = k", "SELECT * FROM a JOIN a ON id = id",
+      "SELECT * FROM a JOIN b ON a.id = a.k",
+      "SELECT COUNT(*) FROM a JOIN b ON a.k = b.k"};
+  for (uint32_t i = 0; i < 4; i++)
+    assert(cached_prepare(db, invalid[i], &s) != PREPARE_SUCCESS);
+  assert(cached_prepare(db, "SELECT * FROM a JOIN b ON a.id = tag", &s) ==
+         PREPARE_JOIN_TYPE_MISMATCH);
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+/** aggregate_with runs an aggregate SELECT on `threads` scan threads. */
+static ResultSet *aggregate_with(Database *db, const char *sql,
+                                 uint32_t threads) {
+  Statement s;
+  assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+  db->scan_threads = threads;
+  ResultSet *result = aggregate_execute(&s, db);
+  free_statement(&s);
+  return result;
+}
+
+void test_parallel_scan() {
+  printf("Running test_parallel_scan...\n");
+  remove(TEST_FILE);
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  assert(cached_prepare(db, "CREATE TABLE t (id INT, grp INT, name TEXT)",
+                        &s) == PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  free_statement(&s);
+  assert(cached_prepare(db, "INSERT INTO t VALUES (?, ?, ?)", &s) ==
+         PREPARE_SUCCESS);
+  constexpr uint32_t PARALLEL_ROWS = 40000;
+  for (uint32_t id = 0; id < PARALLEL_ROWS; id++) {
+    char name[8];
+    snprintf(name, sizeof(name), "n%u", id * 7919 % 101);
+    assert(bind_parameter_int(&s, db, 0, id) == PREPARE_SUCCESS);
+    assert(bind_parameter_int(&s, db, 1, id * 2654435761u % 1000) ==
+           PREPARE_SUCCESS);
+    assert(bind_parameter_text(&s, db, 2, name) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  }
+  free_statement(&s);
+  // Empty some leaves; the tasks must step over them
+  assert(cached_prepare(db, "DELETE FROM t WHERE id = ?", &s) ==
+         PREPARE_SUCCESS);
+  for (uint32_t id = 15000; id < 20000; id++) {
+    assert(bind_parameter_int(&s, db, 0, id) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  }
+  free_statement(&s);
+
+  // The table is cut into tasks; a key range or one thread keeps it serial
+  assert(cached_prepare(db, "SELECT COUNT(*) FROM t WHERE grp = 1", &s) ==
+         PREPARE_SUCCESS);
+  ParallelScan *scan = parallel_scan_open(&s, db, 4);
+  assert(scan != nullptr && parallel_scan_tasks(scan) >= 4);
+  parallel_scan_close(scan);
+  assert(parallel_scan_open(&s, db, 1) == nullptr);
+  free_statement(&s);
+  assert(cached_prepare(db, "SELECT COUNT(*) FROM t WHERE id < 100", &s) ==
+         PREPARE_SUCCESS);
+  free(select_open(&s, db)); // Sets the key range
+  assert(parallel_scan_open(&s, db, 4) == nullptr);
+  free_statement(&s);
+
+  // Parallel results, merged from the tasks, match a single thread's exactly,
+  // groups and their order included
+  const char *queries[] = {
+      "SELECT COUNT(*), SUM(grp), MIN(grp), MAX(grp), AVG(id) FROM t",
+      "SELECT grp, COUNT(*), SUM(id), MIN(id), MAX(id) FROM t GROUP BY grp",
+      "SELECT name, COUNT(*), SUM(grp) FROM t WHERE grp < 500 GROUP BY name",
+      "SELECT COUNT(*), MAX(id) FROM t WHERE name = 'n7' OR grp = 3",
+      "SELECT grp, COUNT(*) FROM t GROUP BY grp ORDER BY grp DESC LIMIT 5",
+  };
+  for (uint32_t q = 0; q < 5; q++) {
+    ResultSet *serial = aggregate_with(db, queries[q], 1);
+    for (uint32_t threads = 2; threads <= 8; threads *= 2) {
+      ResultSet *parallel = aggregate_with(db, queries[q], threads);
+      assert(parallel->num_rows == serial->num_rows);
+      assert(memcmp(parallel->rows, serial->rows,
+                    serial->num_rows * serial->schema.row_size) == 0);
+      result_set_free(parallel);
+    }
+    result_set_free(serial);
+  }
+
+  // Threads count the rows they scan, as a single thread does
+  for (uint32_t threads = 1; threads <= 4; threads *= 4) {
+    db_reset_stats(db);
+    result_set_free(aggregate_with(db, queries[0], threads));
+    assert(db_stats(db).rows_scanned == PARALLEL_ROWS - 5000);
+  }
+
+  // Rows changed only in the cache are seen by the threads too
+  assert(cached_prepare(db, "UPDATE t SET grp = 5000 WHERE id = 39999", &s) ==
+         PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  free_statement(&s);
+  ResultSet *result = aggregate_with(db, "SELECT MAX(grp) FROM t", 4);
+  assert(strcmp((char *)result->rows, "5000") == 0);
+  assert(!result->failed);
+  result_set_free(result);
+
+  // A leaf that cannot be read fails the result instead of leaving it short.
+  // The inner nodes the scan is planned from stay cached from the last query;
+  // the leaves are read from an empty file swapped in for the database's.
+  int fd = db->pager->file_descriptor;
+  int saved = dup(fd);
+  remove("empty.db");
+  int empty = open("empty.db", DB_OPEN_FLAGS, S_IWUSR | S_IRUSR);
+  dup2(empty, fd);
+  result = aggregate_with(db, queries[0], 4);
+  assert(result->failed);
+  result_set_free(result);
+  dup2(saved, fd);
+  close(saved);
+  close(empty);
+  remove("empty.db");
+  result = aggregate_with(db, queries[0], 4);
+  assert(!result->failed);
+  result_set_free(result);
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+void test_result_sink() {
+  printf("Running test_result_sink...\n");
+  uint32_t values[] = {0, 7, 10, 99, 100, 4096, 1000000007u, UINT32_MAX};
+  for (uint32_t i = 0; i < 8; i++) {
+    char digits[10], expected[16];
+    char *start = format_uint(values[i], digits + sizeof(digits));
+    snprintf(expected, sizeof(expected), "%u", values[i]);
+    assert(digits + sizeof(digits) - start == (long)strlen(expected));
+    assert(memcmp(start, expected, strlen(expected)) == 0);
+  }
+
+  // Output printed to the stream before the sink's comes out first, and more
+  // than a buffer's worth is split across flushes intact
+  FILE *out = tmpfile();
+  fprintf(out, "head ");
+  ResultSink sink;
+  sink_open(&sink, out);
+  constexpr uint32_t SINK_LINES = 20000;
+  for (uint32_t i = 0; i < SINK_LINES; i++) {
+    sink_uint(&sink, i);
+    sink_text(&sink, " row", 4);
+    sink_fill(&sink, '.', i % 3);
+    sink_char(&sink, '\n');
+  }
+  sink_flush(&sink);
+  fflush(out);
+  rewind(out);
+  char line[64];
+  assert(fscanf(out, "head ") == 0);
+  for (uint32_t i = 0; i < SINK_LINES; i++) {
+    char expected[64];
+    snprintf(expected, sizeof(expected), "%u row%.*s\n", i, (int)(i % 3),
+             "..");
+    assert(fgets(line, sizeof(line), out) != nullptr);
+    assert(strcmp(line, expected) == 0);
+  }
+  assert(fgets(line, sizeof(line), out) == nullptr);
+  fclose(out);
+  printf("Passed!\n");
+}
+
+/** print_select runs a SELECT in `mode` and returns its output's length. */
+static size_t print_select(Database *db, PrintMode mode, const char *sql,
+                           char *buf, size_t size) {
+  FILE *out = tmpfile();
+  Statement s;
+  assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+  db->out = out;
+  db->print_mode = mode;
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  db->out = stdout;
+  db->print_mode = PRINT_PLAIN;
+  free_statement(&s);
+  rewind(out);
+  size_t len = fread(buf, 1, size - 1, out);
+  buf[len] = '\0';
+  fclose(out);
+  return len;
+}
+
+static uint32_t read_u32le(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void test_output_formats() {
+  printf("Running test_output_formats...\n");
+  remove(TEST_FILE);
+  Database *db = db_open(TEST_FILE);
+  Statement s;
+  assert(cached_prepare(db, "CREATE TABLE t (id INT, note TEXT)", &s) ==
+         PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  free_statement(&s);
+  const char *notes[] = {"plain", "two\nlines", "a\tb, \"c\"", ""};
+  assert(cached_prepare(db, "INSERT INTO t VALUES (?, ?)", &s) ==
+         PREPARE_SUCCESS);
+  for (uint32_t i = 0; i < 4; i++) {
+    assert(bind_parameter_int(&s, db, 0, i * 1000000u) == PREPARE_SUCCESS);
+    assert(bind_parameter_text(&s, db, 1, notes[i]) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  }
+  free_statement(&s);
+
+  char buf[512];
+  print_select(db, PRINT_CSV, "SELECT * FROM t", buf, sizeof(buf));
+  assert(strcmp(buf, "id,note\n0,plain\n1000000,\"two\nlines\"\n"
+                     "2000000,\"a\tb, \"\"c\"\"\"\n3000000,\n") == 0);
+  print_select(db, PRINT_TSV, "SELECT * FROM t", buf, sizeof(buf));
+  assert(strcmp(buf, "id\tnote\n0\tplain\n1000000\ttwo\\nlines\n"
+                     "2000000\ta\\tb, \"c\"\n3000000\t\n") == 0);
+
+  // Binary: a header, length-prefixed rows and a 0 to end
+  size_t len =
+      print_select(db, PRINT_BINARY, "SELECT * FROM t", buf, sizeof(buf));
+  const uint8_t *p = (const uint8_t *)buf;
+  assert(read_u32le(p) == 2);
+  assert(memcmp(p + 4, "\0\2id\1\4note", 10) == 0);
+  p += 14;
+  for (uint32_t i = 0; i < 4; i++) {
+    size_t note = strlen(notes[i]);
+    assert(read_u32le(p) == 4 + 1 + note);
+    assert(read_u32le(p + 4) == i * 1000000u);
+    assert(p[8] == note && memcmp(p + 9, notes[i], note) == 0);
+    p += 9 + note;
+  }
+  assert(read_u32le(p) == 0 && p + 4 == (const uint8_t *)buf + len);
+
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+static void run_statement(Database *db, const char *sql) {
+  Statement s;
+  assert(cached_prepare(db, sql, &s) == PREPARE_SUCCESS);
+  assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  free_statement(&s);
+}
+
+static void write_file(const char *path, const char *text) {
+  FILE *f = fopen(path, "wb");
+  assert(f != nullptr);
+  fputs(text, f);
+  fclose(f);
+}
+
+#define IMPORT_FILE "import_test.csv"
+
+void test_import_csv() {
+  printf("Running test_import_csv...\n");
+  remove(TEST_FILE);
+  Database *db = db_open(TEST_FILE);
+  run_statement(db, "CREATE TABLE t (id INT, note TEXT, score INT)");
+  run_statement(db, "CREATE INDEX t_score ON t(score)");
+  run_statement(db, "INSERT INTO t VALUES (5, 'existing', 1)");
+
+  // A header, CRLF, a blank line, quoting, and keys already taken
+  write_file(IMPORT_FILE, "ID,Note,Score\r\n3,\"a, \"\"b\"\"\",30\r\n\r\n"
+                          "1,plain,10\n5,dup of existing,50\n"
+                          "3,dup in file,31\n2,\"two\nlines\",-20");
+  ImportStats stats;
+  assert(import_csv(db, 0, IMPORT_FILE, 1, &stats) == IMPORT_SUCCESS);
+  assert(stats.rows == 3 && stats.duplicates == 2 && stats.threads == 1);
+  char buf[256];
+  print_select(db, PRINT_CSV, "SELECT * FROM t", buf, sizeof(buf));
+  assert(strcmp(buf, "id,note,score\n1,plain,10\n"
+                     "2,\"two\nlines\",4294967276\n3,\"a, \"\"b\"\"\",30\n"
+                     "5,existing,1\n") == 0);
+  assert(verify_btree(db, 0) && verify_indexes(db, 0));
+
+  // A bad record rejects the whole file; records count from the header
+  struct {
+    const char *text;
+    ImportResult result;
+    uint64_t record;
+  } bad[] = {
+      {"9,x,1\n10,y\n", IMPORT_COLUMN_COUNT, 2},
+      {"9,x,1,2\n", IMPORT_COLUMN_COUNT, 1},
+      {"id,note,score\n9,x,1\n10,y,1z\n", IMPORT_NOT_A_NUMBER, 3},
+      {"9,,\n", IMPORT_NOT_A_NUMBER, 1},
+      {"9,0123456789012345678901234567890123,1\n", IMPORT_STRING_TOO_LONG, 1},
+      {"9,\"open,1\n", IMPORT_BAD_QUOTE, 1},
+      {"9,\"a\"b,1\n", IMPORT_BAD_QUOTE, 1},
+  };
+  for (uint32_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    write_file(IMPORT_FILE, bad[i].text);
+    assert(import_csv(db, 0, IMPORT_FILE, 1, &stats) == bad[i].result);
+    assert(stats.record == bad[i].record && stats.rows == 0);
+    assert(btree_row_count(db, 0) == 4);
+    unpin_page_all(db->pager);
+  }
+  assert(import_csv(db, 0, "missing.csv", 1, &stats) == IMPORT_CANNOT_OPEN);
+
+  // Chunk boundaries land inside quoted fields that span lines
+  run_statement(db, "CREATE TABLE a (id INT, note TEXT, score INT)");
+  run_statement(db, "CREATE TABLE b (id INT, note TEXT, score INT)");
+  constexpr uint32_t IMPORT_ROWS = 12000;
+  FILE *f = fopen(IMPORT_FILE, "wb");
+  for (uint32_t i = 0; i < IMPORT_ROWS; i++) {
+    uint32_t id = i * 7919 % IMPORT_ROWS;
+    fprintf(f,
+            i % 3 ? "%u,row %u of the test,%u\n"
+                  : "%u,\"row %u,\n\"\"x\"\" of the test\",%u\n",
+            id, id, id % 100);
+  }
+  fclose(f);
+  assert(import_csv(db, 1, IMPORT_FILE, 1, &stats) == IMPORT_SUCCESS);
+  assert(stats.rows == IMPORT_ROWS && stats.threads == 1);
+  assert(import_csv(db, 2, IMPORT_FILE, 4, &stats) == IMPORT_SUCCESS);
+  assert(stats.rows == IMPORT_ROWS && stats.threads == 4);
+  assert(verify_btree(db, 2));
+  size_t size = 1 << 20;
+  char *serial = malloc(size);
+  char *parallel = malloc(size);
+  size_t len = print_select(db, PRINT_CSV, "SELECT * FROM a", serial, size);
+  assert(print_select(db, PRINT_CSV, "SELECT * FROM b", parallel, size) ==
+         len);
+  assert(memcmp(serial, parallel, len) == 0);
+  const char *first = "id,note,score\n0,\"row 0,\n\"\"x\"\" of the test\",0\n";
+  assert(strncmp(serial, first, strlen(first)) == 0);
+  free(serial);
+  free(parallel);
+
+  db_close(db);
+  remove(TEST_FILE);
+  remove(IMPORT_FILE);
+  printf("Passed!\n");
+}
+
+/** run_script runs a script file and collects what it printed. */
+static ReplResult run_script(Database *db, const char *path,
+                             bool stop_on_error, char *buf, size_t size) {
+  FILE *out = tmpfile();
+  db->out = out;
+  ReplResult result = repl_execute_script(db, path, stop_on_error);
+  db->out = stdout;
+  rewind(out);
+  size_t len = fread(buf, 1, size - 1, out);
+  buf[len] = '\0';
+  fclose(out);
+  return result;
+}
+
+#define SCRIPT_FILE "script_test.sql"
+#define NESTED_SCRIPT_FILE "script_nested.sql"
+
+void test_script() {
+  printf("Running test_script...\n");
+  remove(TEST_FILE);
+  Database *db = db_open(TEST_FILE);
+
+  // Statements span lines, chunks and more than a kilobyte, and semicolons
+  // inside quotes do not end them
+  size_t size = 3 * SCRIPT_CHUNK_SIZE;
+  char *text = malloc(size);
+  char *p = text;
+  p += sprintf(p, "-- setup\nCREATE TABLE t (id INT, name TEXT);\n\n"
+                  "INSERT INTO t\n  VALUES (1, 'a;b'); -- trailing\n");
+  p += sprintf(p, "-- ");
+  memset(p, 'x', SCRIPT_CHUNK_SIZE - 100);
+  p += SCRIPT_CHUNK_SIZE - 100;
+  p += sprintf(p, "\r\nINSERT INTO t VALUES (2,");
+  memset(p, ' ', 2000);
+  p += 2000;
+  p += sprintf(p, "'long');\nINSERT INTO t VALUES (1, 'dup');\n"
+                  ".mode csv\r\nSELECT * FROM t\nWHERE id > 0");
+  write_file(SCRIPT_FILE, text);
+  char out[512];
+  assert(run_script(db, SCRIPT_FILE, false, out, sizeof(out)) == REPL_ERROR);
+  assert(strcmp(out, "Error: Duplicate key.\nid,name\n1,a;b\n2,long\n") ==
+         0);
+  db->print_mode = PRINT_PLAIN;
+
+  // Stopping on errors, the first failure ends the script; what ran before
+  // it stays applied
+  write_file(SCRIPT_FILE, "INSERT INTO t VALUES (3, 'c');\n"
+                          "INSERT INTO t VALUES (2, 'again');\n"
+                          "INSERT INTO t VALUES (4, 'd');\n");
+  assert(run_script(db, SCRIPT_FILE, true, out, sizeof(out)) == REPL_ERROR);
+  assert(strcmp(out, "Error: Duplicate key.\n"
+                     "Error: Stopped at line 2 of '" SCRIPT_FILE "'.\n") ==
+         0);
+  assert(btree_row_count(db, 0) == 3);
+  unpin_page_all(db->pager);
+  write_file(SCRIPT_FILE, "INSERT INTO t VALUES (4, 'd');\n");
+  assert(run_script(db, SCRIPT_FILE, true, out, sizeof(out)) ==
+         REPL_CONTINUE);
+  assert(strcmp(out, "") == 0);
+
+  // .read nests, though not forever, and .exit ends every level
+  write_file(NESTED_SCRIPT_FILE, ".read " SCRIPT_FILE "\n.exit\n"
+                                 "INSERT INTO t VALUES (9, 'never');\n");
+  write_file(SCRIPT_FILE, "SELECT * FROM t WHERE id = 4;");
+  assert(run_script(db, NESTED_SCRIPT_FILE, false, out, sizeof(out)) ==
+         REPL_EXIT);
+  assert(strcmp(out, "(4, d)\n") == 0);
+  write_file(SCRIPT_FILE, ".read " SCRIPT_FILE);
+  assert(run_script(db, SCRIPT_FILE, false, out, sizeof(out)) == REPL_ERROR);
+  assert(strcmp(out, "Error: Scripts nested too deeply.\n") == 0);
+  assert(db->script_depth == 0);
+  assert(run_script(db, "missing.sql", false, out, sizeof(out)) ==
+         REPL_ERROR);
+  assert(btree_row_count(db, 0) == 4);
+
+  // Transaction statements keep their semicolons, and quotes in comments
+  // are only comments
+  write_file(SCRIPT_FILE, "BEGIN;\nINSERT INTO t VALUES (5, 'e'); -- it's\n"
+                          "INSERT INTO t\n-- Carol's row; id 6\n"
+                          "  VALUES (6, 'f'); -- f's\nCOMMIT ;\n");
+  assert(run_script(db, SCRIPT_FILE, true, out, sizeof(out)) ==
+         REPL_CONTINUE);
+  assert(strcmp(out, "Transaction started.\nTransaction committed.\n") == 0);
+  assert(btree_row_count(db, 0) == 6);
+  unpin_page_all(db->pager);
+
+  free(text);
+  db_close(db);
+  remove(TEST_FILE);
+  remove(SCRIPT_FILE);
+  remove(NESTED_SCRIPT_FILE);
+  printf("Passed!\n");
+}
+
+void test_stats() {
+  printf("Running test_stats...\n");
+  remove(TEST_FILE);
+  Database *db = db_open(TEST_FILE);
+  FILE *out = tmpfile();
+  db->out = out;
+  run_statement(db, "CREATE TABLE t (id INT, name TEXT)");
+  db_reset_stats(db);
+  char sql[64];
+  for (uint32_t id = 0; id < 300; id++) {
+    snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%u, 'row')", id);
+    run_statement(db, sql);
+  }
+  DbStats stats = db_stats(db);
+  assert(stats.splits > 0 && stats.rows_scanned == 0);
+  assert(stats.hits <= stats.fetches && stats.pinned_peak > 0);
+
+  // Scans count the rows they read, whichever path they take
+  db_reset_stats(db);
+  run_statement(db, "SELECT * FROM t WHERE id >= 100 AND id < 150");
+  assert(db_stats(db).rows_scanned == 50);
+  run_statement(db, "SELECT * FROM t ORDER BY id DESC LIMIT 10");
+  assert(db_stats(db).rows_scanned == 60);
+  stats = db_stats(db);
+  assert(stats.splits == 0 && stats.writes == 0 && stats.reads == 0);
+
+  // A reopened file's pages are read back in
+  db_close(db);
+  db = db_open(TEST_FILE);
+  db->out = out;
+  db_reset_stats(db);
+  run_statement(db, "SELECT * FROM t");
+  stats = db_stats(db);
+  assert(stats.reads > 0 && stats.fetches > stats.hits);
+  assert(stats.rows_scanned == 300);
+
+  fclose(out);
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+/** explain_output runs a line through the REPL and collects its output. */
+static void explain_output(Database *db, const char *sql, char *buf,
+                           size_t size) {
+  FILE *out = tmpfile();
+  db->out = out;
+  char line[256];
+  snprintf(line, sizeof(line), "%s", sql);
+  assert(repl_execute_line(db, line) == REPL_CONTINUE);
+  db->out = stdout;
+  rewind(out);
+  size_t len = fread(buf, 1, size - 1, out);
+  buf[len] = '\0';
+  fclose(out);
+}
+
+void test_explain() {
+  printf("Running test_explain...\n");
+  remove(TEST_FILE);
+  Database *db = db_open(TEST_FILE);
+  run_statement(db, "CREATE TABLE t (id INT, name TEXT, v INT)");
+  Statement s;
+  assert(cached_prepare(db, "INSERT INTO t VALUES (?, ?, ?)", &s) ==
+         PREPARE_SUCCESS);
+  constexpr uint32_t EXPLAIN_ROWS = 2000;
+  for (uint32_t id = 1; id <= EXPLAIN_ROWS; id++) {
+    assert(bind_parameter_int(&s, db, 0, id) == PREPARE_SUCCESS);
+    assert(bind_parameter_text(&s, db, 1, "name") == PREPARE_SUCCESS);
+    assert(bind_parameter_int(&s, db, 2, id % 100) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  }
+  free_statement(&s);
+  run_statement(db, "CREATE INDEX by_v ON t (v)");
+
+  // Estimates come from the row counts, without reading the rows
+  char out[1024];
+  uint64_t scanned = db_stats(db).rows_scanned;
+  explain_output(db, "EXPLAIN SELECT * FROM t WHERE id > 100 AND id < 1000",
+                 out, sizeof(out));
+  assert(strstr(out, "SELECT\n  RANGE SEEK t (id 101..999): ~899 rows") ==
+         out);
+  explain_output(db, "EXPLAIN SELECT * FROM t WHERE v = 7", out, sizeof(out));
+  assert(strstr(out, "INDEX SEEK by_v ON t (v = 7): ~20 rows") != nullptr);
+  explain_output(db, "EXPLAIN SELECT * FROM t WHERE name = 'x' LIMIT 5", out,
+                 sizeof(out));
+  // A filter keeps the LIMIT from cutting the walk short
+  assert(strstr(out, "SELECT\n  LIMIT 5\n    FILTER (1 term)\n"
+                     "      FULL SCAN t: ~2000 rows, ~") == out);
+  assert(db_stats(db).rows_scanned == scanned);
+
+  // ANALYZE runs the query, printing the counts instead of the rows
+  explain_output(db, "EXPLAIN ANALYZE SELECT * FROM t WHERE v = 7", out,
+                 sizeof(out));
+  assert(strstr(out, "SELECT (actual rows=20)\n") == out);
+  assert(strstr(out, "~20 rows") != nullptr);
+  assert(strstr(out, "(actual rows=20)\nExecution: 20 rows in ") != nullptr);
+  assert(strstr(out, "\nRows scanned: 20\n") != nullptr);
+  explain_output(db, "EXPLAIN ANALYZE SELECT COUNT(*) FROM t WHERE id > 10",
+                 out, sizeof(out));
+  assert(strstr(out, "ROW COUNTS t: ~") != nullptr);
+  assert(strstr(out, "\nRows scanned: 0\n") != nullptr);
+  assert(db_stats(db).rows_scanned == scanned + 20);
+
+  Statement bad;
+  assert(cached_prepare(db, "EXPLAIN DELETE FROM t WHERE id = 1", &bad) ==
+         PREPARE_EXPLAIN_NOT_SELECT);
+  db_close(db);
+
+  // A plan is printed, not stepped through, so the library refuses it
+  sdb *conn;
+  sdb_stmt *stmt;
+  assert(sdb_open(TEST_FILE, &conn) == SDB_OK);
+  assert(sdb_prepare(conn, "EXPLAIN SELECT * FROM t", &stmt) == SDB_ERROR);
+  sdb_close(conn);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+void test_analyze() {
+  printf("Running test_analyze...\n");
+  remove(TEST_FILE);
+  Database *db = db_open(TEST_FILE);
+  run_statement(db, "CREATE TABLE t (id INT, grp INT, v INT)");
+  Statement s;
+  assert(cached_prepare(db, "INSERT INTO t VALUES (?, ?, ?)", &s) ==
+         PREPARE_SUCCESS);
+  constexpr uint32_t ANALYZE_ROWS = 20000;
+  for (uint32_t id = 1; id <= ANALYZE_ROWS; id++) {
+    assert(bind_parameter_int(&s, db, 0, id) == PREPARE_SUCCESS);
+    assert(bind_parameter_int(&s, db, 1, id % 4) == PREPARE_SUCCESS);
+    assert(bind_parameter_int(&s, db, 2, id % 2000) == PREPARE_SUCCESS);
+    assert(execute_statement(&s, db) == EXECUTE_SUCCESS);
+  }
+  free_statement(&s);
+  run_statement(db, "CREATE INDEX by_grp ON t (grp)");
+  run_statement(db, "CREATE INDEX by_v ON t (v)");
+  run_statement(db, "CREATE TABLE u (id INT)");
+
+  // Unanalyzed, the narrowest range wins however many rows it holds
+  char out[1024];
+  explain_output(db, "EXPLAIN SELECT * FROM t WHERE grp = 1", out,
+                 sizeof(out));
+  assert(strstr(out, "INDEX SEEK by_grp ON t (grp = 1)") != nullptr);
+
+  explain_output(db, "ANALYZE t", out, sizeof(out));
+  assert(strcmp(out, "Analyzed.\n") == 0);
+  const TableStats *stats = db->table_stats[0];
+  assert(stats != nullptr && db->table_stats[1] == nullptr);
+  assert(stats->rows == ANALYZE_ROWS);
+  assert(stats->sampled > 0 && stats->sampled < ANALYZE_ROWS);
+  assert(stats->columns[0].distinct == ANALYZE_ROWS);
+  assert(stats->columns[1].distinct == 4);
+  assert(stats->columns[2].min == 0 && stats->columns[2].max == 1999);
+  KeyRange range = {};
+  key_range_narrow(&range, CMP_EQ, 1);
+  double share = estimate_range(stats, 1, &range);
+  assert(share > 0.2 && share < 0.3);
+  range = (KeyRange){};
+  key_range_narrow(&range, CMP_LT, 500);
+  share = estimate_range(stats, 2, &range);
+  assert(share > 0.2 && share < 0.3);
+
+  // A quarter of the table costs less to scan than to look up row by row
+  explain_output(db, "EXPLAIN SELECT * FROM t WHERE grp = 1", out,
+                 sizeof(out));
+  assert(strstr(out, "FULL SCAN t") != nullptr);
+  explain_output(db, "EXPLAIN SELECT * FROM t WHERE v = 7", out, sizeof(out));
+  assert(strstr(out, "INDEX SEEK by_v ON t (v = 7)") != nullptr);
+  explain_output(db, "EXPLAIN ANALYZE SELECT * FROM t WHERE grp = 1", out,
+                 sizeof(out));
+  assert(strstr(out, "SELECT: ~") == out);
+  assert(strstr(out, " rows (actual rows=5000)\n") != nullptr);
+  db_close(db);
+
+  // Statistics are kept in the file
+  db = db_open(TEST_FILE);
+  assert(db->table_stats[0] != nullptr && db->table_stats[1] == nullptr);
+  assert(db->table_stats[0]->rows == ANALYZE_ROWS);
+  explain_output(db, "EXPLAIN SELECT * FROM t WHERE grp = 1", out,
+                 sizeof(out));
+  assert(strstr(out, "FULL SCAN t") != nullptr);
+  explain_output(db, "ANALYZE", out, sizeof(out));
+  assert(db->table_stats[1] != nullptr && db->table_stats[1]->rows == 0);
+  db_close(db);
+  remove(TEST_FILE);
+  printf("Passed!\n");
+}
+
+void test_trace() {
+  printf("Running test_trace...\n");
+  const char *path = "test_trace.json";
+  uint32_t written, dropped;
+  assert(!trace_stop(&written, &dropped));
+#ifdef SIMPLEDB_TRACING
+  remove(TEST_FILE);
+  Database *db = db_open(TEST_FILE);
+  run_statement(db, "CREATE TABLE t (id INT, v INT)");
+  assert(trace_start(path, 1));
+  char sql[64];
+  for (uint32_t id = 1; id <= 1000; id++) {
+    snprintf(sql, sizeof(sql), "INSERT INTO t VALUES (%u, %u)", id, id);
+    run_statement(db, sql);
+  }
+  assert(trace_stop(&written, &dropped));
+  assert(written > 1000 && dropped == 0);
+  assert(!trace_stop(&written, &dropped));
+  db_close(db);
+
+  FILE *f = fopen(path, "r");
+  assert(f != nullptr);
+  static char json[1 << 20];
+  size_t n = fread(json, 1, sizeof(json) - 1, f);
+  json[n] = '\0';
+  fclose(f);
+  assert(strncmp(json, "{\"traceEvents\":[", 16) == 0);
+  assert(strstr(json, "\"name\":\"get_page\"") != nullptr);
+  assert(strstr(json, "\"name\":\"leaf_node_insert\"") != nullptr);
+  assert(strstr(json, "\"name\":\"leaf_split\"") != nullptr);
+  assert(strstr(json, "\"name\":\"serialize_row\"") != nullptr);
+  remove(path);
+  remove(TEST_FILE);
+#else
+  // Without the build option nothing is recorded
+  assert(!trace_start(path, 1));
+#endif
+  printf("Passed!\n");
+}
+
 int main() {
   test_pager_open_close();
   test_pager_get_page();
@@ -181,6 +2077,31 @@ int main() {
   test_pager_lru_eviction();
   test_btree_node_initialization();
   test_btree_insert_lookup();
+  test_api_prepared_statements();
+  test_api_interleaved_statements();
+  test_api_open_error();
+  test_api_table_full();
+  test_plan_cache();
+  test_secondary_index();
+  test_predicates();
+  test_batch_scan();
+  test_aggregates();
+  test_row_counts();
+  test_internal_split_flushed();
+  test_order_by();
+  test_limit_stops_scan();
+  test_reverse_scan();
+  test_key_ranges();
+  test_joins();
+  test_parallel_scan();
+  test_result_sink();
+  test_output_formats();
+  test_import_csv();
+  test_script();
+  test_stats();
+  test_explain();
+  test_analyze();
+  test_trace();
   printf("All unit tests passed!\n");
   return 0;
 }
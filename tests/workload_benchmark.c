@@ -0,0 +1,364 @@
+/**
+ * workload_benchmark drives the engine through the library API with the
+ * workloads below and prints each one's throughput and latency percentiles
+ * as JSON. `meson test --benchmark -C build` runs it with the defaults.
+ *
+ *   ./build/workload_benchmark [rows] [ops] [workload...]
+ *
+ *   sequential_insert  fill an empty table with `rows` ascending keys
+ *   random_insert      fill another empty table with the keys shuffled
+ *   point_lookup       `ops` lookups of random keys
+ *   range_scan         `ops` / 10 scans of RANGE_ROWS consecutive keys
+ *   full_scan          FULL_SCANS scans of the whole table
+ *   mixed              `ops` of 50% lookups, 25% updates, 15% inserts of new
+ *                      keys and 10% range scans
+ *   delete_heavy       `ops` of 75% deletes of a random row and 25% inserts
+ *                      of a deleted key
+ *
+ * All but random_insert run in order against the table sequential_insert
+ * filled, so naming some workloads still loads it. Each operation is timed on
+ * its own; a scan is one operation however many rows it returns.
+ *
+ * A database file is limited to TABLE_MAX_PAGES pages, which random inserts
+ * leave half full, so `rows` can be at most about 150000.
+ */
+#include "simpledb.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE "workload_bench.db"
+#define RANDOM_FILE "workload_bench_random.db"
+
+constexpr uint32_t RANGE_ROWS = 100;
+constexpr uint32_t FULL_SCANS = 10;
+
+static const char *workload_names[] = {
+    "sequential_insert", "random_insert", "point_lookup", "range_scan",
+    "full_scan",         "mixed",         "delete_heavy",
+};
+constexpr uint32_t NUM_WORKLOADS =
+    sizeof(workload_names) / sizeof(workload_names[0]);
+
+// Operations of one workload, each timed
+typedef struct {
+  uint64_t *latencies_ns;
+  uint32_t ops;
+  uint64_t rows; // Rows written or returned
+  uint64_t start_ns;
+  uint64_t end_ns;
+} Run;
+
+typedef struct {
+  sdb *db;
+  sdb_stmt *insert;
+  sdb_stmt *lookup;
+  sdb_stmt *range;
+  sdb_stmt *scan;
+  sdb_stmt *update;
+  sdb_stmt *delete;
+  uint32_t next_id; // Keys below it are in the table, except deleted ones
+} Bench;
+
+static bool selected[NUM_WORKLOADS];
+static bool first_report = true;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t next_random(uint32_t *state) {
+  // xorshift32: cheap enough not to show up in the measurement
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+static void expect(int rc, int want, const char *what) {
+  if (rc != want) {
+    fprintf(stderr, "%s failed with %d\n", what, rc);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/** step_all runs a statement to the end and returns the rows it produced. */
+static uint32_t step_all(sdb_stmt *stmt, const char *what) {
+  uint32_t rows = 0;
+  int rc;
+  while ((rc = sdb_step(stmt)) == SDB_ROW)
+    rows++;
+  expect(rc, SDB_DONE, what);
+  return rows;
+}
+
+static void prepare(sdb *db, const char *sql, sdb_stmt **out) {
+  expect(sdb_prepare(db, sql, out), SDB_OK, sql);
+}
+
+static void bench_open(Bench *b, const char *file) {
+  remove(file);
+  expect(sdb_open(file, &b->db), SDB_OK, "sdb_open");
+  sdb_stmt *create;
+  prepare(b->db, "CREATE TABLE bench (id INT, v INT)", &create);
+  step_all(create, "CREATE");
+  sdb_finalize(create);
+  prepare(b->db, "INSERT INTO bench VALUES (?, ?)", &b->insert);
+  prepare(b->db, "SELECT * FROM bench WHERE id = ?", &b->lookup);
+  prepare(b->db, "SELECT * FROM bench WHERE id >= ? AND id < ?", &b->range);
+  prepare(b->db, "SELECT * FROM bench", &b->scan);
+  prepare(b->db, "UPDATE bench SET v = ? WHERE id = ?", &b->update);
+  prepare(b->db, "DELETE FROM bench WHERE id = ?", &b->delete);
+  b->next_id = 0;
+}
+
+static void bench_close(Bench *b, const char *file) {
+  sdb_finalize(b->insert);
+  sdb_finalize(b->lookup);
+  sdb_finalize(b->range);
+  sdb_finalize(b->scan);
+  sdb_finalize(b->update);
+  sdb_finalize(b->delete);
+  sdb_close(b->db);
+  remove(file);
+}
+
+static uint32_t insert(Bench *b, uint32_t id) {
+  sdb_bind_int(b->insert, 1, id);
+  sdb_bind_int(b->insert, 2, id);
+  return step_all(b->insert, "INSERT");
+}
+
+static uint32_t lookup(Bench *b, uint32_t id) {
+  sdb_bind_int(b->lookup, 1, id);
+  return step_all(b->lookup, "SELECT");
+}
+
+static uint32_t range_scan(Bench *b, uint32_t first) {
+  sdb_bind_int(b->range, 1, first);
+  sdb_bind_int(b->range, 2, first + RANGE_ROWS);
+  return step_all(b->range, "range SELECT");
+}
+
+static void run_begin(Run *run, uint32_t capacity) {
+  *run = (Run){.latencies_ns = malloc(capacity * sizeof(uint64_t))};
+  run->start_ns = now_ns();
+}
+
+static void run_op(Run *run, uint64_t op_start_ns, uint32_t rows) {
+  run->latencies_ns[run->ops++] = now_ns() - op_start_ns;
+  run->rows += rows;
+}
+
+static int compare_latencies(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/** percentile returns the nearest-rank percentile of sorted latencies. */
+static uint64_t percentile(const Run *run, double p) {
+  uint32_t rank = (uint32_t)(p * run->ops + 0.999999);
+  return run->latencies_ns[rank == 0 ? 0 : rank - 1];
+}
+
+/** run_end prints a workload's results, if it was asked for. */
+static void run_end(Run *run, uint32_t workload) {
+  run->end_ns = now_ns();
+  if (selected[workload] && run->ops > 0) {
+    qsort(run->latencies_ns, run->ops, sizeof(uint64_t), compare_latencies);
+    double seconds = (double)(run->end_ns - run->start_ns) / 1e9;
+    printf("%s\n    {\"name\": \"%s\", \"ops\": %u, \"rows\": %llu, "
+           "\"seconds\": %.6f, \"ops_per_sec\": %.1f,\n"
+           "     \"latency_ns\": {\"p50\": %llu, \"p90\": %llu, "
+           "\"p99\": %llu, \"p999\": %llu, \"max\": %llu}}",
+           first_report ? "" : ",", workload_names[workload], run->ops,
+           (unsigned long long)run->rows, seconds, run->ops / seconds,
+           (unsigned long long)percentile(run, 0.50),
+           (unsigned long long)percentile(run, 0.90),
+           (unsigned long long)percentile(run, 0.99),
+           (unsigned long long)percentile(run, 0.999),
+           (unsigned long long)run->latencies_ns[run->ops - 1]);
+    first_report = false;
+  }
+  free(run->latencies_ns);
+}
+
+static void bench_sequential_insert(Bench *b, uint32_t rows) {
+  Run run;
+  run_begin(&run, rows);
+  for (uint32_t id = 0; id < rows; id++) {
+    uint64_t start = now_ns();
+    insert(b, id);
+    run_op(&run, start, 1);
+  }
+  b->next_id = rows;
+  run_end(&run, 0);
+}
+
+static void bench_random_insert(uint32_t rows) {
+  uint32_t *keys = malloc(rows * sizeof(uint32_t));
+  for (uint32_t i = 0; i < rows; i++)
+    keys[i] = i;
+  uint32_t rng = 88675123u;
+  for (uint32_t i = rows - 1; i > 0; i--) {
+    uint32_t j = next_random(&rng) % (i + 1);
+    uint32_t k = keys[i];
+    keys[i] = keys[j];
+    keys[j] = k;
+  }
+  Bench b;
+  bench_open(&b, RANDOM_FILE);
+  Run run;
+  run_begin(&run, rows);
+  for (uint32_t i = 0; i < rows; i++) {
+    uint64_t start = now_ns();
+    insert(&b, keys[i]);
+    run_op(&run, start, 1);
+  }
+  run_end(&run, 1);
+  bench_close(&b, RANDOM_FILE);
+  free(keys);
+}
+
+static void bench_point_lookup(Bench *b, uint32_t ops) {
+  uint32_t rng = 2463534242u;
+  Run run;
+  run_begin(&run, ops);
+  for (uint32_t i = 0; i < ops; i++) {
+    uint32_t id = next_random(&rng) % b->next_id;
+    uint64_t start = now_ns();
+    uint32_t rows = lookup(b, id);
+    run_op(&run, start, rows);
+  }
+  run_end(&run, 2);
+}
+
+static void bench_range_scan(Bench *b, uint32_t ops) {
+  uint32_t scans = ops / 10 > 0 ? ops / 10 : 1;
+  uint32_t rng = 521288629u;
+  Run run;
+  run_begin(&run, scans);
+  for (uint32_t i = 0; i < scans; i++) {
+    uint32_t first = next_random(&rng) % b->next_id;
+    uint64_t start = now_ns();
+    uint32_t rows = range_scan(b, first);
+    run_op(&run, start, rows);
+  }
+  run_end(&run, 3);
+}
+
+static void bench_full_scan(Bench *b) {
+  Run run;
+  run_begin(&run, FULL_SCANS);
+  for (uint32_t i = 0; i < FULL_SCANS; i++) {
+    uint64_t start = now_ns();
+    uint32_t rows = step_all(b->scan, "full SELECT");
+    run_op(&run, start, rows);
+  }
+  run_end(&run, 4);
+}
+
+static void bench_mixed(Bench *b, uint32_t ops) {
+  uint32_t rng = 1597334677u;
+  Run run;
+  run_begin(&run, ops);
+  for (uint32_t i = 0; i < ops; i++) {
+    uint32_t kind = next_random(&rng) % 100;
+    uint32_t id = next_random(&rng) % b->next_id;
+    uint64_t start = now_ns();
+    uint32_t rows = 1;
+    if (kind < 50) {
+      rows = lookup(b, id);
+    } else if (kind < 75) {
+      sdb_bind_int(b->update, 1, i);
+      sdb_bind_int(b->update, 2, id);
+      step_all(b->update, "UPDATE");
+    } else if (kind < 90) {
+      insert(b, b->next_id++);
+    } else {
+      rows = range_scan(b, id);
+    }
+    run_op(&run, start, rows);
+  }
+  run_end(&run, 5);
+}
+
+static void bench_delete_heavy(Bench *b, uint32_t ops) {
+  // Keys in the table and keys deleted, each picked from at random
+  uint32_t *live = malloc(b->next_id * sizeof(uint32_t));
+  uint32_t *dead = malloc(b->next_id * sizeof(uint32_t));
+  uint32_t num_live = b->next_id;
+  uint32_t num_dead = 0;
+  for (uint32_t i = 0; i < num_live; i++)
+    live[i] = i;
+  uint32_t rng = 3735928559u;
+  Run run;
+  run_begin(&run, ops);
+  for (uint32_t i = 0; i < ops; i++) {
+    bool deleting = num_dead == 0 || (num_live > 0 && next_random(&rng) % 4);
+    uint32_t *from = deleting ? live : dead;
+    uint32_t *num_from = deleting ? &num_live : &num_dead;
+    uint32_t pick = next_random(&rng) % *num_from;
+    uint32_t id = from[pick];
+    from[pick] = from[--*num_from];
+    uint64_t start = now_ns();
+    if (deleting) {
+      sdb_bind_int(b->delete, 1, id);
+      step_all(b->delete, "DELETE");
+      dead[num_dead++] = id;
+    } else {
+      insert(b, id);
+      live[num_live++] = id;
+    }
+    run_op(&run, start, 1);
+  }
+  run_end(&run, 6);
+  free(live);
+  free(dead);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t rows = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000;
+  uint32_t ops = argc > 2 ? (uint32_t)atoi(argv[2]) : 200000;
+  bool usage = rows == 0 || ops == 0;
+  for (int i = 3; i < argc && !usage; i++) {
+    uint32_t w = 0;
+    while (w < NUM_WORKLOADS && strcmp(argv[i], workload_names[w]) != 0)
+      w++;
+    usage = w == NUM_WORKLOADS;
+    if (!usage)
+      selected[w] = true;
+  }
+  if (usage) {
+    printf("Usage: %s [rows] [ops] [workload...]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  for (uint32_t w = 0; argc <= 3 && w < NUM_WORKLOADS; w++)
+    selected[w] = true;
+
+  printf("{\"rows\": %u, \"ops\": %u, \"workloads\": [", rows, ops);
+  Bench b;
+  bench_open(&b, BENCH_FILE);
+  bench_sequential_insert(&b, rows);
+  if (selected[1])
+    bench_random_insert(rows);
+  if (selected[2])
+    bench_point_lookup(&b, ops);
+  if (selected[3])
+    bench_range_scan(&b, ops);
+  if (selected[4])
+    bench_full_scan(&b);
+  if (selected[5])
+    bench_mixed(&b, ops);
+  if (selected[6])
+    bench_delete_heavy(&b, ops);
+  bench_close(&b, BENCH_FILE);
+  printf("\n]}\n");
+  return 0;
+}
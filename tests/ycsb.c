@@ -0,0 +1,549 @@
+/**
+ * ycsb runs the YCSB core workloads against the engine, either embedded
+ * through the library API or over a running `db <file> --serve <socket>`,
+ * and reports throughput and p50/p99/p999 latency per operation.
+ *
+ *   ./build/ycsb --workload A [--distribution zipfian|latest|uniform]
+ *                [--threads N] [--records N] [--operations N]
+ *                [--db FILE | --socket PATH]
+ *
+ *   A  50% reads, 50% updates       D  95% reads, 5% inserts
+ *   B  95% reads, 5% updates        E  95% scans of 1-100 rows, 5% inserts
+ *   C  reads only                   F  50% reads, 50% read-modify-writes
+ *
+ * The load phase inserts --records rows, keys 0 to records - 1, into
+ * `usertable` over one connection; the run phase splits --operations over
+ * --threads threads. Keys are drawn as YCSB draws them: zipfian ranks
+ * (theta 0.99) scrambled by a hash so the popular keys are spread over the
+ * table, latest favouring the newest inserts, or uniform. Each workload
+ * defaults to YCSB's choice, latest for D and zipfian for the rest.
+ *
+ * Embedded, the threads share one connection and take turns on it, as the
+ * server's workers take turns on its Database; --db (default ycsb.db) is
+ * overwritten and removed afterwards. With --socket each thread has its own
+ * connection, and rows left by an earlier run stay (loading them again only
+ * reports duplicates).
+ *
+ * A database file is limited to TABLE_MAX_PAGES pages, about 45000 rows of
+ * `usertable` counting the rows D and E insert.
+ */
+#define _GNU_SOURCE // clock_gettime
+
+#include "simpledb.h"
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+constexpr double ZIPFIAN_THETA = 0.99;
+constexpr uint32_t MAX_SCAN_ROWS = 100;
+constexpr uint32_t FIELD_LENGTH = 31; // Fills a TEXT column
+
+typedef enum : uint8_t {
+  OP_READ,
+  OP_UPDATE,
+  OP_INSERT,
+  OP_SCAN,
+  OP_READ_MODIFY_WRITE,
+  NUM_OPS
+} Op;
+
+static const char *op_names[NUM_OPS] = {"READ", "UPDATE", "INSERT", "SCAN",
+                                        "READ-MODIFY-WRITE"};
+
+typedef enum : uint8_t {
+  DIST_ZIPFIAN,
+  DIST_LATEST,
+  DIST_UNIFORM
+} Distribution;
+
+static const char *distribution_names[] = {"zipfian", "latest", "uniform"};
+
+typedef struct {
+  char name;
+  uint32_t percent[NUM_OPS];
+  Distribution distribution;
+} Workload;
+
+static const Workload workloads[] = {
+    {'A', {50, 50, 0, 0, 0}, DIST_ZIPFIAN},
+    {'B', {95, 5, 0, 0, 0}, DIST_ZIPFIAN},
+    {'C', {100, 0, 0, 0, 0}, DIST_ZIPFIAN},
+    {'D', {95, 0, 5, 0, 0}, DIST_LATEST},
+    {'E', {0, 0, 5, 95, 0}, DIST_ZIPFIAN},
+    {'F', {50, 0, 0, 0, 50}, DIST_ZIPFIAN},
+};
+
+/**
+ * Zipfian draws ranks 0 to items - 1, rank 0 the most often, with Gray et
+ * al.'s method as YCSB does. zetan is kept up to date as items grow.
+ */
+typedef struct {
+  uint64_t items;
+  double zetan;
+  double zeta2;
+  double alpha;
+  double eta;
+} Zipfian;
+
+typedef struct {
+  const Workload *workload;
+  Distribution distribution;
+  const char *socket_path; // Null when embedded
+  uint32_t ops;
+  uint64_t rng;
+  Zipfian zipfian;
+  uint64_t *latencies_ns;
+  Op *done; // Which operation each latency is for
+  sdb_stmt *read;
+  sdb_stmt *update;
+  sdb_stmt *insert;
+  sdb_stmt *scan;
+  int fd;
+  bool failed;
+} Client;
+
+// Keys below it are loaded or claimed by an insert
+static atomic_uint key_count;
+static sdb *db;
+static mtx_t db_lock;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t *state) {
+  // xorshift64*
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1Dull;
+}
+
+static double next_uniform(uint64_t *state) {
+  return (double)(next_random(state) >> 11) / (double)(1ull << 53);
+}
+
+static uint64_t fnv_hash(uint64_t value) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (int i = 0; i < 8; i++) {
+    hash ^= value & 0xFF;
+    hash *= 0x100000001B3ull;
+    value >>= 8;
+  }
+  return hash;
+}
+
+static double zeta(uint64_t from, uint64_t to, double sum) {
+  for (uint64_t i = from + 1; i <= to; i++)
+    sum += 1 / pow((double)i, ZIPFIAN_THETA);
+  return sum;
+}
+
+static void zipfian_grow(Zipfian *z, uint64_t items) {
+  z->zetan = zeta(z->items, items, z->zetan);
+  z->items = items;
+  z->eta =
+      (1 - pow(2.0 / items, 1 - ZIPFIAN_THETA)) / (1 - z->zeta2 / z->zetan);
+}
+
+static void zipfian_init(Zipfian *z, uint64_t items) {
+  *z = (Zipfian){.zeta2 = zeta(0, 2, 0), .alpha = 1 / (1 - ZIPFIAN_THETA)};
+  zipfian_grow(z, items);
+}
+
+static uint64_t zipfian_next(const Zipfian *z, double u) {
+  double uz = u * z->zetan;
+  if (uz < 1)
+    return 0;
+  if (uz < 1 + pow(0.5, ZIPFIAN_THETA))
+    return 1;
+  uint64_t rank =
+      (uint64_t)((double)z->items * pow(z->eta * u - z->eta + 1, z->alpha));
+  return rank < z->items ? rank : z->items - 1;
+}
+
+/** next_key picks the key of a read, update or scan. */
+static uint32_t next_key(Client *c) {
+  uint32_t count = atomic_load(&key_count);
+  if (c->distribution == DIST_UNIFORM)
+    return (uint32_t)(next_random(&c->rng) % count);
+  if (count > c->zipfian.items)
+    zipfian_grow(&c->zipfian, count);
+  uint64_t rank = zipfian_next(&c->zipfian, next_uniform(&c->rng));
+  if (c->distribution == DIST_LATEST)
+    return count - 1 - (uint32_t)rank;
+  return (uint32_t)(fnv_hash(rank) % count);
+}
+
+static void next_value(Client *c, char value[FIELD_LENGTH + 1]) {
+  for (uint32_t i = 0; i < FIELD_LENGTH; i++)
+    value[i] = (char)('a' + next_random(&c->rng) % 26);
+  value[FIELD_LENGTH] = '\0';
+}
+
+static int connect_to(const char *socket_path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -1;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool io_full(int fd, void *buf, size_t len, bool writing) {
+  char *p = buf;
+  while (len > 0) {
+    ssize_t n = writing ? write(fd, p, len) : read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+/** request sends one line and reads, then discards, the response. */
+static bool request(int fd, const char *line) {
+  uint32_t len = (uint32_t)strlen(line);
+  uint32_t header = htonl(len);
+  if (!io_full(fd, &header, sizeof(header), true) ||
+      !io_full(fd, (void *)line, len, true) ||
+      !io_full(fd, &header, sizeof(header), false))
+    return false;
+  uint32_t remaining = ntohl(header);
+  while (remaining > 0) {
+    char scratch[4096];
+    uint32_t chunk = remaining < sizeof(scratch) ? remaining : sizeof(scratch);
+    if (!io_full(fd, scratch, chunk, false))
+      return false;
+    remaining -= chunk;
+  }
+  return true;
+}
+
+/**
+ * step_locked runs a bound statement to the end on the shared connection.
+ * A missing key or a key inserted twice is an answer, not a failure.
+ */
+static bool step_locked(sdb_stmt *stmt) {
+  mtx_lock(&db_lock);
+  int rc;
+  while ((rc = sdb_step(stmt)) == SDB_ROW)
+    ;
+  if (rc != SDB_DONE && rc != SDB_NOTFOUND && rc != SDB_CONSTRAINT)
+    fprintf(stderr, "Statement failed: %s\n", sdb_errmsg(db));
+  mtx_unlock(&db_lock);
+  return rc == SDB_DONE || rc == SDB_NOTFOUND || rc == SDB_CONSTRAINT;
+}
+
+static bool do_read(Client *c, uint32_t key) {
+  if (c->socket_path == nullptr) {
+    sdb_bind_int(c->read, 1, key);
+    return step_locked(c->read);
+  }
+  char line[128];
+  snprintf(line, sizeof(line), "SELECT * FROM usertable WHERE id = %u;", key);
+  return request(c->fd, line);
+}
+
+static bool do_write(Client *c, Op op, uint32_t key) {
+  char value[FIELD_LENGTH + 1];
+  next_value(c, value);
+  if (c->socket_path == nullptr) {
+    sdb_stmt *stmt = op == OP_INSERT ? c->insert : c->update;
+    sdb_bind_int(stmt, op == OP_INSERT ? 1 : 2, key);
+    sdb_bind_text(stmt, op == OP_INSERT ? 2 : 1, value);
+    return step_locked(stmt);
+  }
+  char line[128];
+  if (op == OP_INSERT)
+    snprintf(line, sizeof(line), "INSERT INTO usertable VALUES (%u, '%s');",
+             key, value);
+  else
+    snprintf(line, sizeof(line),
+             "UPDATE usertable SET field0 = '%s' WHERE id = %u;", value, key);
+  return request(c->fd, line);
+}
+
+static bool do_scan(Client *c, uint32_t key, uint32_t rows) {
+  if (c->socket_path == nullptr) {
+    sdb_bind_int(c->scan, 1, key);
+    sdb_bind_int(c->scan, 2, rows);
+    return step_locked(c->scan);
+  }
+  char line[128];
+  snprintf(line, sizeof(line),
+           "SELECT * FROM usertable WHERE id >= %u LIMIT %u;", key, rows);
+  return request(c->fd, line);
+}
+
+static Op next_op(Client *c) {
+  uint32_t pick = (uint32_t)(next_random(&c->rng) % 100);
+  for (Op op = 0; op < NUM_OPS; op++) {
+    if (pick < c->workload->percent[op])
+      return op;
+    pick -= c->workload->percent[op];
+  }
+  return OP_READ;
+}
+
+static bool run_op(Client *c, Op op) {
+  switch (op) {
+  case OP_READ:
+    return do_read(c, next_key(c));
+  case OP_UPDATE:
+    return do_write(c, OP_UPDATE, next_key(c));
+  case OP_INSERT:
+    return do_write(c, OP_INSERT, atomic_fetch_add(&key_count, 1));
+  case OP_SCAN:
+    return do_scan(c, next_key(c),
+                   1 + (uint32_t)(next_random(&c->rng) % MAX_SCAN_ROWS));
+  case OP_READ_MODIFY_WRITE: {
+    uint32_t key = next_key(c);
+    return do_read(c, key) && do_write(c, OP_UPDATE, key);
+  }
+  default:
+    return false;
+  }
+}
+
+static void prepare(const char *sql, sdb_stmt **out) {
+  if (sdb_prepare(db, sql, out) != SDB_OK) {
+    fprintf(stderr, "Cannot prepare %s: %s\n", sql, sdb_errmsg(db));
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void prepare_client(Client *c) {
+  prepare("SELECT * FROM usertable WHERE id = ?", &c->read);
+  prepare("UPDATE usertable SET field0 = ? WHERE id = ?", &c->update);
+  prepare("INSERT INTO usertable VALUES (?, ?)", &c->insert);
+  prepare("SELECT * FROM usertable WHERE id >= ? LIMIT ?", &c->scan);
+}
+
+static void finalize_client(Client *c) {
+  sdb_finalize(c->read);
+  sdb_finalize(c->update);
+  sdb_finalize(c->insert);
+  sdb_finalize(c->scan);
+}
+
+static int client_main(void *arg) {
+  Client *c = arg;
+  if (c->socket_path != nullptr) {
+    c->fd = connect_to(c->socket_path);
+    if (c->fd == -1) {
+      c->failed = true;
+      return 0;
+    }
+  }
+  for (uint32_t i = 0; i < c->ops && !c->failed; i++) {
+    Op op = next_op(c);
+    uint64_t start = now_ns();
+    c->failed = !run_op(c, op);
+    c->latencies_ns[i] = now_ns() - start;
+    c->done[i] = op;
+  }
+  if (c->socket_path != nullptr)
+    close(c->fd);
+  return 0;
+}
+
+/** load inserts the keys 0 to records - 1 over a single connection. */
+static bool load(Client *c, uint32_t records) {
+  if (c->socket_path == nullptr) {
+    sdb_stmt *create;
+    prepare("CREATE TABLE usertable (id INT, field0 TEXT)", &create);
+    bool created = step_locked(create);
+    sdb_finalize(create);
+    if (!created)
+      return false;
+    prepare_client(c);
+  } else {
+    c->fd = connect_to(c->socket_path);
+    if (c->fd == -1)
+      return false;
+    request(c->fd, "CREATE TABLE usertable (id INT, field0 TEXT);");
+  }
+  bool ok = true;
+  for (uint32_t key = 0; key < records && ok; key++)
+    ok = do_write(c, OP_INSERT, key);
+  if (c->socket_path == nullptr)
+    finalize_client(c);
+  else
+    close(c->fd);
+  return ok;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_us(uint64_t *sorted, size_t n, double p) {
+  size_t idx = (size_t)(p * (double)(n - 1));
+  return (double)sorted[idx] / 1000.0;
+}
+
+static void report(Client *clients, uint32_t threads, size_t total) {
+  uint64_t *latencies = malloc(total * sizeof(uint64_t));
+  for (Op op = 0; op < NUM_OPS; op++) {
+    size_t n = 0;
+    for (uint32_t t = 0; t < threads; t++)
+      for (uint32_t i = 0; i < clients[t].ops; i++)
+        if (clients[t].done[i] == op)
+          latencies[n++] = clients[t].latencies_ns[i];
+    if (n == 0)
+      continue;
+    qsort(latencies, n, sizeof(uint64_t), compare_u64);
+    printf("  %-17s %8zu ops  p50 %.1f  p99 %.1f  p999 %.1f us\n",
+           op_names[op], n, percentile_us(latencies, n, 0.50),
+           percentile_us(latencies, n, 0.99),
+           percentile_us(latencies, n, 0.999));
+  }
+  free(latencies);
+}
+
+int main(int argc, char *argv[]) {
+  const Workload *workload = nullptr;
+  int distribution = -1;
+  uint32_t threads = 1, records = 20000, operations = 100000;
+  const char *db_path = "ycsb.db";
+  const char *socket_path = nullptr;
+  bool usage = argc < 2;
+  for (int i = 1; i + 1 < argc && !usage; i += 2) {
+    const char *value = argv[i + 1];
+    if (strcmp(argv[i], "--workload") == 0) {
+      for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+        if (strlen(value) == 1 && toupper(value[0]) == workloads[w].name)
+          workload = &workloads[w];
+      usage = workload == nullptr;
+    } else if (strcmp(argv[i], "--distribution") == 0) {
+      for (int d = 0; d < 3; d++)
+        if (strcmp(value, distribution_names[d]) == 0)
+          distribution = d;
+      usage = distribution == -1;
+    } else if (strcmp(argv[i], "--threads") == 0) {
+      threads = (uint32_t)atoi(value);
+    } else if (strcmp(argv[i], "--records") == 0) {
+      records = (uint32_t)atoi(value);
+    } else if (strcmp(argv[i], "--operations") == 0) {
+      operations = (uint32_t)atoi(value);
+    } else if (strcmp(argv[i], "--db") == 0) {
+      db_path = value;
+    } else if (strcmp(argv[i], "--socket") == 0) {
+      socket_path = value;
+    } else {
+      usage = true;
+    }
+  }
+  if (usage || workload == nullptr || threads == 0 || records == 0 ||
+      operations == 0) {
+    printf("Usage: %s --workload A-F [--distribution zipfian|latest|uniform]\n"
+           "       [--threads N] [--records N] [--operations N]\n"
+           "       [--db FILE | --socket PATH]\n",
+           argv[0]);
+    return EXIT_FAILURE;
+  }
+  Distribution dist = distribution == -1 ? workload->distribution
+                                         : (Distribution)distribution;
+
+  if (socket_path == nullptr) {
+    remove(db_path);
+    if (sdb_open(db_path, &db) != SDB_OK) {
+      printf("Unable to open %s\n", db_path);
+      return EXIT_FAILURE;
+    }
+  }
+  mtx_init(&db_lock, mtx_plain);
+
+  Client loader = {.socket_path = socket_path, .rng = 88172645463325252ull};
+  uint64_t load_start = now_ns();
+  if (!load(&loader, records)) {
+    printf("Load failed.\n");
+    return EXIT_FAILURE;
+  }
+  double load_s = (double)(now_ns() - load_start) / 1e9;
+  printf("Load: %u inserts in %.3f s (%.0f inserts/s)\n", records, load_s,
+         records / load_s);
+  atomic_store(&key_count, records);
+
+  // Every thread starts from the same zeta, summed once
+  Zipfian zipfian;
+  zipfian_init(&zipfian, records);
+  Client *clients = calloc(threads, sizeof(Client));
+  thrd_t *handles = malloc(threads * sizeof(thrd_t));
+  uint64_t *latencies = malloc((size_t)operations * sizeof(uint64_t));
+  Op *done = malloc((size_t)operations * sizeof(Op));
+  uint32_t assigned = 0;
+  for (uint32_t t = 0; t < threads; t++) {
+    uint32_t ops = operations / threads + (t < operations % threads ? 1 : 0);
+    clients[t] = (Client){.workload = workload,
+                          .distribution = dist,
+                          .socket_path = socket_path,
+                          .ops = ops,
+                          .rng = 0x9E3779B97F4A7C15ull * (t + 1),
+                          .zipfian = zipfian,
+                          .latencies_ns = latencies + assigned,
+                          .done = done + assigned};
+    if (socket_path == nullptr)
+      prepare_client(&clients[t]);
+    assigned += ops;
+  }
+
+  uint64_t start = now_ns();
+  for (uint32_t t = 0; t < threads; t++)
+    thrd_create(&handles[t], client_main, &clients[t]);
+  bool failed = false;
+  for (uint32_t t = 0; t < threads; t++) {
+    thrd_join(handles[t], nullptr);
+    failed |= clients[t].failed;
+  }
+  double elapsed_s = (double)(now_ns() - start) / 1e9;
+
+  if (failed) {
+    printf("One or more threads failed.\n");
+    return EXIT_FAILURE;
+  }
+  printf("Workload %c, %s, %u threads, %s: %u operations in %.3f s\n",
+         workload->name, distribution_names[dist], threads,
+         socket_path == nullptr ? "library" : "server", operations,
+         elapsed_s);
+  printf("  Throughput: %.0f ops/s\n", operations / elapsed_s);
+  report(clients, threads, operations);
+
+  if (socket_path == nullptr) {
+    for (uint32_t t = 0; t < threads; t++)
+      finalize_client(&clients[t]);
+    sdb_close(db);
+    remove(db_path);
+  }
+  mtx_destroy(&db_lock);
+  free(done);
+  free(latencies);
+  free(handles);
+  free(clients);
+  return 0;
+}